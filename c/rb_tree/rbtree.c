@@ -4,15 +4,99 @@
  * rb_tree implemention
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "rbtree.h"
 
 
+/**
+ * instrumentation
+ *
+ * counters and USDT probes (provider `rbtree`) compile to nothing
+ * unless RBTREE_INSTRUMENT is defined.
+ */
+#ifdef RBTREE_INSTRUMENT
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RBTREE_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef RBTREE_HAVE_SDT
+#define rbtree_trace(name, ...) STAP_PROBEV(rbtree, name, __VA_ARGS__)
+#else
+#define rbtree_trace(name, ...)
+#endif
+
+#define rbtree_count(tree, field) ((tree)->counters.field++)
+
+#define rbtree_count_case(tree, fixup, nth) do {   \
+    (tree)->counters.fixup##_cases[(nth) - 1]++;   \
+    rbtree_trace(fixup, (tree), (nth));            \
+} while (0)
+
+#define rbtree_descent_begin(tree)   uint64_t rbtree_depth_ = 0
+#define rbtree_descent_restart(tree) (rbtree_depth_ = 0)
+
+#define rbtree_descent_step(tree) do {  \
+    rbtree_depth_++;                    \
+    (tree)->counters.compares++;        \
+} while (0)
+
+#define rbtree_descent_end(tree) do {                          \
+    rbtree_counters_t *_counters = &(tree)->counters;          \
+    _counters->descents++;                                     \
+    _counters->descent_steps += rbtree_depth_;                 \
+    if (rbtree_depth_ > _counters->max_descent_depth) {        \
+        _counters->max_descent_depth = rbtree_depth_;          \
+    }                                                          \
+    rbtree_trace(descent, (tree), rbtree_depth_);              \
+} while (0)
+
+#else
+
+#define rbtree_trace(name, ...)
+#define rbtree_count(tree, field)
+#define rbtree_count_case(tree, fixup, nth)
+#define rbtree_descent_begin(tree)
+#define rbtree_descent_restart(tree)
+#define rbtree_descent_step(tree)
+#define rbtree_descent_end(tree)
+
+#endif
+
+
 #define rbtree_validate_search_mode(mode) do {                                 \
     rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);\
 } while (0);
 
 
+static inline void
+rbtree_augment_node(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree->augment != NULL) {
+        tree->augment(tree, node);
+    }
+}
+
+
+/** `node` and every ancestor, sentinel is never passed to augment */
+static void
+rbtree_augment_up(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree->augment == NULL) {
+        return;
+    }
+
+    for (; !rbtree_is_sentinel(tree, node); node = node->parent) {
+        tree->augment(tree, node);
+    }
+}
+
+
 static int
 rbtree_init_node(rbtree_t      *tree,
                  rbtree_node_t *node,
@@ -98,6 +182,9 @@ rbtree_left_rotate(rbtree_t *tree, rbtree_node_t *node)
         return RBTREE_OK;
     }
 
+    rbtree_count(tree, left_rotates);
+    rbtree_trace(left_rotate, tree, node);
+
     node->right = rchild->left;
     if (!rbtree_is_sentinel(tree, rchild->left)) {
         rchild->left->parent = node;
@@ -118,6 +205,10 @@ rbtree_left_rotate(rbtree_t *tree, rbtree_node_t *node)
     rchild->left = node;
     node->parent = rchild;
 
+    /** only these two subtrees changed, the one above holds the same nodes */
+    rbtree_augment_node(tree, node);
+    rbtree_augment_node(tree, rchild);
+
     return RBTREE_OK;
 }
 
@@ -140,6 +231,9 @@ rbtree_right_rotate(rbtree_t *tree, rbtree_node_t *node)
         return RBTREE_INVALID_TOPOLOGY;
     }
 
+    rbtree_count(tree, right_rotates);
+    rbtree_trace(right_rotate, tree, node);
+
     node->left = lchild->right;
     if (!rbtree_is_sentinel(tree, lchild->right)) {
         lchild->right->parent = node;
@@ -162,14 +256,23 @@ rbtree_right_rotate(rbtree_t *tree, rbtree_node_t *node)
     lchild->right = node;
     node->parent = lchild;
 
+    rbtree_augment_node(tree, node);
+    rbtree_augment_node(tree, lchild);
+
     return RBTREE_OK;
 }
 
 
-static int
-rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
+/**
+ * restore red-black rules above red `node`, except that root may be
+ * left red, which callers tracking black height need to see
+ */
+static void
+rbtree_insert_rebalance(rbtree_t *tree, rbtree_node_t *node)
 {
     while (rbtree_is_red(node->parent)) {
+        rbtree_count(tree, insert_fixup_loops);
+
         /** node is red */
         if (rbtree_is_left_child(node->parent)) {
             /** since parent of node is red, node must have grandparent */
@@ -177,6 +280,8 @@ rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
 
             if (rbtree_is_red(uncle)) {
                 /** case 1: uncle is red */
+                rbtree_count_case(tree, insert_fixup, 1);
+
                 rbtree_set_black(uncle);
                 rbtree_set_black(node->parent);
                 rbtree_set_red(node->parent->parent);
@@ -187,11 +292,15 @@ rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
                 /** case 2: uncle is black and node is right child */
                 if (rbtree_is_right_child(node)) {
                     /** change to case 3 */
+                    rbtree_count_case(tree, insert_fixup, 2);
+
                     node = node->parent;
                     rbtree_left_rotate(tree, node);
                 }
 
                 /** case 3: uncle is black and node is right child */
+                rbtree_count_case(tree, insert_fixup, 3);
+
                 rbtree_set_black(node->parent);
                 rbtree_set_red(node->parent->parent);
                 rbtree_right_rotate(tree, node->parent->parent);
@@ -202,6 +311,8 @@ rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
             rbtree_node_t *uncle = rbtree_get_uncle(node);
 
             if (rbtree_is_red(uncle)) {
+                rbtree_count_case(tree, insert_fixup, 1);
+
                 rbtree_set_black(uncle);
                 rbtree_set_black(node->parent);
                 rbtree_set_red(node->parent->parent);
@@ -210,23 +321,112 @@ rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
             }
             else {
                 if (rbtree_is_left_child(node)) {
+                    rbtree_count_case(tree, insert_fixup, 2);
+
                     node = node->parent;
                     rbtree_right_rotate(tree, node);
                 }
 
+                rbtree_count_case(tree, insert_fixup, 3);
+
                 rbtree_set_black(node->parent);
                 rbtree_set_red(node->parent->parent);
                 rbtree_left_rotate(tree, node->parent->parent);
             }
         }
     }
+}
+
 
+static int
+rbtree_insert_fixup(rbtree_t *tree, rbtree_node_t *node)
+{
+    rbtree_insert_rebalance(tree, node);
     rbtree_set_black(tree->root);
 
     return RBTREE_OK;
 }
 
 
+/**
+ * queue red `node` for rbtree_rebalance, a full queue makes room by
+ * fixing the oldest
+ *
+ * fixups in insertion order keep standard fixup correct with several
+ * red-red pairs in tree: a node is linked below older ones only, and a
+ * rotation lifts only a node being fixed or its parent, both older than
+ * what is still queued. so when a node is fixed, none of its ancestors
+ * is queued and above its parent the tree is balanced, as fixup needs.
+ * red-red pairs a fixup hands down to a new parent were red-red before,
+ * with a queued lower node.
+ */
+static int
+rbtree_defer_fixup(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree->pending_count == tree->pending_capacity) {
+        rbtree_rebalance(tree, 1);
+    }
+
+    size_t tail = tree->pending_head + tree->pending_count;
+    if (tail >= tree->pending_capacity) {
+        tail -= tree->pending_capacity;
+    }
+
+    tree->pending[tail] = node;
+    tree->pending_count++;
+
+    return RBTREE_OK;
+}
+
+
+/** run every pending fixup, for operations which need a balanced tree */
+static inline void
+rbtree_settle(rbtree_t *tree)
+{
+    if (tree->pending_count > 0) {
+        rbtree_rebalance(tree, SIZE_MAX);
+    }
+}
+
+
+/**
+ * link `node` as the `is_left` child of `parent` and rebalance,
+ * `parent` is sentinel for empty tree
+ */
+static int
+rbtree_link_node(rbtree_t      *tree,
+                 rbtree_node_t *parent,
+                 int           is_left,
+                 rbtree_node_t *node)
+{
+    *node = (rbtree_node_t)rbtree_null_node(tree);
+
+    tree->size++;
+
+    node->parent = parent;
+    if (rbtree_is_sentinel(tree, parent)) {
+        /** empty tree */
+        tree->root = node;
+    }
+    else {
+        if (is_left) {
+            parent->left = node;
+        }
+        else {
+            parent->right = node;
+        }
+    }
+
+    rbtree_augment_up(tree, node);
+
+    if (tree->pending_capacity > 0) {
+        return rbtree_defer_fixup(tree, node);
+    }
+
+    return rbtree_insert_fixup(tree, node);
+}
+
+
 int
 rbtree_insert(rbtree_t *tree, rbtree_node_t *node)
 {
@@ -236,12 +436,13 @@ rbtree_insert(rbtree_t *tree, rbtree_node_t *node)
     rbtree_node_t *parent   = tree->root;
     rbtree_node_t *traverse = tree->root;
 
-    *node = (rbtree_node_t)rbtree_null_node(tree);
     int is_left = -1;
 
+    rbtree_descent_begin(tree);
     while (traverse != &tree->sentinel) {
         parent = traverse;
 
+        rbtree_descent_step(tree);
         is_left = tree->compare(node, traverse) <= 0;
 
         if (is_left) {
@@ -251,22 +452,90 @@ rbtree_insert(rbtree_t *tree, rbtree_node_t *node)
             traverse = traverse->right;
         }
     }
+    rbtree_descent_end(tree);
+
+    return rbtree_link_node(tree, parent, is_left, node);
+}
+
+
+int
+rbtree_find_or_insert(rbtree_t *tree,
+                      rbtree_node_t *value,
+                      rbtree_insert_pos_t *pos,
+                      rbtree_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(value != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(pos != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *parent   = tree->root;
+    rbtree_node_t *traverse = tree->root;
+
+    int is_left = -1;
+
+    rbtree_descent_begin(tree);
+    while (traverse != &tree->sentinel) {
+        rbtree_descent_step(tree);
+        int cmp = tree->compare(value, traverse);
+
+        if (cmp == 0) {
+            rbtree_descent_end(tree);
+            *ret = traverse;
+
+            return RBTREE_OK;
+        }
+
+        parent  = traverse;
+        is_left = cmp < 0;
 
-    node->parent = parent;
-    if (rbtree_is_sentinel(tree, parent)) {
-        /** empty tree */
-        tree->root = node;
-    }
-    else {
         if (is_left) {
-            parent->left = node;
+            traverse = traverse->left;
         }
         else {
-            parent->right = node;
+            traverse = traverse->right;
         }
     }
 
-    return rbtree_insert_fixup(tree, node);
+    rbtree_descent_end(tree);
+
+    pos->parent  = parent;
+    pos->is_left = is_left;
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+int
+rbtree_insert_at(rbtree_t *tree, rbtree_insert_pos_t *pos, rbtree_node_t *node)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(pos != NULL && pos->parent != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL && node != &tree->sentinel, RBTREE_INVALID_ARG);
+
+    return rbtree_link_node(tree, pos->parent, pos->is_left, node);
+}
+
+
+int
+rbtree_insert_unique(rbtree_t *tree, rbtree_node_t *node, rbtree_node_t **ret)
+{
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_insert_pos_t pos;
+
+    int err = rbtree_find_or_insert(tree, node, &pos, ret);
+    if (err == RBTREE_OK) {
+        return RBTREE_DUPLICATE;
+    }
+    else if (err != RBTREE_NOT_FOUND) {
+        return err;
+    }
+
+    *ret = node;
+
+    return rbtree_insert_at(tree, &pos, node);
 }
 
 
@@ -350,6 +619,8 @@ static int
 rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
 {
     while (!rbtree_is_root(tree, node) && rbtree_is_black(node)) {
+        rbtree_count(tree, delete_fixup_loops);
+
         rbtree_node_t *brother = NULL;
 
         if (rbtree_is_left_child(node)) {
@@ -358,6 +629,8 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
 
             /** case 1: brother is red */
             if (rbtree_is_red(brother)) {
+                rbtree_count_case(tree, delete_fixup, 1);
+
                 rbtree_set_black(brother);
                 rbtree_set_red(node->parent);
                 rbtree_left_rotate(tree, node->parent);
@@ -372,6 +645,8 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
                  * brother is black,
                  * two children of brother are black
                  */
+                rbtree_count_case(tree, delete_fixup, 2);
+
                 rbtree_set_red(brother);
                 node = node->parent;
             }
@@ -383,6 +658,8 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
                      * brother is black
                      * left child is red and right child is black
                      */
+                    rbtree_count_case(tree, delete_fixup, 3);
+
                     rbtree_set_black(brother->left);
                     rbtree_set_red(brother);
                     rbtree_right_rotate(tree, brother);
@@ -395,6 +672,8 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
                  * brother is black
                  * right child is red
                  */
+                rbtree_count_case(tree, delete_fixup, 4);
+
                 brother->color = node->parent->color;
                 /** make up one black for node */
                 rbtree_set_black(node->parent);
@@ -409,6 +688,8 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
             brother = node->parent->left;
 
             if (rbtree_is_red(brother)) {
+                rbtree_count_case(tree, delete_fixup, 1);
+
                 rbtree_set_black(brother);
                 rbtree_set_red(node->parent);
                 rbtree_right_rotate(tree, node->parent);
@@ -417,17 +698,23 @@ rbtree_delete_fixup(rbtree_t *tree, rbtree_node_t *node)
             }
 
             if (rbtree_is_black(brother->left) && rbtree_is_black(brother->right)) {
+                rbtree_count_case(tree, delete_fixup, 2);
+
                 rbtree_set_red(brother);
                 node = node->parent;
             }
             else {
                 if (rbtree_is_black(brother->left)) {
+                    rbtree_count_case(tree, delete_fixup, 3);
+
                     rbtree_set_black(brother->right);
                     rbtree_set_red(brother);
                     rbtree_left_rotate(tree, brother);
-                    brother = node->parent->right;
+                    brother = node->parent->left;
                 }
 
+                rbtree_count_case(tree, delete_fixup, 4);
+
                 brother->color = node->parent->color;
                 rbtree_set_black(node->parent);
 
@@ -452,7 +739,7 @@ rbtree_delete(rbtree_t *tree, rbtree_node_t *node)
     rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
     rbtree_must(node != NULL && node != &tree->sentinel, RBTREE_INVALID_ARG);
 
-    rbtree_node_t *sentinel = &tree->sentinel;
+    rbtree_settle(tree);
 
     /** use node `replace` to replace the position of to-removed node `node` */
     rbtree_node_t *replace = NULL;
@@ -500,8 +787,18 @@ rbtree_delete(rbtree_t *tree, rbtree_node_t *node)
         if (ret != RBTREE_OK) {
             return ret;
         }
+
+        /** sentinel as `replace2` still points to removed `node` */
+        if (replace2->parent == node) {
+            replace2->parent = replace;
+        }
     }
 
+    tree->size--;
+
+    /** lowest node that lost a descendant, `replace` is on its way up */
+    rbtree_augment_up(tree, replace2->parent);
+
     /** if `node` is red, nothing else is needed */
     if (is_replace_black) {
         rbtree_delete_fixup(tree, replace2);
@@ -511,6 +808,62 @@ rbtree_delete(rbtree_t *tree, rbtree_node_t *node)
 }
 
 
+/**
+ * one step of search descent
+ *
+ * `cmp` is the comparison of the searched key against `traverse`,
+ * returns the next node to visit or NULL when search stops at `traverse`.
+ */
+static inline rbtree_node_t *
+rbtree_search_step(rbtree_node_t *traverse,
+                   int cmp,
+                   rbtree_search_mode_t mode,
+                   rbtree_node_t **result)
+{
+    switch (mode) {
+    case RBTREE_SEARCH_MODE_LT:
+        if (cmp > 0) {
+            *result = traverse;
+
+            return traverse->right;
+        }
+
+        return traverse->left;
+
+    case RBTREE_SEARCH_MODE_GT:
+        if (cmp < 0) {
+            *result = traverse;
+
+            return traverse->left;
+        }
+
+        return traverse->right;
+
+    default:
+        break;
+    }
+
+    if (cmp == 0) {
+        *result = traverse;
+
+        return NULL;
+    }
+    else if (cmp < 0) {
+        if (mode == RBTREE_SEARCH_MODE_GE) {
+            *result = traverse;
+        }
+
+        return traverse->left;
+    }
+
+    if (mode == RBTREE_SEARCH_MODE_LE) {
+        *result = traverse;
+    }
+
+    return traverse->right;
+}
+
+
 int
 rbtree_search(rbtree_t *tree,
               rbtree_node_t *value,
@@ -525,37 +878,123 @@ rbtree_search(rbtree_t *tree,
     rbtree_node_t *result = NULL;
     rbtree_node_t *traverse = tree->root;
 
-    while (rbtree_is_sentinel(tree, traverse)) {
-        int cmp = tree->compare(traverse, value);
+    rbtree_descent_begin(tree);
+    while (traverse != NULL && !rbtree_is_sentinel(tree, traverse)) {
+        rbtree_descent_step(tree);
+        int cmp = tree->compare(value, traverse);
 
-        if (cmp == 0) {
-            result = traverse;
+        traverse = rbtree_search_step(traverse, cmp, mode, &result);
+    }
+    rbtree_descent_end(tree);
 
-            break;
-        }
-        else if (cmp > 0) {
-            if (mode == RBTREE_SEARCH_MODE_GE) {
-                result = traverse;
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+int
+rbtree_search_key(rbtree_t *tree,
+                  const void *key,
+                  rbtree_key_compare compare,
+                  rbtree_search_mode_t mode,
+                  rbtree_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_validate_search_mode(mode);
+
+    rbtree_node_t *result = NULL;
+    rbtree_node_t *traverse = tree->root;
+
+    rbtree_descent_begin(tree);
+    while (traverse != NULL && !rbtree_is_sentinel(tree, traverse)) {
+        rbtree_descent_step(tree);
+        int cmp = compare(key, traverse);
+
+        traverse = rbtree_search_step(traverse, cmp, mode, &result);
+    }
+    rbtree_descent_end(tree);
+
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+int
+rbtree_equal_range(rbtree_t *tree,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_node_t **first,
+                   rbtree_node_t **last)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(first != NULL && last != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *lower = NULL;
+    rbtree_node_t *upper = NULL;
+    rbtree_node_t *traverse = tree->root;
+
+    /** leftmost equal node, equal keys may sit on both sides */
+    rbtree_descent_begin(tree);
+    while (!rbtree_is_sentinel(tree, traverse)) {
+        rbtree_descent_step(tree);
+        int cmp = compare(key, traverse);
+
+        if (cmp <= 0) {
+            if (cmp == 0) {
+                lower = traverse;
             }
 
             traverse = traverse->left;
         }
         else {
-            if (mode == RBTREE_SEARCH_MODE_LE) {
-                result = traverse;
+            traverse = traverse->right;
+        }
+    }
+
+    rbtree_descent_end(tree);
+
+    if (lower == NULL) {
+        return RBTREE_NOT_FOUND;
+    }
+
+    /** rightmost equal node */
+    traverse = tree->root;
+    rbtree_descent_restart(tree);
+    while (!rbtree_is_sentinel(tree, traverse)) {
+        rbtree_descent_step(tree);
+        int cmp = compare(key, traverse);
+
+        if (cmp >= 0) {
+            if (cmp == 0) {
+                upper = traverse;
             }
 
             traverse = traverse->right;
         }
+        else {
+            traverse = traverse->left;
+        }
     }
 
-    if (result != NULL) {
-        *ret = result;
+    rbtree_descent_end(tree);
 
-        return RBTREE_OK;
-    }
+    *first = lower;
+    *last  = upper;
 
-    return RBTREE_NOT_FOUND;
+    return RBTREE_OK;
 }
 
 
@@ -568,12 +1007,799 @@ rbtree_init(rbtree_t *tree, rbtree_compare compare)
 
     tree->root = &tree->sentinel;
     tree->compare = compare;
+    tree->size = 0;
+    tree->augment = NULL;
+    tree->pending = NULL;
+    tree->pending_capacity = 0;
+    tree->pending_head = 0;
+    tree->pending_count = 0;
 
     tree->sentinel.left = &tree->sentinel;
     tree->sentinel.right = &tree->sentinel;
     tree->sentinel.parent = NULL;
     tree->sentinel.color = RBTREE_BLACK;
 
+#ifdef RBTREE_INSTRUMENT
+    memset(&tree->counters, 0, sizeof(tree->counters));
+#endif
+
+    return RBTREE_OK;
+}
+
+
+int
+rbtree_get_counters(rbtree_t *tree, rbtree_counters_t *counters)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(counters != NULL, RBTREE_INVALID_ARG);
+
+#ifdef RBTREE_INSTRUMENT
+    *counters = tree->counters;
+
+    return RBTREE_OK;
+#else
+    return RBTREE_NOT_SUPPORTED;
+#endif
+}
+
+
+int
+rbtree_reset_counters(rbtree_t *tree)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+
+#ifdef RBTREE_INSTRUMENT
+    memset(&tree->counters, 0, sizeof(tree->counters));
+
+    return RBTREE_OK;
+#else
+    return RBTREE_NOT_SUPPORTED;
+#endif
+}
+
+rbtree_node_t *
+rbtree_first(rbtree_t *tree)
+{
+    if (tree == NULL || rbtree_is_sentinel(tree, tree->root)) {
+        return NULL;
+    }
+
+    return rbtree_minimum(tree, tree->root);
+}
+
+
+rbtree_node_t *
+rbtree_last(rbtree_t *tree)
+{
+    if (tree == NULL || rbtree_is_sentinel(tree, tree->root)) {
+        return NULL;
+    }
+
+    return rbtree_maximum(tree, tree->root);
+}
+
+
+rbtree_node_t *
+rbtree_next(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree == NULL || node == NULL) {
+        return NULL;
+    }
+
+    node = rbtree_successor(tree, node);
+
+    return rbtree_is_sentinel(tree, node) ? NULL : node;
+}
+
+
+rbtree_node_t *
+rbtree_prev(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree == NULL || node == NULL) {
+        return NULL;
+    }
+
+    node = rbtree_predecessor(tree, node);
+
+    return rbtree_is_sentinel(tree, node) ? NULL : node;
+}
+
+
+/**
+ * move `node` through `relocate` and point its neighbours at the copy,
+ * the old address is only compared, never read after relocate.
+ */
+static rbtree_node_t *
+rbtree_relocate_node(rbtree_t *tree,
+                     rbtree_node_t *node,
+                     rbtree_relocate relocate,
+                     void *ctx)
+{
+    rbtree_node_t *sentinel = &tree->sentinel;
+    rbtree_node_t *moved = relocate(node, ctx);
+
+    if (moved == NULL || moved == node) {
+        return moved;
+    }
+
+    rbtree_node_t *parent = moved->parent;
+    if (rbtree_is_root(tree, node)) {
+        tree->root = moved;
+    }
+    else if (parent->left == node) {
+        parent->left = moved;
+    }
+    else {
+        parent->right = moved;
+    }
+
+    if (moved->left != sentinel) {
+        moved->left->parent = moved;
+    }
+
+    if (moved->right != sentinel) {
+        moved->right->parent = moved;
+    }
+
+    /** left by the last delete */
+    if (sentinel->parent == node) {
+        sentinel->parent = moved;
+    }
+
+    return moved;
+}
+
+
+static int
+rbtree_compact_breadth_first(rbtree_t *tree, rbtree_relocate relocate, void *ctx)
+{
+    size_t capacity = tree->size + 1;
+    rbtree_node_t **queue = malloc(capacity * sizeof(*queue));
+    if (queue == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    size_t head = 0;
+    size_t tail = 0;
+    int ret = RBTREE_OK;
+
+    /** queued nodes are not moved yet, so their addresses stay valid */
+    queue[tail++] = tree->root;
+    while (head < tail) {
+        rbtree_node_t *moved = rbtree_relocate_node(tree, queue[head++], relocate, ctx);
+        if (moved == NULL) {
+            ret = RBTREE_NO_SPACE;
+
+            break;
+        }
+
+        if (tail + 2 > capacity) {
+            /** size is off, tree was built by hand */
+            rbtree_node_t **grown = realloc(queue, 2 * capacity * sizeof(*queue));
+            if (grown == NULL) {
+                ret = RBTREE_NO_SPACE;
+
+                break;
+            }
+
+            queue = grown;
+            capacity *= 2;
+        }
+
+        if (!rbtree_is_sentinel(tree, moved->left)) {
+            queue[tail++] = moved->left;
+        }
+
+        if (!rbtree_is_sentinel(tree, moved->right)) {
+            queue[tail++] = moved->right;
+        }
+    }
+
+    free(queue);
+
+    return ret;
+}
+
+
+int
+rbtree_compact(rbtree_t *tree,
+               rbtree_compact_order_t order,
+               rbtree_relocate relocate,
+               void *ctx)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(relocate != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(order == RBTREE_COMPACT_IN_ORDER || order == RBTREE_COMPACT_BREADTH_FIRST,
+                RBTREE_INVALID_ARG);
+
+    if (rbtree_is_sentinel(tree, tree->root)) {
+        return RBTREE_OK;
+    }
+
+    /** queued nodes would be left at their old address */
+    rbtree_settle(tree);
+
+    if (order == RBTREE_COMPACT_BREADTH_FIRST) {
+        return rbtree_compact_breadth_first(tree, relocate, ctx);
+    }
+
+    rbtree_compact_cursor_t cursor;
+    rbtree_compact_start(tree, &cursor);
+
+    return rbtree_compact_step(tree, &cursor, SIZE_MAX, relocate, ctx);
+}
+
+
+rbtree_node_t *
+rbtree_compact_pool_relocate(rbtree_node_t *node, void *ctx)
+{
+    rbtree_compact_pool_t *pool = ctx;
+
+    if (pool == NULL || pool->used >= pool->capacity) {
+        return NULL;
+    }
+
+    char *from = (char *)node - pool->node_offset;
+    char *to   = pool->base + pool->used * pool->record_size;
+
+    memcpy(to, from, pool->record_size);
+    pool->used++;
+
+    return (rbtree_node_t *)(to + pool->node_offset);
+}
+
+
+int
+rbtree_compact_start(rbtree_t *tree, rbtree_compact_cursor_t *cursor)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(cursor != NULL, RBTREE_INVALID_ARG);
+
+    cursor->next = rbtree_first(tree);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbtree_compact_step(rbtree_t *tree,
+                    rbtree_compact_cursor_t *cursor,
+                    size_t budget,
+                    rbtree_relocate relocate,
+                    void *ctx)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(cursor != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(relocate != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_settle(tree);
+
+    while (cursor->next != NULL && budget > 0) {
+        rbtree_node_t *moved = rbtree_relocate_node(tree, cursor->next, relocate, ctx);
+        if (moved == NULL) {
+            return RBTREE_NO_SPACE;
+        }
+
+        cursor->next = rbtree_next(tree, moved);
+        budget--;
+    }
+
+    return RBTREE_OK;
+}
+
+
+/**
+ * range operations
+ *
+ * split and join work on sub-trees which share the sentinel of `tree`.
+ * every sub-tree has a black root whose parent is sentinel, and its black
+ * height (black nodes on a path down, sentinel not counted) travels with it.
+ * rotations and fixups only look at `tree->root` for the sub-tree at hand,
+ * so it is pointed at that sub-tree while it is worked on.
+ */
+
+static int
+rbtree_black_height(rbtree_t *tree, rbtree_node_t *root)
+{
+    int height = 0;
+
+    for (rbtree_node_t *node = root; node != &tree->sentinel; node = node->left) {
+        height += rbtree_is_black(node);
+    }
+
+    return height;
+}
+
+
+/** take `node` out of its parent as a sub-tree root, `*height` is its black height */
+static rbtree_node_t *
+rbtree_cut_subtree(rbtree_t *tree, rbtree_node_t *node, int *height)
+{
+    if (rbtree_is_sentinel(tree, node)) {
+        return node;
+    }
+
+    node->parent = &tree->sentinel;
+    if (rbtree_is_red(node)) {
+        rbtree_set_black(node);
+        (*height)++;
+    }
+
+    return node;
+}
+
+
+/**
+ * join `left`, `mid` and `right` into one sub-tree
+ *
+ * all keys of `left` are not greater than `mid` and all keys of `right`
+ * are not less. `mid` is linked where the heights meet, on the right
+ * spine of the higher `left` or the left spine of the higher `right`,
+ * so only that one path is rebalanced.
+ */
+static rbtree_node_t *
+rbtree_join(rbtree_t *tree,
+            rbtree_node_t *left,
+            int left_height,
+            rbtree_node_t *mid,
+            rbtree_node_t *right,
+            int right_height,
+            int *height)
+{
+    rbtree_node_t *sentinel = &tree->sentinel;
+    rbtree_node_t *parent   = sentinel;
+
+    int is_left = left_height < right_height;
+    rbtree_node_t *node = is_left ? right : left;
+    int node_height     = is_left ? right_height : left_height;
+    int target_height   = is_left ? left_height : right_height;
+
+    /** down to a black node as high as the lower side */
+    while (node_height > target_height || rbtree_is_red(node)) {
+        node_height -= rbtree_is_black(node);
+        parent = node;
+        node = is_left ? node->left : node->right;
+    }
+
+    if (is_left) {
+        mid->left  = left;
+        mid->right = node;
+    }
+    else {
+        mid->left  = node;
+        mid->right = right;
+    }
+
+    if (!rbtree_is_sentinel(tree, mid->left)) {
+        mid->left->parent = mid;
+    }
+
+    if (!rbtree_is_sentinel(tree, mid->right)) {
+        mid->right->parent = mid;
+    }
+
+    mid->parent = parent;
+    rbtree_set_red(mid);
+
+    if (rbtree_is_sentinel(tree, parent)) {
+        tree->root = mid;
+    }
+    else if (is_left) {
+        parent->left = mid;
+        tree->root = right;
+    }
+    else {
+        parent->right = mid;
+        tree->root = left;
+    }
+
+    rbtree_augment_up(tree, mid);
+    rbtree_insert_rebalance(tree, mid);
+
+    /** a red root made black adds one level */
+    *height = (is_left ? right_height : left_height) + rbtree_is_red(tree->root);
+    rbtree_set_black(tree->root);
+
+    return tree->root;
+}
+
+
+/**
+ * split sub-tree `root` into nodes less than `key` and the rest
+ *
+ * recursion depth is bounded by the height of tree, and the joins on
+ * the way back up add up to O(log n) in total.
+ */
+static void
+rbtree_split(rbtree_t *tree,
+             rbtree_node_t *root,
+             int height,
+             rbtree_node_t *key,
+             rbtree_node_t **less,
+             int *less_height,
+             rbtree_node_t **rest,
+             int *rest_height)
+{
+    if (rbtree_is_sentinel(tree, root)) {
+        *less = *rest = root;
+        *less_height = *rest_height = 0;
+
+        return;
+    }
+
+    int child_height = height - rbtree_is_black(root);
+    int left_height  = child_height;
+    int right_height = child_height;
+
+    rbtree_node_t *left  = rbtree_cut_subtree(tree, root->left, &left_height);
+    rbtree_node_t *right = rbtree_cut_subtree(tree, root->right, &right_height);
+
+    rbtree_count(tree, compares);
+
+    if (tree->compare(key, root) <= 0) {
+        /** root and its right side are not less than key */
+        rbtree_node_t *middle = NULL;
+        int middle_height = 0;
+
+        rbtree_split(tree, left, left_height, key, less, less_height, &middle, &middle_height);
+        *rest = rbtree_join(tree, middle, middle_height, root, right, right_height, rest_height);
+    }
+    else {
+        rbtree_node_t *middle = NULL;
+        int middle_height = 0;
+
+        rbtree_split(tree, right, right_height, key, &middle, &middle_height, rest, rest_height);
+        *less = rbtree_join(tree, left, left_height, root, middle, middle_height, less_height);
+    }
+}
+
+
+/** join two sub-trees without a middle node, all of `left` before `right` */
+static rbtree_node_t *
+rbtree_join2(rbtree_t *tree,
+             rbtree_node_t *left,
+             int left_height,
+             rbtree_node_t *right,
+             int right_height)
+{
+    if (rbtree_is_sentinel(tree, right)) {
+        return left;
+    }
+
+    /** borrow the smallest node of `right` as middle */
+    rbtree_node_t *mid = rbtree_minimum(tree, right);
+
+    tree->root = right;
+    rbtree_delete(tree, mid);
+    tree->size++;
+
+    right = tree->root;
+    right_height = rbtree_black_height(tree, right);
+
+    int height = 0;
+
+    return rbtree_join(tree, left, left_height, mid, right, right_height, &height);
+}
+
+
+int
+rbtree_detach_range(rbtree_t *tree,
+                    rbtree_node_t *lo,
+                    rbtree_node_t *hi,
+                    rbtree_node_t **detached)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(detached != NULL, RBTREE_INVALID_ARG);
+
+    /** split and join need black height, so every path must be balanced */
+    rbtree_settle(tree);
+
+    rbtree_node_t *sentinel = &tree->sentinel;
+    rbtree_node_t *before   = sentinel;
+    rbtree_node_t *inside   = tree->root;
+    rbtree_node_t *after    = sentinel;
+
+    int before_height = 0;
+    int inside_height = rbtree_black_height(tree, tree->root);
+    int after_height  = 0;
+
+    if (lo != NULL) {
+        rbtree_node_t *root = inside;
+        rbtree_split(tree, root, inside_height, lo, &before, &before_height, &inside, &inside_height);
+    }
+
+    if (hi != NULL) {
+        rbtree_node_t *root = inside;
+        rbtree_split(tree, root, inside_height, hi, &inside, &inside_height, &after, &after_height);
+    }
+
+    tree->root = rbtree_join2(tree, before, before_height, after, after_height);
+    if (!rbtree_is_sentinel(tree, tree->root)) {
+        tree->root->parent = sentinel;
+    }
+
+    *detached = rbtree_is_sentinel(tree, inside) ? NULL : inside;
+
+    return RBTREE_OK;
+}
+
+
+size_t
+rbtree_release_detached(rbtree_t *tree,
+                        rbtree_node_t *detached,
+                        rbtree_release release,
+                        void *ctx)
+{
+    if (tree == NULL || detached == NULL) {
+        return 0;
+    }
+
+    /**
+     * pre-order with an explicit stack, children are read before `release`
+     * may free their parent. a pushed child is prefetched, so loads of
+     * nodes waiting on stack overlap instead of one miss after another.
+     */
+    rbtree_node_t *stack[RBTREE_MAX_HEIGHT + 1];
+    size_t depth = 0;
+    size_t count = 0;
+
+    stack[depth++] = detached;
+    while (depth > 0) {
+        rbtree_node_t *node  = stack[--depth];
+        rbtree_node_t *left  = node->left;
+        rbtree_node_t *right = node->right;
+
+        if (!rbtree_is_sentinel(tree, right)) {
+            __builtin_prefetch(right);
+            stack[depth++] = right;
+        }
+
+        if (!rbtree_is_sentinel(tree, left)) {
+            __builtin_prefetch(left);
+            stack[depth++] = left;
+        }
+
+        if (release != NULL) {
+            release(node, ctx);
+        }
+
+        count++;
+    }
+
+    tree->size -= count;
+
+    return count;
+}
+
+
+int
+rbtree_delete_range(rbtree_t *tree,
+                    rbtree_node_t *lo,
+                    rbtree_node_t *hi,
+                    rbtree_release release,
+                    void *ctx)
+{
+    rbtree_node_t *detached = NULL;
+
+    int ret = rbtree_detach_range(tree, lo, hi, &detached);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_release_detached(tree, detached, release, ctx);
+
+    return RBTREE_OK;
+}
+
+
+/**
+ * link nodes[lo, hi) as a sub-tree under `parent`, middle node on top
+ *
+ * sibling sub-trees differ in size by at most one, so every path ends at
+ * depth `red_depth` or one below. nodes at `red_depth` end the longer
+ * paths, they are leaves and colored red to even out black height.
+ */
+static rbtree_node_t *
+rbtree_build_subtree(rbtree_t *tree,
+                     rbtree_node_t **nodes,
+                     size_t lo,
+                     size_t hi,
+                     rbtree_node_t *parent,
+                     size_t depth,
+                     size_t red_depth)
+{
+    if (lo == hi) {
+        return &tree->sentinel;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    rbtree_node_t *node = nodes[mid];
+
+    node->parent = parent;
+    node->color  = depth == red_depth ? RBTREE_RED : RBTREE_BLACK;
+    node->left   = rbtree_build_subtree(tree, nodes, lo, mid, node, depth + 1, red_depth);
+    node->right  = rbtree_build_subtree(tree, nodes, mid + 1, hi, node, depth + 1, red_depth);
+
+    rbtree_augment_node(tree, node);
+
+    return node;
+}
+
+
+int
+rbtree_build_sorted(rbtree_t *tree, rbtree_node_t **nodes, size_t count)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(nodes != NULL || count == 0, RBTREE_INVALID_ARG);
+    rbtree_must(rbtree_is_sentinel(tree, tree->root), RBTREE_INVALID_ARG);
+
+    /** floor(log2(count + 1)) */
+    size_t red_depth = 0;
+    while ((count + 1) >> (red_depth + 1) != 0) {
+        red_depth++;
+    }
+
+    tree->root = rbtree_build_subtree(tree, nodes, 0, count, &tree->sentinel, 0, red_depth);
+    tree->size = count;
+
+    return RBTREE_OK;
+}
+
+
+/** post-order, depth is bounded by height of tree */
+static void
+rbtree_augment_subtree(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (rbtree_is_sentinel(tree, node)) {
+        return;
+    }
+
+    rbtree_augment_subtree(tree, node->left);
+    rbtree_augment_subtree(tree, node->right);
+    tree->augment(tree, node);
+}
+
+
+int
+rbtree_set_augment(rbtree_t *tree, rbtree_augment augment)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+
+    tree->augment = augment;
+    if (augment != NULL) {
+        rbtree_augment_subtree(tree, tree->root);
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbtree_augment_path(rbtree_t *tree, rbtree_node_t *node)
+{
+    rbtree_must(tree != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_augment_up(tree, node);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbtree_set_relaxed(rbtree_t *tree, rbtree_node_t **pending, size_t capacity)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(pending != NULL || capacity == 0, RBTREE_INVALID_ARG);
+
+    rbtree_settle(tree);
+
+    tree->pending = capacity > 0 ? pending : NULL;
+    tree->pending_capacity = capacity;
+    tree->pending_head = 0;
+    tree->pending_count = 0;
+
+    return RBTREE_OK;
+}
+
+
+size_t
+rbtree_rebalance(rbtree_t *tree, size_t budget)
+{
+    if (tree == NULL) {
+        return 0;
+    }
+
+    while (tree->pending_count > 0 && budget > 0) {
+        rbtree_node_t *node = tree->pending[tree->pending_head];
+
+        tree->pending_head++;
+        if (tree->pending_head == tree->pending_capacity) {
+            tree->pending_head = 0;
+        }
+
+        tree->pending_count--;
+        budget--;
+
+        /** an older fixup may have made it black already */
+        if (rbtree_is_red(node)) {
+            rbtree_insert_fixup(tree, node);
+        }
+    }
+
+    return tree->pending_count;
+}
+
+
+int
+rbtree_stats(rbtree_t *tree, rbtree_stats_t *stats)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(stats != NULL, RBTREE_INVALID_ARG);
+
+    memset(stats, 0, sizeof(*stats));
+
+    rbtree_node_t *sentinel = &tree->sentinel;
+
+    /** black nodes on any path, take the leftmost one */
+    for (rbtree_node_t *node = tree->root; node != sentinel; node = node->left) {
+        if (rbtree_is_black(node)) {
+            stats->black_height++;
+        }
+    }
+
+    /**
+     * walk through parent links instead of recursion or a stack,
+     * `prev` tells whether we come down from parent or up from a child
+     */
+    size_t depth_sum = 0;
+    size_t depth = 0;
+    rbtree_node_t *prev = sentinel;
+    rbtree_node_t *node = tree->root;
+
+    while (node != sentinel) {
+        rbtree_node_t *next = NULL;
+
+        if (prev == node->parent) {
+            stats->count++;
+            depth_sum += depth;
+
+            if (rbtree_is_red(node)) {
+                stats->red_count++;
+            }
+
+            if (depth > stats->max_depth) {
+                stats->max_depth = depth;
+            }
+
+            stats->depth_histogram[depth < RBTREE_MAX_HEIGHT ? depth : RBTREE_MAX_HEIGHT - 1]++;
+
+            if (node->left != sentinel) {
+                next = node->left;
+            }
+            else if (node->right != sentinel) {
+                next = node->right;
+            }
+        }
+        else if (prev == node->left && node->right != sentinel) {
+            next = node->right;
+        }
+
+        prev = node;
+        if (next != NULL) {
+            node = next;
+            depth++;
+        }
+        else {
+            node = node->parent;
+            depth--;
+        }
+    }
+
+    if (stats->count > 0) {
+        stats->height = stats->max_depth + 1;
+        stats->avg_depth = (double)depth_sum / (double)stats->count;
+    }
+
+    stats->memory_bytes = sizeof(*tree) + stats->count * sizeof(rbtree_node_t);
+
     return RBTREE_OK;
 }
 
@@ -6,15 +6,28 @@
 #ifndef __RB_TREE_H__
 #define __RB_TREE_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** error type */
-typedef enum rbtree_ret_e rbtree_ret_t;
 enum rbtree_ret_e {
     RBTREE_INVALID_ARG       = -1000,
     RBTREE_INVALID_TOPOLOGY  = -999,
     RBTREE_NOT_FOUND         = -998,
+    RBTREE_DUPLICATE         = -997,
+    RBTREE_NOT_SUPPORTED     = -996,
+    RBTREE_NO_SPACE          = -995,
+    RBTREE_IO_ERROR          = -994,
+    /** done, but not on disk yet */
+    RBTREE_NOT_DURABLE       = -993,
 
     RBTREE_OK = 0,
 };
+typedef enum rbtree_ret_e rbtree_ret_t;
 
 #define rbtree_must(expr, ret_code) do { \
     if (!(expr)) {                       \
@@ -51,22 +64,143 @@ struct rbtree_node_s {
 /** compare function of two node */
 typedef int (*rbtree_compare)(rbtree_node_t *na, rbtree_node_t *nb);
 
+/** compare function of a search key and a node, same sign as rbtree_compare */
+typedef int (*rbtree_key_compare)(const void *key, rbtree_node_t *node);
+
+/**
+ * operation counters
+ *
+ * only maintained when built with RBTREE_INSTRUMENT defined (make INSTRUMENT=1),
+ * which changes the layout of rbtree_t, so the library and its users
+ * must agree on the flag.
+ */
+typedef struct rbtree_counters_s rbtree_counters_t;
+struct rbtree_counters_s {
+    uint64_t compares;
+    uint64_t descents;
+    uint64_t descent_steps;
+    uint64_t max_descent_depth;
+    uint64_t left_rotates;
+    uint64_t right_rotates;
+    uint64_t insert_fixup_loops;
+    uint64_t delete_fixup_loops;
+    /** hits of case 1, 2 and 3 of rbtree_insert_fixup */
+    uint64_t insert_fixup_cases[3];
+    /** hits of case 1, 2, 3 and 4 of rbtree_delete_fixup */
+    uint64_t delete_fixup_cases[4];
+};
+
 typedef struct rbtree_s rbtree_t;
+
+/**
+ * recompute what the record of `node` keeps about its subtree, such as
+ * a node count, from the node itself and its children, which are current
+ */
+typedef void (*rbtree_augment)(rbtree_t *tree, rbtree_node_t *node);
+
 struct rbtree_s {
     rbtree_node_t *root;
     rbtree_node_t sentinel;
     rbtree_compare compare;
+    /** number of nodes in tree */
+    size_t size;
+    /** NULL unless set by rbtree_set_augment */
+    rbtree_augment augment;
+    /** ring of inserted nodes waiting for fixup, set by rbtree_set_relaxed */
+    rbtree_node_t **pending;
+    size_t pending_capacity;
+    size_t pending_head;
+    size_t pending_count;
+#ifdef RBTREE_INSTRUMENT
+    rbtree_counters_t counters;
+#endif
+};
+
+/**
+ * insertion position handle
+ *
+ * filled by a failed lookup and consumed by `rbtree_insert_at`,
+ * valid only while the tree is not modified in between.
+ */
+typedef struct rbtree_insert_pos_s rbtree_insert_pos_t;
+struct rbtree_insert_pos_s {
+    rbtree_node_t *parent;
+    int is_left;
+};
+
+/** height of rbtree is at most 2 * log2(n + 1), plus pending inserts in relaxed mode */
+#define RBTREE_MAX_HEIGHT 128
+
+/** shape statistics, depth of root is 0 */
+typedef struct rbtree_stats_s rbtree_stats_t;
+struct rbtree_stats_s {
+    size_t count;
+    size_t red_count;
+    size_t height;
+    size_t black_height;
+    size_t max_depth;
+    double avg_depth;
+    /** nodes per depth, the last bucket also takes deeper ones */
+    size_t depth_histogram[RBTREE_MAX_HEIGHT];
+    /** rbtree_t plus embedded nodes, records themselves are not counted */
+    size_t memory_bytes;
+};
+
+/**
+ * move the record holding `node` somewhere else
+ *
+ * the whole record must be copied, the old one may be released at once.
+ * returns the node embedded in the copy, NULL on failure.
+ */
+typedef rbtree_node_t *(*rbtree_relocate)(rbtree_node_t *node, void *ctx);
+
+/** node was taken out of tree and may be freed */
+typedef void (*rbtree_release)(rbtree_node_t *node, void *ctx);
+
+enum rbtree_compact_order_e {
+    RBTREE_COMPACT_IN_ORDER      = 0x01,
+    RBTREE_COMPACT_BREADTH_FIRST = 0x02,
+};
+typedef enum rbtree_compact_order_e rbtree_compact_order_t;
+
+/** ready-made relocation target, records are copied to consecutive slots */
+typedef struct rbtree_compact_pool_s rbtree_compact_pool_t;
+struct rbtree_compact_pool_s {
+    char *base;
+    size_t record_size;
+    /** offset of rbtree_node_t in record */
+    size_t node_offset;
+    size_t used;
+    size_t capacity;
+};
+
+/** incremental compaction state, in-order only */
+typedef struct rbtree_compact_cursor_s rbtree_compact_cursor_t;
+struct rbtree_compact_cursor_s {
+    /** next node to move, NULL when done */
+    rbtree_node_t *next;
 };
 
-typedef enum rbtree_search_mode_e rbtree_search_mode_t;
 enum rbtree_search_mode_e {
     RBTREE_SEARCH_MODE_EQ  = 0x01,
     RBTREE_SEARCH_MODE_LE  = 0x02,
     RBTREE_SEARCH_MODE_GE  = 0x03,
+    RBTREE_SEARCH_MODE_LT  = 0x04,
+    RBTREE_SEARCH_MODE_GT  = 0x05,
 
-    RBTREE_SEARCH_MODE_MAX = 0x04,
+    RBTREE_SEARCH_MODE_MAX = 0x06,
 };
+typedef enum rbtree_search_mode_e rbtree_search_mode_t;
+
 
+int
+rbtree_init(rbtree_t *tree, rbtree_compare compare);
+
+int
+rbtree_insert(rbtree_t *tree, rbtree_node_t *node);
+
+int
+rbtree_delete(rbtree_t *tree, rbtree_node_t *node);
 
 int
 rbtree_search(rbtree_t *tree,
@@ -74,6 +208,185 @@ rbtree_search(rbtree_t *tree,
               rbtree_search_mode_t mode,
               rbtree_node_t **ret);
 
+/**
+ * search by an opaque key instead of a probe node
+ *
+ * LT and GT return the nearest node strictly less or greater than `key`.
+ */
+int
+rbtree_search_key(rbtree_t *tree,
+                  const void *key,
+                  rbtree_key_compare compare,
+                  rbtree_search_mode_t mode,
+                  rbtree_node_t **ret);
+
+/** first and last node equal to `key`, both in tree when RBTREE_OK */
+int
+rbtree_equal_range(rbtree_t *tree,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_node_t **first,
+                   rbtree_node_t **last);
+
+/** in-order walk, NULL when there is no such node */
+rbtree_node_t *
+rbtree_first(rbtree_t *tree);
+
+rbtree_node_t *
+rbtree_last(rbtree_t *tree);
+
+rbtree_node_t *
+rbtree_next(rbtree_t *tree, rbtree_node_t *node);
+
+rbtree_node_t *
+rbtree_prev(rbtree_t *tree, rbtree_node_t *node);
+
+/**
+ * move every node through `relocate` in the given order and fix up
+ * all links into them, including root and the sentinel
+ */
+int
+rbtree_compact(rbtree_t *tree,
+               rbtree_compact_order_t order,
+               rbtree_relocate relocate,
+               void *ctx);
+
+/** relocate callback for rbtree_compact_pool_t passed as `ctx` */
+rbtree_node_t *
+rbtree_compact_pool_relocate(rbtree_node_t *node, void *ctx);
+
+int
+rbtree_compact_start(rbtree_t *tree, rbtree_compact_cursor_t *cursor);
+
+/**
+ * move at most `budget` nodes from cursor on
+ *
+ * tree may change between steps, but `cursor->next` must not be deleted,
+ * start again if it is. new nodes before the cursor are not moved.
+ */
+int
+rbtree_compact_step(rbtree_t *tree,
+                    rbtree_compact_cursor_t *cursor,
+                    size_t budget,
+                    rbtree_relocate relocate,
+                    void *ctx);
+
+/**
+ * remove all nodes in [lo, hi) and pass them to `release`, NULL bound
+ * means unbounded on that side, `release` may be NULL
+ *
+ * the range is cut out by split and join in O(log n), rebalancing only
+ * along the two boundary paths, then released in O(k).
+ */
+int
+rbtree_delete_range(rbtree_t *tree,
+                    rbtree_node_t *lo,
+                    rbtree_node_t *hi,
+                    rbtree_release release,
+                    void *ctx);
+
+/**
+ * cut nodes in [lo, hi) out of tree in O(log n)
+ *
+ * `*detached` is the root of a valid sub-tree, NULL if range is empty.
+ * it still ends in the sentinel of tree, so release it with
+ * rbtree_release_detached before tree goes away. rbtree_size counts
+ * the detached nodes until then.
+ */
+int
+rbtree_detach_range(rbtree_t *tree,
+                    rbtree_node_t *lo,
+                    rbtree_node_t *hi,
+                    rbtree_node_t **detached);
+
+/** pass every node of a detached sub-tree to `release`, returns the count */
+size_t
+rbtree_release_detached(rbtree_t *tree,
+                        rbtree_node_t *detached,
+                        rbtree_release release,
+                        void *ctx);
+
+/**
+ * build tree from `count` nodes already in compare order, O(n)
+ *
+ * tree must be empty and no node may be in a tree. order is trusted,
+ * not checked.
+ */
+int
+rbtree_build_sorted(rbtree_t *tree, rbtree_node_t **nodes, size_t count);
+
+/**
+ * keep per subtree data current through `augment`, NULL to stop
+ *
+ * it is called bottom-up on every node whose subtree changed, by insert,
+ * delete, both rotations, range operations and build, O(log n) calls per
+ * update. nodes already in tree are computed once here, in O(n).
+ */
+int
+rbtree_set_augment(rbtree_t *tree, rbtree_augment augment);
+
+/** call augment from `node` up to root, after data it reads has changed */
+int
+rbtree_augment_path(rbtree_t *tree, rbtree_node_t *node);
+
+/**
+ * relaxed balance: insert only links a node red and queues it in
+ * `pending`, up to `capacity` nodes, fixups run later in insertion order
+ * from rbtree_rebalance. when the queue is full an insert fixes the
+ * oldest one first. the tree stays a valid search tree all along, only
+ * its height grows by up to `capacity`. keep it small for ordered
+ * bursts, they hang queued nodes in one chain every insert walks down.
+ *
+ * delete, range operations and compaction need a balanced tree and run
+ * every pending fixup first. NULL and 0 leave relaxed mode, after
+ * running them as well.
+ */
+int
+rbtree_set_relaxed(rbtree_t *tree, rbtree_node_t **pending, size_t capacity);
+
+/**
+ * run at most `budget` pending fixups, oldest first, and return how many
+ * are left. a fixup is O(1) amortized and O(log n) at worst. it may run
+ * in another thread as long as the caller locks the tree around it.
+ */
+size_t
+rbtree_rebalance(rbtree_t *tree, size_t budget);
+
+/** walk the whole tree, O(n) without recursion */
+int
+rbtree_stats(rbtree_t *tree, rbtree_stats_t *stats);
+
+/** RBTREE_NOT_SUPPORTED if built without RBTREE_INSTRUMENT */
+int
+rbtree_get_counters(rbtree_t *tree, rbtree_counters_t *counters);
+
+int
+rbtree_reset_counters(rbtree_t *tree);
+
+/**
+ * insert `node` only if no node equal to it is in tree
+ *
+ * `*ret` is set to the node which is in tree afterwards,
+ * RBTREE_DUPLICATE is returned if it is not `node`.
+ */
+int
+rbtree_insert_unique(rbtree_t *tree, rbtree_node_t *node, rbtree_node_t **ret);
+
+/**
+ * look up `value`
+ *
+ * RBTREE_OK with `*ret` set if found, otherwise RBTREE_NOT_FOUND
+ * with `*pos` set so that `rbtree_insert_at` links without a new descent.
+ */
+int
+rbtree_find_or_insert(rbtree_t *tree,
+                      rbtree_node_t *value,
+                      rbtree_insert_pos_t *pos,
+                      rbtree_node_t **ret);
+
+int
+rbtree_insert_at(rbtree_t *tree, rbtree_insert_pos_t *pos, rbtree_node_t *node);
+
 
 static inline int
 rbtree_is_sentinel(rbtree_t *tree, rbtree_node_t *node)
@@ -82,6 +395,13 @@ rbtree_is_sentinel(rbtree_t *tree, rbtree_node_t *node)
 }
 
 
+static inline size_t
+rbtree_size(rbtree_t *tree)
+{
+    return tree->size;
+}
+
+
 static inline int
 rbtree_is_root(rbtree_t *tree, rbtree_node_t *node)
 {
@@ -112,4 +432,8 @@ rbtree_get_uncle(rbtree_node_t *node)
 }
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
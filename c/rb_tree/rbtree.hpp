@@ -0,0 +1,707 @@
+/**
+ * file name: rbtree.hpp
+ *
+ * header only C++ wrapper of rbtree.h
+ *
+ * an intrusive tree of T linked through its rbtree_node_t member `Node`.
+ * lookups and the insert descent are templates, so `Compare` is inlined
+ * instead of called through rbtree_compare, rebalancing and erase are
+ * the C ones.
+ *
+ *     struct item {
+ *         uint64_t key;
+ *         rbtree_node_t node;
+ *     };
+ *
+ *     struct item_less {
+ *         bool operator()(const item &a, const item &b) const { return a.key < b.key; }
+ *     };
+ *
+ *     rb::rbtree<item, &item::node, item_less> tree;
+ *
+ * rb::rbtree does not own its values, rb::pmr_rbtree does.
+ * it holds the sentinel of rbtree_t, so it is neither copied nor moved.
+ */
+#ifndef __RB_TREE_HPP__
+#define __RB_TREE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+
+#include "rbtree.h"
+
+
+namespace rb {
+
+/**
+ * `Compare` is a strict weak order like std::less. lookups by another key
+ * type K need it to also take (T, K) and (K, T), as a transparent
+ * comparator of std::set does.
+ */
+template <typename T, rbtree_node_t T::*Node, typename Compare = std::less<T>>
+class rbtree {
+public:
+    using value_type      = T;
+    using key_compare     = Compare;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference       = T &;
+    using const_reference = const T &;
+    using pointer         = T *;
+    using const_pointer   = const T *;
+
+    template <bool Const>
+    class basic_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = std::conditional_t<Const, const T *, T *>;
+        using reference         = std::conditional_t<Const, const T &, T &>;
+
+        basic_iterator() = default;
+
+        /** iterator to const_iterator */
+        template <bool Other, typename = std::enable_if_t<Const && !Other>>
+        basic_iterator(const basic_iterator<Other> &other)
+            : tree_(other.tree_), node_(other.node_)
+        {
+        }
+
+        reference
+        operator*() const
+        {
+            return *rbtree::value_of(node_);
+        }
+
+        pointer
+        operator->() const
+        {
+            return rbtree::value_of(node_);
+        }
+
+        basic_iterator &
+        operator++()
+        {
+            node_ = rbtree::successor(tree_, node_);
+
+            return *this;
+        }
+
+        basic_iterator
+        operator++(int)
+        {
+            basic_iterator old = *this;
+            ++*this;
+
+            return old;
+        }
+
+        /** end() steps back to the last value */
+        basic_iterator &
+        operator--()
+        {
+            node_ = node_ == nullptr ? rbtree::maximum(tree_, tree_->root)
+                                     : rbtree::predecessor(tree_, node_);
+
+            return *this;
+        }
+
+        basic_iterator
+        operator--(int)
+        {
+            basic_iterator old = *this;
+            --*this;
+
+            return old;
+        }
+
+        friend bool
+        operator==(const basic_iterator &a, const basic_iterator &b)
+        {
+            return a.node_ == b.node_;
+        }
+
+        friend bool
+        operator!=(const basic_iterator &a, const basic_iterator &b)
+        {
+            return a.node_ != b.node_;
+        }
+
+    private:
+        friend class rbtree;
+        template <bool> friend class basic_iterator;
+
+        basic_iterator(const rbtree_t *tree, rbtree_node_t *node)
+            : tree_(tree), node_(node)
+        {
+        }
+
+        const rbtree_t *tree_ = nullptr;
+        /** nullptr is end() */
+        rbtree_node_t *node_ = nullptr;
+    };
+
+    using iterator               = basic_iterator<false>;
+    using const_iterator         = basic_iterator<true>;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+
+    explicit rbtree(const Compare &comp = Compare())
+        : comp_(comp)
+    {
+        rbtree_init(&tree_, &rbtree::compare_nodes);
+    }
+
+    rbtree(const rbtree &) = delete;
+    rbtree &operator=(const rbtree &) = delete;
+
+
+    iterator begin() { return make_iterator(minimum(&tree_, tree_.root)); }
+    iterator end() { return make_iterator(nullptr); }
+    const_iterator begin() const { return make_iterator(minimum(&tree_, tree_.root)); }
+    const_iterator end() const { return make_iterator(nullptr); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    size_type size() const { return tree_.size; }
+    bool empty() const { return tree_.size == 0; }
+    key_compare key_comp() const { return comp_; }
+
+    /**
+     * the rbtree_t underneath, for the C API
+     *
+     * C calls which compare, e.g. rbtree_delete_range, use a default
+     * constructed `Compare`.
+     */
+    rbtree_t *native() { return &tree_; }
+
+
+    /**
+     * before values equal to it, as rbtree_insert does, so one tree keeps
+     * one order whichever side inserts. std::multiset puts it after them.
+     */
+    iterator
+    insert(T &value)
+    {
+        rbtree_insert_pos_t pos = { &tree_.sentinel, 0 };
+
+        for (rbtree_node_t *traverse = tree_.root; traverse != &tree_.sentinel; ) {
+            pos.parent  = traverse;
+            pos.is_left = !comp_(*value_of(traverse), value);
+
+            traverse = pos.is_left ? traverse->left : traverse->right;
+        }
+
+        rbtree_insert_at(&tree_, &pos, node_of(value));
+
+        return make_iterator(node_of(value));
+    }
+
+    /** like std::set, `second` is false and nothing changes if an equal value is in */
+    std::pair<iterator, bool>
+    insert_unique(T &value)
+    {
+        rbtree_insert_pos_t pos = { &tree_.sentinel, 0 };
+        rbtree_node_t *bound = nullptr;
+
+        for (rbtree_node_t *traverse = tree_.root; traverse != &tree_.sentinel; ) {
+            pos.parent  = traverse;
+            pos.is_left = !comp_(*value_of(traverse), value);
+
+            if (pos.is_left) {
+                bound = traverse;
+                traverse = traverse->left;
+            }
+            else {
+                traverse = traverse->right;
+            }
+        }
+
+        if (bound != nullptr && !comp_(value, *value_of(bound))) {
+            return { make_iterator(bound), false };
+        }
+
+        rbtree_insert_at(&tree_, &pos, node_of(value));
+
+        return { make_iterator(node_of(value)), true };
+    }
+
+    /** the value is unlinked, not destroyed */
+    iterator
+    erase(iterator pos)
+    {
+        return erase(const_iterator(pos));
+    }
+
+    iterator
+    erase(const_iterator pos)
+    {
+        rbtree_node_t *node = pos.node_;
+        rbtree_node_t *next = successor(&tree_, node);
+
+        rbtree_delete(&tree_, node);
+
+        return make_iterator(next);
+    }
+
+    iterator
+    erase(const_iterator first, const_iterator last)
+    {
+        while (first != last) {
+            first = erase(first);
+        }
+
+        return unconst(last);
+    }
+
+    template <typename K>
+    size_type
+    erase(const K &key)
+    {
+        auto range = equal_range(key);
+        size_type count = 0;
+
+        for (auto it = range.first; it != range.second; count++) {
+            it = erase(it);
+        }
+
+        return count;
+    }
+
+    /** `disposer(T *)` gets the value once it is unlinked */
+    template <typename Disposer>
+    iterator
+    erase_and_dispose(const_iterator pos, Disposer disposer)
+    {
+        T *value = value_of(pos.node_);
+        iterator next = erase(pos);
+
+        disposer(value);
+
+        return next;
+    }
+
+    /** forget all values, O(1), they keep stale links */
+    void
+    clear()
+    {
+        rbtree_init(&tree_, &rbtree::compare_nodes);
+    }
+
+    template <typename Disposer>
+    void
+    clear_and_dispose(Disposer disposer)
+    {
+        rbtree_delete_range(&tree_, nullptr, nullptr, &rbtree::dispose<Disposer>, &disposer);
+    }
+
+    iterator
+    iterator_to(T &value)
+    {
+        return make_iterator(node_of(value));
+    }
+
+    const_iterator
+    iterator_to(const T &value) const
+    {
+        return make_iterator(const_cast<rbtree_node_t *>(&(value.*Node)));
+    }
+
+
+    /** first value not less than `key` */
+    template <typename K>
+    iterator
+    lower_bound(const K &key)
+    {
+        return make_iterator(lower_bound_node(key));
+    }
+
+    template <typename K>
+    const_iterator
+    lower_bound(const K &key) const
+    {
+        return make_iterator(lower_bound_node(key));
+    }
+
+    /** first value greater than `key` */
+    template <typename K>
+    iterator
+    upper_bound(const K &key)
+    {
+        return make_iterator(upper_bound_node(key));
+    }
+
+    template <typename K>
+    const_iterator
+    upper_bound(const K &key) const
+    {
+        return make_iterator(upper_bound_node(key));
+    }
+
+    template <typename K>
+    std::pair<iterator, iterator>
+    equal_range(const K &key)
+    {
+        return { lower_bound(key), upper_bound(key) };
+    }
+
+    template <typename K>
+    std::pair<const_iterator, const_iterator>
+    equal_range(const K &key) const
+    {
+        return { lower_bound(key), upper_bound(key) };
+    }
+
+    template <typename K>
+    iterator
+    find(const K &key)
+    {
+        return make_iterator(find_node(key));
+    }
+
+    template <typename K>
+    const_iterator
+    find(const K &key) const
+    {
+        return make_iterator(find_node(key));
+    }
+
+    template <typename K>
+    bool
+    contains(const K &key) const
+    {
+        return find_node(key) != nullptr;
+    }
+
+    template <typename K>
+    size_type
+    count(const K &key) const
+    {
+        auto range = equal_range(key);
+
+        return static_cast<size_type>(std::distance(range.first, range.second));
+    }
+
+
+    static T *
+    value_of(rbtree_node_t *node)
+    {
+        return reinterpret_cast<T *>(reinterpret_cast<char *>(node) - node_offset());
+    }
+
+    static rbtree_node_t *
+    node_of(T &value)
+    {
+        return &(value.*Node);
+    }
+
+protected:
+    iterator
+    unconst(const_iterator pos)
+    {
+        return make_iterator(pos.node_);
+    }
+
+private:
+    /** offset of `Node` in T, folds to a constant */
+    static std::ptrdiff_t
+    node_offset()
+    {
+        alignas(T) static unsigned char storage[sizeof(T)];
+        T *probe = reinterpret_cast<T *>(storage);
+
+        return reinterpret_cast<char *>(&(probe->*Node)) - reinterpret_cast<char *>(probe);
+    }
+
+    /** rbtree_compare for the C functions which need one */
+    static int
+    compare_nodes(rbtree_node_t *na, rbtree_node_t *nb)
+    {
+        Compare comp;
+        const T &a = *value_of(na);
+        const T &b = *value_of(nb);
+
+        return comp(a, b) ? -1 : comp(b, a) ? 1 : 0;
+    }
+
+    template <typename Disposer>
+    static void
+    dispose(rbtree_node_t *node, void *ctx)
+    {
+        (*static_cast<Disposer *>(ctx))(value_of(node));
+    }
+
+    static rbtree_node_t *
+    minimum(const rbtree_t *tree, rbtree_node_t *node)
+    {
+        if (node == &tree->sentinel) {
+            return nullptr;
+        }
+
+        while (node->left != &tree->sentinel) {
+            node = node->left;
+        }
+
+        return node;
+    }
+
+    static rbtree_node_t *
+    maximum(const rbtree_t *tree, rbtree_node_t *node)
+    {
+        if (node == &tree->sentinel) {
+            return nullptr;
+        }
+
+        while (node->right != &tree->sentinel) {
+            node = node->right;
+        }
+
+        return node;
+    }
+
+    /** same walks as rbtree_next and rbtree_prev, inlined */
+    static rbtree_node_t *
+    successor(const rbtree_t *tree, rbtree_node_t *node)
+    {
+        if (node->right != &tree->sentinel) {
+            return minimum(tree, node->right);
+        }
+
+        rbtree_node_t *parent = node->parent;
+        while (parent != &tree->sentinel && node == parent->right) {
+            node = parent;
+            parent = parent->parent;
+        }
+
+        return parent == &tree->sentinel ? nullptr : parent;
+    }
+
+    static rbtree_node_t *
+    predecessor(const rbtree_t *tree, rbtree_node_t *node)
+    {
+        if (node->left != &tree->sentinel) {
+            return maximum(tree, node->left);
+        }
+
+        rbtree_node_t *parent = node->parent;
+        while (parent != &tree->sentinel && node == parent->left) {
+            node = parent;
+            parent = parent->parent;
+        }
+
+        return parent == &tree->sentinel ? nullptr : parent;
+    }
+
+    template <typename K>
+    rbtree_node_t *
+    lower_bound_node(const K &key) const
+    {
+        rbtree_node_t *bound = nullptr;
+
+        for (rbtree_node_t *traverse = tree_.root; traverse != &tree_.sentinel; ) {
+            if (comp_(*value_of(traverse), key)) {
+                traverse = traverse->right;
+            }
+            else {
+                bound = traverse;
+                traverse = traverse->left;
+            }
+        }
+
+        return bound;
+    }
+
+    template <typename K>
+    rbtree_node_t *
+    upper_bound_node(const K &key) const
+    {
+        rbtree_node_t *bound = nullptr;
+
+        for (rbtree_node_t *traverse = tree_.root; traverse != &tree_.sentinel; ) {
+            if (comp_(key, *value_of(traverse))) {
+                bound = traverse;
+                traverse = traverse->left;
+            }
+            else {
+                traverse = traverse->right;
+            }
+        }
+
+        return bound;
+    }
+
+    template <typename K>
+    rbtree_node_t *
+    find_node(const K &key) const
+    {
+        rbtree_node_t *bound = lower_bound_node(key);
+
+        return bound != nullptr && !comp_(key, *value_of(bound)) ? bound : nullptr;
+    }
+
+    iterator
+    make_iterator(rbtree_node_t *node)
+    {
+        return iterator(&tree_, node);
+    }
+
+    const_iterator
+    make_iterator(rbtree_node_t *node) const
+    {
+        return const_iterator(&tree_, node);
+    }
+
+    rbtree_t tree_;
+    Compare comp_;
+};
+
+
+/**
+ * rbtree which owns its values
+ *
+ * values are built in and given back to a std::pmr::memory_resource,
+ * e.g. a pool or an arena shared with std::pmr containers. erase and
+ * clear destroy them. do not use it through a rbtree reference, whose
+ * erase and clear would only unlink.
+ */
+template <typename T, rbtree_node_t T::*Node, typename Compare = std::less<T>>
+class pmr_rbtree : public rbtree<T, Node, Compare> {
+    using base = rbtree<T, Node, Compare>;
+
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<T>;
+    using typename base::iterator;
+    using typename base::const_iterator;
+    using typename base::size_type;
+
+    explicit pmr_rbtree(allocator_type alloc = {}, const Compare &comp = Compare())
+        : base(comp), alloc_(alloc)
+    {
+    }
+
+    ~pmr_rbtree()
+    {
+        clear();
+    }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+    template <typename... Args>
+    iterator
+    emplace(Args &&...args)
+    {
+        return base::insert(*make(std::forward<Args>(args)...));
+    }
+
+    /** the new value is destroyed again if an equal one is in */
+    template <typename... Args>
+    std::pair<iterator, bool>
+    emplace_unique(Args &&...args)
+    {
+        T *value = make(std::forward<Args>(args)...);
+
+        auto ret = base::insert_unique(*value);
+        if (!ret.second) {
+            destroy(value);
+        }
+
+        return ret;
+    }
+
+    iterator
+    erase(iterator pos)
+    {
+        return erase(const_iterator(pos));
+    }
+
+    iterator
+    erase(const_iterator pos)
+    {
+        return base::erase_and_dispose(pos, disposer{ this });
+    }
+
+    iterator
+    erase(const_iterator first, const_iterator last)
+    {
+        while (first != last) {
+            first = erase(first);
+        }
+
+        return base::unconst(last);
+    }
+
+    template <typename K>
+    size_type
+    erase(const K &key)
+    {
+        auto range = base::equal_range(key);
+        size_type count = 0;
+
+        for (auto it = range.first; it != range.second; count++) {
+            it = erase(it);
+        }
+
+        return count;
+    }
+
+    void
+    clear()
+    {
+        base::clear_and_dispose(disposer{ this });
+    }
+
+private:
+    /** values not made by us must not get in */
+    using base::insert;
+    using base::insert_unique;
+
+    struct disposer {
+        pmr_rbtree *owner;
+
+        void operator()(T *value) const { owner->destroy(value); }
+    };
+
+    template <typename... Args>
+    T *
+    make(Args &&...args)
+    {
+        T *value = alloc_.allocate(1);
+
+        try {
+            std::allocator_traits<allocator_type>::construct(alloc_, value, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            alloc_.deallocate(value, 1);
+            throw;
+        }
+
+        return value;
+    }
+
+    void
+    destroy(T *value)
+    {
+        std::allocator_traits<allocator_type>::destroy(alloc_, value);
+        alloc_.deallocate(value, 1);
+    }
+
+    allocator_type alloc_;
+};
+
+}
+
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * file name: rbtree_agg.c
+ *
+ * range aggregates implemention
+ *
+ * a range query descends to the first node inside the range, then walks
+ * its left subtree against the lower bound and its right subtree against
+ * the upper bound. every subtree hanging wholly inside the range is
+ * taken as its summary, so both walks are one path long.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_agg.h"
+
+
+static void
+rbtree_agg_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    /** tree is the first field */
+    rbtree_agg_t *agg = (rbtree_agg_t *)tree;
+    rbtree_monoid_t *monoid = &agg->monoid;
+    void *summary = rbtree_agg_summary(agg, node);
+
+    monoid->init(summary, monoid->ctx);
+
+    if (!rbtree_is_sentinel(tree, node->left)) {
+        monoid->combine(summary, rbtree_agg_summary(agg, node->left), monoid->ctx);
+    }
+
+    monoid->accumulate(summary, node, monoid->ctx);
+
+    if (!rbtree_is_sentinel(tree, node->right)) {
+        monoid->combine(summary, rbtree_agg_summary(agg, node->right), monoid->ctx);
+    }
+}
+
+
+int
+rbtree_agg_init(rbtree_agg_t *agg, rbtree_compare compare, const rbtree_monoid_t *monoid)
+{
+    rbtree_must(agg != NULL && compare != NULL && monoid != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(monoid->init != NULL && monoid->accumulate != NULL && monoid->combine != NULL,
+                RBTREE_INVALID_ARG);
+
+    agg->monoid = *monoid;
+    rbtree_init(&agg->tree, compare);
+    rbtree_set_augment(&agg->tree, rbtree_agg_augment);
+
+    return RBTREE_OK;
+}
+
+
+/** fold nodes of subtree of `node` not less than `lo` into `result` */
+static void
+rbtree_agg_from(rbtree_agg_t *agg,
+                rbtree_node_t *node,
+                const void *lo,
+                rbtree_key_compare compare,
+                void *result)
+{
+    rbtree_t *tree = &agg->tree;
+    rbtree_monoid_t *monoid = &agg->monoid;
+
+    /** nodes in range where the walk turned left, the last is the smallest */
+    rbtree_node_t *stack[RBTREE_MAX_HEIGHT];
+    size_t depth = 0;
+
+    while (!rbtree_is_sentinel(tree, node)) {
+        if (lo != NULL && compare(lo, node) > 0) {
+            node = node->right;
+        }
+        else {
+            stack[depth++] = node;
+            node = node->left;
+        }
+    }
+
+    while (depth > 0) {
+        node = stack[--depth];
+
+        monoid->accumulate(result, node, monoid->ctx);
+
+        if (!rbtree_is_sentinel(tree, node->right)) {
+            monoid->combine(result, rbtree_agg_summary(agg, node->right), monoid->ctx);
+        }
+    }
+}
+
+
+/** fold nodes of subtree of `node` less than `hi` into `result` */
+static void
+rbtree_agg_until(rbtree_agg_t *agg,
+                 rbtree_node_t *node,
+                 const void *hi,
+                 rbtree_key_compare compare,
+                 void *result)
+{
+    rbtree_t *tree = &agg->tree;
+    rbtree_monoid_t *monoid = &agg->monoid;
+
+    while (!rbtree_is_sentinel(tree, node)) {
+        if (hi != NULL && compare(hi, node) <= 0) {
+            node = node->left;
+        }
+        else {
+            if (!rbtree_is_sentinel(tree, node->left)) {
+                monoid->combine(result, rbtree_agg_summary(agg, node->left), monoid->ctx);
+            }
+
+            monoid->accumulate(result, node, monoid->ctx);
+            node = node->right;
+        }
+    }
+}
+
+
+int
+rbtree_aggregate_range(rbtree_agg_t *agg,
+                       const void *lo,
+                       const void *hi,
+                       rbtree_key_compare compare,
+                       void *result)
+{
+    rbtree_must(agg != NULL && result != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL || (lo == NULL && hi == NULL), RBTREE_INVALID_ARG);
+
+    rbtree_t *tree = &agg->tree;
+    rbtree_monoid_t *monoid = &agg->monoid;
+
+    /** pending inserts of relaxed mode could deepen tree past the stack below */
+    rbtree_rebalance(tree, SIZE_MAX);
+
+    rbtree_node_t *node = tree->root;
+
+    monoid->init(result, monoid->ctx);
+
+    /** first node in range, the top of every node in range */
+    while (!rbtree_is_sentinel(tree, node)) {
+        if (lo != NULL && compare(lo, node) > 0) {
+            node = node->right;
+        }
+        else if (hi != NULL && compare(hi, node) <= 0) {
+            node = node->left;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (rbtree_is_sentinel(tree, node)) {
+        return RBTREE_OK;
+    }
+
+    rbtree_agg_from(agg, node->left, lo, compare, result);
+    monoid->accumulate(result, node, monoid->ctx);
+    rbtree_agg_until(agg, node->right, hi, compare, result);
+
+    return RBTREE_OK;
+}
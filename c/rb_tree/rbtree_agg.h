@@ -0,0 +1,76 @@
+/**
+ * file name: rbtree_agg.h
+ *
+ * head file of range aggregates
+ *
+ * every node keeps a summary of its subtree in a field of the user's
+ * record, folded by a monoid: `init` makes the identity, `accumulate`
+ * folds one node, `combine` joins the summaries of two adjacent key
+ * ranges. rbtree_set_augment keeps summaries current through insert,
+ * delete, the rotations and both fixups, and the summary of any key
+ * range is then put together from O(log n) of them.
+ *
+ * nodes are inserted and deleted with rbtree_insert and rbtree_delete on
+ * `agg->tree`, a node whose summarized data changed in place needs
+ * rbtree_augment_path.
+ */
+#ifndef __RB_TREE_AGG_H__
+#define __RB_TREE_AGG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+/** `offset` of summary field `summary` of `type` whose rbtree_node_t is `node` */
+#define rbtree_summary_offset(type, node, summary) \
+    ((ptrdiff_t)offsetof(type, summary) - (ptrdiff_t)offsetof(type, node))
+
+/**
+ * `combine` has to be associative but not commutative, it is always
+ * given summaries in key order
+ */
+typedef struct rbtree_monoid_s rbtree_monoid_t;
+struct rbtree_monoid_s {
+    size_t size;
+    /** from rbtree_node_t of a node to its summary */
+    ptrdiff_t offset;
+    void (*init)(void *summary, void *ctx);
+    void (*accumulate)(void *summary, rbtree_node_t *node, void *ctx);
+    /** fold `next`, which covers keys after those of `summary`, into `summary` */
+    void (*combine)(void *summary, const void *next, void *ctx);
+    void *ctx;
+};
+
+typedef struct rbtree_agg_s rbtree_agg_t;
+struct rbtree_agg_s {
+    rbtree_t tree;
+    rbtree_monoid_t monoid;
+};
+
+
+int
+rbtree_agg_init(rbtree_agg_t *agg, rbtree_compare compare, const rbtree_monoid_t *monoid);
+
+/**
+ * summary of nodes with key in [`lo`, `hi`), NULL for unbounded, into
+ * `result` of `monoid.size` bytes. O(log n) combines.
+ */
+int
+rbtree_aggregate_range(rbtree_agg_t *agg,
+                       const void *lo,
+                       const void *hi,
+                       rbtree_key_compare compare,
+                       void *result);
+
+
+/** summary of subtree of `node` */
+static inline void *
+rbtree_agg_summary(rbtree_agg_t *agg, rbtree_node_t *node)
+{
+    return (char *)node + agg->monoid.offset;
+}
+
+
+#endif
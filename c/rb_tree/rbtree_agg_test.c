@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_agg.c"
+
+/** sum of bytes, max latency, and whether keys were seen in order */
+typedef struct test_summary_s test_summary_t;
+struct test_summary_s {
+    uint64_t bytes;
+    uint64_t latency;
+    size_t count;
+    int first;
+    int last;
+    int ordered;
+};
+
+typedef struct test_entry_s test_entry_t;
+struct test_entry_s {
+    int key;
+    uint64_t bytes;
+    uint64_t latency;
+    int in_tree;
+    rbtree_node_t node;
+    test_summary_t summary;
+};
+
+#define test_entry_of(ptr) \
+    ((test_entry_t *)((uintptr_t)(ptr) - offsetof(test_entry_t, node)))
+
+static size_t test_combines = 0;
+
+
+static int
+test_entry_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = test_entry_of(na)->key;
+    int bkey = test_entry_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    int akey = *(const int *)key;
+    int bkey = test_entry_of(node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+test_summary_init(void *summary, void *ctx)
+{
+    test_summary_t *sum = summary;
+
+    memset(sum, 0, sizeof(*sum));
+    sum->ordered = 1;
+}
+
+
+static void
+test_summary_combine(void *summary, const void *next, void *ctx)
+{
+    test_summary_t *sum = summary;
+    const test_summary_t *other = next;
+
+    test_combines++;
+
+    if (other->count == 0) {
+        return;
+    }
+
+    if (sum->count == 0) {
+        *sum = *other;
+
+        return;
+    }
+
+    sum->bytes += other->bytes;
+    sum->latency = sum->latency > other->latency ? sum->latency : other->latency;
+    sum->ordered = sum->ordered && other->ordered && sum->last <= other->first;
+    sum->count += other->count;
+    sum->last = other->last;
+}
+
+
+static void
+test_summary_accumulate(void *summary, rbtree_node_t *node, void *ctx)
+{
+    test_entry_t *entry = test_entry_of(node);
+    test_summary_t one = {
+        .bytes   = entry->bytes,
+        .latency = entry->latency,
+        .count   = 1,
+        .first   = entry->key,
+        .last    = entry->key,
+        .ordered = 1,
+    };
+
+    test_summary_combine(summary, &one, ctx);
+}
+
+
+static const rbtree_monoid_t test_monoid = {
+    .size       = sizeof(test_summary_t),
+    .offset     = rbtree_summary_offset(test_entry_t, node, summary),
+    .init       = test_summary_init,
+    .accumulate = test_summary_accumulate,
+    .combine    = test_summary_combine,
+    .ctx        = NULL,
+};
+
+
+/** what walking the range gives */
+static void
+test_walk_range(test_entry_t *entries, size_t count, const int *lo, const int *hi, test_summary_t *sum)
+{
+    test_summary_init(sum, NULL);
+
+    /** entries are indexed by key */
+    for (size_t idx = 0; idx < count; idx++) {
+        test_entry_t *entry = &entries[idx];
+
+        if (entry->in_tree && (lo == NULL || entry->key >= *lo) && (hi == NULL || entry->key < *hi)) {
+            test_summary_accumulate(sum, &entry->node, NULL);
+        }
+    }
+}
+
+
+/** field by field, padding of summaries is not set */
+static void
+test_same_summary(const test_summary_t *got, const test_summary_t *expect)
+{
+    CU_ASSERT(got->count == expect->count);
+    CU_ASSERT(got->bytes == expect->bytes);
+    CU_ASSERT(got->latency == expect->latency);
+    CU_ASSERT(got->ordered == expect->ordered);
+
+    if (expect->count > 0) {
+        CU_ASSERT(got->first == expect->first);
+        CU_ASSERT(got->last == expect->last);
+    }
+}
+
+
+static void
+test_check_range(rbtree_agg_t *agg, test_entry_t *entries, size_t count, const int *lo, const int *hi)
+{
+    test_summary_t expect, got;
+
+    test_walk_range(entries, count, lo, hi, &expect);
+    CU_ASSERT(rbtree_aggregate_range(agg, lo, hi, test_key_compare, &got) == RBTREE_OK);
+
+    CU_ASSERT(got.ordered);
+    test_same_summary(&got, &expect);
+}
+
+
+static void
+test_basic(void)
+{
+    test_entry_t entries[100];
+    rbtree_agg_t agg;
+
+    CU_ASSERT(rbtree_agg_init(NULL, test_entry_compare, &test_monoid) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_agg_init(&agg, test_entry_compare, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_agg_init(&agg, test_entry_compare, &test_monoid) == RBTREE_OK);
+
+    test_summary_t sum;
+    int lo = 10, hi = 20;
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &hi, test_key_compare, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.count == 0);
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &hi, NULL, &sum) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &hi, test_key_compare, NULL) == RBTREE_INVALID_ARG);
+
+    for (int idx = 0; idx < 100; idx++) {
+        entries[idx].key = idx;
+        entries[idx].bytes = idx * 10;
+        entries[idx].latency = (idx * 37) % 100;
+        entries[idx].in_tree = 1;
+        CU_ASSERT(rbtree_insert(&agg.tree, &entries[idx].node) == RBTREE_OK);
+    }
+
+    /** half open */
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &hi, test_key_compare, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.count == 10 && sum.first == 10 && sum.last == 19);
+    CU_ASSERT(sum.bytes == 1450);
+
+    /** whole tree is the root summary */
+    CU_ASSERT(rbtree_aggregate_range(&agg, NULL, NULL, NULL, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.count == 100 && sum.latency == 99);
+    test_same_summary(&sum, rbtree_agg_summary(&agg, agg.tree.root));
+
+    /** empty and inverted ranges */
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &lo, test_key_compare, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.count == 0);
+    CU_ASSERT(rbtree_aggregate_range(&agg, &hi, &lo, test_key_compare, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.count == 0);
+
+    /** changed in place */
+    entries[15].latency = 1000;
+    CU_ASSERT(rbtree_augment_path(&agg.tree, &entries[15].node) == RBTREE_OK);
+    CU_ASSERT(rbtree_aggregate_range(&agg, &lo, &hi, test_key_compare, &sum) == RBTREE_OK);
+    CU_ASSERT(sum.latency == 1000);
+    test_check_range(&agg, entries, 100, NULL, &lo);
+}
+
+
+static void
+test_random(void)
+{
+    enum { NODES = 20000, ROUNDS = 60000 };
+    static test_entry_t entries[NODES];
+
+    rbtree_agg_t agg;
+    rbtree_agg_init(&agg, test_entry_compare, &test_monoid);
+    memset(entries, 0, sizeof(entries));
+
+    srand(20171104);
+
+    for (int idx = 0; idx < NODES; idx++) {
+        entries[idx].key = idx;
+    }
+
+    size_t max_combines = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        test_entry_t *entry = &entries[rand() % NODES];
+
+        if (entry->in_tree) {
+            CU_ASSERT(rbtree_delete(&agg.tree, &entry->node) == RBTREE_OK);
+            entry->in_tree = 0;
+        }
+        else {
+            entry->bytes = rand() % 4096;
+            entry->latency = rand();
+            CU_ASSERT(rbtree_insert(&agg.tree, &entry->node) == RBTREE_OK);
+            entry->in_tree = 1;
+        }
+
+        if (round % 1009 == 0) {
+            int lo = rand() % NODES;
+            int hi = lo + rand() % (NODES - lo + 1);
+
+            test_check_range(&agg, entries, NODES, &lo, &hi);
+            test_check_range(&agg, entries, NODES, &lo, NULL);
+            test_check_range(&agg, entries, NODES, NULL, &hi);
+
+            /** O(log n), not the size of the range */
+            test_combines = 0;
+            test_summary_t sum;
+            rbtree_aggregate_range(&agg, &lo, &hi, test_key_compare, &sum);
+            max_combines = test_combines > max_combines ? test_combines : max_combines;
+        }
+    }
+
+    /** two paths of at most 2 log n, two combines a node */
+    CU_ASSERT(max_combines > 0 && max_combines <= 4 * 2 * 15);
+
+    /** a tree built at once */
+    static rbtree_node_t *sorted[NODES];
+    rbtree_agg_t built;
+    rbtree_agg_init(&built, test_entry_compare, &test_monoid);
+
+    size_t count = 0;
+    for (rbtree_node_t *node = rbtree_first(&agg.tree); node != NULL; node = rbtree_next(&agg.tree, node)) {
+        sorted[count++] = node;
+    }
+
+    /** nodes are moved over */
+    agg.tree.root = &agg.tree.sentinel;
+    agg.tree.size = 0;
+    CU_ASSERT(rbtree_build_sorted(&built.tree, sorted, count) == RBTREE_OK);
+
+    int lo = NODES / 3, hi = NODES / 2;
+    test_check_range(&built, entries, NODES, &lo, &hi);
+    test_check_range(&built, entries, NODES, NULL, NULL);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbtree_agg[] = {
+    { "test_basic",  test_basic  },
+    { "test_random", test_random },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbtree_agg",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_agg,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,2456 @@
+/**
+ * file name: rbtree_bench.c
+ *
+ * micro benchmark of tree variants
+ *
+ * usage: rbtree_bench [count]
+ *        rbtree_bench counters [count]
+ *
+ * every variant inserts the same shuffled keys, looks them up in
+ * another random order, scans in order and deletes them all.
+ *
+ * small sets split the same keys into many sets of a few nodes each,
+ * ops are spread over all sets so every set is cold in cache.
+ *
+ * mixed runs 90% exact lookups and 10% short range scans.
+ *
+ * cache fills with random ttls, then hits every entry, evicts half of
+ * them by LRU and harvests the other half as expired.
+ *
+ * string keys are separate heap strings, compared by a memcmp callback
+ * in rbtree.c and by inline prefix in rbtree_str.c.
+ *
+ * retention drops the lower half of keys one by one and as one range.
+ *
+ * durable logs inserts under /tmp with a sync per 1, 64 and 4096 ops,
+ * then churns with periodic checkpoints and times recovery from log only
+ * and from checkpoint. it runs at most 100000 ops, 2000 when each syncs.
+ *
+ * quantile keeps a window of count / 2 samples, one per tick, and times
+ * steady state adds, p50/p99/p999 queries and one sort of the window.
+ *
+ * aggregate sums bytes and takes max latency over key ranges of 100,
+ * 1% and 10% of keys, by rbtree_aggregate_range and by walking them.
+ *
+ * multi index keeps records by unique id, by time and by owner, once in
+ * three trees by hand and once in rbmulti_t. touch moves time to now,
+ * jitter adds one to it, which seldom passes a neighbour.
+ *
+ * relaxed inserts the second half of keys into a tree holding the
+ * first half, in random order and as appends past every key, with
+ * fixups at once and queued up to 16, 256 and 4096 nodes. depth is the
+ * deepest node right after the burst, settled is after the drain.
+ *
+ * contended splits at most 200000 keys over 1 to 64 writer threads,
+ * each inserts its share then deletes it, through a mutex, a spinlock
+ * or flat combining. latency is per op as the calling thread sees it.
+ *
+ * counters runs insert, search, scan and delete of rbtree.c alone, at
+ * sizes from 1024 to count, and reads cycles, instructions, branch, L1d,
+ * LLC and dTLB misses per op through perf_event_open. counters which
+ * cannot be opened, for lack of a pmu or of permission, show as "-".
+ *
+ * parallel visits every node with rbtree_parallel_foreach and sums them
+ * with rbtree_parallel_reduce from 1 to 32 threads.
+ */
+#define _POSIX_C_SOURCE 200809L
+/** syscall, for perf_event_open */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "rbtree.h"
+#include "rbtree_td.h"
+#include "rbtree_thr.h"
+#include "rbtree_idx.h"
+#include "rbtree_small.h"
+#include "rbtree_hmap.h"
+#include "rbtree_cache.h"
+#include "rbtree_str.h"
+#include "rbtree_wal.h"
+#include "rbtree_fc.h"
+#include "rbtree_par.h"
+#include "rbtree_quant.h"
+#include "rbtree_agg.h"
+#include "rbtree_multi.h"
+
+
+#define bench_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+/** xorshift, deterministic across variants */
+static uint64_t
+bench_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    return x;
+}
+
+
+static void
+bench_shuffle(uint64_t *keys, size_t count, uint64_t seed)
+{
+    for (size_t idx = count - 1; idx > 0; idx--) {
+        size_t pick = bench_rand(&seed) % (idx + 1);
+        uint64_t tmp = keys[idx];
+        keys[idx] = keys[pick];
+        keys[pick] = tmp;
+    }
+}
+
+
+typedef struct bench_result_s bench_result_t;
+struct bench_result_s {
+    const char *name;
+    size_t node_bytes;
+    /** records plus tree overhead */
+    size_t memory_bytes;
+    uint64_t insert_ns;
+    uint64_t search_ns;
+    uint64_t scan_ns;
+    uint64_t delete_ns;
+};
+
+
+static void
+bench_report_header(size_t count)
+{
+    printf("count %zu, ns per op\n", count);
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n",
+           "variant", "node bytes", "MB", "insert", "search", "scan", "delete");
+}
+
+
+static void
+bench_report(bench_result_t *result, size_t count)
+{
+    double n = (double)count;
+
+    printf("%-12s %10zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           result->name,
+           result->node_bytes,
+           result->memory_bytes / (1024.0 * 1024.0),
+           result->insert_ns / n,
+           result->search_ns / n,
+           result->scan_ns / n,
+           result->delete_ns / n);
+}
+
+
+/** rbtree.c */
+
+typedef struct bench_rb_record_s bench_rb_record_t;
+struct bench_rb_record_s {
+    uint64_t key;
+    rbtree_node_t node;
+};
+
+
+static int
+bench_rb_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_rb_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_rb_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_rb_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = bench_owner(node, bench_rb_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_rbtree(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    bench_result_t result = { "rbtree", sizeof(rbtree_node_t), count * sizeof(*records), 0, 0, 0, 0 };
+    rbtree_t tree;
+    rbtree_init(&tree, bench_rb_compare);
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        rbtree_insert(&tree, &records[idx].node);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_node_t *ret = NULL;
+        found += rbtree_search_key(&tree, &probes[idx], bench_rb_key_compare,
+                                   RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t sum = 0;
+    start = bench_now_ns();
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        sum += bench_owner(node, bench_rb_record_t, node)->key;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_delete(&tree, &records[idx].node);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || sum == 0) {
+        printf("rbtree: unexpected result\n");
+    }
+
+    bench_report(&result, count);
+    free(records);
+}
+
+
+/** rbtree.c under hardware counters, linux only, every counter is optional */
+
+enum {
+    BENCH_CTR_CYCLES,
+    BENCH_CTR_INSTRUCTIONS,
+    BENCH_CTR_BRANCH_MISSES,
+    BENCH_CTR_L1D_MISSES,
+    BENCH_CTR_LLC_MISSES,
+    BENCH_CTR_DTLB_MISSES,
+    BENCH_CTR_COUNT,
+};
+
+/** a counter that could not be opened or never ran */
+#define BENCH_CTR_NONE UINT64_MAX
+
+typedef struct bench_counters_s bench_counters_t;
+struct bench_counters_s {
+    int fds[BENCH_CTR_COUNT];
+    uint64_t values[BENCH_CTR_COUNT];
+};
+
+
+#ifdef __linux__
+
+#define BENCH_CTR_CACHE(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static int
+bench_counters_open(bench_counters_t *counters)
+{
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[BENCH_CTR_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, BENCH_CTR_CACHE(PERF_COUNT_HW_CACHE_L1D,
+                                              PERF_COUNT_HW_CACHE_OP_READ,
+                                              PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        { PERF_TYPE_HW_CACHE, BENCH_CTR_CACHE(PERF_COUNT_HW_CACHE_LL,
+                                              PERF_COUNT_HW_CACHE_OP_READ,
+                                              PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        { PERF_TYPE_HW_CACHE, BENCH_CTR_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+                                              PERF_COUNT_HW_CACHE_OP_READ,
+                                              PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    };
+
+    int opened = 0;
+    int err = 0;
+
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[idx].type;
+        attr.config = events[idx].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        /** counters may be multiplexed when there are more than the pmu has */
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[idx] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counters->fds[idx] >= 0) {
+            opened++;
+        }
+        else {
+            err = errno;
+        }
+    }
+
+    if (opened == 0) {
+        printf("hardware counters unavailable: %s, only time is shown\n", strerror(err));
+    }
+
+    return opened;
+}
+
+
+static void
+bench_counters_close(bench_counters_t *counters)
+{
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        if (counters->fds[idx] >= 0) {
+            close(counters->fds[idx]);
+        }
+    }
+}
+
+
+static void
+bench_counters_start(bench_counters_t *counters)
+{
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        if (counters->fds[idx] >= 0) {
+            ioctl(counters->fds[idx], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[idx], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+
+/** add what was counted since start to `values` */
+static void
+bench_counters_stop(bench_counters_t *counters)
+{
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        if (counters->fds[idx] < 0) {
+            continue;
+        }
+
+        ioctl(counters->fds[idx], PERF_EVENT_IOC_DISABLE, 0);
+
+        /** value, time enabled, time running */
+        uint64_t read_values[3];
+        if (read(counters->fds[idx], read_values, sizeof(read_values)) != sizeof(read_values)
+            || read_values[2] == 0) {
+            counters->values[idx] = BENCH_CTR_NONE;
+            continue;
+        }
+
+        if (counters->values[idx] != BENCH_CTR_NONE) {
+            counters->values[idx] += (uint64_t)((double)read_values[0] * read_values[1] / read_values[2]);
+        }
+    }
+}
+
+#else
+
+static int
+bench_counters_open(bench_counters_t *counters)
+{
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        counters->fds[idx] = -1;
+    }
+
+    printf("hardware counters need linux, only time is shown\n");
+
+    return 0;
+}
+
+
+static void
+bench_counters_close(bench_counters_t *counters)
+{
+}
+
+
+static void
+bench_counters_start(bench_counters_t *counters)
+{
+}
+
+
+static void
+bench_counters_stop(bench_counters_t *counters)
+{
+}
+
+#endif
+
+
+/** one phase of one size, counts summed over repeats */
+typedef struct bench_phase_s bench_phase_t;
+struct bench_phase_s {
+    uint64_t ns;
+    bench_counters_t counters;
+};
+
+
+static void
+bench_phase_reset(bench_phase_t *phase, bench_counters_t *counters)
+{
+    phase->ns = 0;
+    phase->counters = *counters;
+
+    for (int idx = 0; idx < BENCH_CTR_COUNT; idx++) {
+        phase->counters.values[idx] = phase->counters.fds[idx] >= 0 ? 0 : BENCH_CTR_NONE;
+    }
+}
+
+
+static void
+bench_phase_begin(bench_phase_t *phase, uint64_t *start)
+{
+    bench_counters_start(&phase->counters);
+    *start = bench_now_ns();
+}
+
+
+static void
+bench_phase_end(bench_phase_t *phase, uint64_t start)
+{
+    phase->ns += bench_now_ns() - start;
+    bench_counters_stop(&phase->counters);
+}
+
+
+static void
+bench_phase_report(const char *name, size_t size, bench_phase_t *phase, size_t ops)
+{
+    uint64_t *values = phase->counters.values;
+
+    printf("%10zu %-8s %8.1f", size, name, phase->ns / (double)ops);
+
+    if (values[BENCH_CTR_CYCLES] != BENCH_CTR_NONE && values[BENCH_CTR_INSTRUCTIONS] != BENCH_CTR_NONE
+        && values[BENCH_CTR_CYCLES] > 0) {
+        printf(" %8.2f", values[BENCH_CTR_INSTRUCTIONS] / (double)values[BENCH_CTR_CYCLES]);
+    }
+    else {
+        printf(" %8s", "-");
+    }
+
+    for (int idx = BENCH_CTR_INSTRUCTIONS; idx < BENCH_CTR_COUNT; idx++) {
+        if (values[idx] != BENCH_CTR_NONE) {
+            printf(" %9.2f", values[idx] / (double)ops);
+        }
+        else {
+            printf(" %9s", "-");
+        }
+    }
+
+    printf("\n");
+}
+
+
+/**
+ * insert, search, scan and delete on rbtree.c for sizes from 1024 up to
+ * `count` by 4, smaller sizes repeat so that every size does about
+ * `count` ops per phase
+ */
+static void
+bench_counters(uint64_t *keys, size_t count)
+{
+    bench_counters_t counters;
+    bench_counters_open(&counters);
+
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    uint64_t *probes = malloc(count * sizeof(*probes));
+    if (records == NULL || probes == NULL) {
+        free(records);
+        free(probes);
+        bench_counters_close(&counters);
+
+        return;
+    }
+
+    printf("%10s %-8s %8s %8s %9s %9s %9s %9s %9s\n",
+           "size", "phase", "ns", "ipc", "instr", "br-miss", "L1d-miss", "LLC-miss", "dTLB-miss");
+
+    for (size_t size = 1024; size <= count; size *= 4) {
+        size_t repeats = count / size;
+        bench_phase_t insert, search, scan, delete;
+
+        bench_phase_reset(&insert, &counters);
+        bench_phase_reset(&search, &counters);
+        bench_phase_reset(&scan, &counters);
+        bench_phase_reset(&delete, &counters);
+
+        /** the first `size` keys, looked up in another order */
+        memcpy(probes, keys, size * sizeof(*probes));
+        bench_shuffle(probes, size, 0xc2b2ae3d27d4eb4full + size);
+
+        size_t found = 0;
+        uint64_t start = 0;
+        for (size_t repeat = 0; repeat < repeats; repeat++) {
+            rbtree_t tree;
+            rbtree_init(&tree, bench_rb_compare);
+
+            bench_phase_begin(&insert, &start);
+            for (size_t idx = 0; idx < size; idx++) {
+                records[idx].key = keys[idx];
+                rbtree_insert(&tree, &records[idx].node);
+            }
+            bench_phase_end(&insert, start);
+
+            bench_phase_begin(&search, &start);
+            for (size_t idx = 0; idx < size; idx++) {
+                rbtree_node_t *ret = NULL;
+                found += rbtree_search_key(&tree, &probes[idx], bench_rb_key_compare,
+                                           RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+            }
+            bench_phase_end(&search, start);
+
+            uint64_t sum = 0;
+            bench_phase_begin(&scan, &start);
+            for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+                sum += bench_owner(node, bench_rb_record_t, node)->key;
+            }
+            bench_phase_end(&scan, start);
+            found += sum == 0;
+
+            bench_phase_begin(&delete, &start);
+            for (size_t idx = 0; idx < size; idx++) {
+                rbtree_delete(&tree, &records[idx].node);
+            }
+            bench_phase_end(&delete, start);
+        }
+
+        if (found != size * repeats) {
+            printf("counters: unexpected result\n");
+        }
+
+        bench_phase_report("insert", size, &insert, size * repeats);
+        bench_phase_report("search", size, &search, size * repeats);
+        bench_phase_report("scan", size, &scan, size * repeats);
+        bench_phase_report("delete", size, &delete, size * repeats);
+    }
+
+    free(records);
+    free(probes);
+    bench_counters_close(&counters);
+}
+
+
+/** rbtree_td.c */
+
+typedef struct bench_td_record_s bench_td_record_t;
+struct bench_td_record_s {
+    uint64_t key;
+    rbtd_node_t node;
+};
+
+
+static int
+bench_td_compare(rbtd_node_t *na, rbtd_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_td_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_td_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_td_key_compare(const void *key, rbtd_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = bench_owner(node, bench_td_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_rbtd(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    bench_td_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    bench_result_t result = { "rbtree_td", sizeof(rbtd_node_t), count * sizeof(*records), 0, 0, 0, 0 };
+    rbtd_tree_t tree;
+    rbtd_init(&tree, bench_td_compare);
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        rbtd_insert(&tree, &records[idx].node);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtd_node_t *ret = NULL;
+        found += rbtd_search_key(&tree, &probes[idx], bench_td_key_compare,
+                                 RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t sum = 0;
+    rbtd_iter_t iter;
+    start = bench_now_ns();
+    for (rbtd_node_t *node = rbtd_iter_first(&tree, &iter); node != NULL; node = rbtd_iter_next(&iter)) {
+        sum += bench_owner(node, bench_td_record_t, node)->key;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtd_delete(&tree, &records[idx].node);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || sum == 0) {
+        printf("rbtree_td: unexpected result\n");
+    }
+
+    bench_report(&result, count);
+    free(records);
+}
+
+
+/** rbtree_thr.c */
+
+typedef struct bench_thr_record_s bench_thr_record_t;
+struct bench_thr_record_s {
+    uint64_t key;
+    rbthr_node_t node;
+};
+
+
+static int
+bench_thr_compare(rbthr_node_t *na, rbthr_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_thr_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_thr_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_thr_key_compare(const void *key, rbthr_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = bench_owner(node, bench_thr_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_rbthr(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    bench_thr_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    bench_result_t result = { "rbtree_thr", sizeof(rbthr_node_t), count * sizeof(*records), 0, 0, 0, 0 };
+    rbthr_tree_t tree;
+    rbthr_init(&tree, bench_thr_compare);
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        rbthr_insert(&tree, &records[idx].node);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbthr_node_t *ret = NULL;
+        found += rbthr_search_key(&tree, &probes[idx], bench_thr_key_compare,
+                                  RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t sum = 0;
+    start = bench_now_ns();
+    for (rbthr_node_t *node = rbthr_first(&tree); node != NULL; node = rbthr_next(node)) {
+        sum += bench_owner(node, bench_thr_record_t, node)->key;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbthr_delete(&tree, &records[idx].node);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || sum == 0) {
+        printf("rbtree_thr: unexpected result\n");
+    }
+
+    bench_report(&result, count);
+    free(records);
+}
+
+
+/** rbtree_idx.c */
+
+typedef struct bench_idx_record_s bench_idx_record_t;
+struct bench_idx_record_s {
+    rbidx_node_t node;
+    uint64_t key;
+};
+
+
+static int
+bench_idx_compare(const void *ra, const void *rb)
+{
+    uint64_t akey = ((const bench_idx_record_t *)ra)->key;
+    uint64_t bkey = ((const bench_idx_record_t *)rb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_idx_key_compare(const void *key, const void *record)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = ((const bench_idx_record_t *)record)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_rbidx(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    uint32_t *slots = malloc(count * sizeof(*slots));
+    if (slots == NULL) {
+        return;
+    }
+
+    bench_result_t result = { "rbtree_idx", sizeof(rbidx_node_t), 0, 0, 0, 0, 0 };
+    rbidx_tree_t tree;
+    if (rbidx_init(&tree, sizeof(bench_idx_record_t), (uint32_t)count + 1, bench_idx_compare) != RBTREE_OK) {
+        free(slots);
+
+        return;
+    }
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbidx_alloc(&tree, &slots[idx]);
+
+        bench_idx_record_t *record = rbidx_record(&tree, slots[idx]);
+        record->key = keys[idx];
+        rbidx_insert(&tree, slots[idx]);
+    }
+    result.insert_ns = bench_now_ns() - start;
+    result.memory_bytes = rbidx_used_bytes(&tree);
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        uint32_t ret = 0;
+        found += rbidx_search_key(&tree, &probes[idx], bench_idx_key_compare,
+                                  RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t sum = 0;
+    start = bench_now_ns();
+    for (uint32_t idx = rbidx_first(&tree); idx != RBIDX_SENTINEL; idx = rbidx_next(&tree, idx)) {
+        sum += ((bench_idx_record_t *)rbidx_record(&tree, idx))->key;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbidx_delete(&tree, slots[idx]);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || sum == 0) {
+        printf("rbtree_idx: unexpected result\n");
+    }
+
+    bench_report(&result, count);
+    rbidx_destroy(&tree);
+    free(slots);
+}
+
+
+/** many small sets, rbtree_t against rbsmall_t */
+
+static void
+bench_small(uint64_t *keys, size_t count, size_t set_size, int small)
+{
+    size_t sets = count / set_size;
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    rbtree_t *trees   = small ? NULL : malloc(sets * sizeof(*trees));
+    rbsmall_t *smalls = small ? malloc(sets * sizeof(*smalls)) : NULL;
+    if (records == NULL || (trees == NULL && smalls == NULL)) {
+        free(records);
+        free(trees);
+        free(smalls);
+
+        return;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s/%zu", small ? "rbsmall" : "rbtree", set_size);
+
+    size_t set_bytes = small ? sizeof(rbsmall_t) : sizeof(rbtree_t);
+    bench_result_t result = { name, sizeof(rbtree_node_t), count * sizeof(*records) + sets * set_bytes, 0, 0, 0, 0 };
+
+    for (size_t set = 0; set < sets; set++) {
+        if (small) {
+            rbsmall_init(&smalls[set], bench_rb_compare);
+        }
+        else {
+            rbtree_init(&trees[set], bench_rb_compare);
+        }
+    }
+
+    /** record idx goes to set idx % sets, one round fills one slot of every set */
+    size_t total = sets * set_size;
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < total; idx++) {
+        records[idx].key = keys[idx];
+        if (small) {
+            rbsmall_insert(&smalls[idx % sets], &records[idx].node);
+        }
+        else {
+            rbtree_insert(&trees[idx % sets], &records[idx].node);
+        }
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < total; idx++) {
+        rbtree_node_t *ret = NULL;
+        size_t set = (idx * 7919) % total;
+        uint64_t key = keys[set];
+
+        if (small) {
+            found += rbsmall_search_key(&smalls[set % sets], &key, bench_rb_key_compare,
+                                        RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+        }
+        else {
+            found += rbtree_search_key(&trees[set % sets], &key, bench_rb_key_compare,
+                                       RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+        }
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t sum = 0;
+    start = bench_now_ns();
+    for (size_t set = 0; set < sets; set++) {
+        if (small) {
+            for (rbtree_node_t *node = rbsmall_first(&smalls[set]); node != NULL; node = rbsmall_next(&smalls[set], node)) {
+                sum += bench_owner(node, bench_rb_record_t, node)->key;
+            }
+        }
+        else {
+            for (rbtree_node_t *node = rbtree_first(&trees[set]); node != NULL; node = rbtree_next(&trees[set], node)) {
+                sum += bench_owner(node, bench_rb_record_t, node)->key;
+            }
+        }
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < total; idx++) {
+        if (small) {
+            rbsmall_delete(&smalls[idx % sets], &records[idx].node);
+        }
+        else {
+            rbtree_delete(&trees[idx % sets], &records[idx].node);
+        }
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != total || sum == 0) {
+        printf("%s: unexpected result\n", name);
+    }
+
+    bench_report(&result, total);
+    free(records);
+    free(trees);
+    free(smalls);
+}
+
+
+/** mixed point and range access, rbtree_t against rbhmap_t */
+
+#define BENCH_SCAN_LENGTH 16
+
+
+static const void *
+bench_rb_key(rbtree_node_t *node)
+{
+    return &bench_owner(node, bench_rb_record_t, node)->key;
+}
+
+
+static uint64_t
+bench_rb_hash(const void *key)
+{
+    return rbhmap_mix64(*(const uint64_t *)key);
+}
+
+
+static void
+bench_mixed(uint64_t *keys, uint64_t *probes, size_t count, int hashed)
+{
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    bench_result_t result = { hashed ? "rbhmap" : "rbtree", sizeof(rbtree_node_t), count * sizeof(*records), 0, 0, 0, 0 };
+    rbhmap_t map;
+    if (rbhmap_init(&map, bench_rb_compare, bench_rb_key_compare, bench_rb_key, bench_rb_hash, count) != RBTREE_OK) {
+        free(records);
+
+        return;
+    }
+
+    rbtree_t *tree = rbhmap_tree(&map);
+    if (hashed) {
+        result.memory_bytes += (map.mask + 1) * sizeof(rbhmap_slot_t);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        if (hashed) {
+            rbhmap_insert(&map, &records[idx].node, NULL);
+        }
+        else {
+            rbtree_insert(tree, &records[idx].node);
+        }
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    /** every 10th op is a range scan, reported as search */
+    size_t found = 0;
+    uint64_t sum = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_node_t *ret = NULL;
+
+        if (idx % 10 == 9) {
+            rbtree_search_key(tree, &probes[idx], bench_rb_key_compare, RBTREE_SEARCH_MODE_GE, &ret);
+            for (int step = 0; ret != NULL && step < BENCH_SCAN_LENGTH; step++) {
+                sum += bench_owner(ret, bench_rb_record_t, node)->key;
+                ret = rbtree_next(tree, ret);
+            }
+
+            found++;
+        }
+        else if (hashed) {
+            found += rbhmap_find(&map, &probes[idx], &ret) == RBTREE_OK;
+        }
+        else {
+            found += rbtree_search_key(tree, &probes[idx], bench_rb_key_compare,
+                                       RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+        }
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        if (hashed) {
+            rbhmap_delete(&map, &records[idx].node);
+        }
+        else {
+            rbtree_delete(tree, &records[idx].node);
+        }
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || sum == 0) {
+        printf("%s: unexpected result\n", result.name);
+    }
+
+    bench_report(&result, count);
+    rbhmap_destroy(&map);
+    free(records);
+}
+
+
+/** rbcache_t hit path and eviction */
+
+typedef struct bench_cache_record_s bench_cache_record_t;
+struct bench_cache_record_s {
+    rbcache_entry_t entry;
+    uint64_t key;
+};
+
+
+static const void *
+bench_cache_key(rbtree_node_t *node)
+{
+    return &bench_owner(rbcache_entry_of(node), bench_cache_record_t, entry)->key;
+}
+
+
+static int
+bench_cache_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = *(const uint64_t *)bench_cache_key(na);
+    uint64_t bkey = *(const uint64_t *)bench_cache_key(nb);
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_cache_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = *(const uint64_t *)bench_cache_key(node);
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_cache_release(rbcache_entry_t *entry, void *ctx)
+{
+    (*(size_t *)ctx)++;
+}
+
+
+static void
+bench_cache(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    bench_cache_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    rbcache_t cache;
+    if (rbcache_init(&cache, bench_cache_compare, bench_cache_key_compare, bench_cache_key, bench_rb_hash, count) != RBTREE_OK) {
+        free(records);
+
+        return;
+    }
+
+    /** ttls spread over [1, count] */
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        rbcache_insert(&cache, &records[idx].entry, 0, 1 + bench_rand(&seed) % count, 1);
+    }
+    uint64_t fill_ns = bench_now_ns() - start;
+
+    size_t released = 0;
+    rbcache_set_limit(&cache, count, 0, bench_cache_release, &released);
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbcache_entry_t *ret = NULL;
+        found += rbcache_get(&cache, &probes[idx], 0, &ret) == RBTREE_OK;
+    }
+    uint64_t hit_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    rbcache_set_limit(&cache, count / 2, 0, bench_cache_release, &released);
+    uint64_t evict_ns = bench_now_ns() - start;
+    size_t evicted = released;
+
+    start = bench_now_ns();
+    size_t expired = rbcache_expire(&cache, count, SIZE_MAX);
+    uint64_t expire_ns = bench_now_ns() - start;
+
+    if (found != count || evicted != count - count / 2 || rbcache_size(&cache) != 0) {
+        printf("rbcache: unexpected result\n");
+    }
+
+    printf("%-12s %10.1f %10.1f %10.1f %10.1f\n", "rbcache",
+           fill_ns / (double)count,
+           hit_ns / (double)count,
+           evict_ns / (double)evicted,
+           expire_ns / (double)expired);
+
+    rbcache_destroy(&cache);
+    free(records);
+}
+
+
+/** string keys, rbtree_t with memcmp against rbstr_node_t */
+
+typedef struct bench_str_record_s bench_str_record_t;
+struct bench_str_record_s {
+    rbtree_node_t node;
+    size_t len;
+    const char *key;
+};
+
+
+static int
+bench_str_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    bench_str_record_t *ra = bench_owner(na, bench_str_record_t, node);
+    bench_str_record_t *rb = bench_owner(nb, bench_str_record_t, node);
+
+    int ret = memcmp(ra->key, rb->key, ra->len < rb->len ? ra->len : rb->len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return (ra->len > rb->len) - (ra->len < rb->len);
+}
+
+
+/** keys[idx] becomes a heap string of the given shape */
+static char **
+bench_str_keys(uint64_t *keys, size_t count, int url)
+{
+    char **strs = malloc(count * sizeof(*strs));
+    if (strs == NULL) {
+        return NULL;
+    }
+
+    for (size_t idx = 0; idx < count; idx++) {
+        char buf[80];
+        uint64_t x = keys[idx];
+        uint64_t y = bench_rand(&x);
+
+        if (url) {
+            snprintf(buf, sizeof(buf), "https://api.example.com/v1/users/%llu/orders/%llu",
+                     (unsigned long long)(y % 100000), (unsigned long long)keys[idx]);
+        }
+        else {
+            uint64_t z = bench_rand(&x);
+            snprintf(buf, sizeof(buf), "%08llx-%04llx-%04llx-%04llx-%012llx",
+                     (unsigned long long)(y >> 32), (unsigned long long)(y >> 16 & 0xffff),
+                     (unsigned long long)(y & 0xffff), (unsigned long long)(z >> 48),
+                     (unsigned long long)(z & 0xffffffffffffull));
+        }
+
+        strs[idx] = strdup(buf);
+    }
+
+    return strs;
+}
+
+
+static void
+bench_str(uint64_t *keys, uint64_t *probes, size_t count, int url, int prefixed)
+{
+    char **strs = bench_str_keys(keys, count, url);
+    bench_str_record_t *records = malloc(count * sizeof(*records));
+    rbstr_node_t *nodes = malloc(count * sizeof(*nodes));
+    if (strs == NULL || records == NULL || nodes == NULL) {
+        free(strs);
+        free(records);
+        free(nodes);
+
+        return;
+    }
+
+    /** probe order, a shuffle of the same keys */
+    size_t *order = malloc(count * sizeof(*order));
+    for (size_t idx = 0; idx < count; idx++) {
+        order[idx] = probes[idx] % count;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s/%s", prefixed ? "rbstr" : "rbtree", url ? "url" : "uuid");
+
+    size_t node_bytes = prefixed ? sizeof(rbstr_node_t) : sizeof(bench_str_record_t);
+    bench_result_t result = { name, node_bytes, count * node_bytes, 0, 0, 0, 0 };
+    rbtree_t tree;
+    if (prefixed) {
+        rbstr_init(&tree);
+    }
+    else {
+        rbtree_init(&tree, bench_str_compare);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        size_t len = strlen(strs[idx]);
+        if (prefixed) {
+            rbstr_node_init(&nodes[idx], strs[idx], len);
+            rbtree_insert(&tree, &nodes[idx].node);
+        }
+        else {
+            records[idx].key = strs[idx];
+            records[idx].len = len;
+            rbtree_insert(&tree, &records[idx].node);
+        }
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    size_t found = 0;
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        const char *key = strs[order[idx]];
+        size_t len = strlen(key);
+
+        if (prefixed) {
+            rbstr_node_t *ret = NULL;
+            found += rbstr_search(&tree, key, len, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+        }
+        else {
+            bench_str_record_t probe = { .key = key, .len = len, };
+            rbtree_node_t *ret = NULL;
+            found += rbtree_search(&tree, &probe.node, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK;
+        }
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    size_t scanned = 0;
+    start = bench_now_ns();
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        scanned++;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_delete(&tree, prefixed ? &nodes[idx].node : &records[idx].node);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    if (found != count || scanned != count) {
+        printf("%s: unexpected result\n", name);
+    }
+
+    bench_report(&result, count);
+
+    for (size_t idx = 0; idx < count; idx++) {
+        free(strs[idx]);
+    }
+
+    free(order);
+    free(strs);
+    free(records);
+    free(nodes);
+}
+
+
+/** retention, rbtree_delete per node against rbtree_delete_range */
+
+static void
+bench_count_release(rbtree_node_t *node, void *ctx)
+{
+    (*(size_t *)ctx)++;
+}
+
+
+static void
+bench_retention(uint64_t *keys, size_t count)
+{
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    /** keys are idx * 2654435761 + 1, so the cutoff splits them in half */
+    bench_rb_record_t cutoff = { .key = (count / 2) * 2654435761u + 1, };
+    uint64_t elapsed[3] = { 0, 0, 0 };
+    size_t dropped[3] = { 0, 0, 0 };
+
+    for (int way = 0; way < 3; way++) {
+        rbtree_t tree;
+        rbtree_init(&tree, bench_rb_compare);
+
+        for (size_t idx = 0; idx < count; idx++) {
+            records[idx].key = keys[idx];
+            rbtree_insert(&tree, &records[idx].node);
+        }
+
+        rbtree_node_t *detached = NULL;
+        uint64_t start = bench_now_ns();
+
+        if (way == 0) {
+            /** what a retention job does today */
+            for (rbtree_node_t *node = rbtree_first(&tree);
+                 node != NULL && bench_rb_compare(node, &cutoff.node) < 0;
+                 node = rbtree_first(&tree))
+            {
+                rbtree_delete(&tree, node);
+                dropped[way]++;
+            }
+        }
+        else if (way == 1) {
+            rbtree_delete_range(&tree, NULL, &cutoff.node, bench_count_release, &dropped[way]);
+        }
+        else {
+            /** cut only, release is left for later */
+            rbtree_detach_range(&tree, NULL, &cutoff.node, &detached);
+        }
+
+        elapsed[way] = bench_now_ns() - start;
+
+        if (way == 2) {
+            dropped[way] = rbtree_release_detached(&tree, detached, NULL, NULL);
+        }
+
+        if (rbtree_size(&tree) != count - dropped[way]) {
+            printf("retention: unexpected result\n");
+        }
+    }
+
+    printf("%-12s %10.1f %10.1f %10.1f\n", "rbtree",
+           elapsed[0] / 1000000.0, elapsed[1] / 1000000.0, elapsed[2] / 1000000.0);
+
+    if (dropped[0] != dropped[1] || dropped[0] != dropped[2]) {
+        printf("retention: unexpected result\n");
+    }
+
+    free(records);
+}
+
+
+/** rbwal_t, cost of logging and of recovery */
+
+typedef struct bench_wal_record_s bench_wal_record_t;
+struct bench_wal_record_s {
+    uint64_t key;
+    uint64_t value;
+    rbtree_node_t node;
+};
+
+
+static int
+bench_wal_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_wal_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_wal_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static size_t
+bench_wal_encode(rbtree_node_t *node, void *buf, size_t cap, void *ctx)
+{
+    if (cap >= 16) {
+        memcpy(buf, &bench_owner(node, bench_wal_record_t, node)->key, 16);
+    }
+
+    return 16;
+}
+
+
+static rbtree_node_t *
+bench_wal_decode(const void *buf, size_t len, void *ctx)
+{
+    bench_wal_record_t *record = malloc(sizeof(*record));
+    if (record == NULL) {
+        return NULL;
+    }
+
+    memcpy(&record->key, buf, 16);
+
+    return &record->node;
+}
+
+
+static void
+bench_wal_release(rbtree_node_t *node, void *ctx)
+{
+    free(bench_owner(node, bench_wal_record_t, node));
+}
+
+
+static const rbwal_codec_t bench_wal_codec = {
+    .encode  = bench_wal_encode,
+    .decode  = bench_wal_decode,
+    .release = bench_wal_release,
+};
+
+
+static void
+bench_wal_report(const char *name, size_t group, size_t ops, uint64_t elapsed, rbwal_t *wal)
+{
+    const rbwal_stats_t *stats = rbwal_stats(wal);
+    double written = (double)(stats->log_bytes + stats->checkpoint_bytes);
+
+    printf("%-12s %10zu %10zu %10.1f %10llu %10llu %10.2f\n",
+           name, group, ops, (double)elapsed / ops,
+           (unsigned long long)stats->syncs,
+           (unsigned long long)stats->checkpoints,
+           written / stats->payload_bytes);
+}
+
+
+static uint64_t
+bench_wal_recover(const char *path, size_t expect)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, bench_wal_compare);
+
+    rbwal_t wal;
+    uint64_t start = bench_now_ns();
+
+    if (rbwal_open(&wal, &tree, path, &bench_wal_codec, NULL) != RBTREE_OK) {
+        printf("durable: recovery failed\n");
+
+        return 0;
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+
+    if (rbtree_size(&tree) != expect) {
+        printf("durable: unexpected result\n");
+    }
+
+    rbwal_close(&wal);
+    rbtree_delete_range(&tree, NULL, NULL, bench_wal_release, NULL);
+
+    return elapsed;
+}
+
+
+static void
+bench_durable(uint64_t *keys, size_t count)
+{
+    char dir[] = "/tmp/rbtree_bench_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        printf("durable: no temporary directory\n");
+
+        return;
+    }
+
+    /** sized from the template, so no path can be cut short */
+    char path[sizeof(dir) + 8], log[sizeof(path) + 8], ckpt[sizeof(path) + 8];
+    snprintf(path, sizeof(path), "%s/tree", dir);
+    snprintf(log, sizeof(log), "%s.log", path);
+    snprintf(ckpt, sizeof(ckpt), "%s.ckpt", path);
+
+    size_t total = count < 100000 ? count : 100000;
+    size_t groups[] = { 1, 64, 4096 };
+
+    for (int way = 0; way < 4; way++) {
+        rbwal_options_t options = {
+            .group_ops = way < 3 ? groups[way] : 64,
+            /** a checkpoint per a quarter of records */
+            .checkpoint_bytes = way < 3 ? 0 : total / 4 * 32,
+        };
+
+        size_t ops = way == 0 && total > 2000 ? 2000 : total;
+
+        unlink(log);
+        unlink(ckpt);
+
+        rbtree_t tree;
+        rbtree_init(&tree, bench_wal_compare);
+
+        rbwal_t wal;
+        if (rbwal_open(&wal, &tree, path, &bench_wal_codec, &options) != RBTREE_OK) {
+            printf("durable: open failed\n");
+            break;
+        }
+
+        uint64_t elapsed = 0;
+        size_t done = 0;
+
+        if (way < 3) {
+            uint64_t start = bench_now_ns();
+            for (; done < ops; done++) {
+                bench_wal_record_t *record = malloc(sizeof(*record));
+                record->key   = keys[done];
+                record->value = done;
+                rbwal_insert(&wal, &record->node);
+            }
+
+            rbwal_sync(&wal);
+            elapsed = bench_now_ns() - start;
+        }
+        else {
+            /** a steady set of a quarter of records, oldest replaced by newest */
+            size_t live = ops / 4 > 0 ? ops / 4 : 1;
+            bench_wal_record_t **ring = malloc(live * sizeof(*ring));
+
+            uint64_t start = bench_now_ns();
+            for (; done < ops; done++) {
+                if (done >= live) {
+                    rbwal_delete(&wal, &ring[done % live]->node);
+                    free(ring[done % live]);
+                }
+
+                bench_wal_record_t *record = malloc(sizeof(*record));
+                record->key   = keys[done];
+                record->value = done;
+                rbwal_insert(&wal, &record->node);
+
+                ring[done % live] = record;
+            }
+
+            rbwal_sync(&wal);
+            elapsed = bench_now_ns() - start;
+            free(ring);
+
+            done = live;
+            ops = wal.stats.ops;
+        }
+
+        bench_wal_report(way < 3 ? "log" : "checkpoint", options.group_ops, ops, elapsed, &wal);
+
+        rbwal_close(&wal);
+        rbtree_delete_range(&tree, NULL, NULL, bench_wal_release, NULL);
+
+        if (way == 1) {
+            /** same records recovered from a log and from a checkpoint */
+            uint64_t from_log = bench_wal_recover(path, done);
+
+            rbtree_init(&tree, bench_wal_compare);
+            rbwal_open(&wal, &tree, path, &bench_wal_codec, &options);
+            rbwal_checkpoint(&wal);
+            rbwal_close(&wal);
+            rbtree_delete_range(&tree, NULL, NULL, bench_wal_release, NULL);
+
+            uint64_t from_ckpt = bench_wal_recover(path, done);
+
+            printf("%-12s %10zu records, log %.1f ms, checkpoint %.1f ms\n",
+                   "recovery", done, from_log / 1000000.0, from_ckpt / 1000000.0);
+        }
+    }
+
+    unlink(log);
+    unlink(ckpt);
+    rmdir(dir);
+}
+
+
+/** rbquant_t, sliding window quantiles against sorting the window */
+
+static int
+bench_quant_value_compare(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+
+    return (va > vb) - (va < vb);
+}
+
+
+static void
+bench_quant(size_t count)
+{
+    rbquant_t quant;
+    uint64_t *window = malloc(count * sizeof(*window));
+    if (window == NULL || rbquant_init(&quant, count, count / 2) != RBTREE_OK) {
+        free(window);
+
+        return;
+    }
+
+    /** one sample per tick, window holds the last count / 2 */
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    uint64_t now = 0;
+    for (; now < count; now++) {
+        rbquant_add(&quant, bench_rand(&seed) % 1000000, now);
+    }
+
+    /** steady state, every add also expires one */
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++, now++) {
+        rbquant_add(&quant, bench_rand(&seed) % 1000000, now);
+    }
+    uint64_t add_ns = bench_now_ns() - start;
+
+    double quantiles[] = { 0.5, 0.99, 0.999 };
+    uint64_t values[3] = { 0, 0, 0 };
+    size_t queries = 100000;
+
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < queries; idx++) {
+        rbquant_query(&quant, quantiles[idx % 3], &values[idx % 3]);
+    }
+    uint64_t query_ns = bench_now_ns() - start;
+
+    /** what a sort based tracker pays per query */
+    size_t size = rbquant_size(&quant);
+    start = bench_now_ns();
+    for (size_t idx = 0; idx < size; idx++) {
+        window[idx] = quant.ring[(quant.head + idx) % quant.capacity].value;
+    }
+
+    qsort(window, size, sizeof(*window), bench_quant_value_compare);
+    uint64_t sort_ns = bench_now_ns() - start;
+
+    for (int idx = 0; idx < 3; idx++) {
+        size_t rank = (size_t)(quantiles[idx] * size + 0.999999);
+        if (values[idx] != window[rank - 1]) {
+            printf("quantile: unexpected result\n");
+        }
+    }
+
+    printf("%-12s %10zu %10.1f %10.1f %10.1f\n", "rbquant", size,
+           add_ns / (double)count, query_ns / (double)queries, sort_ns / 1000000.0);
+
+    rbquant_destroy(&quant);
+    free(window);
+}
+
+
+/** range aggregates, rbtree_aggregate_range against walking the range */
+
+typedef struct bench_summary_s bench_summary_t;
+struct bench_summary_s {
+    uint64_t bytes;
+    uint64_t latency;
+};
+
+typedef struct bench_agg_record_s bench_agg_record_t;
+struct bench_agg_record_s {
+    uint64_t key;
+    uint64_t bytes;
+    uint64_t latency;
+    rbtree_node_t node;
+    bench_summary_t summary;
+};
+
+
+static void
+bench_summary_init(void *summary, void *ctx)
+{
+    memset(summary, 0, sizeof(bench_summary_t));
+}
+
+
+static void
+bench_summary_combine(void *summary, const void *next, void *ctx)
+{
+    bench_summary_t *sum = summary;
+    const bench_summary_t *other = next;
+
+    sum->bytes += other->bytes;
+    if (other->latency > sum->latency) {
+        sum->latency = other->latency;
+    }
+}
+
+
+static void
+bench_summary_accumulate(void *summary, rbtree_node_t *node, void *ctx)
+{
+    bench_agg_record_t *record = bench_owner(node, bench_agg_record_t, node);
+    bench_summary_t one = { record->bytes, record->latency };
+
+    bench_summary_combine(summary, &one, ctx);
+}
+
+
+static int
+bench_agg_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_agg_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_agg_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_agg_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = bench_owner(node, bench_agg_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_aggregate(size_t count)
+{
+    static const rbtree_monoid_t monoid = {
+        .size       = sizeof(bench_summary_t),
+        .offset     = rbtree_summary_offset(bench_agg_record_t, node, summary),
+        .init       = bench_summary_init,
+        .accumulate = bench_summary_accumulate,
+        .combine    = bench_summary_combine,
+    };
+
+    enum { QUERIES = 1000 };
+    uint64_t *order = malloc(count * sizeof(*order));
+    bench_agg_record_t *records = malloc(count * sizeof(*records));
+    if (order == NULL || records == NULL) {
+        free(order);
+        free(records);
+
+        return;
+    }
+
+    rbtree_agg_t agg;
+    rbtree_agg_init(&agg, bench_agg_compare, &monoid);
+
+    /** keys 0 .. count - 1, inserted shuffled */
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t idx = 0; idx < count; idx++) {
+        order[idx] = idx;
+        records[idx].key = idx;
+        records[idx].bytes = bench_rand(&seed) % 65536;
+        records[idx].latency = bench_rand(&seed) % 1000000;
+    }
+
+    bench_shuffle(order, count, seed);
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_insert(&agg.tree, &records[order[idx]].node);
+    }
+    uint64_t insert_ns = bench_now_ns() - start;
+
+    size_t widths[] = { 100, count / 100, count / 10 };
+    for (size_t width_idx = 0; width_idx < sizeof(widths) / sizeof(widths[0]); width_idx++) {
+        size_t width = widths[width_idx] > 0 ? widths[width_idx] : 1;
+        if (width > count) {
+            continue;
+        }
+
+        uint64_t lows[QUERIES];
+        for (size_t idx = 0; idx < QUERIES; idx++) {
+            lows[idx] = bench_rand(&seed) % (count - width + 1);
+        }
+
+        bench_summary_t agg_sum = { 0, 0 };
+        start = bench_now_ns();
+        for (size_t idx = 0; idx < QUERIES; idx++) {
+            uint64_t hi = lows[idx] + width;
+            bench_summary_t sum;
+
+            rbtree_aggregate_range(&agg, &lows[idx], &hi, bench_agg_key_compare, &sum);
+            bench_summary_combine(&agg_sum, &sum, NULL);
+        }
+        uint64_t agg_ns = bench_now_ns() - start;
+
+        bench_summary_t walk_sum = { 0, 0 };
+        start = bench_now_ns();
+        for (size_t idx = 0; idx < QUERIES; idx++) {
+            uint64_t hi = lows[idx] + width;
+            rbtree_node_t *node = NULL;
+
+            rbtree_search_key(&agg.tree, &lows[idx], bench_agg_key_compare, RBTREE_SEARCH_MODE_GE, &node);
+            for (; node != NULL && bench_agg_key_compare(&hi, node) > 0; node = rbtree_next(&agg.tree, node)) {
+                bench_summary_accumulate(&walk_sum, node, NULL);
+            }
+        }
+        uint64_t walk_ns = bench_now_ns() - start;
+
+        if (agg_sum.bytes != walk_sum.bytes || agg_sum.latency != walk_sum.latency) {
+            printf("aggregate: unexpected result\n");
+        }
+
+        printf("%-12s %10zu %10.1f %10.1f %10.1f\n", "rbtree_agg", width,
+               insert_ns / (double)count, agg_ns / (double)QUERIES, walk_ns / (double)QUERIES);
+    }
+
+    free(order);
+    free(records);
+}
+
+
+/** rbmulti_t against three trees kept in sync by hand */
+
+typedef struct bench_multi_record_s bench_multi_record_t;
+struct bench_multi_record_s {
+    uint64_t id;
+    uint64_t time;
+    uint64_t owner;
+    rbtree_node_t by_id;
+    rbtree_node_t by_time;
+    rbtree_node_t by_owner;
+};
+
+
+static int
+bench_multi_id_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_multi_record_t, by_id)->id;
+    uint64_t bkey = bench_owner(nb, bench_multi_record_t, by_id)->id;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_multi_time_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_multi_record_t, by_time)->time;
+    uint64_t bkey = bench_owner(nb, bench_multi_record_t, by_time)->time;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_multi_owner_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_multi_record_t, by_owner)->owner;
+    uint64_t bkey = bench_owner(nb, bench_multi_record_t, by_owner)->owner;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_multi_set_time(void *record, void *ctx)
+{
+    ((bench_multi_record_t *)record)->time = *(uint64_t *)ctx;
+}
+
+
+static void
+bench_multi_report(const char *name, uint64_t insert_ns, uint64_t touch_ns, uint64_t jitter_ns,
+                   uint64_t erase_ns, size_t count)
+{
+    printf("%-12s %10.1f %10.1f %10.1f %10.1f\n", name,
+           insert_ns / (double)count, touch_ns / (double)count,
+           jitter_ns / (double)count, erase_ns / (double)count);
+}
+
+
+static void
+bench_multi(uint64_t *keys, uint64_t *probes, size_t count)
+{
+    static const rbmulti_index_t indexes[3] = {
+        { rbmulti_node_offset(bench_multi_record_t, by_id),    bench_multi_id_compare,    1 },
+        { rbmulti_node_offset(bench_multi_record_t, by_time),  bench_multi_time_compare,  0 },
+        { rbmulti_node_offset(bench_multi_record_t, by_owner), bench_multi_owner_compare, 0 },
+    };
+
+    bench_multi_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    /** by hand first, then the container on the same records */
+    for (int variant = 0; variant < 2; variant++) {
+        rbtree_t trees[3];
+        rbmulti_t multi;
+        uint64_t seed = 0x2545f4914f6cdd1dull;
+
+        for (int idx = 0; idx < 3; idx++) {
+            rbtree_init(&trees[idx], indexes[idx].compare);
+        }
+
+        rbmulti_init(&multi, indexes, 3);
+
+        for (size_t idx = 0; idx < count; idx++) {
+            records[idx].id = keys[idx];
+            records[idx].time = bench_rand(&seed) % (count * 16);
+            records[idx].owner = bench_rand(&seed) % 1024;
+        }
+
+        uint64_t start = bench_now_ns();
+        for (size_t idx = 0; idx < count; idx++) {
+            bench_multi_record_t *record = &records[idx];
+
+            if (variant == 0) {
+                rbtree_node_t *exist = NULL;
+
+                if (rbtree_insert_unique(&trees[0], &record->by_id, &exist) == RBTREE_OK) {
+                    rbtree_insert(&trees[1], &record->by_time);
+                    rbtree_insert(&trees[2], &record->by_owner);
+                }
+            }
+            else {
+                rbmulti_insert(&multi, record, NULL);
+            }
+        }
+        uint64_t insert_ns = bench_now_ns() - start;
+
+        /** keys and probes mod count are permutations of 0 .. count - 1 */
+
+        /** last seen moves to now, the record goes to the end of time index */
+        uint64_t now = count * 16;
+        start = bench_now_ns();
+        for (size_t idx = 0; idx < count; idx++) {
+            bench_multi_record_t *record = &records[probes[idx] % count];
+
+            now++;
+            if (variant == 0) {
+                rbtree_delete(&trees[1], &record->by_time);
+                record->time = now;
+                rbtree_insert(&trees[1], &record->by_time);
+            }
+            else {
+                rbmulti_modify(&multi, record, 1u << 1, bench_multi_set_time, NULL, &now);
+            }
+        }
+        uint64_t touch_ns = bench_now_ns() - start;
+
+        /** a small correction, which seldom passes a neighbour */
+        start = bench_now_ns();
+        for (size_t idx = 0; idx < count; idx++) {
+            bench_multi_record_t *record = &records[keys[idx] % count];
+            uint64_t time = record->time + 1;
+
+            if (variant == 0) {
+                rbtree_delete(&trees[1], &record->by_time);
+                record->time = time;
+                rbtree_insert(&trees[1], &record->by_time);
+            }
+            else {
+                rbmulti_modify(&multi, record, 1u << 1, bench_multi_set_time, NULL, &time);
+            }
+        }
+        uint64_t jitter_ns = bench_now_ns() - start;
+
+        start = bench_now_ns();
+        for (size_t idx = 0; idx < count; idx++) {
+            bench_multi_record_t *record = &records[probes[idx] % count];
+
+            if (variant == 0) {
+                rbtree_delete(&trees[0], &record->by_id);
+                rbtree_delete(&trees[1], &record->by_time);
+                rbtree_delete(&trees[2], &record->by_owner);
+            }
+            else {
+                rbmulti_erase(&multi, record);
+            }
+        }
+        uint64_t erase_ns = bench_now_ns() - start;
+
+        bench_multi_report(variant == 0 ? "by hand" : "rbmulti", insert_ns, touch_ns, jitter_ns, erase_ns, count);
+    }
+
+    free(records);
+}
+
+
+/** relaxed balance, a burst into a tree holding half of the keys */
+
+static void
+bench_relaxed(uint64_t *keys, size_t count, int ascending, size_t capacity)
+{
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    rbtree_node_t **pending = malloc((capacity > 0 ? capacity : 1) * sizeof(*pending));
+    if (records == NULL || pending == NULL) {
+        free(records);
+        free(pending);
+
+        return;
+    }
+
+    rbtree_t tree;
+    rbtree_init(&tree, bench_rb_compare);
+
+    size_t half = count / 2;
+    for (size_t idx = 0; idx < half; idx++) {
+        records[idx].key = keys[idx];
+        rbtree_insert(&tree, &records[idx].node);
+    }
+
+    /** an ascending burst appends past every key already in tree */
+    for (size_t idx = half; idx < count; idx++) {
+        records[idx].key = ascending ? (1ull << 62) + idx : keys[idx];
+    }
+
+    rbtree_set_relaxed(&tree, pending, capacity);
+
+    uint64_t start = bench_now_ns();
+    for (size_t idx = half; idx < count; idx++) {
+        rbtree_insert(&tree, &records[idx].node);
+    }
+    uint64_t insert_ns = bench_now_ns() - start;
+
+    rbtree_stats_t before;
+    rbtree_stats(&tree, &before);
+
+    start = bench_now_ns();
+    rbtree_rebalance(&tree, SIZE_MAX);
+    uint64_t drain_ns = bench_now_ns() - start;
+
+    rbtree_stats_t after;
+    rbtree_stats(&tree, &after);
+
+    if (after.count != count) {
+        printf("relaxed: unexpected result\n");
+    }
+
+    printf("%-12s %10s %10zu %10.1f %10zu %10.3f %10zu\n",
+           capacity == 0 ? "eager" : "relaxed",
+           ascending ? "ascending" : "random",
+           capacity,
+           (double)insert_ns / (count - half),
+           before.max_depth,
+           drain_ns / 1e6,
+           after.max_depth);
+
+    free(records);
+    free(pending);
+}
+
+
+/** contended writers, one lock around rbtree.c against rbtree_fc.c */
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_SPINS       128
+
+enum {
+    BENCH_LOCK_MUTEX,
+    BENCH_LOCK_SPIN,
+    BENCH_LOCK_FC,
+};
+
+typedef struct bench_shared_s bench_shared_t;
+struct bench_shared_s {
+    int kind;
+    rbtree_t tree;
+    pthread_mutex_t mutex;
+    _Atomic int spin;
+    rbfc_t fc;
+    pthread_barrier_t barrier;
+};
+
+typedef struct bench_writer_s bench_writer_t;
+struct bench_writer_s {
+    pthread_t thread;
+    bench_shared_t *shared;
+    bench_rb_record_t *records;
+    size_t count;
+    /** ns of each insert then each delete */
+    uint32_t *latency;
+    uint64_t start;
+    uint64_t end;
+};
+
+
+/** test and test and set, yields as rbfc waiters do */
+static void
+bench_spin_lock(_Atomic int *spin)
+{
+    int spins = 0;
+
+    for (;;) {
+        if (atomic_load_explicit(spin, memory_order_relaxed) == 0
+            && atomic_exchange_explicit(spin, 1, memory_order_acquire) == 0)
+        {
+            return;
+        }
+
+        if (++spins >= BENCH_SPINS) {
+            spins = 0;
+            sched_yield();
+        }
+    }
+}
+
+
+static void
+bench_writer_op(bench_shared_t *shared, rbfc_slot_t *slot, rbtree_node_t *node, int insert)
+{
+    if (shared->kind == BENCH_LOCK_FC) {
+        if (insert) {
+            rbfc_insert(&shared->fc, slot, node);
+        }
+        else {
+            rbfc_delete(&shared->fc, slot, node);
+        }
+
+        return;
+    }
+
+    if (shared->kind == BENCH_LOCK_MUTEX) {
+        pthread_mutex_lock(&shared->mutex);
+    }
+    else {
+        bench_spin_lock(&shared->spin);
+    }
+
+    if (insert) {
+        rbtree_insert(&shared->tree, node);
+    }
+    else {
+        rbtree_delete(&shared->tree, node);
+    }
+
+    if (shared->kind == BENCH_LOCK_MUTEX) {
+        pthread_mutex_unlock(&shared->mutex);
+    }
+    else {
+        atomic_store_explicit(&shared->spin, 0, memory_order_release);
+    }
+}
+
+
+static void *
+bench_writer(void *arg)
+{
+    bench_writer_t *writer = arg;
+    bench_shared_t *shared = writer->shared;
+    rbfc_slot_t *slot = NULL;
+
+    if (shared->kind == BENCH_LOCK_FC) {
+        rbfc_register(&shared->fc, &slot);
+    }
+
+    pthread_barrier_wait(&shared->barrier);
+    writer->start = bench_now_ns();
+
+    uint64_t last = writer->start;
+    for (size_t op = 0; op < 2 * writer->count; op++) {
+        bench_rb_record_t *record = &writer->records[op % writer->count];
+
+        bench_writer_op(shared, slot, &record->node, op < writer->count);
+
+        uint64_t now = bench_now_ns();
+        writer->latency[op] = now - last > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - last);
+        last = now;
+    }
+
+    writer->end = last;
+
+    if (slot != NULL) {
+        rbfc_unregister(&shared->fc, slot);
+    }
+
+    return NULL;
+}
+
+
+static int
+bench_latency_compare(const void *a, const void *b)
+{
+    uint32_t la = *(const uint32_t *)a;
+    uint32_t lb = *(const uint32_t *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+
+static void
+bench_contended(uint64_t *keys, size_t count, int threads, int kind)
+{
+    static const char *names[] = { "mutex", "spin", "rbfc" };
+
+    bench_shared_t shared;
+    bench_writer_t writers[BENCH_MAX_THREADS];
+
+    bench_rb_record_t *records = malloc(count * sizeof(*records));
+    uint32_t *latency = malloc(2 * count * sizeof(*latency));
+    if (records == NULL || latency == NULL) {
+        free(records);
+        free(latency);
+
+        return;
+    }
+
+    shared.kind = kind;
+    rbtree_init(&shared.tree, bench_rb_compare);
+    pthread_mutex_init(&shared.mutex, NULL);
+    atomic_init(&shared.spin, 0);
+    rbfc_init(&shared.fc, bench_rb_compare, threads);
+    pthread_barrier_init(&shared.barrier, NULL, threads);
+
+    /** every writer inserts then deletes its own share of keys */
+    size_t share = count / threads;
+    for (int idx = 0; idx < threads; idx++) {
+        writers[idx].shared = &shared;
+        writers[idx].records = records + idx * share;
+        writers[idx].count = share;
+        writers[idx].latency = latency + 2 * idx * share;
+
+        for (size_t rec = 0; rec < share; rec++) {
+            writers[idx].records[rec].key = keys[idx * share + rec];
+        }
+    }
+
+    for (int idx = 0; idx < threads; idx++) {
+        pthread_create(&writers[idx].thread, NULL, bench_writer, &writers[idx]);
+    }
+
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+    for (int idx = 0; idx < threads; idx++) {
+        pthread_join(writers[idx].thread, NULL);
+        start = writers[idx].start < start ? writers[idx].start : start;
+        end = writers[idx].end > end ? writers[idx].end : end;
+    }
+
+    rbtree_t *tree = kind == BENCH_LOCK_FC ? rbfc_tree(&shared.fc) : &shared.tree;
+    if (rbtree_size(tree) != 0) {
+        printf("%s: unexpected result\n", names[kind]);
+    }
+
+    size_t ops = 2 * share * threads;
+    qsort(latency, ops, sizeof(*latency), bench_latency_compare);
+
+    printf("%-12s %10d %10.2f %10u %10u %10u\n",
+           names[kind], threads,
+           ops * 1000.0 / (end - start),
+           latency[ops / 2],
+           latency[ops * 99 / 100],
+           latency[ops * 999 / 1000]);
+
+    pthread_barrier_destroy(&shared.barrier);
+    rbfc_destroy(&shared.fc);
+    pthread_mutex_destroy(&shared.mutex);
+    free(records);
+    free(latency);
+}
+
+
+/** rbtree_par.c, whole tree visits from 1 to 32 threads */
+
+typedef struct bench_par_record_s bench_par_record_t;
+struct bench_par_record_s {
+    uint64_t key;
+    uint64_t value;
+    rbtree_node_t node;
+};
+
+
+static int
+bench_par_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = bench_owner(na, bench_par_record_t, node)->key;
+    uint64_t bkey = bench_owner(nb, bench_par_record_t, node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_par_visit(rbtree_node_t *node, void *ctx)
+{
+    bench_par_record_t *record = bench_owner(node, bench_par_record_t, node);
+
+    record->value = record->key * 3;
+}
+
+
+static void
+bench_par_init(void *acc, void *ctx)
+{
+    *(uint64_t *)acc = 0;
+}
+
+
+static void
+bench_par_accumulate(void *acc, rbtree_node_t *node, void *ctx)
+{
+    *(uint64_t *)acc += bench_owner(node, bench_par_record_t, node)->value;
+}
+
+
+static void
+bench_par_combine(void *acc, const void *next, void *ctx)
+{
+    *(uint64_t *)acc += *(const uint64_t *)next;
+}
+
+
+static void
+bench_parallel(uint64_t *keys, size_t count)
+{
+    bench_par_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL) {
+        return;
+    }
+
+    rbtree_t tree;
+    rbtree_init(&tree, bench_par_compare);
+
+    uint64_t expect = 0;
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = keys[idx];
+        expect += keys[idx] * 3;
+        rbtree_insert(&tree, &records[idx].node);
+    }
+
+    rbtree_reducer_t reducer = {
+        .size       = sizeof(uint64_t),
+        .init       = bench_par_init,
+        .accumulate = bench_par_accumulate,
+        .combine    = bench_par_combine,
+    };
+
+    double base[2] = { 0, 0 };
+    for (size_t threads = 1; threads <= 32; threads *= 2) {
+        uint64_t start = bench_now_ns();
+        rbtree_parallel_foreach(&tree, threads, bench_par_visit, NULL);
+        uint64_t foreach_ns = bench_now_ns() - start;
+
+        uint64_t sum = 0;
+        start = bench_now_ns();
+        rbtree_parallel_reduce(&tree, threads, &reducer, &sum);
+        uint64_t reduce_ns = bench_now_ns() - start;
+
+        if (sum != expect) {
+            printf("parallel: unexpected result\n");
+        }
+
+        if (threads == 1) {
+            base[0] = foreach_ns;
+            base[1] = reduce_ns;
+        }
+
+        printf("%-12s %10zu %10.1f %10.2f %10.1f %10.2f\n", "rbtree", threads,
+               foreach_ns / 1000000.0, base[0] / foreach_ns,
+               reduce_ns / 1000000.0, base[1] / reduce_ns);
+    }
+
+    free(records);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    size_t count = 1000000;
+    int counters = argc > 1 && strcmp(argv[1], "counters") == 0;
+    if (argc > 1 + counters) {
+        count = strtoull(argv[1 + counters], NULL, 10);
+    }
+
+    if (count < 2) {
+        printf("usage: %s [counters] [count]\n", argv[0]);
+
+        return 1;
+    }
+
+    uint64_t *keys   = malloc(count * sizeof(*keys));
+    uint64_t *probes = malloc(count * sizeof(*probes));
+    if (keys == NULL || probes == NULL) {
+        printf("out of memory\n");
+
+        return 1;
+    }
+
+    /** unique keys, spread out so they are not in insertion order */
+    for (size_t idx = 0; idx < count; idx++) {
+        keys[idx]   = idx * 2654435761u + 1;
+        probes[idx] = keys[idx];
+    }
+
+    bench_shuffle(keys, count, 0x9e3779b97f4a7c15ull);
+    bench_shuffle(probes, count, 0xc2b2ae3d27d4eb4full);
+
+    if (counters) {
+        printf("counters, per op, ipc is instructions per cycle\n");
+        bench_counters(keys, count);
+
+        free(keys);
+        free(probes);
+
+        return 0;
+    }
+
+    bench_report_header(count);
+    bench_rbtree(keys, probes, count);
+    bench_rbtd(keys, probes, count);
+    bench_rbthr(keys, probes, count);
+    bench_rbidx(keys, probes, count);
+
+    printf("\nsmall sets\n");
+    bench_report_header(count);
+    for (size_t set_size = 4; set_size <= 2 * RBSMALL_CAPACITY; set_size *= 2) {
+        bench_small(keys, count, set_size, 0);
+        bench_small(keys, count, set_size, 1);
+    }
+
+    printf("\nmixed, 90%% find and 10%% scan of %d, both as search\n", BENCH_SCAN_LENGTH);
+    bench_report_header(count);
+    bench_mixed(keys, probes, count, 0);
+    bench_mixed(keys, probes, count, 1);
+
+    printf("\ncache, ns per entry\n");
+    printf("%-12s %10s %10s %10s %10s\n", "variant", "fill", "hit", "evict", "expire");
+    bench_cache(keys, probes, count);
+
+    printf("\nstring keys, %d byte prefix\n", RBSTR_PREFIX_BYTES);
+    bench_report_header(count);
+    for (int url = 0; url <= 1; url++) {
+        bench_str(keys, probes, count, url, 0);
+        bench_str(keys, probes, count, url, 1);
+    }
+
+    printf("\nretention, drop lower half, ms in total\n");
+    printf("%-12s %10s %10s %10s\n", "variant", "per node", "range", "detach");
+    bench_retention(keys, count);
+
+    printf("\ndurable, ns per op, amp is bytes written per record byte\n");
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n",
+           "variant", "group", "ops", "op", "syncs", "ckpts", "amp");
+    bench_durable(keys, count);
+
+    printf("\nquantile, ns per add and query, ms per sort\n");
+    printf("%-12s %10s %10s %10s %10s\n", "variant", "window", "add", "query", "sort");
+    bench_quant(count);
+
+    printf("\naggregate, ns per insert and query\n");
+    printf("%-12s %10s %10s %10s %10s\n", "variant", "width", "insert", "aggregate", "walk");
+    bench_aggregate(count);
+
+    printf("\nmulti index, ns per op\n");
+    printf("%-12s %10s %10s %10s %10s\n", "variant", "insert", "touch", "jitter", "erase");
+    bench_multi(keys, probes, count);
+
+    printf("\nrelaxed, burst of %zu inserts into %zu keys, ns per insert, ms per drain\n",
+           count - count / 2, count / 2);
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n",
+           "variant", "order", "pending", "insert", "depth", "drain", "settled");
+    for (int ascending = 0; ascending <= 1; ascending++) {
+        bench_relaxed(keys, count, ascending, 0);
+        for (size_t capacity = 16; capacity <= 4096; capacity *= 16) {
+            bench_relaxed(keys, count, ascending, capacity);
+        }
+    }
+
+    size_t contended = count < 200000 ? count : 200000;
+    printf("\ncontended writers, %zu keys, Mops is over all threads, ns per op\n", contended);
+    printf("%-12s %10s %10s %10s %10s %10s\n",
+           "variant", "threads", "Mops", "p50", "p99", "p99.9");
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        for (int kind = BENCH_LOCK_MUTEX; kind <= BENCH_LOCK_FC; kind++) {
+            bench_contended(keys, contended, threads, kind);
+        }
+    }
+
+    printf("\nparallel, ms in total, speedup over 1 thread\n");
+    printf("%-12s %10s %10s %10s %10s %10s\n",
+           "variant", "threads", "foreach", "x", "reduce", "x");
+    bench_parallel(keys, count);
+
+    free(keys);
+    free(probes);
+
+    return 0;
+}
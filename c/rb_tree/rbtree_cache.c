@@ -0,0 +1,298 @@
+/**
+ * file name: rbtree_cache.c
+ *
+ * expiring cache implemention
+ *
+ * an entry is linked twice, by its key node into the map and by its expiry
+ * node into the expiry tree, so the map's tree stays ordered by key and
+ * a new ttl only moves the expiry node.
+ */
+#include <stdio.h>
+
+#include "rbtree_cache.h"
+
+
+#define rbcache_expiry_entry(ptr) \
+    ((rbcache_entry_t *)((uintptr_t)(ptr) - offsetof(rbcache_entry_t, expiry)))
+
+
+static int
+rbcache_expiry_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t aexpire = rbcache_expiry_entry(na)->expire_at;
+    uint64_t bexpire = rbcache_expiry_entry(nb)->expire_at;
+
+    return (aexpire > bexpire) - (aexpire < bexpire);
+}
+
+
+static inline int
+rbcache_is_limited(rbcache_t *cache)
+{
+    return cache->max_count != 0 || cache->max_charge != 0;
+}
+
+
+static inline int
+rbcache_is_over(rbcache_t *cache)
+{
+    return (cache->max_count != 0 && rbcache_size(cache) > cache->max_count) ||
+           (cache->max_charge != 0 && cache->charge > cache->max_charge);
+}
+
+
+static inline uint64_t
+rbcache_expire_at(uint64_t now, uint64_t ttl)
+{
+    if (ttl == 0 || ttl >= RBCACHE_NEVER - now) {
+        return RBCACHE_NEVER;
+    }
+
+    return now + ttl;
+}
+
+
+static inline void
+rbcache_lru_unlink(rbcache_entry_t *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+}
+
+
+static inline void
+rbcache_lru_push(rbcache_t *cache, rbcache_entry_t *entry)
+{
+    entry->prev = &cache->lru;
+    entry->next = cache->lru.next;
+    cache->lru.next->prev = entry;
+    cache->lru.next = entry;
+}
+
+
+/** entry is known to be in cache */
+static void
+rbcache_drop(rbcache_t *cache, rbcache_entry_t *entry)
+{
+    rbhmap_delete(&cache->map, &entry->node);
+    rbtree_delete(&cache->expiry, &entry->expiry);
+    rbcache_lru_unlink(entry);
+    cache->charge -= entry->charge;
+
+    if (cache->release != NULL) {
+        cache->release(entry, cache->ctx);
+    }
+}
+
+
+static inline int
+rbcache_contains(rbcache_t *cache, rbcache_entry_t *entry)
+{
+    rbtree_node_t *node = NULL;
+
+    return rbhmap_find(&cache->map, cache->map.key(&entry->node), &node) == RBTREE_OK &&
+           node == &entry->node;
+}
+
+
+int
+rbcache_init(rbcache_t *cache,
+             rbtree_compare compare,
+             rbtree_key_compare key_compare,
+             rbhmap_key key,
+             rbhmap_hash hash,
+             size_t capacity)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+
+    int ret = rbhmap_init(&cache->map, compare, key_compare, key, hash, capacity);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_init(&cache->expiry, rbcache_expiry_compare);
+
+    cache->lru.prev   = &cache->lru;
+    cache->lru.next   = &cache->lru;
+    cache->charge     = 0;
+    cache->max_count  = 0;
+    cache->max_charge = 0;
+    cache->release    = NULL;
+    cache->ctx        = NULL;
+
+    return RBTREE_OK;
+}
+
+
+void
+rbcache_destroy(rbcache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    rbhmap_destroy(&cache->map);
+}
+
+
+int
+rbcache_set_limit(rbcache_t *cache,
+                  size_t max_count,
+                  size_t max_charge,
+                  rbcache_release release,
+                  void *ctx)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+
+    cache->max_count  = max_count;
+    cache->max_charge = max_charge;
+    cache->release    = release;
+    cache->ctx        = ctx;
+
+    /** apply to what is cached already */
+    while (rbcache_is_over(cache)) {
+        rbcache_drop(cache, cache->lru.prev);
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbcache_insert(rbcache_t *cache,
+               rbcache_entry_t *entry,
+               uint64_t now,
+               uint64_t ttl,
+               size_t charge)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(entry != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(cache->max_charge == 0 || charge <= cache->max_charge, RBTREE_NO_SPACE);
+
+    entry->expire_at = rbcache_expire_at(now, ttl);
+    entry->charge    = charge;
+
+    int ret = rbhmap_insert(&cache->map, &entry->node, NULL);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_insert(&cache->expiry, &entry->expiry);
+    rbcache_lru_push(cache, entry);
+    cache->charge += charge;
+
+    /** expired entries go first, then least recently used, never the new one */
+    while (rbcache_is_over(cache)) {
+        rbcache_entry_t *victim = rbcache_expiry_entry(rbtree_first(&cache->expiry));
+
+        if (victim->expire_at > now) {
+            victim = cache->lru.prev;
+        }
+
+        rbcache_drop(cache, victim);
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbcache_delete(rbcache_t *cache, rbcache_entry_t *entry)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(entry != NULL, RBTREE_INVALID_ARG);
+
+    int ret = rbhmap_delete(&cache->map, &entry->node);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_delete(&cache->expiry, &entry->expiry);
+    rbcache_lru_unlink(entry);
+    cache->charge -= entry->charge;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbcache_get(rbcache_t *cache, const void *key, uint64_t now, rbcache_entry_t **ret)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *node = NULL;
+    int err = rbhmap_find(&cache->map, key, &node);
+    rbtree_must(err == RBTREE_OK, err);
+
+    rbcache_entry_t *entry = rbcache_entry_of(node);
+    if (entry->expire_at <= now) {
+        rbcache_drop(cache, entry);
+
+        return RBTREE_NOT_FOUND;
+    }
+
+    /** list order only matters for eviction */
+    if (rbcache_is_limited(cache) && cache->lru.next != entry) {
+        rbcache_lru_unlink(entry);
+        rbcache_lru_push(cache, entry);
+    }
+
+    *ret = entry;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbcache_touch(rbcache_t *cache, rbcache_entry_t *entry, uint64_t now, uint64_t ttl)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(entry != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(rbcache_contains(cache, entry), RBTREE_NOT_FOUND);
+
+    uint64_t expire_at = rbcache_expire_at(now, ttl);
+    if (expire_at == entry->expire_at) {
+        return RBTREE_OK;
+    }
+
+    /** key map is not touched, only the expiry node moves */
+    rbtree_delete(&cache->expiry, &entry->expiry);
+    entry->expire_at = expire_at;
+    rbtree_insert(&cache->expiry, &entry->expiry);
+
+    return RBTREE_OK;
+}
+
+
+size_t
+rbcache_expire(rbcache_t *cache, uint64_t now, size_t budget)
+{
+    size_t count = 0;
+
+    if (cache == NULL) {
+        return 0;
+    }
+
+    while (count < budget) {
+        rbtree_node_t *soonest = rbtree_first(&cache->expiry);
+        if (soonest == NULL || rbcache_expiry_entry(soonest)->expire_at > now) {
+            break;
+        }
+
+        rbcache_drop(cache, rbcache_expiry_entry(soonest));
+        count++;
+    }
+
+    return count;
+}
+
+
+int
+rbcache_next_expiry(rbcache_t *cache, uint64_t *expire_at)
+{
+    rbtree_must(cache != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(expire_at != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *soonest = rbtree_first(&cache->expiry);
+    rbtree_must(soonest != NULL, RBTREE_NOT_FOUND);
+    rbtree_must(rbcache_expiry_entry(soonest)->expire_at != RBCACHE_NEVER, RBTREE_NOT_FOUND);
+
+    *expire_at = rbcache_expiry_entry(soonest)->expire_at;
+
+    return RBTREE_OK;
+}
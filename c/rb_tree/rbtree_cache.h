@@ -0,0 +1,148 @@
+/**
+ * file name: rbtree_cache.h
+ *
+ * head file of expiring cache
+ *
+ * entries are intrusive, embed a rbcache_entry_t in the record:
+ *
+ *     struct my_record {
+ *         rbcache_entry_t entry;
+ *         uint64_t key;
+ *     };
+ *
+ * entries are kept in a rbhmap_t by key, lookup goes through its hash
+ * table, and in a rbtree_t of their own ordered by expiry time, so all
+ * expired entries are found from its leftmost node.
+ * with a count or charge limit set, entries also sit on a LRU list and the
+ * least recently used are evicted to make room.
+ *
+ * the cache never reads a clock, every call takes `now` in caller's unit.
+ * entries dropped by the cache itself are handed to the release callback.
+ */
+#ifndef __RB_TREE_CACHE_H__
+#define __RB_TREE_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+#include "rbtree_hmap.h"
+
+
+/** expire_at of entries without ttl */
+#define RBCACHE_NEVER UINT64_MAX
+
+typedef struct rbcache_entry_s rbcache_entry_t;
+struct rbcache_entry_s {
+    /** in key map, key callbacks get this node */
+    rbtree_node_t node;
+    /** in expiry tree */
+    rbtree_node_t expiry;
+    /** LRU list, most recent first */
+    rbcache_entry_t *prev;
+    rbcache_entry_t *next;
+    uint64_t expire_at;
+    size_t charge;
+};
+
+#define rbcache_entry_of(ptr) \
+    ((rbcache_entry_t *)((uintptr_t)(ptr) - offsetof(rbcache_entry_t, node)))
+
+/** entry was expired or evicted and is no longer in cache */
+typedef void (*rbcache_release)(rbcache_entry_t *entry, void *ctx);
+
+typedef struct rbcache_s rbcache_t;
+struct rbcache_s {
+    /** by key */
+    rbhmap_t map;
+    /** by expire_at, equal times are kept as duplicates */
+    rbtree_t expiry;
+    /** head of LRU list */
+    rbcache_entry_t lru;
+    size_t charge;
+    /** 0 if unbounded */
+    size_t max_count;
+    size_t max_charge;
+    rbcache_release release;
+    void *ctx;
+};
+
+
+/**
+ * `compare`, `key_compare` and `key` work on the node of rbcache_entry_t
+ * and order entries by key as in rbhmap_init, `capacity` is a hint of
+ * entry count
+ */
+int
+rbcache_init(rbcache_t *cache,
+             rbtree_compare compare,
+             rbtree_key_compare key_compare,
+             rbhmap_key key,
+             rbhmap_hash hash,
+             size_t capacity);
+
+/** frees the hash table, entries left in cache are not released */
+void
+rbcache_destroy(rbcache_t *cache);
+
+/** bound cache size, entries over the bound are released on insert */
+int
+rbcache_set_limit(rbcache_t *cache,
+                  size_t max_count,
+                  size_t max_charge,
+                  rbcache_release release,
+                  void *ctx);
+
+/**
+ * add entry which expires at `now + ttl`, never if `ttl` is 0
+ *
+ * RBTREE_DUPLICATE if key is cached already, replace it by
+ * rbcache_delete first. RBTREE_NO_SPACE if `charge` alone is over limit.
+ */
+int
+rbcache_insert(rbcache_t *cache,
+               rbcache_entry_t *entry,
+               uint64_t now,
+               uint64_t ttl,
+               size_t charge);
+
+/** remove entry, release callback is not called */
+int
+rbcache_delete(rbcache_t *cache, rbcache_entry_t *entry);
+
+/**
+ * look up key, an expired entry is released and not returned
+ *
+ * a hit makes the entry most recently used.
+ */
+int
+rbcache_get(rbcache_t *cache, const void *key, uint64_t now, rbcache_entry_t **ret);
+
+/** reset ttl of entry in cache, 0 for never */
+int
+rbcache_touch(rbcache_t *cache, rbcache_entry_t *entry, uint64_t now, uint64_t ttl);
+
+/** release up to `budget` expired entries, soonest first, returns the count */
+size_t
+rbcache_expire(rbcache_t *cache, uint64_t now, size_t budget);
+
+/** soonest expiry time, RBTREE_NOT_FOUND if no entry has a ttl */
+int
+rbcache_next_expiry(rbcache_t *cache, uint64_t *expire_at);
+
+
+static inline size_t
+rbcache_size(rbcache_t *cache)
+{
+    return rbhmap_size(&cache->map);
+}
+
+
+static inline size_t
+rbcache_charge(rbcache_t *cache)
+{
+    return cache->charge;
+}
+
+
+#endif
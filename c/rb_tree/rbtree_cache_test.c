@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_cache.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    rbcache_entry_t entry;
+    uint64_t key;
+    int released;
+};
+
+#define rbcache_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static test_record_t *
+test_record_of(rbtree_node_t *node)
+{
+    return rbcache_owner(rbcache_entry_of(node), test_record_t, entry);
+}
+
+
+static int
+test_node_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = test_record_of(na)->key;
+    uint64_t bkey = test_record_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = test_record_of(node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static const void *
+test_node_key(rbtree_node_t *node)
+{
+    return &test_record_of(node)->key;
+}
+
+
+static uint64_t
+test_hash(const void *key)
+{
+    return rbhmap_mix64(*(const uint64_t *)key);
+}
+
+
+static void
+test_release(rbcache_entry_t *entry, void *ctx)
+{
+    size_t *count = ctx;
+
+    rbcache_owner(entry, test_record_t, entry)->released++;
+    (*count)++;
+}
+
+
+static void
+test_init_cache(rbcache_t *cache, test_record_t *records, int count)
+{
+    rbcache_init(cache, test_node_compare, test_key_compare, test_node_key, test_hash, 0);
+
+    for (int idx = 0; idx < count; idx++) {
+        records[idx].key = idx;
+        records[idx].released = 0;
+    }
+}
+
+
+static void
+test_ttl(void)
+{
+    rbcache_t cache;
+
+    CU_ASSERT(rbcache_init(NULL, test_node_compare, test_key_compare, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbcache_init(&cache, NULL, test_key_compare, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbcache_init(&cache, test_node_compare, NULL, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+
+    test_record_t records[100];
+    test_init_cache(&cache, records, 100);
+
+    size_t released = 0;
+    rbcache_set_limit(&cache, 0, 0, test_release, &released);
+
+    uint64_t expire_at = 0;
+    CU_ASSERT(rbcache_next_expiry(&cache, &expire_at) == RBTREE_NOT_FOUND);
+
+    /** record idx lives for idx + 1 ticks, record 0 never expires */
+    for (int idx = 0; idx < 100; idx++) {
+        CU_ASSERT(rbcache_insert(&cache, &records[idx].entry, 1000, idx == 0 ? 0 : idx + 1, 1) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbcache_insert(&cache, &records[5].entry, 1000, 1, 1) == RBTREE_DUPLICATE);
+    CU_ASSERT(rbcache_size(&cache) == 100);
+    CU_ASSERT(rbcache_charge(&cache) == 100);
+
+    CU_ASSERT(rbcache_next_expiry(&cache, &expire_at) == RBTREE_OK);
+    CU_ASSERT(expire_at == 1002);
+
+    rbcache_entry_t *ret = NULL;
+    uint64_t key = 10;
+    CU_ASSERT(rbcache_get(&cache, &key, 1010, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &records[10].entry);
+
+    /** expired on lookup */
+    CU_ASSERT(rbcache_get(&cache, &key, 1011, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(records[10].released == 1);
+    CU_ASSERT(released == 1);
+    CU_ASSERT(rbcache_size(&cache) == 99);
+
+    /** bulk harvest in expiry order, budget bounds the work */
+    CU_ASSERT(rbcache_expire(&cache, 1050, 10) == 10);
+    CU_ASSERT(rbcache_next_expiry(&cache, &expire_at) == RBTREE_OK);
+    CU_ASSERT(expire_at == 1013);
+
+    CU_ASSERT(rbcache_expire(&cache, 1050, SIZE_MAX) == 49 - 10 - 1);
+    CU_ASSERT(rbcache_size(&cache) == 51);
+
+    for (int idx = 1; idx < 100; idx++) {
+        CU_ASSERT(records[idx].released == (idx + 1 <= 50));
+    }
+
+    /** touch moves expiry both ways */
+    CU_ASSERT(rbcache_touch(&cache, &records[10].entry, 1050, 5) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbcache_touch(&cache, &records[99].entry, 1050, 1) == RBTREE_OK);
+    CU_ASSERT(rbcache_touch(&cache, &records[0].entry, 1050, 2) == RBTREE_OK);
+    CU_ASSERT(rbcache_touch(&cache, &records[60].entry, 1050, 0) == RBTREE_OK);
+
+    /** key map stays ordered by key, ordered searches keep working */
+    uint64_t last = 0;
+    size_t count = 0;
+    rbtree_t *tree = rbhmap_tree(&cache.map);
+    for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+        CU_ASSERT(count == 0 || test_record_of(node)->key > last);
+        last = test_record_of(node)->key;
+        count++;
+    }
+
+    CU_ASSERT(count == rbcache_size(&cache));
+
+    rbtree_node_t *node = NULL;
+    key = 10;
+    CU_ASSERT(rbhmap_search_key(&cache.map, &key, RBTREE_SEARCH_MODE_GT, &node) == RBTREE_OK);
+    CU_ASSERT(node == &records[50].entry.node);
+    key = 60;
+    CU_ASSERT(rbhmap_search_key(&cache.map, &key, RBTREE_SEARCH_MODE_LT, &node) == RBTREE_OK);
+    CU_ASSERT(node == &records[59].entry.node);
+
+    CU_ASSERT(rbcache_next_expiry(&cache, &expire_at) == RBTREE_OK);
+    CU_ASSERT(expire_at == 1051);
+    CU_ASSERT(rbcache_expire(&cache, 1052, SIZE_MAX) == 4);
+    CU_ASSERT(records[0].released == 1);
+    CU_ASSERT(records[50].released == 1);
+    CU_ASSERT(records[51].released == 1);
+    CU_ASSERT(records[99].released == 1);
+
+    CU_ASSERT(rbcache_expire(&cache, UINT64_MAX - 1, SIZE_MAX) == 46);
+    CU_ASSERT(rbcache_size(&cache) == 1);
+    CU_ASSERT(records[60].released == 0);
+
+    /** delete does not release */
+    CU_ASSERT(rbcache_delete(&cache, &records[60].entry) == RBTREE_OK);
+    CU_ASSERT(rbcache_delete(&cache, &records[60].entry) == RBTREE_NOT_FOUND);
+    CU_ASSERT(records[60].released == 0);
+    CU_ASSERT(rbcache_size(&cache) == 0);
+    CU_ASSERT(rbcache_charge(&cache) == 0);
+
+    rbcache_destroy(&cache);
+}
+
+
+static void
+test_lru(void)
+{
+    rbcache_t cache;
+    test_record_t records[16];
+    test_init_cache(&cache, records, 16);
+
+    size_t released = 0;
+    for (int idx = 0; idx < 8; idx++) {
+        rbcache_insert(&cache, &records[idx].entry, 0, 0, 1);
+    }
+
+    /** limit applies at once */
+    CU_ASSERT(rbcache_set_limit(&cache, 4, 0, test_release, &released) == RBTREE_OK);
+    CU_ASSERT(rbcache_size(&cache) == 4);
+    CU_ASSERT(released == 4);
+    CU_ASSERT(records[3].released == 1);
+    CU_ASSERT(records[4].released == 0);
+
+    /** hit on 4 makes 5 least recently used */
+    rbcache_entry_t *ret = NULL;
+    uint64_t key = 4;
+    CU_ASSERT(rbcache_get(&cache, &key, 0, &ret) == RBTREE_OK);
+
+    CU_ASSERT(rbcache_insert(&cache, &records[8].entry, 0, 0, 1) == RBTREE_OK);
+    CU_ASSERT(records[5].released == 1);
+    CU_ASSERT(records[4].released == 0);
+
+    /** an expired entry goes before the least recently used */
+    CU_ASSERT(rbcache_insert(&cache, &records[9].entry, 0, 10, 1) == RBTREE_OK);
+    CU_ASSERT(records[6].released == 1);
+    CU_ASSERT(rbcache_insert(&cache, &records[10].entry, 20, 0, 1) == RBTREE_OK);
+    CU_ASSERT(records[9].released == 1);
+    CU_ASSERT(records[7].released == 0);
+    CU_ASSERT(rbcache_size(&cache) == 4);
+
+    rbcache_destroy(&cache);
+}
+
+
+static void
+test_charge(void)
+{
+    rbcache_t cache;
+    test_record_t records[16];
+    test_init_cache(&cache, records, 16);
+
+    size_t released = 0;
+    rbcache_set_limit(&cache, 0, 100, test_release, &released);
+
+    CU_ASSERT(rbcache_insert(&cache, &records[0].entry, 0, 0, 101) == RBTREE_NO_SPACE);
+    CU_ASSERT(rbcache_size(&cache) == 0);
+
+    CU_ASSERT(rbcache_insert(&cache, &records[0].entry, 0, 0, 40) == RBTREE_OK);
+    CU_ASSERT(rbcache_insert(&cache, &records[1].entry, 0, 0, 40) == RBTREE_OK);
+    CU_ASSERT(rbcache_charge(&cache) == 80);
+
+    /** one big entry pushes out both */
+    CU_ASSERT(rbcache_insert(&cache, &records[2].entry, 0, 0, 100) == RBTREE_OK);
+    CU_ASSERT(rbcache_size(&cache) == 1);
+    CU_ASSERT(rbcache_charge(&cache) == 100);
+    CU_ASSERT(released == 2);
+
+    rbcache_destroy(&cache);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbcache[] = {
+    { "test_ttl",    test_ttl    },
+    { "test_lru",    test_lru    },
+    { "test_charge", test_charge },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbcache",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbcache,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,266 @@
+/**
+ * file name: rbtree_fc.c
+ *
+ * flat combining rbtree implemention
+ *
+ * a slot goes RBFC_OP_NONE -> op by its thread, with arguments written
+ * before the release store of op, and op -> RBFC_OP_NONE by the combiner
+ * once `ret` is written. the thread spins on its own cache line and
+ * takes the combiner role whenever it is free, so an operation never
+ * waits on a combiner that already left.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "rbtree_fc.h"
+
+
+enum rbfc_op_e {
+    RBFC_OP_NONE = 0,
+    RBFC_OP_INSERT,
+    RBFC_OP_DELETE,
+    RBFC_OP_SEARCH,
+};
+
+
+int
+rbfc_init(rbfc_t *fc, rbtree_compare compare, size_t slots)
+{
+    rbtree_must(fc != NULL && compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(slots > 0, RBTREE_INVALID_ARG);
+
+    memset(fc, 0, sizeof(*fc));
+
+    int ret = rbtree_init(&fc->tree, compare);
+    if (ret != RBTREE_OK) {
+        return ret;
+    }
+
+    fc->slots = aligned_alloc(RBFC_CACHE_LINE, slots * sizeof(*fc->slots));
+    fc->batch = malloc(slots * sizeof(*fc->batch));
+    if (fc->slots == NULL || fc->batch == NULL) {
+        free(fc->slots);
+        free(fc->batch);
+
+        return RBTREE_NO_SPACE;
+    }
+
+    memset(fc->slots, 0, slots * sizeof(*fc->slots));
+    fc->slot_count = slots;
+    atomic_init(&fc->slot_used, 0);
+    atomic_init(&fc->combining, 0);
+
+    return RBTREE_OK;
+}
+
+
+void
+rbfc_destroy(rbfc_t *fc)
+{
+    if (fc == NULL) {
+        return;
+    }
+
+    free(fc->slots);
+    free(fc->batch);
+    fc->slots = NULL;
+    fc->batch = NULL;
+    fc->slot_count = 0;
+}
+
+
+int
+rbfc_register(rbfc_t *fc, rbfc_slot_t **slot)
+{
+    rbtree_must(fc != NULL && slot != NULL, RBTREE_INVALID_ARG);
+
+    for (size_t idx = 0; idx < fc->slot_count; idx++) {
+        int expect = 0;
+        if (!atomic_compare_exchange_strong(&fc->slots[idx].owned, &expect, 1)) {
+            continue;
+        }
+
+        /** raise the scanned range to cover it */
+        size_t used = atomic_load(&fc->slot_used);
+        while (used <= idx && !atomic_compare_exchange_weak(&fc->slot_used, &used, idx + 1)) {
+        }
+
+        *slot = &fc->slots[idx];
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NO_SPACE;
+}
+
+
+int
+rbfc_unregister(rbfc_t *fc, rbfc_slot_t *slot)
+{
+    rbtree_must(fc != NULL && slot != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(slot >= fc->slots && slot < fc->slots + fc->slot_count, RBTREE_INVALID_ARG);
+    rbtree_must(atomic_load(&slot->op) == RBFC_OP_NONE, RBTREE_INVALID_ARG);
+
+    atomic_store_explicit(&slot->owned, 0, memory_order_release);
+
+    return RBTREE_OK;
+}
+
+
+static void
+rbfc_apply(rbfc_t *fc, rbfc_slot_t *slot, int op)
+{
+    switch (op) {
+    case RBFC_OP_INSERT:
+        slot->ret = rbtree_insert(&fc->tree, slot->node);
+        break;
+
+    case RBFC_OP_DELETE:
+        slot->ret = rbtree_delete(&fc->tree, slot->node);
+        break;
+
+    default:
+        slot->ret = rbtree_search_key(&fc->tree, slot->key, slot->key_compare, slot->mode, &slot->node);
+        break;
+    }
+
+    atomic_store_explicit(&slot->op, RBFC_OP_NONE, memory_order_release);
+}
+
+
+/** one round over published slots, returns operations applied */
+static size_t
+rbfc_combine_pass(rbfc_t *fc)
+{
+    size_t used = atomic_load_explicit(&fc->slot_used, memory_order_acquire);
+    size_t count = 0;
+    size_t applied = 0;
+
+    /** searches right away, inserts and deletes are gathered */
+    for (size_t idx = 0; idx < used; idx++) {
+        rbfc_slot_t *slot = &fc->slots[idx];
+
+        int op = atomic_load_explicit(&slot->op, memory_order_acquire);
+        if (op == RBFC_OP_NONE) {
+            continue;
+        }
+
+        if (op == RBFC_OP_SEARCH) {
+            rbfc_apply(fc, slot, op);
+            applied++;
+
+            continue;
+        }
+
+        /** insertion sort, a batch is at most one op per thread */
+        size_t pos = count++;
+        while (pos > 0 && fc->tree.compare(fc->batch[pos - 1]->node, slot->node) > 0) {
+            fc->batch[pos] = fc->batch[pos - 1];
+            pos--;
+        }
+
+        fc->batch[pos] = slot;
+    }
+
+    for (size_t idx = 0; idx < count; idx++) {
+        rbfc_slot_t *slot = fc->batch[idx];
+
+        rbfc_apply(fc, slot, atomic_load_explicit(&slot->op, memory_order_relaxed));
+    }
+
+    applied += count;
+    if (applied > fc->stats.max_batch) {
+        fc->stats.max_batch = applied;
+    }
+
+    return applied;
+}
+
+
+/** publish op in slot and wait until some combiner applied it */
+static int
+rbfc_run(rbfc_t *fc, rbfc_slot_t *slot, int op)
+{
+    atomic_store_explicit(&slot->op, op, memory_order_release);
+
+    int spins = 0;
+    for (;;) {
+        if (atomic_load_explicit(&slot->op, memory_order_acquire) == RBFC_OP_NONE) {
+            return slot->ret;
+        }
+
+        if (atomic_load_explicit(&fc->combining, memory_order_relaxed) == 0
+            && atomic_exchange_explicit(&fc->combining, 1, memory_order_acquire) == 0)
+        {
+            fc->stats.combines++;
+
+            /** own op is published, so the first pass takes it */
+            for (int pass = 0; pass < RBFC_PASSES; pass++) {
+                size_t applied = rbfc_combine_pass(fc);
+                if (applied == 0) {
+                    break;
+                }
+
+                fc->stats.ops += applied;
+            }
+
+            atomic_store_explicit(&fc->combining, 0, memory_order_release);
+
+            continue;
+        }
+
+        if (++spins >= RBFC_SPINS) {
+            spins = 0;
+            sched_yield();
+        }
+    }
+}
+
+
+int
+rbfc_insert(rbfc_t *fc, rbfc_slot_t *slot, rbtree_node_t *node)
+{
+    rbtree_must(fc != NULL && slot != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    slot->node = node;
+
+    return rbfc_run(fc, slot, RBFC_OP_INSERT);
+}
+
+
+int
+rbfc_delete(rbfc_t *fc, rbfc_slot_t *slot, rbtree_node_t *node)
+{
+    rbtree_must(fc != NULL && slot != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    slot->node = node;
+
+    return rbfc_run(fc, slot, RBFC_OP_DELETE);
+}
+
+
+int
+rbfc_search_key(rbfc_t *fc,
+                rbfc_slot_t *slot,
+                const void *key,
+                rbtree_key_compare compare,
+                rbtree_search_mode_t mode,
+                rbtree_node_t **ret)
+{
+    rbtree_must(fc != NULL && slot != NULL && ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    slot->key = key;
+    slot->key_compare = compare;
+    slot->mode = mode;
+    slot->node = NULL;
+
+    int err = rbfc_run(fc, slot, RBFC_OP_SEARCH);
+    *ret = slot->node;
+
+    return err;
+}
@@ -0,0 +1,135 @@
+/**
+ * file name: rbtree_fc.h
+ *
+ * head file of flat combining rbtree
+ *
+ * a rbtree_t shared by many threads without a lock around every call.
+ * each thread registers a slot once and publishes its operation there,
+ * whoever gets the combiner role applies all published operations as
+ * one batch and hands back their results:
+ *
+ *     rbfc_slot_t *slot = NULL;
+ *     rbfc_register(&fc, &slot);
+ *     ...
+ *     rbfc_insert(&fc, slot, &record->node);
+ *
+ * the tree is touched by one thread at a time, so it stays in that
+ * core's cache instead of moving with a lock between all of them.
+ * inserts and deletes of a batch are sorted first, consecutive descents
+ * then share their upper path.
+ *
+ * operations of one batch are concurrent calls, they may be applied in
+ * any order among each other.
+ */
+#ifndef __RB_TREE_FC_H__
+#define __RB_TREE_FC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "rbtree.h"
+
+
+#define RBFC_CACHE_LINE 64
+
+/** polls of own slot before giving up the cpu */
+#define RBFC_SPINS 128
+
+/** rounds over slots by one combiner while they have work */
+#define RBFC_PASSES 4
+
+/** publication slot of a thread, on a cache line of its own */
+typedef struct rbfc_slot_s rbfc_slot_t;
+struct rbfc_slot_s {
+    /** rbfc_op_t while published, RBFC_OP_NONE once done */
+    _Alignas(RBFC_CACHE_LINE) _Atomic int op;
+    /** held by a registered thread */
+    _Atomic int owned;
+    int ret;
+    rbtree_search_mode_t mode;
+    rbtree_node_t *node;
+    const void *key;
+    rbtree_key_compare key_compare;
+};
+
+typedef struct rbfc_stats_s rbfc_stats_t;
+struct rbfc_stats_s {
+    /** times a thread became combiner */
+    uint64_t combines;
+    /** operations applied, by own thread or another */
+    uint64_t ops;
+    uint64_t max_batch;
+};
+
+typedef struct rbfc_s rbfc_t;
+struct rbfc_s {
+    rbtree_t tree;
+
+    rbfc_slot_t *slots;
+    size_t slot_count;
+    /** slots below are scanned, never shrinks */
+    _Atomic size_t slot_used;
+
+    /** combiner role, 1 while taken */
+    _Alignas(RBFC_CACHE_LINE) _Atomic int combining;
+    /** scratch of combiner */
+    rbfc_slot_t **batch;
+
+    rbfc_stats_t stats;
+};
+
+
+/** `slots` is the most threads registered at a time */
+int
+rbfc_init(rbfc_t *fc, rbtree_compare compare, size_t slots);
+
+/** no operation may be in flight, nodes left in tree are not touched */
+void
+rbfc_destroy(rbfc_t *fc);
+
+/** claim a slot for calling thread, RBTREE_NO_SPACE if all are taken */
+int
+rbfc_register(rbfc_t *fc, rbfc_slot_t **slot);
+
+int
+rbfc_unregister(rbfc_t *fc, rbfc_slot_t *slot);
+
+/** as rbtree_insert, `slot` belongs to calling thread */
+int
+rbfc_insert(rbfc_t *fc, rbfc_slot_t *slot, rbtree_node_t *node);
+
+/** as rbtree_delete */
+int
+rbfc_delete(rbfc_t *fc, rbfc_slot_t *slot, rbtree_node_t *node);
+
+/**
+ * as rbtree_search_key, the node in `ret` may be deleted by another
+ * thread right after, owners of records have to agree on their lifetime
+ */
+int
+rbfc_search_key(rbfc_t *fc,
+                rbfc_slot_t *slot,
+                const void *key,
+                rbtree_key_compare compare,
+                rbtree_search_mode_t mode,
+                rbtree_node_t **ret);
+
+
+/** underlying tree, only while no operation is in flight */
+static inline rbtree_t *
+rbfc_tree(rbfc_t *fc)
+{
+    return &fc->tree;
+}
+
+
+/** read by combiner without sync, exact once threads are quiet */
+static inline const rbfc_stats_t *
+rbfc_stats(rbfc_t *fc)
+{
+    return &fc->stats;
+}
+
+
+#endif
@@ -0,0 +1,244 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_fc.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    uint64_t key;
+    rbtree_node_t node;
+};
+
+#define test_record_of(ptr) \
+    ((test_record_t *)((uintptr_t)(ptr) - offsetof(test_record_t, node)))
+
+
+static int
+test_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = test_record_of(na)->key;
+    uint64_t bkey = test_record_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = test_record_of(node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+test_ops(void)
+{
+    rbfc_t fc;
+    rbfc_slot_t *slot = NULL;
+    rbfc_slot_t *other = NULL;
+    test_record_t records[16];
+
+    CU_ASSERT(rbfc_init(&fc, test_compare, 2) == RBTREE_OK);
+    CU_ASSERT(rbfc_register(&fc, &slot) == RBTREE_OK);
+    CU_ASSERT(rbfc_register(&fc, &other) == RBTREE_OK);
+    CU_ASSERT(slot != other);
+    CU_ASSERT(((uintptr_t)slot & (RBFC_CACHE_LINE - 1)) == 0);
+
+    /** all slots taken */
+    rbfc_slot_t *third = NULL;
+    CU_ASSERT(rbfc_register(&fc, &third) == RBTREE_NO_SPACE);
+
+    for (int idx = 0; idx < 16; idx++) {
+        records[idx].key = idx * 10;
+        CU_ASSERT(rbfc_insert(&fc, idx % 2 ? slot : other, &records[idx].node) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbtree_size(rbfc_tree(&fc)) == 16);
+
+    rbtree_node_t *node = NULL;
+    uint64_t key = 35;
+    CU_ASSERT(rbfc_search_key(&fc, slot, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &node) == RBTREE_OK);
+    CU_ASSERT(node == &records[4].node);
+    CU_ASSERT(rbfc_search_key(&fc, slot, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &node) == RBTREE_NOT_FOUND);
+
+    CU_ASSERT(rbfc_delete(&fc, slot, &records[4].node) == RBTREE_OK);
+    CU_ASSERT(rbfc_search_key(&fc, other, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &node) == RBTREE_OK);
+    CU_ASSERT(node == &records[5].node);
+    CU_ASSERT(rbtree_size(rbfc_tree(&fc)) == 15);
+
+    CU_ASSERT(rbfc_insert(&fc, slot, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbfc_search_key(&fc, slot, &key, test_key_compare, RBTREE_SEARCH_MODE_MAX, &node) == RBTREE_INVALID_ARG);
+
+    /** a given back slot is handed out again */
+    CU_ASSERT(rbfc_unregister(&fc, other) == RBTREE_OK);
+    CU_ASSERT(rbfc_register(&fc, &third) == RBTREE_OK);
+    CU_ASSERT(third == other);
+
+    /** each call was its own combine */
+    CU_ASSERT(rbfc_stats(&fc)->ops == 20);
+    CU_ASSERT(rbfc_stats(&fc)->combines == 20);
+    CU_ASSERT(rbfc_stats(&fc)->max_batch == 1);
+
+    rbfc_destroy(&fc);
+}
+
+
+#define TEST_THREADS 8
+#define TEST_RECORDS 4000
+
+typedef struct test_worker_s test_worker_t;
+struct test_worker_s {
+    pthread_t thread;
+    rbfc_t *fc;
+    test_record_t *records;
+    int id;
+    int errors;
+};
+
+
+static void *
+test_worker(void *arg)
+{
+    test_worker_t *worker = arg;
+    rbfc_slot_t *slot = NULL;
+
+    if (rbfc_register(worker->fc, &slot) != RBTREE_OK) {
+        worker->errors++;
+
+        return NULL;
+    }
+
+    /** keys of workers interleave, so batches mix them */
+    for (int idx = 0; idx < TEST_RECORDS; idx++) {
+        test_record_t *record = &worker->records[idx];
+        record->key = (uint64_t)idx * TEST_THREADS + worker->id;
+
+        worker->errors += rbfc_insert(worker->fc, slot, &record->node) != RBTREE_OK;
+    }
+
+    for (int idx = 0; idx < TEST_RECORDS; idx++) {
+        test_record_t *record = &worker->records[idx];
+        rbtree_node_t *node = NULL;
+
+        worker->errors += rbfc_search_key(worker->fc, slot, &record->key, test_key_compare,
+                                          RBTREE_SEARCH_MODE_EQ, &node) != RBTREE_OK;
+        worker->errors += node != &record->node;
+
+        /** odd ones go again */
+        if (idx % 2) {
+            worker->errors += rbfc_delete(worker->fc, slot, &record->node) != RBTREE_OK;
+        }
+    }
+
+    worker->errors += rbfc_unregister(worker->fc, slot) != RBTREE_OK;
+
+    return NULL;
+}
+
+
+static void
+test_threads(void)
+{
+    rbfc_t fc;
+    test_worker_t workers[TEST_THREADS];
+
+    test_record_t *records = malloc(TEST_THREADS * TEST_RECORDS * sizeof(*records));
+    CU_ASSERT_FATAL(records != NULL);
+    CU_ASSERT(rbfc_init(&fc, test_compare, TEST_THREADS) == RBTREE_OK);
+
+    for (int idx = 0; idx < TEST_THREADS; idx++) {
+        workers[idx].fc = &fc;
+        workers[idx].records = records + idx * TEST_RECORDS;
+        workers[idx].id = idx;
+        workers[idx].errors = 0;
+        CU_ASSERT(pthread_create(&workers[idx].thread, NULL, test_worker, &workers[idx]) == 0);
+    }
+
+    for (int idx = 0; idx < TEST_THREADS; idx++) {
+        pthread_join(workers[idx].thread, NULL);
+        CU_ASSERT(workers[idx].errors == 0);
+    }
+
+    /** even indexes of every worker are left, in key order */
+    rbtree_t *tree = rbfc_tree(&fc);
+    rbtree_stats_t stats;
+    CU_ASSERT(rbtree_stats(tree, &stats) == RBTREE_OK);
+    CU_ASSERT(stats.count == TEST_THREADS * TEST_RECORDS / 2);
+
+    uint64_t expect = 0;
+    for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+        CU_ASSERT(test_record_of(node)->key == expect);
+
+        expect++;
+        if (expect % (2 * TEST_THREADS) == TEST_THREADS) {
+            expect += TEST_THREADS;
+        }
+    }
+
+    const rbfc_stats_t *fc_stats = rbfc_stats(&fc);
+    CU_ASSERT(fc_stats->ops == TEST_THREADS * TEST_RECORDS * 5 / 2);
+    CU_ASSERT(fc_stats->combines <= fc_stats->ops);
+    CU_ASSERT(fc_stats->max_batch <= TEST_THREADS);
+
+    rbfc_destroy(&fc);
+    free(records);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbfc[] = {
+    { "test_ops",     test_ops     },
+    { "test_threads", test_threads },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbfc",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbfc,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,242 @@
+/**
+ * file name: rbtree_hmap.c
+ *
+ * hash indexed rbtree implemention
+ *
+ * hash table is linear probing with the full hash kept in every slot,
+ * so probing and growing only touch the table, not the records.
+ * delete shifts the following entries back instead of leaving tombstones.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rbtree_hmap.h"
+
+
+#define RBHMAP_MIN_SLOTS 16
+
+/** grow when more than 7/8 of slots are used */
+#define rbhmap_is_full(map, count) ((count) * 8 > ((map)->mask + 1) * 7)
+
+
+static size_t
+rbhmap_slots_for(size_t capacity)
+{
+    size_t slots = RBHMAP_MIN_SLOTS;
+
+    while (capacity * 8 > slots * 7) {
+        slots *= 2;
+    }
+
+    return slots;
+}
+
+
+/** slot holding `key`, or the empty slot ending its probe sequence */
+static size_t
+rbhmap_probe(rbhmap_t *map, const void *key, uint64_t hash)
+{
+    size_t idx = hash & map->mask;
+
+    while (map->slots[idx].node != NULL) {
+        if (map->slots[idx].hash == hash &&
+            map->key_compare(key, map->slots[idx].node) == 0)
+        {
+            break;
+        }
+
+        idx = (idx + 1) & map->mask;
+    }
+
+    return idx;
+}
+
+
+static int
+rbhmap_grow(rbhmap_t *map)
+{
+    size_t count = (map->mask + 1) * 2;
+    rbhmap_slot_t *slots = calloc(count, sizeof(*slots));
+    rbtree_must(slots != NULL, RBTREE_NO_SPACE);
+
+    rbhmap_slot_t *old = map->slots;
+    size_t old_count = map->mask + 1;
+
+    map->slots = slots;
+    map->mask  = count - 1;
+
+    /** keys are unique, only an empty slot is needed */
+    for (size_t from = 0; from < old_count; from++) {
+        if (old[from].node == NULL) {
+            continue;
+        }
+
+        size_t idx = old[from].hash & map->mask;
+        while (slots[idx].node != NULL) {
+            idx = (idx + 1) & map->mask;
+        }
+
+        slots[idx] = old[from];
+    }
+
+    free(old);
+
+    return RBTREE_OK;
+}
+
+
+/** empty slot `idx` and move back entries probed past it */
+static void
+rbhmap_remove_slot(rbhmap_t *map, size_t idx)
+{
+    size_t next = (idx + 1) & map->mask;
+
+    while (map->slots[next].node != NULL) {
+        size_t home = map->slots[next].hash & map->mask;
+
+        /** entry may move if its home is not between the hole and itself */
+        if (((next - home) & map->mask) >= ((next - idx) & map->mask)) {
+            map->slots[idx] = map->slots[next];
+            idx = next;
+        }
+
+        next = (next + 1) & map->mask;
+    }
+
+    map->slots[idx].node = NULL;
+    map->slots[idx].hash = 0;
+}
+
+
+int
+rbhmap_init(rbhmap_t *map,
+            rbtree_compare compare,
+            rbtree_key_compare key_compare,
+            rbhmap_key key,
+            rbhmap_hash hash,
+            size_t capacity)
+{
+    rbtree_must(map != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(key_compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(key != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(hash != NULL, RBTREE_INVALID_ARG);
+
+    int ret = rbtree_init(&map->tree, compare);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    size_t count = rbhmap_slots_for(capacity);
+
+    map->slots = calloc(count, sizeof(*map->slots));
+    rbtree_must(map->slots != NULL, RBTREE_NO_SPACE);
+
+    map->mask        = count - 1;
+    map->hash        = hash;
+    map->key         = key;
+    map->key_compare = key_compare;
+
+    return RBTREE_OK;
+}
+
+
+void
+rbhmap_destroy(rbhmap_t *map)
+{
+    if (map == NULL) {
+        return;
+    }
+
+    free(map->slots);
+    map->slots = NULL;
+    map->mask  = 0;
+}
+
+
+int
+rbhmap_insert(rbhmap_t *map, rbtree_node_t *node, rbtree_node_t **ret)
+{
+    rbtree_must(map != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    const void *key = map->key(node);
+    uint64_t hash = map->hash(key);
+
+    size_t idx = rbhmap_probe(map, key, hash);
+    if (map->slots[idx].node != NULL) {
+        if (ret != NULL) {
+            *ret = map->slots[idx].node;
+        }
+
+        return RBTREE_DUPLICATE;
+    }
+
+    /** grow first, a failed insert leaves both sides untouched */
+    if (rbhmap_is_full(map, rbhmap_size(map) + 1)) {
+        int err = rbhmap_grow(map);
+        rbtree_must(err == RBTREE_OK, err);
+
+        idx = rbhmap_probe(map, key, hash);
+    }
+
+    int err = rbtree_insert(&map->tree, node);
+    rbtree_must(err == RBTREE_OK, err);
+
+    map->slots[idx].hash = hash;
+    map->slots[idx].node = node;
+
+    if (ret != NULL) {
+        *ret = node;
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbhmap_delete(rbhmap_t *map, rbtree_node_t *node)
+{
+    rbtree_must(map != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    const void *key = map->key(node);
+    size_t idx = rbhmap_probe(map, key, map->hash(key));
+
+    rbtree_must(map->slots[idx].node == node, RBTREE_NOT_FOUND);
+
+    int ret = rbtree_delete(&map->tree, node);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbhmap_remove_slot(map, idx);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbhmap_find(rbhmap_t *map, const void *key, rbtree_node_t **ret)
+{
+    rbtree_must(map != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    size_t idx = rbhmap_probe(map, key, map->hash(key));
+    rbtree_must(map->slots[idx].node != NULL, RBTREE_NOT_FOUND);
+
+    *ret = map->slots[idx].node;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbhmap_search_key(rbhmap_t *map,
+                  const void *key,
+                  rbtree_search_mode_t mode,
+                  rbtree_node_t **ret)
+{
+    rbtree_must(map != NULL, RBTREE_INVALID_ARG);
+
+    if (mode == RBTREE_SEARCH_MODE_EQ) {
+        return rbhmap_find(map, key, ret);
+    }
+
+    return rbtree_search_key(&map->tree, key, map->key_compare, mode, ret);
+}
@@ -0,0 +1,109 @@
+/**
+ * file name: rbtree_hmap.h
+ *
+ * head file of hash indexed rbtree
+ *
+ * an ordered map over intrusive records: the records are linked in a
+ * rbtree_t for ordered and range access, and an open addressing hash
+ * table points at the same records for exact match lookups.
+ * keys are unique, insert and delete keep both sides consistent.
+ *
+ * ordered access goes through rbhmap_tree(), which must only be read,
+ * never changed directly.
+ */
+#ifndef __RB_TREE_HMAP_H__
+#define __RB_TREE_HMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+/** hash of a search key */
+typedef uint64_t (*rbhmap_hash)(const void *key);
+
+/** search key of a node, passed to rbhmap_hash and the key compare */
+typedef const void *(*rbhmap_key)(rbtree_node_t *node);
+
+/** one slot of hash table, empty if node is NULL */
+typedef struct rbhmap_slot_s rbhmap_slot_t;
+struct rbhmap_slot_s {
+    uint64_t hash;
+    rbtree_node_t *node;
+};
+
+typedef struct rbhmap_s rbhmap_t;
+struct rbhmap_s {
+    rbtree_t tree;
+    rbhmap_slot_t *slots;
+    /** slot count - 1, slot count is a power of 2 */
+    size_t mask;
+    rbhmap_hash hash;
+    rbhmap_key key;
+    rbtree_key_compare key_compare;
+};
+
+
+/** `capacity` is a hint of node count, table grows as needed */
+int
+rbhmap_init(rbhmap_t *map,
+            rbtree_compare compare,
+            rbtree_key_compare key_compare,
+            rbhmap_key key,
+            rbhmap_hash hash,
+            size_t capacity);
+
+/** frees the hash table, nodes belong to the caller */
+void
+rbhmap_destroy(rbhmap_t *map);
+
+/** RBTREE_DUPLICATE with `*ret` set if key is there, `ret` may be NULL */
+int
+rbhmap_insert(rbhmap_t *map, rbtree_node_t *node, rbtree_node_t **ret);
+
+/** node must be in map */
+int
+rbhmap_delete(rbhmap_t *map, rbtree_node_t *node);
+
+/** exact match through hash table, no tree descent */
+int
+rbhmap_find(rbhmap_t *map, const void *key, rbtree_node_t **ret);
+
+/** RBTREE_SEARCH_MODE_EQ is a hash lookup, other modes descend the tree */
+int
+rbhmap_search_key(rbhmap_t *map,
+                  const void *key,
+                  rbtree_search_mode_t mode,
+                  rbtree_node_t **ret);
+
+
+static inline rbtree_t *
+rbhmap_tree(rbhmap_t *map)
+{
+    return &map->tree;
+}
+
+
+static inline size_t
+rbhmap_size(rbhmap_t *map)
+{
+    return rbtree_size(&map->tree);
+}
+
+
+/** a 64 bit finalizer, for keys that are integers already */
+static inline uint64_t
+rbhmap_mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+
+    return x;
+}
+
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_hmap.c"
+
+typedef struct test_node_s test_node_t;
+struct test_node_s {
+    uint64_t key;
+    rbtree_node_t rbnode;
+};
+
+#define rbhmap_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static int
+test_node_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = rbhmap_owner(na, test_node_t, rbnode)->key;
+    uint64_t bkey = rbhmap_owner(nb, test_node_t, rbnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = rbhmap_owner(node, test_node_t, rbnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static const void *
+test_node_key(rbtree_node_t *node)
+{
+    return &rbhmap_owner(node, test_node_t, rbnode)->key;
+}
+
+
+static uint64_t
+test_hash(const void *key)
+{
+    return rbhmap_mix64(*(const uint64_t *)key);
+}
+
+
+/** long clusters that wrap around the end of table */
+static uint64_t
+test_weak_hash(const void *key)
+{
+    return (*(const uint64_t *)key % 4) + UINT64_MAX - 2;
+}
+
+
+/** every entry is reachable from its home slot */
+static void
+test_is_rbhmap(rbhmap_t *map)
+{
+    size_t count = 0;
+
+    for (size_t idx = 0; idx <= map->mask; idx++) {
+        rbhmap_slot_t *slot = &map->slots[idx];
+        if (slot->node == NULL) {
+            continue;
+        }
+
+        count++;
+        CU_ASSERT(slot->hash == map->hash(map->key(slot->node)));
+
+        for (size_t probe = slot->hash & map->mask; probe != idx; probe = (probe + 1) & map->mask) {
+            CU_ASSERT(map->slots[probe].node != NULL);
+        }
+    }
+
+    CU_ASSERT(count == rbhmap_size(map));
+    CU_ASSERT(!rbhmap_is_full(map, count));
+}
+
+
+static void
+test_init(void)
+{
+    rbhmap_t map;
+
+    CU_ASSERT(rbhmap_init(NULL, test_node_compare, test_key_compare, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbhmap_init(&map, NULL, test_key_compare, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbhmap_init(&map, test_node_compare, NULL, test_node_key, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbhmap_init(&map, test_node_compare, test_key_compare, NULL, test_hash, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, NULL, 0) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, test_hash, 0) == RBTREE_OK);
+    CU_ASSERT(map.mask + 1 == RBHMAP_MIN_SLOTS);
+    rbhmap_destroy(&map);
+
+    /** sized up front for the hint */
+    CU_ASSERT(rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, test_hash, 1000) == RBTREE_OK);
+    CU_ASSERT(map.mask + 1 == 2048);
+    rbhmap_destroy(&map);
+    CU_ASSERT(map.slots == NULL);
+}
+
+
+static void
+test_insert_delete(void)
+{
+    rbhmap_t map;
+    rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, test_hash, 0);
+
+    test_node_t a = { .key = 1, };
+    test_node_t b = { .key = 1, };
+    rbtree_node_t *ret = NULL;
+
+    CU_ASSERT(rbhmap_insert(&map, NULL, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbhmap_insert(&map, &a.rbnode, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &a.rbnode);
+
+    /** keys are unique */
+    CU_ASSERT(rbhmap_insert(&map, &b.rbnode, &ret) == RBTREE_DUPLICATE);
+    CU_ASSERT(ret == &a.rbnode);
+    CU_ASSERT(rbhmap_size(&map) == 1);
+
+    /** a node with the same key which is not in map */
+    CU_ASSERT(rbhmap_delete(&map, &b.rbnode) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbhmap_delete(&map, &a.rbnode) == RBTREE_OK);
+    CU_ASSERT(rbhmap_delete(&map, &a.rbnode) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbhmap_size(&map) == 0);
+
+    uint64_t key = 1;
+    CU_ASSERT(rbhmap_find(&map, &key, &ret) == RBTREE_NOT_FOUND);
+
+    rbhmap_destroy(&map);
+}
+
+
+static void
+do_test_random(rbhmap_hash hash)
+{
+    rbhmap_t map;
+    rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, hash, 0);
+
+    enum { NODES = 1024 };
+    static test_node_t nodes[NODES];
+    static int in_map[NODES];
+    memset(in_map, 0, sizeof(in_map));
+
+    srand(20171005);
+
+    size_t count = 0;
+    for (int round = 0; round < 8 * NODES; round++) {
+        int idx = rand() % NODES;
+        rbtree_node_t *ret = NULL;
+
+        if (in_map[idx]) {
+            CU_ASSERT(rbhmap_delete(&map, &nodes[idx].rbnode) == RBTREE_OK);
+            CU_ASSERT(rbhmap_find(&map, &nodes[idx].key, &ret) == RBTREE_NOT_FOUND);
+            in_map[idx] = 0;
+            count--;
+        }
+        else {
+            nodes[idx].key = (uint64_t)idx * 3;
+            CU_ASSERT(rbhmap_insert(&map, &nodes[idx].rbnode, NULL) == RBTREE_OK);
+            in_map[idx] = 1;
+            count++;
+        }
+
+        CU_ASSERT(rbhmap_size(&map) == count);
+
+        if (round % 128 == 0) {
+            test_is_rbhmap(&map);
+        }
+    }
+
+    test_is_rbhmap(&map);
+
+    /** both sides agree */
+    for (int idx = 0; idx < NODES; idx++) {
+        rbtree_node_t *ret = NULL;
+        uint64_t key = (uint64_t)idx * 3;
+
+        if (in_map[idx]) {
+            CU_ASSERT(rbhmap_find(&map, &key, &ret) == RBTREE_OK);
+            CU_ASSERT(ret == &nodes[idx].rbnode);
+            CU_ASSERT(rbtree_search_key(rbhmap_tree(&map), &key, test_key_compare,
+                                        RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+            CU_ASSERT(ret == &nodes[idx].rbnode);
+        }
+        else {
+            CU_ASSERT(rbhmap_find(&map, &key, &ret) == RBTREE_NOT_FOUND);
+        }
+    }
+
+    rbhmap_destroy(&map);
+}
+
+
+static void
+test_random(void)
+{
+    do_test_random(test_hash);
+}
+
+
+static void
+test_collision(void)
+{
+    do_test_random(test_weak_hash);
+}
+
+
+static void
+test_search(void)
+{
+    rbhmap_t map;
+    rbhmap_init(&map, test_node_compare, test_key_compare, test_node_key, test_hash, 0);
+
+    /** keys 0, 2, 4, ..., 62 */
+    test_node_t nodes[32];
+    for (int idx = 0; idx < 32; idx++) {
+        nodes[idx].key = idx * 2;
+        rbhmap_insert(&map, &nodes[idx].rbnode, NULL);
+    }
+
+    rbtree_node_t *ret = NULL;
+    uint64_t key = 8;
+
+    CU_ASSERT(rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[4].rbnode);
+    CU_ASSERT(rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[3].rbnode);
+
+    key = 9;
+    CU_ASSERT(rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[5].rbnode);
+    CU_ASSERT(rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_MAX, &ret) == RBTREE_INVALID_ARG);
+
+    /** range scan through the tree */
+    key = 10;
+    int expect = 5;
+    rbhmap_search_key(&map, &key, RBTREE_SEARCH_MODE_GE, &ret);
+    for (rbtree_node_t *node = ret; node != NULL; node = rbtree_next(rbhmap_tree(&map), node)) {
+        CU_ASSERT(node == &nodes[expect].rbnode);
+        expect++;
+    }
+
+    CU_ASSERT(expect == 32);
+
+    rbhmap_destroy(&map);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbhmap[] = {
+    { "test_init",          test_init          },
+    { "test_insert_delete", test_insert_delete },
+    { "test_random",        test_random        },
+    { "test_collision",     test_collision     },
+    { "test_search",        test_search        },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbhmap",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbhmap,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
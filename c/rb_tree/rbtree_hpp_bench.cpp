@@ -0,0 +1,338 @@
+/**
+ * file name: rbtree_hpp_bench.cpp
+ *
+ * micro benchmark of rbtree.hpp against std::set and std::map
+ *
+ * usage: rbtree_hpp_bench [count]
+ *
+ * same workload as rbtree_bench: insert shuffled keys, look them up in
+ * another random order, scan in order and delete them all.
+ *
+ * intrusive trees link records of one preallocated array, std
+ * containers and pmr variants allocate a node per key, the pmr ones
+ * from an unsynchronized pool.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <vector>
+
+#include "rbtree.hpp"
+
+
+static uint64_t
+bench_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/** xorshift, same sequence as rbtree_bench */
+static uint64_t
+bench_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    return x;
+}
+
+
+static void
+bench_shuffle(std::vector<uint64_t> &keys, uint64_t seed)
+{
+    for (size_t idx = keys.size() - 1; idx > 0; idx--) {
+        size_t pick = bench_rand(&seed) % (idx + 1);
+        std::swap(keys[idx], keys[pick]);
+    }
+}
+
+
+struct bench_result {
+    const char *name;
+    size_t node_bytes;
+    uint64_t insert_ns;
+    uint64_t search_ns;
+    uint64_t scan_ns;
+    uint64_t delete_ns;
+};
+
+
+static void
+bench_report(const bench_result &result, size_t count, uint64_t check)
+{
+    double n = (double)count;
+
+    printf("%-12s %10zu %10.1f %10.1f %10.1f %10.1f\n",
+           result.name,
+           result.node_bytes,
+           result.insert_ns / n,
+           result.search_ns / n,
+           result.scan_ns / n,
+           result.delete_ns / n);
+
+    if (check != count) {
+        printf("%s: unexpected result\n", result.name);
+    }
+}
+
+
+struct bench_record {
+    uint64_t key;
+    rbtree_node_t node;
+
+    bench_record(uint64_t k = 0) : key(k) {}
+};
+
+struct bench_less {
+    using is_transparent = void;
+
+    bool operator()(const bench_record &a, const bench_record &b) const { return a.key < b.key; }
+    bool operator()(const bench_record &a, uint64_t b) const { return a.key < b; }
+    bool operator()(uint64_t a, const bench_record &b) const { return a < b.key; }
+};
+
+
+/** rbtree.c through its compare callback */
+
+static int
+bench_c_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = rb::rbtree<bench_record, &bench_record::node>::value_of(na)->key;
+    uint64_t bkey = rb::rbtree<bench_record, &bench_record::node>::value_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+bench_c_key_compare(const void *key, rbtree_node_t *node)
+{
+    uint64_t akey = *static_cast<const uint64_t *>(key);
+    uint64_t bkey = rb::rbtree<bench_record, &bench_record::node>::value_of(node)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+bench_c(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &probes)
+{
+    size_t count = keys.size();
+    std::vector<bench_record> records(keys.begin(), keys.end());
+    bench_result result = { "rbtree_t", sizeof(bench_record), 0, 0, 0, 0 };
+
+    rbtree_t tree;
+    rbtree_init(&tree, bench_c_compare);
+
+    uint64_t start = bench_now_ns();
+    for (bench_record &record : records) {
+        rbtree_insert(&tree, &record.node);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    uint64_t found = 0;
+    start = bench_now_ns();
+    for (uint64_t key : probes) {
+        rbtree_node_t *node = NULL;
+        found += rbtree_search_key(&tree, &key, bench_c_key_compare, RBTREE_SEARCH_MODE_EQ, &node) == RBTREE_OK;
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t scanned = 0;
+    start = bench_now_ns();
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        scanned++;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (bench_record &record : records) {
+        rbtree_delete(&tree, &record.node);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    bench_report(result, count, found == scanned ? found : 0);
+}
+
+
+/** rb::rbtree, same records, compare inlined */
+static void
+bench_hpp(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &probes)
+{
+    size_t count = keys.size();
+    std::vector<bench_record> records(keys.begin(), keys.end());
+    bench_result result = { "rb::rbtree", sizeof(bench_record), 0, 0, 0, 0 };
+
+    rb::rbtree<bench_record, &bench_record::node, bench_less> tree;
+
+    uint64_t start = bench_now_ns();
+    for (bench_record &record : records) {
+        tree.insert(record);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    uint64_t found = 0;
+    start = bench_now_ns();
+    for (uint64_t key : probes) {
+        found += tree.find(key) != tree.end();
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t scanned = 0;
+    start = bench_now_ns();
+    for (const bench_record &record : tree) {
+        scanned += record.key != 0;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (bench_record &record : records) {
+        tree.erase(tree.iterator_to(record));
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    bench_report(result, count, found == scanned ? found : 0);
+}
+
+
+/** rb::pmr_rbtree, records made in a pool */
+static void
+bench_hpp_pmr(const std::vector<uint64_t> &keys, const std::vector<uint64_t> &probes)
+{
+    size_t count = keys.size();
+    bench_result result = { "rb::pmr", sizeof(bench_record), 0, 0, 0, 0 };
+
+    std::pmr::unsynchronized_pool_resource pool;
+    rb::pmr_rbtree<bench_record, &bench_record::node, bench_less> tree(&pool);
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t key : keys) {
+        tree.emplace(key);
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    uint64_t found = 0;
+    start = bench_now_ns();
+    for (uint64_t key : probes) {
+        found += tree.find(key) != tree.end();
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t scanned = 0;
+    start = bench_now_ns();
+    for (const bench_record &record : tree) {
+        scanned += record.key != 0;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint64_t key : keys) {
+        tree.erase(tree.find(key));
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    bench_report(result, count, found == scanned ? found : 0);
+}
+
+
+/** std::set, std::map and their pmr forms share one body */
+template <typename Container>
+static void
+bench_std(const char *name, Container &tree, const std::vector<uint64_t> &keys,
+          const std::vector<uint64_t> &probes)
+{
+    size_t count = keys.size();
+
+    /** libstdc++ node is 32 bytes of links and color plus the value */
+    bench_result result = { name, 32 + sizeof(typename Container::value_type), 0, 0, 0, 0 };
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t key : keys) {
+        if constexpr (std::is_same_v<typename Container::value_type, uint64_t>) {
+            tree.insert(key);
+        }
+        else {
+            tree.emplace(key, key);
+        }
+    }
+    result.insert_ns = bench_now_ns() - start;
+
+    uint64_t found = 0;
+    start = bench_now_ns();
+    for (uint64_t key : probes) {
+        found += tree.find(key) != tree.end();
+    }
+    result.search_ns = bench_now_ns() - start;
+
+    uint64_t scanned = 0;
+    start = bench_now_ns();
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        scanned++;
+    }
+    result.scan_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint64_t key : keys) {
+        tree.erase(key);
+    }
+    result.delete_ns = bench_now_ns() - start;
+
+    bench_report(result, count, found == scanned ? found : 0);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    size_t count = 1000000;
+    if (argc > 1) {
+        count = strtoull(argv[1], NULL, 10);
+    }
+
+    if (count < 2) {
+        printf("usage: %s [count]\n", argv[0]);
+
+        return 1;
+    }
+
+    std::vector<uint64_t> keys(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        keys[idx] = idx * 2654435761u + 1;
+    }
+
+    std::vector<uint64_t> probes(keys);
+
+    bench_shuffle(keys, 0x9e3779b97f4a7c15ull);
+    bench_shuffle(probes, 0xc2b2ae3d27d4eb4full);
+
+    printf("count %zu, ns per op\n", count);
+    printf("%-12s %10s %10s %10s %10s %10s\n",
+           "variant", "node bytes", "insert", "search", "scan", "delete");
+
+    bench_c(keys, probes);
+    bench_hpp(keys, probes);
+
+    std::set<uint64_t> set;
+    bench_std("std::set", set, keys, probes);
+
+    std::map<uint64_t, uint64_t> map;
+    bench_std("std::map", map, keys, probes);
+
+    bench_hpp_pmr(keys, probes);
+
+    std::pmr::unsynchronized_pool_resource pool;
+    std::pmr::set<uint64_t> pmr_set(&pool);
+    bench_std("std::pmr", pmr_set, keys, probes);
+
+    return 0;
+}
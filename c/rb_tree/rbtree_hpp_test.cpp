@@ -0,0 +1,349 @@
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <iterator>
+#include <memory_resource>
+#include <set>
+#include <vector>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree.hpp"
+
+
+struct test_item {
+    int key;
+    int seq;
+    rbtree_node_t node;
+
+    test_item(int k = 0, int s = 0) : key(k), seq(s) {}
+};
+
+/** transparent, so an int looks up too */
+struct test_less {
+    using is_transparent = void;
+
+    bool operator()(const test_item &a, const test_item &b) const { return a.key < b.key; }
+    bool operator()(const test_item &a, int b) const { return a.key < b; }
+    bool operator()(int a, const test_item &b) const { return a < b.key; }
+};
+
+using test_tree = rb::rbtree<test_item, &test_item::node, test_less>;
+
+
+/** same content and order as a std::multiset of (key, seq) */
+static void
+test_same(const test_tree &tree, const std::multiset<std::pair<int, int>> &expect)
+{
+    CU_ASSERT(tree.size() == expect.size());
+
+    auto it = expect.begin();
+    for (const test_item &item : tree) {
+        CU_ASSERT(it != expect.end() && item.key == it->first && item.seq == it->second);
+        ++it;
+    }
+
+    CU_ASSERT(it == expect.end());
+}
+
+
+static void
+test_insert_erase(void)
+{
+    enum { ITEMS = 2000 };
+    static test_item items[ITEMS];
+
+    test_tree tree;
+    std::multiset<std::pair<int, int>> expect;
+
+    CU_ASSERT(tree.empty());
+    CU_ASSERT(tree.begin() == tree.end());
+
+    srand(20171014);
+
+    /** duplicates go before equal ones, so a falling seq keeps them sorted */
+    for (int idx = 0; idx < ITEMS; idx++) {
+        items[idx] = test_item(rand() % 500, -idx);
+
+        auto it = tree.insert(items[idx]);
+        CU_ASSERT(&*it == &items[idx]);
+        expect.insert({ items[idx].key, -idx });
+    }
+
+    test_same(tree, expect);
+
+    for (int idx = 0; idx < ITEMS; idx += 3) {
+        auto next = tree.erase(tree.iterator_to(items[idx]));
+        expect.erase({ items[idx].key, -idx });
+
+        auto want = expect.upper_bound({ items[idx].key, -idx });
+        CU_ASSERT(want == expect.end() ? next == tree.end() : next->seq == want->second);
+    }
+
+    test_same(tree, expect);
+
+    /** still a valid C tree */
+    rbtree_stats_t stats;
+    CU_ASSERT(rbtree_stats(tree.native(), &stats) == RBTREE_OK);
+    CU_ASSERT(stats.count == tree.size());
+    CU_ASSERT(stats.height <= 2 * 11);
+
+    /** erase by key takes all equal ones */
+    int key = items[1].key;
+    size_t count = 0;
+    for (auto &pair : expect) {
+        count += pair.first == key;
+    }
+
+    CU_ASSERT(tree.count(key) == count);
+    CU_ASSERT(tree.erase(key) == count);
+    CU_ASSERT(tree.count(key) == 0);
+    CU_ASSERT(!tree.contains(key));
+
+    /** a range */
+    auto first = tree.lower_bound(100);
+    auto last  = tree.lower_bound(200);
+    size_t before = tree.size();
+    size_t span = std::distance(first, last);
+
+    CU_ASSERT(tree.erase(first, last) == last);
+    CU_ASSERT(tree.size() == before - span);
+    CU_ASSERT(tree.lower_bound(100) == last);
+
+    /** C and C++ inserts agree on where an equal value goes */
+    test_item mixed[3] = { test_item(1000, 0), test_item(1000, 1), test_item(1000, 2) };
+    tree.insert(mixed[0]);
+    CU_ASSERT(rbtree_insert(tree.native(), &mixed[1].node) == RBTREE_OK);
+    tree.insert(mixed[2]);
+
+    auto same = tree.lower_bound(1000);
+    CU_ASSERT(same->seq == 2 && std::next(same)->seq == 1 && std::next(same, 2)->seq == 0);
+
+    tree.clear();
+    CU_ASSERT(tree.empty());
+}
+
+
+static void
+test_unique(void)
+{
+    test_tree tree;
+    test_item items[] = { { 5, 0 }, { 3, 1 }, { 5, 2 }, { 8, 3 }, { 3, 4 } };
+
+    int inserted = 0;
+    for (test_item &item : items) {
+        auto ret = tree.insert_unique(item);
+        inserted += ret.second;
+
+        CU_ASSERT(ret.first->key == item.key);
+        CU_ASSERT(ret.second == (&*ret.first == &item));
+    }
+
+    CU_ASSERT(inserted == 3);
+    CU_ASSERT(tree.size() == 3);
+    CU_ASSERT(tree.find(5)->seq == 0);
+    CU_ASSERT(tree.find(3)->seq == 1);
+    CU_ASSERT(tree.find(4) == tree.end());
+}
+
+
+static void
+test_bounds(void)
+{
+    test_tree tree;
+    std::vector<test_item> items;
+    items.reserve(100);
+
+    /** the later of equal items goes first */
+    for (int key = 0; key < 100; key += 2) {
+        items.emplace_back(key, 1);
+        items.emplace_back(key, 0);
+    }
+
+    for (test_item &item : items) {
+        tree.insert(item);
+    }
+
+    const test_tree &ctree = tree;
+
+    CU_ASSERT(ctree.lower_bound(10)->key == 10 && ctree.lower_bound(10)->seq == 0);
+    CU_ASSERT(ctree.lower_bound(11)->key == 12);
+    CU_ASSERT(ctree.upper_bound(10)->key == 12);
+    CU_ASSERT(ctree.lower_bound(-5) == ctree.begin());
+    CU_ASSERT(ctree.upper_bound(98) == ctree.end());
+    CU_ASSERT(ctree.lower_bound(test_item(20)) == ctree.lower_bound(20));
+
+    auto range = ctree.equal_range(40);
+    CU_ASSERT(std::distance(range.first, range.second) == 2);
+    CU_ASSERT(range.first->seq == 0 && std::next(range.first)->seq == 1);
+
+    range = ctree.equal_range(41);
+    CU_ASSERT(range.first == range.second && range.first->key == 42);
+
+    /** backwards, from end() */
+    test_tree::const_iterator it = ctree.end();
+    --it;
+    CU_ASSERT(it->key == 98 && it->seq == 1);
+
+    int seen = 0;
+    for (auto rit = ctree.rbegin(); rit != ctree.rend(); ++rit) {
+        CU_ASSERT(rit->key == 98 - seen / 2 * 2);
+        seen++;
+    }
+
+    CU_ASSERT(seen == 100);
+
+    /** iterator to const_iterator, and both compare */
+    test_tree::iterator mit = tree.find(50);
+    test_tree::const_iterator cit = mit;
+    CU_ASSERT(cit == mit);
+    CU_ASSERT(std::prev(std::next(cit)) == cit);
+
+    /** C calls go through the wrapped compare */
+    test_item lo(10), hi(20);
+    CU_ASSERT(rbtree_delete_range(tree.native(), &lo.node, &hi.node, NULL, NULL) == RBTREE_OK);
+    CU_ASSERT(tree.size() == 90);
+    CU_ASSERT(tree.lower_bound(10)->key == 20);
+}
+
+
+/** counts what goes through it */
+class test_resource : public std::pmr::memory_resource {
+public:
+    size_t live = 0;
+    size_t total = 0;
+
+private:
+    void *
+    do_allocate(size_t bytes, size_t align) override
+    {
+        live++;
+        total++;
+
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void
+    do_deallocate(void *ptr, size_t bytes, size_t align) override
+    {
+        live--;
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, align);
+    }
+
+    bool
+    do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+
+static void
+test_pmr(void)
+{
+    test_resource resource;
+
+    {
+        rb::pmr_rbtree<test_item, &test_item::node, test_less> tree(&resource);
+
+        for (int key = 0; key < 100; key++) {
+            CU_ASSERT(tree.emplace(key, 0)->key == key);
+        }
+
+        CU_ASSERT(resource.live == 100);
+
+        /** a refused duplicate is given back at once */
+        auto ret = tree.emplace_unique(7, 1);
+        CU_ASSERT(!ret.second && ret.first->seq == 0);
+        CU_ASSERT(resource.live == 100 && resource.total == 101);
+
+        CU_ASSERT(tree.emplace_unique(100, 1).second);
+        CU_ASSERT(resource.live == 101);
+
+        CU_ASSERT(tree.erase(tree.find(50))->key == 51);
+        CU_ASSERT(tree.erase(10) == 1);
+        tree.erase(tree.lower_bound(60), tree.lower_bound(70));
+        CU_ASSERT(tree.size() == 89);
+        CU_ASSERT(resource.live == 89);
+
+        tree.clear();
+        CU_ASSERT(resource.live == 0);
+
+        tree.emplace(1, 0);
+        tree.emplace(2, 0);
+    }
+
+    /** destructor frees the rest */
+    CU_ASSERT(resource.live == 0);
+
+    /** a pool shared with a std::pmr container */
+    std::pmr::unsynchronized_pool_resource pool(&resource);
+    {
+        rb::pmr_rbtree<test_item, &test_item::node, test_less> tree(&pool);
+        std::pmr::vector<int> keys(&pool);
+
+        for (int key = 0; key < 1000; key++) {
+            tree.emplace(key, 0);
+            keys.push_back(key);
+        }
+
+        CU_ASSERT(std::equal(keys.begin(), keys.end(), tree.begin(),
+                             [](int key, const test_item &item) { return key == item.key; }));
+    }
+
+    pool.release();
+    CU_ASSERT(resource.live == 0);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbtree_hpp[] = {
+    { "test_insert_erase", test_insert_erase },
+    { "test_unique",       test_unique       },
+    { "test_bounds",       test_bounds       },
+    { "test_pmr",          test_pmr          },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbtree_hpp",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_hpp,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
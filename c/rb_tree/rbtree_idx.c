@@ -0,0 +1,685 @@
+/**
+ * file name: rbtree_idx.c
+ *
+ * index based rbtree implemention
+ *
+ * same algorithms as rbtree.c, with slot 0 playing the sentinel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_idx.h"
+
+
+#define rbidx_left(tree, idx)   (rbidx_node((tree), (idx))->left)
+#define rbidx_right(tree, idx)  (rbidx_node((tree), (idx))->right)
+#define rbidx_parent(tree, idx) (rbidx_node((tree), (idx))->parent)
+#define rbidx_color(tree, idx)  (rbidx_node((tree), (idx))->color)
+
+#define rbidx_is_red(tree, idx)   (rbidx_color((tree), (idx)) == RBTREE_RED)
+#define rbidx_is_black(tree, idx) (!rbidx_is_red((tree), (idx)))
+
+
+/** records are 8 bytes aligned so payload may hold any scalar */
+static inline size_t
+rbidx_align_record(size_t record_size)
+{
+    return (record_size + 7) & ~(size_t)7;
+}
+
+
+size_t
+rbidx_buffer_bytes(size_t record_size, uint32_t capacity)
+{
+    return sizeof(rbidx_header_t) + (size_t)capacity * rbidx_align_record(record_size);
+}
+
+
+static void
+rbidx_init_header(rbidx_header_t *header, size_t record_size, uint32_t capacity)
+{
+    memset(header, 0, sizeof(*header));
+
+    header->magic       = RBIDX_MAGIC;
+    header->record_size = (uint32_t)rbidx_align_record(record_size);
+    header->capacity    = capacity;
+    header->used        = 1;
+    header->root        = RBIDX_SENTINEL;
+    header->free_head   = RBIDX_SENTINEL;
+    header->size        = 0;
+
+    /** sentinel is black and links to itself */
+    rbidx_node_t *sentinel = (rbidx_node_t *)(header + 1);
+    memset(sentinel, 0, header->record_size);
+    sentinel->color = RBTREE_BLACK;
+}
+
+
+int
+rbidx_init(rbidx_tree_t *tree,
+           size_t record_size,
+           uint32_t capacity,
+           rbidx_compare compare)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(record_size >= sizeof(rbidx_node_t), RBTREE_INVALID_ARG);
+    rbtree_must(record_size <= UINT32_MAX / 2, RBTREE_INVALID_ARG);
+
+    /** at least sentinel and one record */
+    capacity = capacity < 2 ? 2 : capacity;
+
+    rbidx_header_t *header = malloc(rbidx_buffer_bytes(record_size, capacity));
+    if (header == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    rbidx_init_header(header, record_size, capacity);
+
+    tree->header   = header;
+    tree->compare  = compare;
+    tree->growable = 1;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbidx_init_buffer(rbidx_tree_t *tree,
+                  void *buffer,
+                  size_t buffer_bytes,
+                  size_t record_size,
+                  rbidx_compare compare)
+{
+    rbtree_must(tree != NULL && buffer != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(record_size >= sizeof(rbidx_node_t), RBTREE_INVALID_ARG);
+    rbtree_must(record_size <= UINT32_MAX / 2, RBTREE_INVALID_ARG);
+    rbtree_must(((uintptr_t)buffer & 7) == 0, RBTREE_INVALID_ARG);
+
+    if (buffer_bytes < rbidx_buffer_bytes(record_size, 2)) {
+        return RBTREE_NO_SPACE;
+    }
+
+    size_t capacity = (buffer_bytes - sizeof(rbidx_header_t)) / rbidx_align_record(record_size);
+    capacity = capacity > UINT32_MAX ? UINT32_MAX : capacity;
+
+    rbidx_init_header(buffer, record_size, (uint32_t)capacity);
+
+    tree->header   = buffer;
+    tree->compare  = compare;
+    tree->growable = 0;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbidx_attach(rbidx_tree_t *tree,
+             void *buffer,
+             size_t buffer_bytes,
+             rbidx_compare compare)
+{
+    rbtree_must(tree != NULL && buffer != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(((uintptr_t)buffer & 7) == 0, RBTREE_INVALID_ARG);
+    rbtree_must(buffer_bytes >= sizeof(rbidx_header_t), RBTREE_INVALID_ARG);
+
+    /** header comes from outside, trust nothing it says about the layout */
+    rbidx_header_t *header = buffer;
+    rbtree_must(header->magic == RBIDX_MAGIC, RBTREE_INVALID_ARG);
+    rbtree_must(header->record_size >= sizeof(rbidx_node_t), RBTREE_INVALID_ARG);
+    rbtree_must(header->record_size <= UINT32_MAX / 2, RBTREE_INVALID_ARG);
+    rbtree_must(header->capacity >= 2, RBTREE_INVALID_ARG);
+    rbtree_must(rbidx_buffer_bytes(header->record_size, header->capacity) <= buffer_bytes,
+                RBTREE_INVALID_ARG);
+    rbtree_must(header->used <= header->capacity, RBTREE_INVALID_ARG);
+
+    tree->header   = header;
+    tree->compare  = compare;
+    tree->growable = 0;
+
+    return RBTREE_OK;
+}
+
+
+void
+rbidx_destroy(rbidx_tree_t *tree)
+{
+    if (tree == NULL) {
+        return;
+    }
+
+    if (tree->growable) {
+        free(tree->header);
+    }
+
+    tree->header = NULL;
+}
+
+
+static int
+rbidx_grow(rbidx_tree_t *tree)
+{
+    rbidx_header_t *header = tree->header;
+
+    if (!tree->growable || header->capacity == UINT32_MAX) {
+        return RBTREE_NO_SPACE;
+    }
+
+    uint64_t capacity = (uint64_t)header->capacity * 2;
+    capacity = capacity > UINT32_MAX ? UINT32_MAX : capacity;
+
+    header = realloc(header, rbidx_buffer_bytes(header->record_size, (uint32_t)capacity));
+    if (header == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    header->capacity = (uint32_t)capacity;
+    tree->header = header;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbidx_alloc(rbidx_tree_t *tree, uint32_t *idx)
+{
+    rbtree_must(tree != NULL && tree->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(idx != NULL, RBTREE_INVALID_ARG);
+
+    rbidx_header_t *header = tree->header;
+
+    if (header->free_head != RBIDX_SENTINEL) {
+        *idx = header->free_head;
+        header->free_head = rbidx_left(tree, *idx);
+    }
+    else {
+        if (header->used == header->capacity) {
+            int ret = rbidx_grow(tree);
+            if (ret != RBTREE_OK) {
+                return ret;
+            }
+
+            header = tree->header;
+        }
+
+        *idx = header->used++;
+    }
+
+    memset(rbidx_record(tree, *idx), 0, header->record_size);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbidx_free(rbidx_tree_t *tree, uint32_t idx)
+{
+    rbtree_must(tree != NULL && tree->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(idx != RBIDX_SENTINEL && idx < tree->header->used, RBTREE_INVALID_ARG);
+
+    rbidx_left(tree, idx) = tree->header->free_head;
+    tree->header->free_head = idx;
+
+    return RBTREE_OK;
+}
+
+
+static void
+rbidx_left_rotate(rbidx_tree_t *tree, uint32_t node)
+{
+    uint32_t rchild = rbidx_right(tree, node);
+
+    rbidx_right(tree, node) = rbidx_left(tree, rchild);
+    if (rbidx_left(tree, rchild) != RBIDX_SENTINEL) {
+        rbidx_parent(tree, rbidx_left(tree, rchild)) = node;
+    }
+
+    uint32_t parent = rbidx_parent(tree, node);
+    rbidx_parent(tree, rchild) = parent;
+
+    if (parent == RBIDX_SENTINEL) {
+        tree->header->root = rchild;
+    }
+    else if (rbidx_left(tree, parent) == node) {
+        rbidx_left(tree, parent) = rchild;
+    }
+    else {
+        rbidx_right(tree, parent) = rchild;
+    }
+
+    rbidx_left(tree, rchild) = node;
+    rbidx_parent(tree, node) = rchild;
+}
+
+
+static void
+rbidx_right_rotate(rbidx_tree_t *tree, uint32_t node)
+{
+    uint32_t lchild = rbidx_left(tree, node);
+
+    rbidx_left(tree, node) = rbidx_right(tree, lchild);
+    if (rbidx_right(tree, lchild) != RBIDX_SENTINEL) {
+        rbidx_parent(tree, rbidx_right(tree, lchild)) = node;
+    }
+
+    uint32_t parent = rbidx_parent(tree, node);
+    rbidx_parent(tree, lchild) = parent;
+
+    if (parent == RBIDX_SENTINEL) {
+        tree->header->root = lchild;
+    }
+    else if (rbidx_left(tree, parent) == node) {
+        rbidx_left(tree, parent) = lchild;
+    }
+    else {
+        rbidx_right(tree, parent) = lchild;
+    }
+
+    rbidx_right(tree, lchild) = node;
+    rbidx_parent(tree, node) = lchild;
+}
+
+
+static void
+rbidx_insert_fixup(rbidx_tree_t *tree, uint32_t node)
+{
+    while (rbidx_is_red(tree, rbidx_parent(tree, node))) {
+        uint32_t parent = rbidx_parent(tree, node);
+        uint32_t grand  = rbidx_parent(tree, parent);
+
+        if (parent == rbidx_left(tree, grand)) {
+            uint32_t uncle = rbidx_right(tree, grand);
+
+            if (rbidx_is_red(tree, uncle)) {
+                /** case 1: uncle is red */
+                rbidx_color(tree, uncle)  = RBTREE_BLACK;
+                rbidx_color(tree, parent) = RBTREE_BLACK;
+                rbidx_color(tree, grand)  = RBTREE_RED;
+
+                node = grand;
+            }
+            else {
+                /** case 2: uncle is black and node is right child */
+                if (node == rbidx_right(tree, parent)) {
+                    node = parent;
+                    rbidx_left_rotate(tree, node);
+                    parent = rbidx_parent(tree, node);
+                }
+
+                /** case 3: uncle is black and node is left child */
+                rbidx_color(tree, parent) = RBTREE_BLACK;
+                rbidx_color(tree, grand)  = RBTREE_RED;
+                rbidx_right_rotate(tree, grand);
+            }
+        }
+        else {
+            /** exchange left and right */
+            uint32_t uncle = rbidx_left(tree, grand);
+
+            if (rbidx_is_red(tree, uncle)) {
+                rbidx_color(tree, uncle)  = RBTREE_BLACK;
+                rbidx_color(tree, parent) = RBTREE_BLACK;
+                rbidx_color(tree, grand)  = RBTREE_RED;
+
+                node = grand;
+            }
+            else {
+                if (node == rbidx_left(tree, parent)) {
+                    node = parent;
+                    rbidx_right_rotate(tree, node);
+                    parent = rbidx_parent(tree, node);
+                }
+
+                rbidx_color(tree, parent) = RBTREE_BLACK;
+                rbidx_color(tree, grand)  = RBTREE_RED;
+                rbidx_left_rotate(tree, grand);
+            }
+        }
+    }
+
+    rbidx_color(tree, tree->header->root) = RBTREE_BLACK;
+}
+
+
+int
+rbidx_insert(rbidx_tree_t *tree, uint32_t idx)
+{
+    rbtree_must(tree != NULL && tree->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(idx != RBIDX_SENTINEL && idx < tree->header->used, RBTREE_INVALID_ARG);
+
+    void *record = rbidx_record(tree, idx);
+
+    uint32_t parent   = RBIDX_SENTINEL;
+    uint32_t traverse = tree->header->root;
+    int is_left = 0;
+
+    while (traverse != RBIDX_SENTINEL) {
+        parent  = traverse;
+        is_left = tree->compare(record, rbidx_record(tree, traverse)) <= 0;
+
+        traverse = is_left ? rbidx_left(tree, traverse) : rbidx_right(tree, traverse);
+    }
+
+    rbidx_node_t *node = rbidx_node(tree, idx);
+    node->left   = RBIDX_SENTINEL;
+    node->right  = RBIDX_SENTINEL;
+    node->parent = parent;
+    node->color  = RBTREE_RED;
+
+    if (parent == RBIDX_SENTINEL) {
+        /** empty tree */
+        tree->header->root = idx;
+    }
+    else if (is_left) {
+        rbidx_left(tree, parent) = idx;
+    }
+    else {
+        rbidx_right(tree, parent) = idx;
+    }
+
+    tree->header->size++;
+    rbidx_insert_fixup(tree, idx);
+
+    return RBTREE_OK;
+}
+
+
+static uint32_t
+rbidx_minimum(rbidx_tree_t *tree, uint32_t node)
+{
+    while (rbidx_left(tree, node) != RBIDX_SENTINEL) {
+        node = rbidx_left(tree, node);
+    }
+
+    return node;
+}
+
+
+static uint32_t
+rbidx_maximum(rbidx_tree_t *tree, uint32_t node)
+{
+    while (rbidx_right(tree, node) != RBIDX_SENTINEL) {
+        node = rbidx_right(tree, node);
+    }
+
+    return node;
+}
+
+
+/** put sub-tree `replace` at the position of `node` */
+static void
+rbidx_transplant(rbidx_tree_t *tree, uint32_t node, uint32_t replace)
+{
+    uint32_t parent = rbidx_parent(tree, node);
+
+    if (parent == RBIDX_SENTINEL) {
+        tree->header->root = replace;
+    }
+    else if (node == rbidx_left(tree, parent)) {
+        rbidx_left(tree, parent) = replace;
+    }
+    else {
+        rbidx_right(tree, parent) = replace;
+    }
+
+    /** written even for sentinel, delete fixup starts from there */
+    rbidx_parent(tree, replace) = parent;
+}
+
+
+static void
+rbidx_delete_fixup(rbidx_tree_t *tree, uint32_t node)
+{
+    while (node != tree->header->root && rbidx_is_black(tree, node)) {
+        uint32_t parent = rbidx_parent(tree, node);
+
+        if (node == rbidx_left(tree, parent)) {
+            uint32_t brother = rbidx_right(tree, parent);
+
+            /** case 1: brother is red */
+            if (rbidx_is_red(tree, brother)) {
+                rbidx_color(tree, brother) = RBTREE_BLACK;
+                rbidx_color(tree, parent)  = RBTREE_RED;
+                rbidx_left_rotate(tree, parent);
+
+                brother = rbidx_right(tree, parent);
+            }
+
+            if (rbidx_is_black(tree, rbidx_left(tree, brother)) &&
+                rbidx_is_black(tree, rbidx_right(tree, brother)))
+            {
+                /** case 2: both children of brother are black */
+                rbidx_color(tree, brother) = RBTREE_RED;
+                node = parent;
+            }
+            else {
+                if (rbidx_is_black(tree, rbidx_right(tree, brother))) {
+                    /** case 3: left child of brother is red */
+                    rbidx_color(tree, rbidx_left(tree, brother)) = RBTREE_BLACK;
+                    rbidx_color(tree, brother) = RBTREE_RED;
+                    rbidx_right_rotate(tree, brother);
+
+                    brother = rbidx_right(tree, parent);
+                }
+
+                /** case 4: right child of brother is red */
+                rbidx_color(tree, brother) = rbidx_color(tree, parent);
+                rbidx_color(tree, parent)  = RBTREE_BLACK;
+                rbidx_color(tree, rbidx_right(tree, brother)) = RBTREE_BLACK;
+                rbidx_left_rotate(tree, parent);
+
+                node = tree->header->root;
+            }
+        }
+        else {
+            /** exchange left and right */
+            uint32_t brother = rbidx_left(tree, parent);
+
+            if (rbidx_is_red(tree, brother)) {
+                rbidx_color(tree, brother) = RBTREE_BLACK;
+                rbidx_color(tree, parent)  = RBTREE_RED;
+                rbidx_right_rotate(tree, parent);
+
+                brother = rbidx_left(tree, parent);
+            }
+
+            if (rbidx_is_black(tree, rbidx_left(tree, brother)) &&
+                rbidx_is_black(tree, rbidx_right(tree, brother)))
+            {
+                rbidx_color(tree, brother) = RBTREE_RED;
+                node = parent;
+            }
+            else {
+                if (rbidx_is_black(tree, rbidx_left(tree, brother))) {
+                    rbidx_color(tree, rbidx_right(tree, brother)) = RBTREE_BLACK;
+                    rbidx_color(tree, brother) = RBTREE_RED;
+                    rbidx_left_rotate(tree, brother);
+
+                    brother = rbidx_left(tree, parent);
+                }
+
+                rbidx_color(tree, brother) = rbidx_color(tree, parent);
+                rbidx_color(tree, parent)  = RBTREE_BLACK;
+                rbidx_color(tree, rbidx_left(tree, brother)) = RBTREE_BLACK;
+                rbidx_right_rotate(tree, parent);
+
+                node = tree->header->root;
+            }
+        }
+    }
+
+    rbidx_color(tree, node) = RBTREE_BLACK;
+}
+
+
+int
+rbidx_delete(rbidx_tree_t *tree, uint32_t idx)
+{
+    rbtree_must(tree != NULL && tree->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(idx != RBIDX_SENTINEL && idx < tree->header->used, RBTREE_INVALID_ARG);
+
+    uint32_t replace  = idx;
+    uint32_t replace2 = RBIDX_SENTINEL;
+    uint32_t color    = rbidx_color(tree, replace);
+
+    if (rbidx_left(tree, idx) == RBIDX_SENTINEL) {
+        replace2 = rbidx_right(tree, idx);
+        rbidx_transplant(tree, idx, replace2);
+    }
+    else if (rbidx_right(tree, idx) == RBIDX_SENTINEL) {
+        replace2 = rbidx_left(tree, idx);
+        rbidx_transplant(tree, idx, replace2);
+    }
+    else {
+        /** successor has no left child */
+        replace  = rbidx_minimum(tree, rbidx_right(tree, idx));
+        color    = rbidx_color(tree, replace);
+        replace2 = rbidx_right(tree, replace);
+
+        if (rbidx_parent(tree, replace) == idx) {
+            rbidx_parent(tree, replace2) = replace;
+        }
+        else {
+            rbidx_transplant(tree, replace, replace2);
+            rbidx_right(tree, replace) = rbidx_right(tree, idx);
+            rbidx_parent(tree, rbidx_right(tree, replace)) = replace;
+        }
+
+        rbidx_transplant(tree, idx, replace);
+        rbidx_left(tree, replace) = rbidx_left(tree, idx);
+        rbidx_parent(tree, rbidx_left(tree, replace)) = replace;
+        rbidx_color(tree, replace) = rbidx_color(tree, idx);
+    }
+
+    tree->header->size--;
+
+    if (color == RBTREE_BLACK) {
+        rbidx_delete_fixup(tree, replace2);
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbidx_search_key(rbidx_tree_t *tree,
+                 const void *key,
+                 rbidx_key_compare compare,
+                 rbtree_search_mode_t mode,
+                 uint32_t *ret)
+{
+    rbtree_must(tree != NULL && tree->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    uint32_t result   = RBIDX_SENTINEL;
+    uint32_t traverse = tree->header->root;
+
+    while (traverse != RBIDX_SENTINEL) {
+        int cmp = compare(key, rbidx_record(tree, traverse));
+
+        if (mode == RBTREE_SEARCH_MODE_LT) {
+            if (cmp > 0) {
+                result = traverse;
+                traverse = rbidx_right(tree, traverse);
+            }
+            else {
+                traverse = rbidx_left(tree, traverse);
+            }
+
+            continue;
+        }
+
+        if (mode == RBTREE_SEARCH_MODE_GT) {
+            if (cmp < 0) {
+                result = traverse;
+                traverse = rbidx_left(tree, traverse);
+            }
+            else {
+                traverse = rbidx_right(tree, traverse);
+            }
+
+            continue;
+        }
+
+        if (cmp == 0) {
+            result = traverse;
+
+            break;
+        }
+        else if (cmp < 0) {
+            if (mode == RBTREE_SEARCH_MODE_GE) {
+                result = traverse;
+            }
+
+            traverse = rbidx_left(tree, traverse);
+        }
+        else {
+            if (mode == RBTREE_SEARCH_MODE_LE) {
+                result = traverse;
+            }
+
+            traverse = rbidx_right(tree, traverse);
+        }
+    }
+
+    *ret = result;
+
+    return result != RBIDX_SENTINEL ? RBTREE_OK : RBTREE_NOT_FOUND;
+}
+
+
+uint32_t
+rbidx_first(rbidx_tree_t *tree)
+{
+    uint32_t root = tree->header->root;
+
+    return root == RBIDX_SENTINEL ? RBIDX_SENTINEL : rbidx_minimum(tree, root);
+}
+
+
+uint32_t
+rbidx_last(rbidx_tree_t *tree)
+{
+    uint32_t root = tree->header->root;
+
+    return root == RBIDX_SENTINEL ? RBIDX_SENTINEL : rbidx_maximum(tree, root);
+}
+
+
+uint32_t
+rbidx_next(rbidx_tree_t *tree, uint32_t idx)
+{
+    if (rbidx_right(tree, idx) != RBIDX_SENTINEL) {
+        return rbidx_minimum(tree, rbidx_right(tree, idx));
+    }
+
+    uint32_t parent = rbidx_parent(tree, idx);
+    while (parent != RBIDX_SENTINEL && idx == rbidx_right(tree, parent)) {
+        idx    = parent;
+        parent = rbidx_parent(tree, idx);
+    }
+
+    return parent;
+}
+
+
+uint32_t
+rbidx_prev(rbidx_tree_t *tree, uint32_t idx)
+{
+    if (rbidx_left(tree, idx) != RBIDX_SENTINEL) {
+        return rbidx_maximum(tree, rbidx_left(tree, idx));
+    }
+
+    uint32_t parent = rbidx_parent(tree, idx);
+    while (parent != RBIDX_SENTINEL && idx == rbidx_left(tree, parent)) {
+        idx    = parent;
+        parent = rbidx_parent(tree, idx);
+    }
+
+    return parent;
+}
@@ -0,0 +1,169 @@
+/**
+ * file name: rbtree_idx.h
+ *
+ * head file of index based rbtree
+ *
+ * records live in one contiguous buffer and link to each other by
+ * uint32 slot index, slot 0 is the sentinel. the buffer holds no pointer,
+ * so it can be relocated, copied with memcpy or written to disk as-is.
+ *
+ * every record starts with a rbidx_node_t:
+ *
+ *     struct my_record {
+ *         rbidx_node_t node;
+ *         uint64_t key;
+ *     };
+ *
+ * record pointers are only valid until the next rbidx_alloc,
+ * which may move a growable buffer, keep indexes instead.
+ */
+#ifndef __RB_TREE_IDX_H__
+#define __RB_TREE_IDX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+#define RBIDX_SENTINEL 0
+#define RBIDX_MAGIC    0x72626978
+
+typedef struct rbidx_node_s rbidx_node_t;
+struct rbidx_node_s {
+    uint32_t left;
+    uint32_t right;
+    uint32_t parent;
+    uint32_t color;
+};
+
+/** head of buffer, slots follow it */
+typedef struct rbidx_header_s rbidx_header_t;
+struct rbidx_header_s {
+    uint32_t magic;
+    uint32_t record_size;
+    /** slots in buffer, including sentinel */
+    uint32_t capacity;
+    /** slots ever handed out, including sentinel */
+    uint32_t used;
+    uint32_t root;
+    /** free slots are chained through their left link */
+    uint32_t free_head;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+
+/** compare function of two records */
+typedef int (*rbidx_compare)(const void *ra, const void *rb);
+
+/** compare function of a search key and a record */
+typedef int (*rbidx_key_compare)(const void *key, const void *record);
+
+typedef struct rbidx_tree_s rbidx_tree_t;
+struct rbidx_tree_s {
+    rbidx_header_t *header;
+    rbidx_compare compare;
+    /** buffer is malloc'ed by us and may grow */
+    int growable;
+};
+
+
+/** growable buffer with room for `capacity` records */
+int
+rbidx_init(rbidx_tree_t *tree,
+           size_t record_size,
+           uint32_t capacity,
+           rbidx_compare compare);
+
+/** fixed caller owned buffer, e.g. mmap'ed file or shared memory */
+int
+rbidx_init_buffer(rbidx_tree_t *tree,
+                  void *buffer,
+                  size_t buffer_bytes,
+                  size_t record_size,
+                  rbidx_compare compare);
+
+/**
+ * use a buffer built before, e.g. copied or read back from disk.
+ * `buffer_bytes` is what the caller really has, the header must fit in it.
+ */
+int
+rbidx_attach(rbidx_tree_t *tree,
+             void *buffer,
+             size_t buffer_bytes,
+             rbidx_compare compare);
+
+void
+rbidx_destroy(rbidx_tree_t *tree);
+
+/** bytes for `capacity` records of `record_size` */
+size_t
+rbidx_buffer_bytes(size_t record_size, uint32_t capacity);
+
+/** take a free slot, RBTREE_NO_SPACE if buffer is full and fixed */
+int
+rbidx_alloc(rbidx_tree_t *tree, uint32_t *idx);
+
+/** give back a slot which is not in tree */
+int
+rbidx_free(rbidx_tree_t *tree, uint32_t idx);
+
+int
+rbidx_insert(rbidx_tree_t *tree, uint32_t idx);
+
+/** idx must be in tree, its slot is not freed */
+int
+rbidx_delete(rbidx_tree_t *tree, uint32_t idx);
+
+int
+rbidx_search_key(rbidx_tree_t *tree,
+                 const void *key,
+                 rbidx_key_compare compare,
+                 rbtree_search_mode_t mode,
+                 uint32_t *ret);
+
+/** in-order walk, RBIDX_SENTINEL when there is no such node */
+uint32_t
+rbidx_first(rbidx_tree_t *tree);
+
+uint32_t
+rbidx_last(rbidx_tree_t *tree);
+
+uint32_t
+rbidx_next(rbidx_tree_t *tree, uint32_t idx);
+
+uint32_t
+rbidx_prev(rbidx_tree_t *tree, uint32_t idx);
+
+
+static inline void *
+rbidx_record(rbidx_tree_t *tree, uint32_t idx)
+{
+    return (char *)(tree->header + 1) + (size_t)idx * tree->header->record_size;
+}
+
+
+static inline rbidx_node_t *
+rbidx_node(rbidx_tree_t *tree, uint32_t idx)
+{
+    return (rbidx_node_t *)rbidx_record(tree, idx);
+}
+
+
+static inline size_t
+rbidx_size(rbidx_tree_t *tree)
+{
+    return tree->header->size;
+}
+
+
+/** bytes in use from start of buffer, enough to copy the whole tree */
+static inline size_t
+rbidx_used_bytes(rbidx_tree_t *tree)
+{
+    return sizeof(rbidx_header_t) + (size_t)tree->header->used * tree->header->record_size;
+}
+
+
+#endif
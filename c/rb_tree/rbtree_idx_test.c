@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_idx.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    rbidx_node_t node;
+    int key;
+};
+
+
+static int
+test_record_compare(const void *ra, const void *rb)
+{
+    int akey = ((const test_record_t *)ra)->key;
+    int bkey = ((const test_record_t *)rb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, const void *record)
+{
+    int akey = *(const int *)key;
+    int bkey = ((const test_record_t *)record)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key(rbidx_tree_t *tree, uint32_t idx)
+{
+    return ((test_record_t *)rbidx_record(tree, idx))->key;
+}
+
+
+static int
+do_check_sub_rbidx(rbidx_tree_t *tree, uint32_t idx, size_t *count)
+{
+    if (idx == RBIDX_SENTINEL) {
+        return 1;
+    }
+
+    (*count)++;
+
+    uint32_t left  = rbidx_left(tree, idx);
+    uint32_t right = rbidx_right(tree, idx);
+
+    if (rbidx_is_red(tree, idx)) {
+        CU_ASSERT(rbidx_is_black(tree, left));
+        CU_ASSERT(rbidx_is_black(tree, right));
+    }
+
+    if (left != RBIDX_SENTINEL) {
+        CU_ASSERT(rbidx_parent(tree, left) == idx);
+        CU_ASSERT(test_key(tree, left) <= test_key(tree, idx));
+    }
+
+    if (right != RBIDX_SENTINEL) {
+        CU_ASSERT(rbidx_parent(tree, right) == idx);
+        CU_ASSERT(test_key(tree, right) >= test_key(tree, idx));
+    }
+
+    int left_black_height  = do_check_sub_rbidx(tree, left, count);
+    int right_black_height = do_check_sub_rbidx(tree, right, count);
+
+    CU_ASSERT(left_black_height == right_black_height);
+
+    return left_black_height + rbidx_is_black(tree, idx);
+}
+
+
+static void
+test_is_rbidx(rbidx_tree_t *tree)
+{
+    size_t count = 0;
+
+    CU_ASSERT(rbidx_is_black(tree, RBIDX_SENTINEL));
+    CU_ASSERT(rbidx_is_black(tree, tree->header->root));
+    CU_ASSERT(rbidx_parent(tree, tree->header->root) == RBIDX_SENTINEL ||
+              tree->header->root == RBIDX_SENTINEL);
+
+    do_check_sub_rbidx(tree, tree->header->root, &count);
+    CU_ASSERT(count == rbidx_size(tree));
+}
+
+
+static void
+test_init(void)
+{
+    rbidx_tree_t tree;
+
+    CU_ASSERT(sizeof(rbidx_node_t) == 16);
+
+    CU_ASSERT(rbidx_init(NULL, sizeof(test_record_t), 4, test_record_compare) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbidx_init(&tree, sizeof(test_record_t), 4, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbidx_init(&tree, 4, 4, test_record_compare) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbidx_init(&tree, sizeof(test_record_t), 4, test_record_compare) == RBTREE_OK);
+    CU_ASSERT(rbidx_size(&tree) == 0);
+    CU_ASSERT(rbidx_first(&tree) == RBIDX_SENTINEL);
+    CU_ASSERT(tree.header->record_size == 24);
+
+    /** grows past initial capacity */
+    for (int idx = 0; idx < 100; idx++) {
+        uint32_t slot = 0;
+        CU_ASSERT(rbidx_alloc(&tree, &slot) == RBTREE_OK);
+        CU_ASSERT(slot == (uint32_t)idx + 1);
+    }
+
+    CU_ASSERT(tree.header->capacity >= 101);
+
+    /** freed slots are reused first */
+    CU_ASSERT(rbidx_free(&tree, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbidx_free(&tree, 50) == RBTREE_OK);
+
+    uint32_t slot = 0;
+    CU_ASSERT(rbidx_alloc(&tree, &slot) == RBTREE_OK);
+    CU_ASSERT(slot == 50);
+
+    rbidx_destroy(&tree);
+    CU_ASSERT(tree.header == NULL);
+}
+
+
+static void
+test_fixed_buffer(void)
+{
+    rbidx_tree_t tree;
+
+    uint64_t buffer[64];
+    CU_ASSERT(rbidx_init_buffer(&tree, buffer, 16, sizeof(test_record_t), test_record_compare) == RBTREE_NO_SPACE);
+    CU_ASSERT(rbidx_init_buffer(&tree, buffer, sizeof(buffer), sizeof(test_record_t), test_record_compare) == RBTREE_OK);
+
+    /** (512 - 32) / 24 slots, one is sentinel */
+    uint32_t capacity = tree.header->capacity;
+    CU_ASSERT(capacity == 20);
+
+    for (uint32_t idx = 1; idx < capacity; idx++) {
+        uint32_t slot = 0;
+        CU_ASSERT(rbidx_alloc(&tree, &slot) == RBTREE_OK);
+
+        test_record_t *record = rbidx_record(&tree, slot);
+        record->key = (int)(capacity - idx);
+        CU_ASSERT(rbidx_insert(&tree, slot) == RBTREE_OK);
+    }
+
+    uint32_t slot = 0;
+    CU_ASSERT(rbidx_alloc(&tree, &slot) == RBTREE_NO_SPACE);
+
+    test_is_rbidx(&tree);
+
+    /** buffer holds no pointer, a plain copy is a working tree */
+    uint64_t copy[64];
+    memcpy(copy, buffer, rbidx_used_bytes(&tree));
+
+    rbidx_tree_t copied;
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(copy), test_record_compare) == RBTREE_OK);
+    test_is_rbidx(&copied);
+
+    int expect = 1;
+    for (uint32_t idx = rbidx_first(&copied); idx != RBIDX_SENTINEL; idx = rbidx_next(&copied, idx)) {
+        CU_ASSERT(test_key(&copied, idx) == expect);
+        expect++;
+    }
+
+    CU_ASSERT(expect == (int)capacity);
+
+    /** attach checks the header fits in what the caller has */
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(rbidx_header_t) - 1, test_record_compare) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(copy) - 8, test_record_compare) == RBTREE_INVALID_ARG);
+
+    rbidx_header_t *header = (rbidx_header_t *)copy;
+    header->capacity = UINT32_MAX;
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(copy), test_record_compare) == RBTREE_INVALID_ARG);
+    header->capacity = capacity;
+    header->record_size = 4;
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(copy), test_record_compare) == RBTREE_INVALID_ARG);
+
+    /** attach checks magic */
+    memset(copy, 0, sizeof(copy));
+    CU_ASSERT(rbidx_attach(&copied, copy, sizeof(copy), test_record_compare) == RBTREE_INVALID_ARG);
+}
+
+
+static void
+test_insert_delete(void)
+{
+    rbidx_tree_t tree;
+    rbidx_init(&tree, sizeof(test_record_t), 16, test_record_compare);
+
+    enum { NODES = 1024 };
+    static uint32_t slots[NODES];
+    memset(slots, 0, sizeof(slots));
+
+    srand(20171003);
+
+    size_t count = 0;
+    for (int round = 0; round < 16 * NODES; round++) {
+        int idx = rand() % NODES;
+
+        if (slots[idx] != RBIDX_SENTINEL) {
+            CU_ASSERT(rbidx_delete(&tree, slots[idx]) == RBTREE_OK);
+            CU_ASSERT(rbidx_free(&tree, slots[idx]) == RBTREE_OK);
+            slots[idx] = RBIDX_SENTINEL;
+            count--;
+        }
+        else {
+            CU_ASSERT(rbidx_alloc(&tree, &slots[idx]) == RBTREE_OK);
+
+            test_record_t *record = rbidx_record(&tree, slots[idx]);
+            record->key = rand() % (NODES / 2);
+
+            CU_ASSERT(rbidx_insert(&tree, slots[idx]) == RBTREE_OK);
+            count++;
+        }
+
+        CU_ASSERT(rbidx_size(&tree) == count);
+
+        if (round % 256 == 0) {
+            test_is_rbidx(&tree);
+        }
+    }
+
+    test_is_rbidx(&tree);
+
+    size_t walked = 0;
+    int last = -1;
+    for (uint32_t idx = rbidx_first(&tree); idx != RBIDX_SENTINEL; idx = rbidx_next(&tree, idx)) {
+        CU_ASSERT(test_key(&tree, idx) >= last);
+        last = test_key(&tree, idx);
+        walked++;
+    }
+
+    CU_ASSERT(walked == count);
+
+    for (uint32_t idx = rbidx_last(&tree); idx != RBIDX_SENTINEL; idx = rbidx_prev(&tree, idx)) {
+        CU_ASSERT(test_key(&tree, idx) <= last);
+        last = test_key(&tree, idx);
+        walked--;
+    }
+
+    CU_ASSERT(walked == 0);
+
+    rbidx_destroy(&tree);
+}
+
+
+static void
+test_search(void)
+{
+    rbidx_tree_t tree;
+    rbidx_init(&tree, sizeof(test_record_t), 4, test_record_compare);
+
+    uint32_t ret = 0;
+    int key = 0;
+
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_MAX, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+
+    /** keys 0, 2, 4, ..., 62 */
+    for (int idx = 0; idx < 32; idx++) {
+        uint32_t slot = 0;
+        rbidx_alloc(&tree, &slot);
+
+        test_record_t *record = rbidx_record(&tree, slot);
+        record->key = idx * 2;
+        rbidx_insert(&tree, slot);
+    }
+
+    key = 8;
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(test_key(&tree, ret) == 8);
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_key(&tree, ret) == 6);
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_key(&tree, ret) == 10);
+
+    key = 9;
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_key(&tree, ret) == 8);
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_key(&tree, ret) == 10);
+
+    key = 0;
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_NOT_FOUND);
+    key = 62;
+    CU_ASSERT(rbidx_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_NOT_FOUND);
+
+    rbidx_destroy(&tree);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbidx[] = {
+    { "test_init",          test_init          },
+    { "test_fixed_buffer",  test_fixed_buffer  },
+    { "test_insert_delete", test_insert_delete },
+    { "test_search",        test_search        },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbidx",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbidx,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
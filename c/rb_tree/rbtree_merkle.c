@@ -0,0 +1,268 @@
+/**
+ * file name: rbtree_merkle.c
+ *
+ * hashed rbtree implemention
+ *
+ * an entry's hash is cached in its node, so the augment callback only
+ * adds up children and rotations never call back into user's hash.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_merkle.h"
+
+
+typedef struct rbmerkle_diff_s rbmerkle_diff_t;
+struct rbmerkle_diff_s {
+    rbmerkle_t *mine;
+    rbmerkle_t *theirs;
+    rbmerkle_visit visit;
+    void *ctx;
+};
+
+
+/** finalizer of splitmix64, spreads weak user hashes before they are summed */
+static inline uint64_t
+rbmerkle_mix(uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+
+static inline uint64_t
+rbmerkle_sub_sum(rbtree_t *tree, rbtree_node_t *node)
+{
+    return rbtree_is_sentinel(tree, node) ? 0 : rbmerkle_node(node)->sum;
+}
+
+
+static inline size_t
+rbmerkle_sub_count(rbtree_t *tree, rbtree_node_t *node)
+{
+    return rbtree_is_sentinel(tree, node) ? 0 : rbmerkle_node(node)->count;
+}
+
+
+static void
+rbmerkle_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    rbmerkle_node_t *mnode = rbmerkle_node(node);
+
+    mnode->sum = mnode->hash
+               + rbmerkle_sub_sum(tree, node->left)
+               + rbmerkle_sub_sum(tree, node->right);
+    mnode->count = 1
+                 + rbmerkle_sub_count(tree, node->left)
+                 + rbmerkle_sub_count(tree, node->right);
+}
+
+
+int
+rbmerkle_init(rbmerkle_t *merkle, rbtree_compare compare, rbmerkle_hash hash)
+{
+    rbtree_must(merkle != NULL && compare != NULL && hash != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_init(&merkle->tree, compare);
+    rbtree_set_augment(&merkle->tree, rbmerkle_augment);
+    merkle->hash = hash;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbmerkle_insert(rbmerkle_t *merkle, rbmerkle_node_t *node)
+{
+    rbtree_must(merkle != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *exist = NULL;
+
+    node->hash = rbmerkle_mix(merkle->hash(&node->node));
+
+    return rbtree_insert_unique(&merkle->tree, &node->node, &exist);
+}
+
+
+int
+rbmerkle_delete(rbmerkle_t *merkle, rbmerkle_node_t *node)
+{
+    rbtree_must(merkle != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    return rbtree_delete(&merkle->tree, &node->node);
+}
+
+
+int
+rbmerkle_update(rbmerkle_t *merkle, rbmerkle_node_t *node)
+{
+    rbtree_must(merkle != NULL && node != NULL, RBTREE_INVALID_ARG);
+
+    node->hash = rbmerkle_mix(merkle->hash(&node->node));
+
+    return rbtree_augment_path(&merkle->tree, &node->node);
+}
+
+
+/** sum and count of entries less than `bound`, or not greater if `inclusive` */
+static void
+rbmerkle_prefix(rbtree_t *tree,
+                rbtree_node_t *bound,
+                int inclusive,
+                uint64_t *sum,
+                size_t *count)
+{
+    rbtree_node_t *node = tree->root;
+
+    *sum = 0;
+    *count = 0;
+
+    while (!rbtree_is_sentinel(tree, node)) {
+        int cmp = tree->compare(node, bound);
+
+        if (cmp < 0 || (inclusive && cmp == 0)) {
+            *sum += rbmerkle_sub_sum(tree, node->left) + rbmerkle_node(node)->hash;
+            *count += rbmerkle_sub_count(tree, node->left) + 1;
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+}
+
+
+void
+rbmerkle_range(rbmerkle_t *merkle,
+               rbtree_node_t *lo,
+               rbtree_node_t *hi,
+               uint64_t *sum,
+               size_t *count)
+{
+    rbtree_t *tree = &merkle->tree;
+
+    if (hi == NULL) {
+        *sum = rbmerkle_sub_sum(tree, tree->root);
+        *count = rbmerkle_sub_count(tree, tree->root);
+    }
+    else {
+        rbmerkle_prefix(tree, hi, 0, sum, count);
+    }
+
+    /** sums wrap, so cutting off the prefix below `lo` is exact */
+    if (lo != NULL) {
+        uint64_t below_sum;
+        size_t below_count;
+
+        rbmerkle_prefix(tree, lo, 1, &below_sum, &below_count);
+        *sum -= below_sum;
+        *count -= below_count;
+    }
+}
+
+
+/** every entry of subtree of `mine` is missing in `theirs` */
+static size_t
+rbmerkle_diff_mine_only(rbmerkle_diff_t *diff, rbtree_node_t *node)
+{
+    rbtree_t *tree = &diff->mine->tree;
+    size_t found = 0;
+
+    while (!rbtree_is_sentinel(tree, node)) {
+        found += rbmerkle_diff_mine_only(diff, node->left);
+        diff->visit(node, NULL, diff->ctx);
+        found++;
+        node = node->right;
+    }
+
+    return found;
+}
+
+
+/** every entry of `theirs` in (`lo`, `hi`) is missing in `mine` */
+static size_t
+rbmerkle_diff_theirs_only(rbmerkle_diff_t *diff, rbtree_node_t *lo, rbtree_node_t *hi)
+{
+    rbtree_t *tree = &diff->theirs->tree;
+    rbtree_node_t *node = NULL;
+    size_t found = 0;
+
+    if (lo == NULL) {
+        node = rbtree_first(tree);
+    }
+    else if (rbtree_search(tree, lo, RBTREE_SEARCH_MODE_GT, &node) != RBTREE_OK) {
+        node = NULL;
+    }
+
+    while (node != NULL && (hi == NULL || tree->compare(node, hi) < 0)) {
+        diff->visit(NULL, node, diff->ctx);
+        found++;
+        node = rbtree_next(tree, node);
+    }
+
+    return found;
+}
+
+
+/**
+ * subtree of `mine` at `node` against entries of `theirs` in (`lo`, `hi`),
+ * the bounds are its nearest ancestors on either side
+ */
+static size_t
+rbmerkle_diff_sub(rbmerkle_diff_t *diff, rbtree_node_t *node, rbtree_node_t *lo, rbtree_node_t *hi)
+{
+    rbtree_t *tree = &diff->mine->tree;
+    uint64_t sum;
+    size_t count;
+
+    rbmerkle_range(diff->theirs, lo, hi, &sum, &count);
+
+    if (sum == rbmerkle_sub_sum(tree, node) && count == rbmerkle_sub_count(tree, node)) {
+        return 0;
+    }
+
+    if (count == 0) {
+        return rbmerkle_diff_mine_only(diff, node);
+    }
+
+    if (rbtree_is_sentinel(tree, node)) {
+        return rbmerkle_diff_theirs_only(diff, lo, hi);
+    }
+
+    size_t found = rbmerkle_diff_sub(diff, node->left, lo, node);
+
+    rbtree_node_t *other = NULL;
+    if (rbtree_search(&diff->theirs->tree, node, RBTREE_SEARCH_MODE_EQ, &other) != RBTREE_OK) {
+        diff->visit(node, NULL, diff->ctx);
+        found++;
+    }
+    else if (rbmerkle_node(other)->hash != rbmerkle_node(node)->hash) {
+        diff->visit(node, other, diff->ctx);
+        found++;
+    }
+
+    return found + rbmerkle_diff_sub(diff, node->right, node, hi);
+}
+
+
+size_t
+rbmerkle_diff(rbmerkle_t *mine, rbmerkle_t *theirs, rbmerkle_visit visit, void *ctx)
+{
+    if (mine == NULL || theirs == NULL || visit == NULL) {
+        return 0;
+    }
+
+    rbmerkle_diff_t diff = {
+        .mine   = mine,
+        .theirs = theirs,
+        .visit  = visit,
+        .ctx    = ctx,
+    };
+
+    return rbmerkle_diff_sub(&diff, mine->tree.root, NULL, NULL);
+}
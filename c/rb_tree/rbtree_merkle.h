@@ -0,0 +1,110 @@
+/**
+ * file name: rbtree_merkle.h
+ *
+ * head file of hashed rbtree for replica diffing
+ *
+ * every node keeps a digest of its subtree, the sum of its entries'
+ * mixed hashes and their count, updated through rbtree_set_augment. a
+ * sum does not depend on the shape of the tree, so two replicas holding
+ * the same entries agree on the digest of any key range even when they
+ * were built in different orders, and the digest of a range is read in
+ * one descent.
+ *
+ * rbmerkle_diff walks one tree and compares each subtree with the same
+ * key range of the other, it descends only where the digests differ.
+ *
+ * keys must be unique within a tree. the digest guards against drift
+ * and lost updates, it is not meant to stand up to crafted collisions.
+ */
+#ifndef __RB_TREE_MERKLE_H__
+#define __RB_TREE_MERKLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+/** hash of key and value of an entry, mixed again before it is summed */
+typedef uint64_t (*rbmerkle_hash)(rbtree_node_t *node);
+
+/**
+ * one difference, `mine` from the tree walked and `theirs` from the
+ * other, one of them is NULL when the key is on one side only
+ */
+typedef void (*rbmerkle_visit)(rbtree_node_t *mine, rbtree_node_t *theirs, void *ctx);
+
+typedef struct rbmerkle_node_s rbmerkle_node_t;
+struct rbmerkle_node_s {
+    rbtree_node_t node;
+    /** hash of this entry */
+    uint64_t hash;
+    /** sum of hashes and number of entries in subtree */
+    uint64_t sum;
+    size_t count;
+};
+
+typedef struct rbmerkle_s rbmerkle_t;
+struct rbmerkle_s {
+    rbtree_t tree;
+    rbmerkle_hash hash;
+};
+
+
+int
+rbmerkle_init(rbmerkle_t *merkle, rbtree_compare compare, rbmerkle_hash hash);
+
+/** RBTREE_DUPLICATE with `node` not inserted if its key is in tree */
+int
+rbmerkle_insert(rbmerkle_t *merkle, rbmerkle_node_t *node);
+
+int
+rbmerkle_delete(rbmerkle_t *merkle, rbmerkle_node_t *node);
+
+/** rehash `node` after its value was changed in place, key must not change */
+int
+rbmerkle_update(rbmerkle_t *merkle, rbmerkle_node_t *node);
+
+/** sum of hashes and number of entries with key in (`lo`, `hi`), NULL for unbounded */
+void
+rbmerkle_range(rbmerkle_t *merkle,
+               rbtree_node_t *lo,
+               rbtree_node_t *hi,
+               uint64_t *sum,
+               size_t *count);
+
+/**
+ * report every entry that differs between `mine` and `theirs` and
+ * return how many, both trees must have the same compare and hash.
+ * costs O(d log^2 n) compares for d differences.
+ */
+size_t
+rbmerkle_diff(rbmerkle_t *mine, rbmerkle_t *theirs, rbmerkle_visit visit, void *ctx);
+
+
+static inline rbmerkle_node_t *
+rbmerkle_node(rbtree_node_t *node)
+{
+    return (rbmerkle_node_t *)((uintptr_t)node - offsetof(rbmerkle_node_t, node));
+}
+
+
+/** digest of the whole tree */
+static inline uint64_t
+rbmerkle_root_hash(rbmerkle_t *merkle)
+{
+    rbtree_t *tree = &merkle->tree;
+
+    return rbtree_is_sentinel(tree, tree->root) ? 0 : rbmerkle_node(tree->root)->sum;
+}
+
+
+static inline int
+rbmerkle_equal(rbmerkle_t *mine, rbmerkle_t *theirs)
+{
+    return rbtree_size(&mine->tree) == rbtree_size(&theirs->tree)
+        && rbmerkle_root_hash(mine) == rbmerkle_root_hash(theirs);
+}
+
+
+#endif
@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_merkle.c"
+
+typedef struct test_entry_s test_entry_t;
+struct test_entry_s {
+    int key;
+    uint64_t value;
+    int in_tree;
+    rbmerkle_node_t mnode;
+};
+
+#define test_entry_of(ptr) \
+    ((test_entry_t *)((uintptr_t)(ptr) - offsetof(test_entry_t, mnode.node)))
+
+/** each difference reported by a diff */
+typedef struct test_diff_s test_diff_t;
+struct test_diff_s {
+    size_t count;
+    rbtree_node_t *mine[256];
+    rbtree_node_t *theirs[256];
+};
+
+static size_t test_compares = 0;
+
+
+static int
+test_entry_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = test_entry_of(na)->key;
+    int bkey = test_entry_of(nb)->key;
+
+    test_compares++;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static uint64_t
+test_entry_hash(rbtree_node_t *node)
+{
+    test_entry_t *entry = test_entry_of(node);
+
+    return (uint64_t)entry->key * 0x9e3779b97f4a7c15ull ^ entry->value;
+}
+
+
+static void
+test_diff_visit(rbtree_node_t *mine, rbtree_node_t *theirs, void *ctx)
+{
+    test_diff_t *diff = ctx;
+
+    if (diff->count < 256) {
+        diff->mine[diff->count] = mine;
+        diff->theirs[diff->count] = theirs;
+    }
+
+    diff->count++;
+}
+
+
+/** digests of every subtree add up */
+static void
+do_check_sub_merkle(rbtree_t *tree, rbtree_node_t *node, uint64_t *sum, size_t *count)
+{
+    if (rbtree_is_sentinel(tree, node)) {
+        *sum = 0;
+        *count = 0;
+
+        return;
+    }
+
+    uint64_t left_sum, right_sum;
+    size_t left_count, right_count;
+
+    do_check_sub_merkle(tree, node->left, &left_sum, &left_count);
+    do_check_sub_merkle(tree, node->right, &right_sum, &right_count);
+
+    rbmerkle_node_t *mnode = rbmerkle_node(node);
+    CU_ASSERT(mnode->hash == rbmerkle_mix(test_entry_hash(node)));
+
+    *sum = left_sum + right_sum + mnode->hash;
+    *count = left_count + right_count + 1;
+
+    CU_ASSERT(mnode->sum == *sum);
+    CU_ASSERT(mnode->count == *count);
+}
+
+
+static void
+test_is_merkle(rbmerkle_t *merkle)
+{
+    uint64_t sum;
+    size_t count;
+
+    do_check_sub_merkle(&merkle->tree, merkle->tree.root, &sum, &count);
+    CU_ASSERT(count == rbtree_size(&merkle->tree));
+    CU_ASSERT(sum == rbmerkle_root_hash(merkle));
+}
+
+
+static void
+test_maintain(void)
+{
+    enum { NODES = 2000, ROUNDS = 20000 };
+    static test_entry_t entries[NODES];
+
+    rbmerkle_t merkle;
+    CU_ASSERT(rbmerkle_init(NULL, test_entry_compare, test_entry_hash) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbmerkle_init(&merkle, test_entry_compare, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbmerkle_init(&merkle, test_entry_compare, test_entry_hash) == RBTREE_OK);
+    CU_ASSERT(rbmerkle_root_hash(&merkle) == 0);
+
+    memset(entries, 0, sizeof(entries));
+    for (int idx = 0; idx < NODES; idx++) {
+        entries[idx].key = idx;
+    }
+
+    srand(20171028);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        test_entry_t *entry = &entries[rand() % NODES];
+
+        if (!entry->in_tree) {
+            entry->value = rand();
+            CU_ASSERT(rbmerkle_insert(&merkle, &entry->mnode) == RBTREE_OK);
+            entry->in_tree = 1;
+        }
+        else if (rand() % 2) {
+            entry->value = rand();
+            CU_ASSERT(rbmerkle_update(&merkle, &entry->mnode) == RBTREE_OK);
+        }
+        else {
+            CU_ASSERT(rbmerkle_delete(&merkle, &entry->mnode) == RBTREE_OK);
+            entry->in_tree = 0;
+        }
+
+        if (round % 487 == 0) {
+            test_is_merkle(&merkle);
+        }
+    }
+
+    test_is_merkle(&merkle);
+
+    /** keys are unique */
+    test_entry_t dup = { .key = 7, };
+    if (!entries[7].in_tree) {
+        CU_ASSERT(rbmerkle_insert(&merkle, &entries[7].mnode) == RBTREE_OK);
+        entries[7].in_tree = 1;
+    }
+
+    uint64_t before = rbmerkle_root_hash(&merkle);
+    CU_ASSERT(rbmerkle_insert(&merkle, &dup.mnode) == RBTREE_DUPLICATE);
+    CU_ASSERT(rbmerkle_root_hash(&merkle) == before);
+    test_is_merkle(&merkle);
+
+    /** range digest against a plain walk */
+    test_entry_t lo = { .key = 300, };
+    test_entry_t hi = { .key = 1200, };
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (int idx = 301; idx < 1200; idx++) {
+        if (entries[idx].in_tree) {
+            sum += entries[idx].mnode.hash;
+            count++;
+        }
+    }
+
+    uint64_t range_sum;
+    size_t range_count;
+    rbmerkle_range(&merkle, &lo.mnode.node, &hi.mnode.node, &range_sum, &range_count);
+    CU_ASSERT(range_sum == sum);
+    CU_ASSERT(range_count == count);
+
+    rbmerkle_range(&merkle, NULL, NULL, &range_sum, &range_count);
+    CU_ASSERT(range_sum == rbmerkle_root_hash(&merkle));
+    CU_ASSERT(range_count == rbtree_size(&merkle.tree));
+}
+
+
+/** `theirs` takes whatever `mine` has for every reported difference */
+static void
+test_reconcile(rbmerkle_t *theirs, test_diff_t *diff, test_entry_t *pool, size_t *pool_used)
+{
+    for (size_t idx = 0; idx < diff->count; idx++) {
+        test_entry_t *mine = diff->mine[idx] ? test_entry_of(diff->mine[idx]) : NULL;
+        test_entry_t *other = diff->theirs[idx] ? test_entry_of(diff->theirs[idx]) : NULL;
+
+        if (mine == NULL) {
+            CU_ASSERT(rbmerkle_delete(theirs, &other->mnode) == RBTREE_OK);
+            other->in_tree = 0;
+        }
+        else if (other == NULL) {
+            test_entry_t *copy = &pool[(*pool_used)++];
+            copy->key = mine->key;
+            copy->value = mine->value;
+            CU_ASSERT(rbmerkle_insert(theirs, &copy->mnode) == RBTREE_OK);
+            copy->in_tree = 1;
+        }
+        else {
+            other->value = mine->value;
+            CU_ASSERT(rbmerkle_update(theirs, &other->mnode) == RBTREE_OK);
+        }
+    }
+}
+
+
+static void
+test_replicas(void)
+{
+    enum { NODES = 100000, CHANGES = 20 };
+    static test_entry_t primary[NODES + CHANGES];
+    static test_entry_t replica[NODES + 2 * CHANGES];
+
+    rbmerkle_t mine, theirs;
+    rbmerkle_init(&mine, test_entry_compare, test_entry_hash);
+    rbmerkle_init(&theirs, test_entry_compare, test_entry_hash);
+
+    memset(primary, 0, sizeof(primary));
+    memset(replica, 0, sizeof(replica));
+
+    srand(20171029);
+
+    /** same entries, ascending on one side and descending on the other, so shapes differ */
+    for (int idx = 0; idx < NODES; idx++) {
+        primary[idx].key = idx * 2;
+        primary[idx].value = rand();
+        CU_ASSERT(rbmerkle_insert(&mine, &primary[idx].mnode) == RBTREE_OK);
+        primary[idx].in_tree = 1;
+    }
+
+    for (int idx = 0; idx < NODES; idx++) {
+        replica[idx].key = primary[NODES - 1 - idx].key;
+        replica[idx].value = primary[NODES - 1 - idx].value;
+        CU_ASSERT(rbmerkle_insert(&theirs, &replica[idx].mnode) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbmerkle_equal(&mine, &theirs));
+
+    /** equal replicas cost one range digest */
+    test_diff_t diff = { 0, };
+    test_compares = 0;
+    CU_ASSERT(rbmerkle_diff(&mine, &theirs, test_diff_visit, &diff) == 0);
+    CU_ASSERT(diff.count == 0);
+    CU_ASSERT(test_compares == 0);
+
+    /** changed values, lost inserts and lost deletes on the primary */
+    for (int change = 0; change < CHANGES; change++) {
+        test_entry_t *entry = &primary[rand() % NODES];
+
+        switch (change % 3) {
+        case 0:
+            if (entry->in_tree) {
+                entry->value++;
+                CU_ASSERT(rbmerkle_update(&mine, &entry->mnode) == RBTREE_OK);
+            }
+            break;
+        case 1:
+            primary[NODES + change].key = entry->key + 1;
+            primary[NODES + change].value = rand();
+            CU_ASSERT(rbmerkle_insert(&mine, &primary[NODES + change].mnode) == RBTREE_OK);
+            break;
+        default:
+            if (entry->in_tree) {
+                CU_ASSERT(rbmerkle_delete(&mine, &entry->mnode) == RBTREE_OK);
+                entry->in_tree = 0;
+            }
+            break;
+        }
+    }
+
+    /** keys past both ends on the replica only */
+    replica[NODES].key = -5;
+    replica[NODES + 1].key = NODES * 2 + 5;
+    CU_ASSERT(rbmerkle_insert(&theirs, &replica[NODES].mnode) == RBTREE_OK);
+    CU_ASSERT(rbmerkle_insert(&theirs, &replica[NODES + 1].mnode) == RBTREE_OK);
+
+    CU_ASSERT(!rbmerkle_equal(&mine, &theirs));
+
+    test_compares = 0;
+    size_t found = rbmerkle_diff(&mine, &theirs, test_diff_visit, &diff);
+    CU_ASSERT(found == diff.count);
+    CU_ASSERT(found > 2 && found <= CHANGES + 2);
+
+    /** far from a full compare */
+    CU_ASSERT(test_compares < NODES / 4);
+
+    /** each difference is real, and they come in key order */
+    for (size_t idx = 0; idx < diff.count; idx++) {
+        test_entry_t *entry = diff.mine[idx] ? test_entry_of(diff.mine[idx]) : test_entry_of(diff.theirs[idx]);
+        rbtree_node_t *other = NULL;
+
+        if (diff.mine[idx] == NULL) {
+            CU_ASSERT(rbtree_search(&mine.tree, diff.theirs[idx], RBTREE_SEARCH_MODE_EQ, &other) == RBTREE_NOT_FOUND);
+        }
+        else if (diff.theirs[idx] == NULL) {
+            CU_ASSERT(rbtree_search(&theirs.tree, diff.mine[idx], RBTREE_SEARCH_MODE_EQ, &other) == RBTREE_NOT_FOUND);
+        }
+        else {
+            CU_ASSERT(test_entry_of(diff.mine[idx])->value != test_entry_of(diff.theirs[idx])->value);
+        }
+
+        if (idx > 0) {
+            test_entry_t *prev = diff.mine[idx - 1] ? test_entry_of(diff.mine[idx - 1]) : test_entry_of(diff.theirs[idx - 1]);
+            CU_ASSERT(prev->key < entry->key);
+        }
+    }
+
+    /** reconcile, after which both agree */
+    size_t pool_used = NODES + 2;
+    test_reconcile(&theirs, &diff, replica, &pool_used);
+
+    CU_ASSERT(rbmerkle_equal(&mine, &theirs));
+    test_is_merkle(&theirs);
+
+    diff.count = 0;
+    CU_ASSERT(rbmerkle_diff(&mine, &theirs, test_diff_visit, &diff) == 0);
+    CU_ASSERT(rbmerkle_diff(&theirs, &mine, test_diff_visit, &diff) == 0);
+
+    rbtree_node_t *node = rbtree_first(&theirs.tree);
+    for (rbtree_node_t *expect = rbtree_first(&mine.tree); expect != NULL; expect = rbtree_next(&mine.tree, expect)) {
+        CU_ASSERT(test_entry_of(node)->key == test_entry_of(expect)->key);
+        CU_ASSERT(test_entry_of(node)->value == test_entry_of(expect)->value);
+        node = rbtree_next(&theirs.tree, node);
+    }
+
+    CU_ASSERT(node == NULL);
+
+    /** one side empty */
+    rbmerkle_t empty;
+    rbmerkle_init(&empty, test_entry_compare, test_entry_hash);
+    diff.count = 0;
+    CU_ASSERT(rbmerkle_diff(&empty, &mine, test_diff_visit, &diff) == rbtree_size(&mine.tree));
+    CU_ASSERT(rbmerkle_diff(&mine, &empty, test_diff_visit, &diff) == rbtree_size(&mine.tree));
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbmerkle[] = {
+    { "test_maintain", test_maintain },
+    { "test_replicas", test_replicas },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbmerkle",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbmerkle,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,223 @@
+/**
+ * file name: rbtree_multi.c
+ *
+ * multi-index container implemention
+ *
+ * every index is a plain rbtree_t. a place is found with one descent
+ * per index and linked with rbtree_insert_at, trees do not share nodes,
+ * so places found in one stay valid while others are linked.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_multi.h"
+
+
+int
+rbmulti_init(rbmulti_t *multi, const rbmulti_index_t *indexes, size_t count)
+{
+    rbtree_must(multi != NULL && indexes != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(count > 0 && count <= RBMULTI_MAX_INDEXES, RBTREE_INVALID_ARG);
+
+    memset(multi, 0, sizeof(*multi));
+
+    for (size_t idx = 0; idx < count; idx++) {
+        rbtree_must(indexes[idx].compare != NULL, RBTREE_INVALID_ARG);
+
+        multi->indexes[idx] = indexes[idx];
+        rbtree_init(&multi->trees[idx], indexes[idx].compare);
+    }
+
+    multi->count = count;
+
+    return RBTREE_OK;
+}
+
+
+/**
+ * place of `node` in `index`, before nodes equal to it as in rbtree_insert.
+ * RBTREE_DUPLICATE with `*exist` set if the index is unique and has one.
+ */
+static int
+rbmulti_locate(rbmulti_t *multi,
+               size_t index,
+               rbtree_node_t *node,
+               rbtree_insert_pos_t *pos,
+               rbtree_node_t **exist)
+{
+    rbtree_t *tree = &multi->trees[index];
+    int unique = multi->indexes[index].unique;
+
+    rbtree_node_t *parent = tree->root;
+    rbtree_node_t *traverse = tree->root;
+    int is_left = -1;
+
+    while (!rbtree_is_sentinel(tree, traverse)) {
+        int cmp = tree->compare(node, traverse);
+
+        if (cmp == 0 && unique) {
+            *exist = traverse;
+
+            return RBTREE_DUPLICATE;
+        }
+
+        parent = traverse;
+        is_left = cmp <= 0;
+        traverse = is_left ? traverse->left : traverse->right;
+    }
+
+    pos->parent = parent;
+    pos->is_left = is_left;
+
+    return RBTREE_OK;
+}
+
+
+/** whether `node` is still in order with its neighbours in `index` */
+static int
+rbmulti_in_order(rbmulti_t *multi, size_t index, rbtree_node_t *node)
+{
+    rbtree_t *tree = &multi->trees[index];
+
+    /** equal neighbours are out of order in a unique index */
+    int limit = multi->indexes[index].unique ? -1 : 0;
+
+    rbtree_node_t *prev = rbtree_prev(tree, node);
+    if (prev != NULL && tree->compare(prev, node) > limit) {
+        return 0;
+    }
+
+    rbtree_node_t *next = rbtree_next(tree, node);
+    if (next != NULL && tree->compare(node, next) > limit) {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+int
+rbmulti_insert(rbmulti_t *multi, void *record, void **exist)
+{
+    rbtree_must(multi != NULL && record != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_insert_pos_t pos[RBMULTI_MAX_INDEXES];
+
+    for (size_t idx = 0; idx < multi->count; idx++) {
+        rbtree_node_t *other = NULL;
+
+        if (rbmulti_locate(multi, idx, rbmulti_node(multi, idx, record), &pos[idx], &other) != RBTREE_OK) {
+            if (exist != NULL) {
+                *exist = rbmulti_record(multi, idx, other);
+            }
+
+            return RBTREE_DUPLICATE;
+        }
+    }
+
+    for (size_t idx = 0; idx < multi->count; idx++) {
+        rbtree_insert_at(&multi->trees[idx], &pos[idx], rbmulti_node(multi, idx, record));
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbmulti_erase(rbmulti_t *multi, void *record)
+{
+    rbtree_must(multi != NULL && record != NULL, RBTREE_INVALID_ARG);
+
+    for (size_t idx = 0; idx < multi->count; idx++) {
+        rbtree_delete(&multi->trees[idx], rbmulti_node(multi, idx, record));
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbmulti_modify(rbmulti_t *multi,
+               void *record,
+               unsigned mask,
+               rbmulti_modifier modify,
+               rbmulti_modifier rollback,
+               void *ctx)
+{
+    rbtree_must(multi != NULL && record != NULL && modify != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_insert_pos_t pos[RBMULTI_MAX_INDEXES];
+    int moved[RBMULTI_MAX_INDEXES];
+
+    modify(record, ctx);
+
+    /** out of order nodes are unlinked first, descents must not meet them */
+    for (size_t idx = 0; idx < multi->count; idx++) {
+        moved[idx] = (mask & (1u << idx)) && !rbmulti_in_order(multi, idx, rbmulti_node(multi, idx, record));
+
+        if (moved[idx]) {
+            rbtree_delete(&multi->trees[idx], rbmulti_node(multi, idx, record));
+        }
+    }
+
+    int err = RBTREE_OK;
+    for (size_t idx = 0; idx < multi->count && err == RBTREE_OK; idx++) {
+        rbtree_node_t *other = NULL;
+
+        if (moved[idx]) {
+            err = rbmulti_locate(multi, idx, rbmulti_node(multi, idx, record), &pos[idx], &other);
+        }
+    }
+
+    if (err != RBTREE_OK) {
+        if (rollback == NULL) {
+            for (size_t idx = 0; idx < multi->count; idx++) {
+                if (!moved[idx]) {
+                    rbtree_delete(&multi->trees[idx], rbmulti_node(multi, idx, record));
+                }
+            }
+
+            return err;
+        }
+
+        /** old keys had their places, so they find them again */
+        rollback(record, ctx);
+
+        for (size_t idx = 0; idx < multi->count; idx++) {
+            rbtree_node_t *other = NULL;
+
+            if (moved[idx]) {
+                rbmulti_locate(multi, idx, rbmulti_node(multi, idx, record), &pos[idx], &other);
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < multi->count; idx++) {
+        if (moved[idx]) {
+            rbtree_insert_at(&multi->trees[idx], &pos[idx], rbmulti_node(multi, idx, record));
+        }
+    }
+
+    return err;
+}
+
+
+int
+rbmulti_search_key(rbmulti_t *multi,
+                   size_t index,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_search_mode_t mode,
+                   void **ret)
+{
+    rbtree_must(multi != NULL && index < multi->count && ret != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_node_t *node = NULL;
+
+    int err = rbtree_search_key(&multi->trees[index], key, compare, mode, &node);
+    if (err == RBTREE_OK) {
+        *ret = rbmulti_record(multi, index, node);
+    }
+
+    return err;
+}
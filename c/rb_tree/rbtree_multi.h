@@ -0,0 +1,120 @@
+/**
+ * file name: rbtree_multi.h
+ *
+ * head file of multi-index container
+ *
+ * one intrusive record embeds a rbtree_node_t per index, an index is
+ * declared by where its node sits in the record, how two nodes compare
+ * and whether its keys are unique.
+ *
+ * a record is in all indexes or in none: insert finds its place in
+ * every index before it links any, so a duplicate in one unique index
+ * leaves the record out of all of them.
+ */
+#ifndef __RB_TREE_MULTI_H__
+#define __RB_TREE_MULTI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+#define RBMULTI_MAX_INDEXES 8
+
+/** index mask of rbmulti_modify for keys of every index */
+#define RBMULTI_ALL_INDEXES ((1u << RBMULTI_MAX_INDEXES) - 1)
+
+/** `offset` of node `field` in `type` */
+#define rbmulti_node_offset(type, field) ((ptrdiff_t)offsetof(type, field))
+
+typedef struct rbmulti_index_s rbmulti_index_t;
+struct rbmulti_index_s {
+    ptrdiff_t offset;
+    rbtree_compare compare;
+    int unique;
+};
+
+typedef struct rbmulti_s rbmulti_t;
+struct rbmulti_s {
+    rbtree_t trees[RBMULTI_MAX_INDEXES];
+    rbmulti_index_t indexes[RBMULTI_MAX_INDEXES];
+    size_t count;
+};
+
+/** change keys of `record` in place, rbmulti_modify works out which ones */
+typedef void (*rbmulti_modifier)(void *record, void *ctx);
+
+
+/** `count` indexes, described by `indexes` */
+int
+rbmulti_init(rbmulti_t *multi, const rbmulti_index_t *indexes, size_t count);
+
+/**
+ * link `record` into every index, or into none and return
+ * RBTREE_DUPLICATE with `*exist` set to the record it clashed with
+ */
+int
+rbmulti_insert(rbmulti_t *multi, void *record, void **exist);
+
+/** unlink `record` from every index */
+int
+rbmulti_erase(rbmulti_t *multi, void *record);
+
+/**
+ * change `record` by `modify`, then re-sort it in those indexes only
+ * where it is out of order with its neighbours now. only indexes with
+ * their bit set in `mask` are checked, keys of others must not change.
+ *
+ * if new keys clash in a unique index, `rollback` is called to restore
+ * them and the record stays as it was. without `rollback` the record is
+ * erased from every index. either way RBTREE_DUPLICATE is returned.
+ */
+int
+rbmulti_modify(rbmulti_t *multi,
+               void *record,
+               unsigned mask,
+               rbmulti_modifier modify,
+               rbmulti_modifier rollback,
+               void *ctx);
+
+/** search in `index`, `*ret` is the record */
+int
+rbmulti_search_key(rbmulti_t *multi,
+                   size_t index,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_search_mode_t mode,
+                   void **ret);
+
+
+/** tree of `index`, to walk in its order */
+static inline rbtree_t *
+rbmulti_tree(rbmulti_t *multi, size_t index)
+{
+    return &multi->trees[index];
+}
+
+
+static inline rbtree_node_t *
+rbmulti_node(rbmulti_t *multi, size_t index, void *record)
+{
+    return (rbtree_node_t *)((char *)record + multi->indexes[index].offset);
+}
+
+
+static inline void *
+rbmulti_record(rbmulti_t *multi, size_t index, rbtree_node_t *node)
+{
+    return node == NULL ? NULL : (char *)node - multi->indexes[index].offset;
+}
+
+
+static inline size_t
+rbmulti_size(rbmulti_t *multi)
+{
+    return multi->count > 0 ? rbtree_size(&multi->trees[0]) : 0;
+}
+
+
+#endif
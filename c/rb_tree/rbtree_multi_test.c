@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_multi.c"
+
+enum { TEST_BY_ID, TEST_BY_TIME, TEST_BY_OWNER, TEST_INDEXES };
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    int id;
+    int time;
+    int owner;
+    int in_tree;
+    rbtree_node_t by_id;
+    rbtree_node_t by_time;
+    rbtree_node_t by_owner;
+};
+
+#define test_record_of(ptr, field) \
+    ((test_record_t *)((uintptr_t)(ptr) - offsetof(test_record_t, field)))
+
+static size_t test_compares[TEST_INDEXES];
+
+
+static int
+test_id_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = test_record_of(na, by_id)->id;
+    int bkey = test_record_of(nb, by_id)->id;
+
+    test_compares[TEST_BY_ID]++;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_time_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = test_record_of(na, by_time)->time;
+    int bkey = test_record_of(nb, by_time)->time;
+
+    test_compares[TEST_BY_TIME]++;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_owner_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = test_record_of(na, by_owner)->owner;
+    int bkey = test_record_of(nb, by_owner)->owner;
+
+    test_compares[TEST_BY_OWNER]++;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_id_key_compare(const void *key, rbtree_node_t *node)
+{
+    int akey = *(const int *)key;
+    int bkey = test_record_of(node, by_id)->id;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static const rbmulti_index_t test_indexes[TEST_INDEXES] = {
+    { rbmulti_node_offset(test_record_t, by_id),    test_id_compare,    1 },
+    { rbmulti_node_offset(test_record_t, by_time),  test_time_compare,  0 },
+    { rbmulti_node_offset(test_record_t, by_owner), test_owner_compare, 0 },
+};
+
+
+/** new keys for a record, and the old ones for rollback */
+typedef struct test_change_s test_change_t;
+struct test_change_s {
+    int id;
+    int time;
+    int owner;
+    int old_id;
+    int old_time;
+    int old_owner;
+};
+
+
+static void
+test_modify(void *record, void *ctx)
+{
+    test_record_t *rec = record;
+    test_change_t *change = ctx;
+
+    change->old_id = rec->id;
+    change->old_time = rec->time;
+    change->old_owner = rec->owner;
+
+    rec->id = change->id;
+    rec->time = change->time;
+    rec->owner = change->owner;
+}
+
+
+static void
+test_rollback(void *record, void *ctx)
+{
+    test_record_t *rec = record;
+    test_change_t *change = ctx;
+
+    rec->id = change->old_id;
+    rec->time = change->old_time;
+    rec->owner = change->old_owner;
+}
+
+
+/** every index is in order, holds `count` records and only those in tree */
+static void
+test_is_multi(rbmulti_t *multi, size_t count)
+{
+    for (size_t index = 0; index < TEST_INDEXES; index++) {
+        rbtree_t *tree = rbmulti_tree(multi, index);
+        rbtree_node_t *prev = NULL;
+        size_t seen = 0;
+
+        CU_ASSERT(rbtree_size(tree) == count);
+
+        for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+            test_record_t *record = rbmulti_record(multi, index, node);
+            CU_ASSERT(record->in_tree);
+
+            if (prev != NULL) {
+                int cmp = tree->compare(prev, node);
+                CU_ASSERT(test_indexes[index].unique ? cmp < 0 : cmp <= 0);
+            }
+
+            prev = node;
+            seen++;
+        }
+
+        CU_ASSERT(seen == count);
+    }
+}
+
+
+static void
+test_basic(void)
+{
+    rbmulti_t multi;
+    test_record_t records[4] = {
+        { .id = 1, .time = 30, .owner = 7 },
+        { .id = 2, .time = 10, .owner = 7 },
+        { .id = 3, .time = 20, .owner = 5 },
+        { .id = 2, .time = 40, .owner = 9 },
+    };
+
+    CU_ASSERT(rbmulti_init(NULL, test_indexes, TEST_INDEXES) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbmulti_init(&multi, test_indexes, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbmulti_init(&multi, test_indexes, RBMULTI_MAX_INDEXES + 1) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbmulti_init(&multi, test_indexes, TEST_INDEXES) == RBTREE_OK);
+
+    for (int idx = 0; idx < 3; idx++) {
+        CU_ASSERT(rbmulti_insert(&multi, &records[idx], NULL) == RBTREE_OK);
+        records[idx].in_tree = 1;
+    }
+
+    /** id 2 is taken, so it goes into no index */
+    void *exist = NULL;
+    CU_ASSERT(rbmulti_insert(&multi, &records[3], &exist) == RBTREE_DUPLICATE);
+    CU_ASSERT(exist == &records[1]);
+    CU_ASSERT(rbmulti_size(&multi) == 3);
+    test_is_multi(&multi, 3);
+
+    /** each index has its own order */
+    rbtree_node_t *first = rbtree_first(rbmulti_tree(&multi, TEST_BY_TIME));
+    CU_ASSERT(rbmulti_record(&multi, TEST_BY_TIME, first) == &records[1]);
+    first = rbtree_first(rbmulti_tree(&multi, TEST_BY_OWNER));
+    CU_ASSERT(rbmulti_record(&multi, TEST_BY_OWNER, first) == &records[2]);
+
+    void *found = NULL;
+    int key = 3;
+    CU_ASSERT(rbmulti_search_key(&multi, TEST_BY_ID, &key, test_id_key_compare, RBTREE_SEARCH_MODE_EQ, &found) == RBTREE_OK);
+    CU_ASSERT(found == &records[2]);
+    CU_ASSERT(rbmulti_search_key(&multi, TEST_INDEXES, &key, test_id_key_compare, RBTREE_SEARCH_MODE_EQ, &found) == RBTREE_INVALID_ARG);
+
+    /** a new time touches the time index only */
+    test_change_t change = { .id = 3, .time = 5, .owner = 5 };
+    memset(test_compares, 0, sizeof(test_compares));
+    CU_ASSERT(rbmulti_modify(&multi, &records[2], RBMULTI_ALL_INDEXES, test_modify, test_rollback, &change) == RBTREE_OK);
+    CU_ASSERT(records[2].time == 5);
+    CU_ASSERT(test_compares[TEST_BY_ID] <= 2 && test_compares[TEST_BY_OWNER] <= 2);
+    first = rbtree_first(rbmulti_tree(&multi, TEST_BY_TIME));
+    CU_ASSERT(rbmulti_record(&multi, TEST_BY_TIME, first) == &records[2]);
+    test_is_multi(&multi, 3);
+
+    /** with a mask other indexes are not even checked */
+    change = (test_change_t){ .id = 3, .time = 50, .owner = 5 };
+    memset(test_compares, 0, sizeof(test_compares));
+    CU_ASSERT(rbmulti_modify(&multi, &records[2], 1u << TEST_BY_TIME, test_modify, test_rollback, &change) == RBTREE_OK);
+    CU_ASSERT(test_compares[TEST_BY_ID] == 0 && test_compares[TEST_BY_OWNER] == 0);
+    CU_ASSERT(test_compares[TEST_BY_TIME] > 0);
+    first = rbtree_last(rbmulti_tree(&multi, TEST_BY_TIME));
+    CU_ASSERT(rbmulti_record(&multi, TEST_BY_TIME, first) == &records[2]);
+    test_is_multi(&multi, 3);
+
+    /** an id which is taken is rolled back */
+    change = (test_change_t){ .id = 1, .time = 99, .owner = 1 };
+    CU_ASSERT(rbmulti_modify(&multi, &records[2], RBMULTI_ALL_INDEXES, test_modify, test_rollback, &change) == RBTREE_DUPLICATE);
+    CU_ASSERT(records[2].id == 3 && records[2].time == 50 && records[2].owner == 5);
+    test_is_multi(&multi, 3);
+
+    /** and without rollback the record is dropped */
+    CU_ASSERT(rbmulti_modify(&multi, &records[2], RBMULTI_ALL_INDEXES, test_modify, NULL, &change) == RBTREE_DUPLICATE);
+    records[2].in_tree = 0;
+    test_is_multi(&multi, 2);
+
+    CU_ASSERT(rbmulti_erase(&multi, &records[0]) == RBTREE_OK);
+    records[0].in_tree = 0;
+    test_is_multi(&multi, 1);
+}
+
+
+static void
+test_random(void)
+{
+    enum { RECORDS = 3000, ROUNDS = 30000 };
+    static test_record_t records[RECORDS];
+
+    rbmulti_t multi;
+    rbmulti_init(&multi, test_indexes, TEST_INDEXES);
+    memset(records, 0, sizeof(records));
+
+    srand(20171111);
+
+    size_t in_tree = 0;
+    size_t resorted = 0, checks = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        test_record_t *record = &records[rand() % RECORDS];
+        int op = rand() % 3;
+
+        if (!record->in_tree) {
+            record->id = rand() % (2 * RECORDS);
+            record->time = rand() % 1000;
+            record->owner = rand() % 50;
+
+            void *exist = NULL;
+            int err = rbmulti_insert(&multi, record, &exist);
+            if (err == RBTREE_OK) {
+                record->in_tree = 1;
+                in_tree++;
+            }
+            else {
+                CU_ASSERT(err == RBTREE_DUPLICATE);
+                CU_ASSERT(((test_record_t *)exist)->id == record->id);
+            }
+        }
+        else if (op == 0) {
+            CU_ASSERT(rbmulti_erase(&multi, record) == RBTREE_OK);
+            record->in_tree = 0;
+            in_tree--;
+        }
+        else {
+            /** mostly one key at a time, sometimes all of them */
+            test_change_t change = { record->id, record->time, record->owner };
+            int which = rand() % 4;
+
+            if (which == 0 || which == 3) {
+                change.id = rand() % (2 * RECORDS);
+            }
+
+            if (which == 1 || which == 3) {
+                change.time += rand() % 21 - 10;
+            }
+
+            if (which == 2 || which == 3) {
+                change.owner = rand() % 50;
+            }
+
+            memset(test_compares, 0, sizeof(test_compares));
+            int err = rbmulti_modify(&multi, record, RBMULTI_ALL_INDEXES, test_modify, op == 1 ? test_rollback : NULL, &change);
+
+            if (err == RBTREE_OK) {
+                CU_ASSERT(record->id == change.id && record->time == change.time);
+            }
+            else {
+                CU_ASSERT(err == RBTREE_DUPLICATE);
+
+                if (op == 1) {
+                    CU_ASSERT(record->id == change.old_id && record->time == change.old_time);
+                }
+                else {
+                    record->in_tree = 0;
+                    in_tree--;
+                }
+            }
+
+            /** indexes whose key is unchanged see only the neighbour check */
+            if (which == 1) {
+                CU_ASSERT(test_compares[TEST_BY_ID] <= 2);
+                CU_ASSERT(test_compares[TEST_BY_OWNER] <= 2);
+                checks++;
+                resorted += test_compares[TEST_BY_TIME] > 2;
+            }
+        }
+
+        if (round % 503 == 0) {
+            test_is_multi(&multi, in_tree);
+        }
+    }
+
+    test_is_multi(&multi, in_tree);
+
+    /** small steps in time mostly keep their place */
+    CU_ASSERT(checks > 0 && resorted < checks);
+
+    for (int idx = 0; idx < RECORDS; idx++) {
+        if (records[idx].in_tree) {
+            void *found = NULL;
+            CU_ASSERT(rbmulti_search_key(&multi, TEST_BY_ID, &records[idx].id, test_id_key_compare,
+                                         RBTREE_SEARCH_MODE_EQ, &found) == RBTREE_OK);
+            CU_ASSERT(found == &records[idx]);
+        }
+    }
+}
+
+
+/** equal keys of a non unique index go newest first, as in rbtree_insert */
+static void
+test_duplicate_order(void)
+{
+    rbmulti_t multi;
+    rbmulti_init(&multi, test_indexes, TEST_INDEXES);
+
+    rbtree_t plain;
+    rbtree_init(&plain, test_owner_compare);
+
+    test_record_t records[4];
+    test_record_t others[4];
+    memset(records, 0, sizeof(records));
+    memset(others, 0, sizeof(others));
+
+    for (int idx = 0; idx < 4; idx++) {
+        records[idx].id = idx;
+        records[idx].time = idx;
+        records[idx].owner = 7;
+        others[idx].owner = 7;
+
+        CU_ASSERT(rbmulti_insert(&multi, &records[idx], NULL) == RBTREE_OK);
+        rbtree_insert(&plain, &others[idx].by_owner);
+    }
+
+    rbtree_t *tree = rbmulti_tree(&multi, TEST_BY_OWNER);
+    rbtree_node_t *other = rbtree_first(&plain);
+
+    for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+        CU_ASSERT_FATAL(other != NULL);
+        CU_ASSERT(test_record_of(node, by_owner) - records == test_record_of(other, by_owner) - others);
+        other = rbtree_next(&plain, other);
+    }
+
+    CU_ASSERT(other == NULL);
+    CU_ASSERT(test_record_of(rbtree_first(tree), by_owner) == &records[3]);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbmulti[] = {
+    { "test_basic",           test_basic           },
+    { "test_random",          test_random          },
+    { "test_duplicate_order", test_duplicate_order },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbmulti",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbmulti,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,317 @@
+/**
+ * file name: rbtree_par.c
+ *
+ * parallel traversal implemention
+ *
+ * the top `depth` levels are walked in order into pieces, either a
+ * single node above the cut or a whole subtree at it. subtrees become
+ * tasks, each thread gets a run of neighbouring ones in its deque, takes
+ * from its front and steals from the back of others once it runs dry.
+ * no task makes new ones, so all deques empty means done.
+ *
+ * for reduce, every task fills its own accumulator, the caller folds
+ * single nodes and accumulators piece by piece in key order at the end.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rbtree_par.h"
+
+
+typedef struct rbtree_par_piece_s rbtree_par_piece_t;
+struct rbtree_par_piece_s {
+    rbtree_node_t *node;
+    /** whole subtree of node, else node alone */
+    int subtree;
+};
+
+/** tasks [top, bottom) not taken yet */
+typedef struct rbtree_par_deque_s rbtree_par_deque_t;
+struct rbtree_par_deque_s {
+    pthread_mutex_t lock;
+    size_t top;
+    size_t bottom;
+};
+
+typedef struct rbtree_par_s rbtree_par_t;
+struct rbtree_par_s {
+    rbtree_t *tree;
+
+    rbtree_par_piece_t *pieces;
+    size_t piece_count;
+    /** of subtree pieces, in key order */
+    rbtree_node_t **tasks;
+    size_t task_count;
+
+    rbtree_par_deque_t *deques;
+    size_t threads;
+
+    rbtree_visit visit;
+    void *ctx;
+
+    const rbtree_reducer_t *reducer;
+    /** one accumulator per task */
+    char *partials;
+};
+
+typedef struct rbtree_par_worker_s rbtree_par_worker_t;
+struct rbtree_par_worker_s {
+    pthread_t thread;
+    rbtree_par_t *par;
+    size_t id;
+};
+
+
+static void
+rbtree_par_cut(rbtree_par_t *par, rbtree_node_t *node, size_t depth, size_t cut)
+{
+    if (rbtree_is_sentinel(par->tree, node)) {
+        return;
+    }
+
+    if (depth == cut) {
+        par->pieces[par->piece_count++] = (rbtree_par_piece_t){ node, 1 };
+        par->tasks[par->task_count++] = node;
+
+        return;
+    }
+
+    rbtree_par_cut(par, node->left, depth + 1, cut);
+    par->pieces[par->piece_count++] = (rbtree_par_piece_t){ node, 0 };
+    rbtree_par_cut(par, node->right, depth + 1, cut);
+}
+
+
+static void
+rbtree_par_run_task(rbtree_par_t *par, size_t task)
+{
+    rbtree_t *tree = par->tree;
+    rbtree_node_t *node = par->tasks[task];
+
+    rbtree_node_t *last = node;
+    while (!rbtree_is_sentinel(tree, last->right)) {
+        last = last->right;
+    }
+
+    while (!rbtree_is_sentinel(tree, node->left)) {
+        node = node->left;
+    }
+
+    /** rbtree_next stays inside the subtree until `last` */
+    if (par->reducer != NULL) {
+        const rbtree_reducer_t *reducer = par->reducer;
+        void *acc = par->partials + task * reducer->size;
+
+        reducer->init(acc, reducer->ctx);
+        for (;; node = rbtree_next(tree, node)) {
+            reducer->accumulate(acc, node, reducer->ctx);
+            if (node == last) {
+                break;
+            }
+        }
+    }
+    else {
+        for (;; node = rbtree_next(tree, node)) {
+            par->visit(node, par->ctx);
+            if (node == last) {
+                break;
+            }
+        }
+    }
+}
+
+
+/** front of own deque, or back of another, -1 once all are empty */
+static long
+rbtree_par_take(rbtree_par_t *par, size_t id)
+{
+    for (size_t step = 0; step < par->threads; step++) {
+        rbtree_par_deque_t *deque = &par->deques[(id + step) % par->threads];
+        long task = -1;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->top < deque->bottom) {
+            task = step == 0 ? (long)deque->top++ : (long)--deque->bottom;
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (task >= 0) {
+            return task;
+        }
+    }
+
+    return -1;
+}
+
+
+static void *
+rbtree_par_worker(void *arg)
+{
+    rbtree_par_worker_t *worker = arg;
+
+    for (;;) {
+        long task = rbtree_par_take(worker->par, worker->id);
+        if (task < 0) {
+            return NULL;
+        }
+
+        rbtree_par_run_task(worker->par, (size_t)task);
+    }
+}
+
+
+static int
+rbtree_par_run(rbtree_par_t *par, size_t threads)
+{
+    rbtree_t *tree = par->tree;
+
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+
+    /** enough subtrees to keep every thread busy, none for one thread */
+    size_t cut = 0;
+    while (threads > 1 && cut < RBTREE_PAR_MAX_DEPTH && ((size_t)1 << cut) < threads * RBTREE_PAR_TASKS) {
+        cut++;
+    }
+
+    size_t max_pieces = ((size_t)2 << cut) - 1;
+    par->pieces = malloc(max_pieces * sizeof(*par->pieces));
+    par->tasks  = malloc(((size_t)1 << cut) * sizeof(*par->tasks));
+    if (par->pieces == NULL || par->tasks == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    rbtree_par_cut(par, tree->root, 0, cut);
+
+    if (par->task_count < threads) {
+        threads = par->task_count > 0 ? par->task_count : 1;
+    }
+
+    par->threads = threads;
+    par->deques  = malloc(threads * sizeof(*par->deques));
+    rbtree_par_worker_t *workers = malloc(threads * sizeof(*workers));
+
+    if (par->reducer != NULL && par->task_count > 0) {
+        par->partials = malloc(par->task_count * par->reducer->size);
+    }
+
+    if (par->deques == NULL || workers == NULL
+        || (par->reducer != NULL && par->task_count > 0 && par->partials == NULL))
+    {
+        free(workers);
+
+        return RBTREE_NO_SPACE;
+    }
+
+    for (size_t idx = 0; idx < threads; idx++) {
+        pthread_mutex_init(&par->deques[idx].lock, NULL);
+        par->deques[idx].top    = par->task_count * idx / threads;
+        par->deques[idx].bottom = par->task_count * (idx + 1) / threads;
+
+        workers[idx].par = par;
+        workers[idx].id  = idx;
+    }
+
+    /** a thread that fails to start leaves its tasks to be stolen */
+    size_t started = 1;
+    for (size_t idx = 1; idx < threads; idx++) {
+        if (pthread_create(&workers[idx].thread, NULL, rbtree_par_worker, &workers[idx]) != 0) {
+            break;
+        }
+
+        started++;
+    }
+
+    rbtree_par_worker(&workers[0]);
+
+    for (size_t idx = 1; idx < started; idx++) {
+        pthread_join(workers[idx].thread, NULL);
+    }
+
+    for (size_t idx = 0; idx < threads; idx++) {
+        pthread_mutex_destroy(&par->deques[idx].lock);
+    }
+
+    free(workers);
+
+    return RBTREE_OK;
+}
+
+
+static void
+rbtree_par_free(rbtree_par_t *par)
+{
+    free(par->pieces);
+    free(par->tasks);
+    free(par->deques);
+    free(par->partials);
+}
+
+
+int
+rbtree_parallel_foreach(rbtree_t *tree, size_t threads, rbtree_visit visit, void *ctx)
+{
+    rbtree_must(tree != NULL && visit != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_par_t par;
+    memset(&par, 0, sizeof(par));
+    par.tree  = tree;
+    par.visit = visit;
+    par.ctx   = ctx;
+
+    int ret = rbtree_par_run(&par, threads);
+    if (ret == RBTREE_OK) {
+        /** nodes above the cut */
+        for (size_t idx = 0; idx < par.piece_count; idx++) {
+            if (!par.pieces[idx].subtree) {
+                visit(par.pieces[idx].node, ctx);
+            }
+        }
+    }
+
+    rbtree_par_free(&par);
+
+    return ret;
+}
+
+
+int
+rbtree_parallel_reduce(rbtree_t *tree,
+                       size_t threads,
+                       const rbtree_reducer_t *reducer,
+                       void *result)
+{
+    rbtree_must(tree != NULL && reducer != NULL && result != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(reducer->init != NULL && reducer->accumulate != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(reducer->combine != NULL && reducer->size > 0, RBTREE_INVALID_ARG);
+
+    rbtree_par_t par;
+    memset(&par, 0, sizeof(par));
+    par.tree    = tree;
+    par.reducer = reducer;
+
+    int ret = rbtree_par_run(&par, threads);
+    if (ret == RBTREE_OK) {
+        reducer->init(result, reducer->ctx);
+
+        size_t task = 0;
+        for (size_t idx = 0; idx < par.piece_count; idx++) {
+            if (par.pieces[idx].subtree) {
+                reducer->combine(result, par.partials + task++ * reducer->size, reducer->ctx);
+            }
+            else {
+                reducer->accumulate(result, par.pieces[idx].node, reducer->ctx);
+            }
+        }
+    }
+
+    rbtree_par_free(&par);
+
+    return ret;
+}
@@ -0,0 +1,64 @@
+/**
+ * file name: rbtree_par.h
+ *
+ * head file of parallel traversal
+ *
+ * the tree is cut near its root into disjoint subtrees, which run as
+ * tasks on a work stealing pool of threads started for the call. the
+ * caller's thread is one of them. tasks are made several per thread,
+ * so subtrees of uneven size even out by stealing.
+ *
+ * the tree must not be modified during a call.
+ */
+#ifndef __RB_TREE_PAR_H__
+#define __RB_TREE_PAR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+/** tasks made per thread */
+#define RBTREE_PAR_TASKS 16
+
+/** cut no deeper than this, 2^depth subtrees at most */
+#define RBTREE_PAR_MAX_DEPTH 16
+
+typedef void (*rbtree_visit)(rbtree_node_t *node, void *ctx);
+
+/**
+ * a fold over nodes in key order
+ *
+ * every task folds its subtree into an accumulator of `size` bytes
+ * made by `init`, accumulators are then combined in key order, so
+ * `combine` has to be associative but not commutative.
+ */
+typedef struct rbtree_reducer_s rbtree_reducer_t;
+struct rbtree_reducer_s {
+    size_t size;
+    void (*init)(void *acc, void *ctx);
+    void (*accumulate)(void *acc, rbtree_node_t *node, void *ctx);
+    /** fold `next`, which covers keys after those of `acc`, into `acc` */
+    void (*combine)(void *acc, const void *next, void *ctx);
+    void *ctx;
+};
+
+
+/**
+ * call `visit` on every node, from `threads` threads at once, 0 for one
+ * per online cpu. nodes of one subtree are visited in order, subtrees
+ * in no order.
+ */
+int
+rbtree_parallel_foreach(rbtree_t *tree, size_t threads, rbtree_visit visit, void *ctx);
+
+/** fold every node into `result`, as a sequential fold in key order would */
+int
+rbtree_parallel_reduce(rbtree_t *tree,
+                       size_t threads,
+                       const rbtree_reducer_t *reducer,
+                       void *result);
+
+
+#endif
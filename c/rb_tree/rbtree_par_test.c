@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_par.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    uint64_t key;
+    _Atomic int visits;
+    rbtree_node_t node;
+};
+
+#define test_record_of(ptr) \
+    ((test_record_t *)((uintptr_t)(ptr) - offsetof(test_record_t, node)))
+
+
+static int
+test_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = test_record_of(na)->key;
+    uint64_t bkey = test_record_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+test_visit(rbtree_node_t *node, void *ctx)
+{
+    atomic_fetch_add(&test_record_of(node)->visits, 1);
+    atomic_fetch_add((_Atomic uint64_t *)ctx, test_record_of(node)->key);
+}
+
+
+/** polynomial hash of keys in order, combines only if order is kept */
+typedef struct test_acc_s test_acc_t;
+struct test_acc_s {
+    uint64_t hash;
+    uint64_t pow;
+    uint64_t count;
+};
+
+#define TEST_BASE 1000003u
+
+
+static void
+test_init(void *acc, void *ctx)
+{
+    *(test_acc_t *)acc = (test_acc_t){ 0, 1, 0 };
+}
+
+
+static void
+test_accumulate(void *acc, rbtree_node_t *node, void *ctx)
+{
+    test_acc_t *sum = acc;
+
+    sum->hash = sum->hash * TEST_BASE + test_record_of(node)->key;
+    sum->pow *= TEST_BASE;
+    sum->count++;
+}
+
+
+static void
+test_combine(void *acc, const void *next, void *ctx)
+{
+    test_acc_t *sum = acc;
+    const test_acc_t *more = next;
+
+    sum->hash = sum->hash * more->pow + more->hash;
+    sum->pow *= more->pow;
+    sum->count += more->count;
+}
+
+
+static const rbtree_reducer_t test_reducer = {
+    .size       = sizeof(test_acc_t),
+    .init       = test_init,
+    .accumulate = test_accumulate,
+    .combine    = test_combine,
+};
+
+
+static void
+test_sizes(size_t count)
+{
+    test_record_t *records = malloc((count + 1) * sizeof(*records));
+    CU_ASSERT_FATAL(records != NULL);
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    srand(20171014 + count);
+    for (size_t idx = 0; idx < count; idx++) {
+        records[idx].key = rand();
+        rbtree_insert(&tree, &records[idx].node);
+    }
+
+    /** what a plain fold in order gives */
+    test_acc_t expect;
+    test_init(&expect, NULL);
+
+    uint64_t key_sum = 0;
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        test_accumulate(&expect, node, NULL);
+        key_sum += test_record_of(node)->key;
+    }
+
+    size_t thread_counts[] = { 1, 2, 3, 8, 0 };
+    for (size_t run = 0; run < sizeof(thread_counts) / sizeof(thread_counts[0]); run++) {
+        for (size_t idx = 0; idx < count; idx++) {
+            atomic_init(&records[idx].visits, 0);
+        }
+
+        _Atomic uint64_t sum;
+        atomic_init(&sum, 0);
+        CU_ASSERT(rbtree_parallel_foreach(&tree, thread_counts[run], test_visit, &sum) == RBTREE_OK);
+        CU_ASSERT(atomic_load(&sum) == key_sum);
+
+        int once = 1;
+        for (size_t idx = 0; idx < count; idx++) {
+            once &= atomic_load(&records[idx].visits) == 1;
+        }
+
+        CU_ASSERT(once);
+
+        test_acc_t result;
+        CU_ASSERT(rbtree_parallel_reduce(&tree, thread_counts[run], &test_reducer, &result) == RBTREE_OK);
+        CU_ASSERT(result.count == count);
+        CU_ASSERT(result.hash == expect.hash);
+    }
+
+    free(records);
+}
+
+
+static void
+test_foreach_reduce(void)
+{
+    test_sizes(0);
+    test_sizes(1);
+    test_sizes(7);
+    test_sizes(1000);
+    test_sizes(100000);
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    test_acc_t result;
+    rbtree_reducer_t broken = test_reducer;
+    broken.combine = NULL;
+
+    CU_ASSERT(rbtree_parallel_foreach(NULL, 1, test_visit, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_parallel_foreach(&tree, 1, NULL, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_parallel_reduce(&tree, 1, &broken, &result) == RBTREE_INVALID_ARG);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbtree_par[] = {
+    { "test_foreach_reduce", test_foreach_reduce },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbtree_par",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_par,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,221 @@
+/**
+ * file name: rbtree_quant.c
+ *
+ * sliding window quantile tracker implemention
+ *
+ * the ring slot of a sample is its record, so adding and expiring never
+ * allocate. a sample leaves the tree when its slot is reused or expires.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbtree_quant.h"
+
+
+#define rbquant_sample_of(ptr) \
+    ((rbquant_sample_t *)((uintptr_t)(ptr) - offsetof(rbquant_sample_t, node)))
+
+
+static int
+rbquant_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t avalue = rbquant_sample_of(na)->value;
+    uint64_t bvalue = rbquant_sample_of(nb)->value;
+
+    return (avalue > bvalue) - (avalue < bvalue);
+}
+
+
+static inline size_t
+rbquant_count(rbtree_t *tree, rbtree_node_t *node)
+{
+    return rbtree_is_sentinel(tree, node) ? 0 : rbquant_sample_of(node)->count;
+}
+
+
+static void
+rbquant_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    rbquant_sample_of(node)->count = 1 + rbquant_count(tree, node->left) + rbquant_count(tree, node->right);
+}
+
+
+int
+rbquant_init(rbquant_t *quant, size_t capacity, uint64_t window)
+{
+    rbtree_must(quant != NULL && capacity > 0, RBTREE_INVALID_ARG);
+
+    memset(quant, 0, sizeof(*quant));
+
+    quant->ring = malloc(capacity * sizeof(*quant->ring));
+    if (quant->ring == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    quant->capacity = capacity;
+    quant->window = window;
+
+    rbtree_init(&quant->tree, rbquant_compare);
+    rbtree_set_augment(&quant->tree, rbquant_augment);
+
+    return RBTREE_OK;
+}
+
+
+void
+rbquant_destroy(rbquant_t *quant)
+{
+    if (quant == NULL) {
+        return;
+    }
+
+    free(quant->ring);
+    quant->ring = NULL;
+    quant->capacity = 0;
+    rbtree_init(&quant->tree, rbquant_compare);
+}
+
+
+static void
+rbquant_drop_oldest(rbquant_t *quant)
+{
+    rbtree_delete(&quant->tree, &quant->ring[quant->head].node);
+
+    quant->head++;
+    if (quant->head == quant->capacity) {
+        quant->head = 0;
+    }
+}
+
+
+size_t
+rbquant_expire(rbquant_t *quant, uint64_t now)
+{
+    /** a `now` gone back would wrap the age below and drop every sample */
+    if (quant == NULL || now < quant->now) {
+        return 0;
+    }
+
+    quant->now = now;
+
+    if (quant->window == 0) {
+        return 0;
+    }
+
+    size_t dropped = 0;
+    while (rbquant_size(quant) > 0 && now - quant->ring[quant->head].time >= quant->window) {
+        rbquant_drop_oldest(quant);
+        dropped++;
+    }
+
+    return dropped;
+}
+
+
+int
+rbquant_add(rbquant_t *quant, uint64_t value, uint64_t now)
+{
+    rbtree_must(quant != NULL && quant->ring != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(now >= quant->now, RBTREE_INVALID_ARG);
+
+    quant->now = now;
+    rbquant_expire(quant, now);
+
+    size_t size = rbquant_size(quant);
+    if (size == quant->capacity) {
+        rbquant_drop_oldest(quant);
+        size--;
+    }
+
+    size_t tail = quant->head + size;
+    if (tail >= quant->capacity) {
+        tail -= quant->capacity;
+    }
+
+    rbquant_sample_t *sample = &quant->ring[tail];
+    sample->value = value;
+    sample->time  = now;
+
+    return rbtree_insert(&quant->tree, &sample->node);
+}
+
+
+int
+rbquant_select(rbquant_t *quant, size_t k, uint64_t *value)
+{
+    rbtree_must(quant != NULL && value != NULL, RBTREE_INVALID_ARG);
+
+    rbtree_t *tree = &quant->tree;
+    if (k >= rbtree_size(tree)) {
+        return RBTREE_NOT_FOUND;
+    }
+
+    rbtree_node_t *node = tree->root;
+    for (;;) {
+        size_t left = rbquant_count(tree, node->left);
+
+        if (k < left) {
+            node = node->left;
+        }
+        else if (k == left) {
+            *value = rbquant_sample_of(node)->value;
+
+            return RBTREE_OK;
+        }
+        else {
+            k -= left + 1;
+            node = node->right;
+        }
+    }
+}
+
+
+int
+rbquant_query(rbquant_t *quant, double quantile, uint64_t *value)
+{
+    rbtree_must(quant != NULL && value != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(quantile >= 0.0 && quantile <= 1.0, RBTREE_INVALID_ARG);
+
+    size_t size = rbquant_size(quant);
+    if (size == 0) {
+        return RBTREE_NOT_FOUND;
+    }
+
+    /** ceil without libm, rank 0 is taken as the smallest too */
+    double exact = quantile * (double)size;
+    size_t rank = (size_t)exact;
+    if ((double)rank < exact) {
+        rank++;
+    }
+
+    if (rank > size) {
+        rank = size;
+    }
+
+    return rbquant_select(quant, rank > 0 ? rank - 1 : 0, value);
+}
+
+
+size_t
+rbquant_rank(rbquant_t *quant, uint64_t value)
+{
+    if (quant == NULL) {
+        return 0;
+    }
+
+    rbtree_t *tree = &quant->tree;
+    rbtree_node_t *node = tree->root;
+    size_t rank = 0;
+
+    while (!rbtree_is_sentinel(tree, node)) {
+        if (rbquant_sample_of(node)->value < value) {
+            rank += rbquant_count(tree, node->left) + 1;
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+
+    return rank;
+}
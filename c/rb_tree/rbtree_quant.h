@@ -0,0 +1,87 @@
+/**
+ * file name: rbtree_quant.h
+ *
+ * head file of sliding window quantile tracker
+ *
+ * samples of the window sit in a rbtree ordered by value, every node
+ * keeps the size of its subtree through rbtree_set_augment, so the k-th
+ * smallest value is found in one descent. they also sit in a ring in
+ * arrival order, which is time order, so the oldest are always at its
+ * head when they expire.
+ *
+ * the tracker never reads a clock, every call takes `now` in caller's
+ * unit and it must not go backwards.
+ */
+#ifndef __RB_TREE_QUANT_H__
+#define __RB_TREE_QUANT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+typedef struct rbquant_sample_s rbquant_sample_t;
+struct rbquant_sample_s {
+    rbtree_node_t node;
+    uint64_t value;
+    uint64_t time;
+    /** samples in subtree of node */
+    size_t count;
+};
+
+typedef struct rbquant_s rbquant_t;
+struct rbquant_s {
+    rbtree_t tree;
+    /** ring of samples, oldest at `head` */
+    rbquant_sample_t *ring;
+    size_t capacity;
+    size_t head;
+    /** samples older than this are dropped, 0 for no time limit */
+    uint64_t window;
+    uint64_t now;
+};
+
+
+/**
+ * track at most `capacity` samples of the last `window` time units,
+ * past capacity the oldest sample makes room for a new one
+ */
+int
+rbquant_init(rbquant_t *quant, size_t capacity, uint64_t window);
+
+void
+rbquant_destroy(rbquant_t *quant);
+
+/** add a sample taken at `now`, RBTREE_INVALID_ARG if `now` went back */
+int
+rbquant_add(rbquant_t *quant, uint64_t value, uint64_t now);
+
+/** drop samples out of window at `now`, returns how many, none if `now` went back */
+size_t
+rbquant_expire(rbquant_t *quant, uint64_t now);
+
+/**
+ * value at `quantile` in [0, 1] by nearest rank, the ceil(q * n)-th
+ * smallest of n samples, 0 is the smallest. RBTREE_NOT_FOUND if empty.
+ */
+int
+rbquant_query(rbquant_t *quant, double quantile, uint64_t *value);
+
+/** k-th smallest sample value, k from 0 */
+int
+rbquant_select(rbquant_t *quant, size_t k, uint64_t *value);
+
+/** samples less than `value` */
+size_t
+rbquant_rank(rbquant_t *quant, uint64_t value);
+
+
+static inline size_t
+rbquant_size(rbquant_t *quant)
+{
+    return rbtree_size(&quant->tree);
+}
+
+
+#endif
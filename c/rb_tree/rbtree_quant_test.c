@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_quant.c"
+
+
+static int
+test_value_compare(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+
+    return (va > vb) - (va < vb);
+}
+
+
+/** values of samples in window, sorted, as the sort-based way does it */
+static size_t
+test_window(rbquant_t *quant, uint64_t *sorted)
+{
+    size_t size = rbquant_size(quant);
+
+    for (size_t idx = 0; idx < size; idx++) {
+        sorted[idx] = quant->ring[(quant->head + idx) % quant->capacity].value;
+    }
+
+    qsort(sorted, size, sizeof(*sorted), test_value_compare);
+
+    return size;
+}
+
+
+static void
+test_basic(void)
+{
+    rbquant_t quant;
+    uint64_t value = 0;
+
+    CU_ASSERT(rbquant_init(NULL, 10, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbquant_init(&quant, 0, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbquant_init(&quant, 100, 0) == RBTREE_OK);
+
+    CU_ASSERT(rbquant_query(&quant, 0.5, &value) == RBTREE_NOT_FOUND);
+
+    /** 1 to 100 in reverse */
+    for (uint64_t idx = 100; idx > 0; idx--) {
+        CU_ASSERT(rbquant_add(&quant, idx, 0) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbquant_size(&quant) == 100);
+
+    CU_ASSERT(rbquant_query(&quant, 0.0, &value) == RBTREE_OK && value == 1);
+    CU_ASSERT(rbquant_query(&quant, 0.5, &value) == RBTREE_OK && value == 50);
+    CU_ASSERT(rbquant_query(&quant, 0.99, &value) == RBTREE_OK && value == 99);
+    CU_ASSERT(rbquant_query(&quant, 0.999, &value) == RBTREE_OK && value == 100);
+    CU_ASSERT(rbquant_query(&quant, 1.0, &value) == RBTREE_OK && value == 100);
+    CU_ASSERT(rbquant_query(&quant, 1.5, &value) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbquant_query(&quant, -0.1, &value) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbquant_select(&quant, 0, &value) == RBTREE_OK && value == 1);
+    CU_ASSERT(rbquant_select(&quant, 99, &value) == RBTREE_OK && value == 100);
+    CU_ASSERT(rbquant_select(&quant, 100, &value) == RBTREE_NOT_FOUND);
+
+    CU_ASSERT(rbquant_rank(&quant, 0) == 0);
+    CU_ASSERT(rbquant_rank(&quant, 51) == 50);
+    CU_ASSERT(rbquant_rank(&quant, 1000) == 100);
+
+    /** full, the oldest (100, 99, ...) make room */
+    CU_ASSERT(rbquant_add(&quant, 0, 0) == RBTREE_OK);
+    CU_ASSERT(rbquant_add(&quant, 0, 0) == RBTREE_OK);
+    CU_ASSERT(rbquant_size(&quant) == 100);
+    CU_ASSERT(rbquant_query(&quant, 1.0, &value) == RBTREE_OK && value == 98);
+    CU_ASSERT(rbquant_rank(&quant, 1) == 2);
+
+    rbquant_destroy(&quant);
+}
+
+
+static void
+test_window_expiry(void)
+{
+    enum { CAPACITY = 3000, WINDOW = 1000 };
+    static uint64_t sorted[CAPACITY];
+
+    rbquant_t quant;
+    CU_ASSERT(rbquant_init(&quant, CAPACITY, WINDOW) == RBTREE_OK);
+
+    srand(20171021);
+
+    uint64_t now = 0;
+    for (int round = 0; round < 40000; round++) {
+        /** bursts and gaps, so the window is sometimes bound by time, sometimes by capacity */
+        now += (round / 5000) % 2 ? rand() % 3 : rand() % 2 == 0;
+
+        CU_ASSERT(rbquant_add(&quant, rand() % 5000, now) == RBTREE_OK);
+
+        if (round % 331 == 0) {
+            size_t size = test_window(&quant, sorted);
+            CU_ASSERT(size == rbquant_size(&quant));
+            CU_ASSERT(size <= CAPACITY);
+
+            /** nothing older than window is left */
+            CU_ASSERT(now - quant.ring[quant.head].time < WINDOW);
+
+            double quantiles[] = { 0.0, 0.25, 0.5, 0.9, 0.99, 0.999, 1.0 };
+            for (size_t idx = 0; idx < sizeof(quantiles) / sizeof(quantiles[0]); idx++) {
+                uint64_t value = 0;
+                size_t rank = (size_t)(quantiles[idx] * size);
+                rank += (double)rank < quantiles[idx] * size;
+                rank = rank > 0 ? rank - 1 : 0;
+
+                CU_ASSERT(rbquant_query(&quant, quantiles[idx], &value) == RBTREE_OK);
+                CU_ASSERT(value == sorted[rank]);
+            }
+
+            uint64_t probe = rand() % 5000;
+            size_t below = 0;
+            while (below < size && sorted[below] < probe) {
+                below++;
+            }
+
+            CU_ASSERT(rbquant_rank(&quant, probe) == below);
+        }
+    }
+
+    /** time went back */
+    CU_ASSERT(rbquant_add(&quant, 1, now - 1) == RBTREE_INVALID_ARG);
+
+    size_t size = rbquant_size(&quant);
+    CU_ASSERT(size > 0);
+    CU_ASSERT(rbquant_expire(&quant, 0) == 0);
+    CU_ASSERT(rbquant_size(&quant) == size);
+
+    /** a long gap empties it, and time can not go back past it */
+    CU_ASSERT(rbquant_expire(&quant, now + WINDOW) > 0);
+    CU_ASSERT(rbquant_size(&quant) == 0);
+    CU_ASSERT(rbquant_add(&quant, 1, now) == RBTREE_INVALID_ARG);
+
+    rbquant_destroy(&quant);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbquant[] = {
+    { "test_basic",         test_basic         },
+    { "test_window_expiry", test_window_expiry },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbquant",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbquant,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,351 @@
+/**
+ * file name: rbtree_shm.c
+ *
+ * rbtree in POSIX shared memory implemention
+ *
+ * readers run a seqlock: note an even sequence, search, copy the record,
+ * and accept it only if the sequence did not change meanwhile. a search
+ * racing a writer may follow stale links, so it checks every index
+ * against the capacity and stops after RBTREE_MAX_HEIGHT steps instead
+ * of trusting the tree shape.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rbtree_shm.h"
+
+
+/** tries of a reader before it gives up on a writer that never finishes */
+#define RBSHM_READ_RETRIES (1u << 20)
+
+/** rbidx buffer starts on its own cache line after the header */
+#define RBSHM_DATA_OFFSET ((sizeof(rbshm_header_t) + 63) & ~(size_t)63)
+
+
+static inline void *
+rbshm_data(rbshm_header_t *header)
+{
+    return (char *)header + RBSHM_DATA_OFFSET;
+}
+
+
+static int
+rbshm_error(int err)
+{
+    switch (err) {
+    case EEXIST:
+        return RBTREE_DUPLICATE;
+    case ENOENT:
+        return RBTREE_NOT_FOUND;
+    case ENOMEM:
+    case ENOSPC:
+    case EFBIG:
+        return RBTREE_NO_SPACE;
+    default:
+        return RBTREE_INVALID_ARG;
+    }
+}
+
+
+int
+rbshm_create(rbshm_t *shm,
+             const char *name,
+             size_t bytes,
+             size_t record_size,
+             rbidx_compare compare)
+{
+    rbtree_must(shm != NULL && name != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+
+    if (bytes < RBSHM_DATA_OFFSET + rbidx_buffer_bytes(record_size, 2)) {
+        return RBTREE_NO_SPACE;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return rbshm_error(errno);
+    }
+
+    int ret = RBTREE_OK;
+    void *addr = MAP_FAILED;
+
+    if (ftruncate(fd, (off_t)bytes) != 0) {
+        ret = rbshm_error(errno);
+        goto failed;
+    }
+
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ret = rbshm_error(errno);
+        goto failed;
+    }
+
+    rbshm_header_t *header = addr;
+    header->bytes = bytes;
+    atomic_init(&header->seq, 0);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int err = pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if (err != 0) {
+        ret = rbshm_error(err);
+        goto failed;
+    }
+
+    ret = rbidx_init_buffer(&shm->tree, rbshm_data(header),
+                            bytes - RBSHM_DATA_OFFSET, record_size, compare);
+    if (ret != RBTREE_OK) {
+        pthread_mutex_destroy(&header->lock);
+        goto failed;
+    }
+
+    /** magic last, a segment without it is not ready for rbshm_open */
+    atomic_thread_fence(memory_order_release);
+    header->magic = RBSHM_MAGIC;
+
+    close(fd);
+
+    shm->header   = header;
+    shm->bytes    = bytes;
+    shm->writable = 1;
+
+    return RBTREE_OK;
+
+failed:
+    if (addr != MAP_FAILED) {
+        munmap(addr, bytes);
+    }
+
+    close(fd);
+    shm_unlink(name);
+
+    return ret;
+}
+
+
+int
+rbshm_open(rbshm_t *shm, const char *name, rbidx_compare compare, int writable)
+{
+    rbtree_must(shm != NULL && name != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        return rbshm_error(errno);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int ret = rbshm_error(errno);
+        close(fd);
+
+        return ret;
+    }
+
+    size_t bytes = (size_t)st.st_size;
+    if (bytes < RBSHM_DATA_OFFSET + sizeof(rbidx_header_t)) {
+        close(fd);
+
+        return RBTREE_INVALID_ARG;
+    }
+
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *addr = mmap(NULL, bytes, prot, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        return rbshm_error(errno);
+    }
+
+    rbshm_header_t *header = addr;
+    int ret = RBTREE_INVALID_ARG;
+
+    if (header->magic == RBSHM_MAGIC && header->bytes == bytes) {
+        atomic_thread_fence(memory_order_acquire);
+        ret = rbidx_attach(&shm->tree, rbshm_data(header), bytes - RBSHM_DATA_OFFSET, compare);
+    }
+
+    if (ret != RBTREE_OK) {
+        munmap(addr, bytes);
+
+        return ret;
+    }
+
+    shm->header   = header;
+    shm->bytes    = bytes;
+    shm->writable = writable;
+
+    return RBTREE_OK;
+}
+
+
+void
+rbshm_close(rbshm_t *shm)
+{
+    if (shm == NULL || shm->header == NULL) {
+        return;
+    }
+
+    munmap(shm->header, shm->bytes);
+
+    shm->header = NULL;
+    shm->tree.header = NULL;
+}
+
+
+int
+rbshm_unlink(const char *name)
+{
+    rbtree_must(name != NULL, RBTREE_INVALID_ARG);
+
+    return shm_unlink(name) == 0 ? RBTREE_OK : rbshm_error(errno);
+}
+
+
+int
+rbshm_write_lock(rbshm_t *shm)
+{
+    rbtree_must(shm != NULL && shm->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(shm->writable, RBTREE_NOT_SUPPORTED);
+
+    int err = pthread_mutex_lock(&shm->header->lock);
+    if (err == EOWNERDEAD) {
+        pthread_mutex_consistent(&shm->header->lock);
+    }
+    else if (err != 0) {
+        return rbshm_error(err);
+    }
+
+    uint64_t seq = atomic_load_explicit(&shm->header->seq, memory_order_relaxed);
+
+    /**
+     * the last writer died between its lock and unlock, seq stays odd and
+     * this writer's unlock makes it even again
+     */
+    if (seq & 1) {
+        return RBTREE_INVALID_TOPOLOGY;
+    }
+
+    /** odd, changes below must not be seen before it */
+    atomic_store_explicit(&shm->header->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbshm_write_unlock(rbshm_t *shm)
+{
+    rbtree_must(shm != NULL && shm->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(shm->writable, RBTREE_NOT_SUPPORTED);
+
+    /** even again, publishes changes above */
+    uint64_t seq = atomic_load_explicit(&shm->header->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->header->seq, seq + 1, memory_order_release);
+
+    int err = pthread_mutex_unlock(&shm->header->lock);
+
+    return err == 0 ? RBTREE_OK : rbshm_error(err);
+}
+
+
+/**
+ * rbidx_search_key which survives a tree changing under it,
+ * RBTREE_INVALID_TOPOLOGY if links lead out of buffer or go round
+ */
+static int
+rbshm_search(rbidx_tree_t *tree,
+             uint32_t capacity,
+             const void *key,
+             rbidx_key_compare compare,
+             rbtree_search_mode_t mode,
+             uint32_t *ret)
+{
+    uint32_t result   = RBIDX_SENTINEL;
+    uint32_t traverse = tree->header->root;
+
+    for (int steps = 0; traverse != RBIDX_SENTINEL; steps++) {
+        if (traverse >= capacity || steps == RBTREE_MAX_HEIGHT) {
+            return RBTREE_INVALID_TOPOLOGY;
+        }
+
+        int cmp = compare(key, rbidx_record(tree, traverse));
+        rbidx_node_t *node = rbidx_node(tree, traverse);
+
+        if (cmp == 0 && mode != RBTREE_SEARCH_MODE_LT && mode != RBTREE_SEARCH_MODE_GT) {
+            result = traverse;
+
+            break;
+        }
+
+        /** LT and LE keep the last node left of key, GT and GE the last right of it */
+        if (cmp > 0 && (mode == RBTREE_SEARCH_MODE_LT || mode == RBTREE_SEARCH_MODE_LE)) {
+            result = traverse;
+        }
+        else if (cmp < 0 && (mode == RBTREE_SEARCH_MODE_GT || mode == RBTREE_SEARCH_MODE_GE)) {
+            result = traverse;
+        }
+
+        /** equal keys of LT go left, of GT go right */
+        traverse = cmp > 0 || (cmp == 0 && mode == RBTREE_SEARCH_MODE_GT) ? node->right : node->left;
+    }
+
+    *ret = result;
+
+    return result != RBIDX_SENTINEL ? RBTREE_OK : RBTREE_NOT_FOUND;
+}
+
+
+int
+rbshm_lookup(rbshm_t *shm,
+             const void *key,
+             rbidx_key_compare compare,
+             rbtree_search_mode_t mode,
+             void *out)
+{
+    rbtree_must(shm != NULL && shm->header != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL && out != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    rbidx_tree_t *tree = &shm->tree;
+
+    /** fixed at create, safe to read without the seqlock */
+    uint32_t capacity    = tree->header->capacity;
+    size_t   record_size = tree->header->record_size;
+
+    for (uint32_t tries = 0; tries < RBSHM_READ_RETRIES; tries++) {
+        uint64_t seq = atomic_load_explicit(&shm->header->seq, memory_order_acquire);
+        if (seq & 1) {
+            sched_yield();
+
+            continue;
+        }
+
+        uint32_t idx = RBIDX_SENTINEL;
+        int ret = rbshm_search(tree, capacity, key, compare, mode, &idx);
+
+        if (ret == RBTREE_OK) {
+            memcpy(out, rbidx_record(tree, idx), record_size);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->header->seq, memory_order_relaxed) == seq) {
+            return ret;
+        }
+    }
+
+    return RBTREE_INVALID_TOPOLOGY;
+}
@@ -0,0 +1,116 @@
+/**
+ * file name: rbtree_shm.h
+ *
+ * head file of rbtree in POSIX shared memory
+ *
+ * an index based tree (rbtree_idx.h) in a shm_open segment. links are
+ * slot indexes, so every process may map the segment at its own address.
+ *
+ * one writer at a time holds a process-shared mutex around changes and
+ * bumps a sequence counter before and after, readers never lock: they
+ * search and copy the record out, then retry if the counter moved.
+ *
+ *     writer                          reader
+ *     rbshm_write_lock(&shm);         rbshm_lookup(&shm, &key, compare,
+ *     rbidx_alloc(rbshm_tree(&shm));               RBTREE_SEARCH_MODE_EQ,
+ *     rbidx_insert(...);                           &copy);
+ *     rbshm_write_unlock(&shm);
+ *
+ * the mutex is robust, a writer which dies holding it leaves the
+ * counter odd. readers give up on it after a bounded number of tries,
+ * the next writer gets the lock with RBTREE_INVALID_TOPOLOGY.
+ */
+#ifndef __RB_TREE_SHM_H__
+#define __RB_TREE_SHM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "rbtree.h"
+#include "rbtree_idx.h"
+
+
+#define RBSHM_MAGIC 0x7262736d
+
+/** head of segment, rbidx buffer follows on its own cache line */
+typedef struct rbshm_header_s rbshm_header_t;
+struct rbshm_header_s {
+    uint32_t magic;
+    uint32_t reserved;
+    /** size of whole segment */
+    uint64_t bytes;
+    /** odd while a writer is changing tree */
+    _Atomic uint64_t seq;
+    pthread_mutex_t lock;
+};
+
+typedef struct rbshm_s rbshm_t;
+struct rbshm_s {
+    rbshm_header_t *header;
+    size_t bytes;
+    int writable;
+    rbidx_tree_t tree;
+};
+
+
+/**
+ * create segment `name` of `bytes` and map it writable,
+ * RBTREE_DUPLICATE if it exists
+ */
+int
+rbshm_create(rbshm_t *shm,
+             const char *name,
+             size_t bytes,
+             size_t record_size,
+             rbidx_compare compare);
+
+/** map an existing segment, readers may map it read only */
+int
+rbshm_open(rbshm_t *shm, const char *name, rbidx_compare compare, int writable);
+
+/** unmap, the segment lives on until rbshm_unlink */
+void
+rbshm_close(rbshm_t *shm);
+
+int
+rbshm_unlink(const char *name);
+
+/**
+ * exclusive access to rbshm_tree() for changes
+ *
+ * RBTREE_INVALID_TOPOLOGY if the last writer died in the middle of a
+ * change. the lock is held all the same: check or rebuild the tree,
+ * then rbshm_write_unlock lets readers in again.
+ */
+int
+rbshm_write_lock(rbshm_t *shm);
+
+int
+rbshm_write_unlock(rbshm_t *shm);
+
+/**
+ * lock free search, copies the found record to `out`
+ *
+ * never sees a half done change, retries while a writer is busy and
+ * returns RBTREE_INVALID_TOPOLOGY if it stays busy too long, as when it
+ * died holding the lock. `compare` may see torn records and must not trust their content
+ * beyond comparing, e.g. follow pointers in them.
+ */
+int
+rbshm_lookup(rbshm_t *shm,
+             const void *key,
+             rbidx_key_compare compare,
+             rbtree_search_mode_t mode,
+             void *out);
+
+
+static inline rbidx_tree_t *
+rbshm_tree(rbshm_t *shm)
+{
+    return &shm->tree;
+}
+
+
+#endif
@@ -0,0 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_shm.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    rbidx_node_t node;
+    uint64_t key;
+    /** derived from key, a torn copy would not match */
+    uint64_t check;
+};
+
+#define TEST_READERS 4
+#define TEST_KEYS    2048
+
+
+static uint64_t
+test_check(uint64_t key)
+{
+    return key * 0x9e3779b97f4a7c15ULL ^ 0x5bd1e995;
+}
+
+
+static int
+test_compare(const void *ra, const void *rb)
+{
+    uint64_t akey = ((const test_record_t *)ra)->key;
+    uint64_t bkey = ((const test_record_t *)rb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, const void *record)
+{
+    uint64_t akey = *(const uint64_t *)key;
+    uint64_t bkey = ((const test_record_t *)record)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static void
+test_name(char *name, size_t len)
+{
+    snprintf(name, len, "/rbshm_test_%ld", (long)getpid());
+}
+
+
+static int
+test_add(rbshm_t *shm, uint64_t key, uint32_t *ret)
+{
+    rbidx_tree_t *tree = rbshm_tree(shm);
+
+    uint32_t idx = RBIDX_SENTINEL;
+    int err = rbidx_alloc(tree, &idx);
+    if (err != RBTREE_OK) {
+        return err;
+    }
+
+    test_record_t *record = rbidx_record(tree, idx);
+    record->key   = key;
+    record->check = test_check(key);
+
+    *ret = idx;
+
+    return rbidx_insert(tree, idx);
+}
+
+
+static void
+test_open(void)
+{
+    char name[64];
+    test_name(name, sizeof(name));
+
+    rbshm_t shm;
+    size_t bytes = 1 << 16;
+
+    CU_ASSERT(rbshm_open(&shm, name, test_compare, 0) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbshm_create(&shm, name, 16, sizeof(test_record_t), test_compare) == RBTREE_NO_SPACE);
+    CU_ASSERT(rbshm_create(&shm, name, bytes, sizeof(test_record_t), test_compare) == RBTREE_OK);
+
+    rbshm_t again;
+    CU_ASSERT(rbshm_create(&again, name, bytes, sizeof(test_record_t), test_compare) == RBTREE_DUPLICATE);
+
+    uint32_t idx = RBIDX_SENTINEL;
+    rbshm_write_lock(&shm);
+    for (uint64_t key = 0; key < 100; key++) {
+        CU_ASSERT(test_add(&shm, key * 2, &idx) == RBTREE_OK);
+    }
+    rbshm_write_unlock(&shm);
+
+    /** a second mapping sits at another address and sees the same tree */
+    rbshm_t reader;
+    CU_ASSERT(rbshm_open(&reader, name, test_compare, 0) == RBTREE_OK);
+    CU_ASSERT(reader.header != shm.header);
+    CU_ASSERT(rbidx_size(rbshm_tree(&reader)) == 100);
+    CU_ASSERT(rbshm_write_lock(&reader) == RBTREE_NOT_SUPPORTED);
+
+    test_record_t record;
+    uint64_t key = 42;
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 42 && record.check == test_check(42));
+
+    key = 43;
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &record) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 42);
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 44);
+
+    key = 44;
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 44);
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 46);
+
+    key = 198;
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &record) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbshm_lookup(&reader, &key, test_key_compare, RBTREE_SEARCH_MODE_MAX, &record) == RBTREE_INVALID_ARG);
+
+    /** segment is fixed size */
+    rbshm_write_lock(&shm);
+    int err = RBTREE_OK;
+    for (uint64_t odd = 1; err == RBTREE_OK; odd += 2) {
+        err = test_add(&shm, odd, &idx);
+    }
+    rbshm_write_unlock(&shm);
+
+    CU_ASSERT(err == RBTREE_NO_SPACE);
+    CU_ASSERT(rbidx_size(rbshm_tree(&reader)) == rbshm_tree(&reader)->header->capacity - 1);
+
+    rbshm_close(&reader);
+    rbshm_close(&shm);
+
+    CU_ASSERT(rbshm_unlink(name) == RBTREE_OK);
+    CU_ASSERT(rbshm_unlink(name) == RBTREE_NOT_FOUND);
+}
+
+
+/** runs in a child, even keys are always there, odd ones come and go */
+static int
+test_reader(const char *name, int seed)
+{
+    rbshm_t shm;
+    if (rbshm_open(&shm, name, test_compare, 0) != RBTREE_OK) {
+        return 1;
+    }
+
+    srand(seed);
+
+    int failed = 0;
+    for (int round = 0; round < 200000 && !failed; round++) {
+        uint64_t key = rand() % TEST_KEYS;
+        test_record_t record;
+
+        int ret = rbshm_lookup(&shm, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &record);
+        if (ret == RBTREE_OK) {
+            failed = record.key != key || record.check != test_check(key);
+        }
+        else {
+            failed = ret != RBTREE_NOT_FOUND || key % 2 == 0;
+        }
+
+        ret = rbshm_lookup(&shm, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &record);
+        if (ret == RBTREE_OK) {
+            failed |= record.key <= key || record.key > (key | 1) + 1 || record.check != test_check(record.key);
+        }
+        else {
+            failed |= key < TEST_KEYS - 2;
+        }
+    }
+
+    rbshm_close(&shm);
+
+    return failed;
+}
+
+
+static void
+test_readers(void)
+{
+    char name[64];
+    test_name(name, sizeof(name));
+
+    size_t bytes = RBSHM_DATA_OFFSET + rbidx_buffer_bytes(sizeof(test_record_t), TEST_KEYS + 1);
+
+    rbshm_t shm;
+    CU_ASSERT_FATAL(rbshm_create(&shm, name, bytes, sizeof(test_record_t), test_compare) == RBTREE_OK);
+
+    static uint32_t slots[TEST_KEYS];
+
+    rbshm_write_lock(&shm);
+    for (uint64_t key = 0; key < TEST_KEYS; key++) {
+        CU_ASSERT(test_add(&shm, key, &slots[key]) == RBTREE_OK);
+    }
+    rbshm_write_unlock(&shm);
+
+    pid_t pids[TEST_READERS];
+    for (int idx = 0; idx < TEST_READERS; idx++) {
+        pids[idx] = fork();
+        CU_ASSERT_FATAL(pids[idx] >= 0);
+
+        if (pids[idx] == 0) {
+            _exit(test_reader(name, idx + 1));
+        }
+    }
+
+    /** writer churns odd keys until all readers are done */
+    rbidx_tree_t *tree = rbshm_tree(&shm);
+    int running = TEST_READERS;
+    int failed = 0;
+
+    srand(20171013);
+
+    while (running > 0) {
+        uint64_t key = (rand() % (TEST_KEYS / 2)) * 2 + 1;
+
+        rbshm_write_lock(&shm);
+        if (slots[key] != RBIDX_SENTINEL) {
+            rbidx_delete(tree, slots[key]);
+            rbidx_free(tree, slots[key]);
+            slots[key] = RBIDX_SENTINEL;
+        }
+        else {
+            CU_ASSERT(test_add(&shm, key, &slots[key]) == RBTREE_OK);
+        }
+        rbshm_write_unlock(&shm);
+
+        for (int idx = 0; idx < TEST_READERS; idx++) {
+            int status = 0;
+            if (pids[idx] > 0 && waitpid(pids[idx], &status, WNOHANG) == pids[idx]) {
+                failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                pids[idx] = 0;
+                running--;
+            }
+        }
+    }
+
+    CU_ASSERT(failed == 0);
+
+    rbshm_close(&shm);
+    CU_ASSERT(rbshm_unlink(name) == RBTREE_OK);
+}
+
+
+/** a writer killed in the middle of a change */
+static void
+test_dead_writer(void)
+{
+    char name[64];
+    test_name(name, sizeof(name));
+
+    rbshm_t shm;
+    CU_ASSERT_FATAL(rbshm_create(&shm, name, 1 << 16, sizeof(test_record_t), test_compare) == RBTREE_OK);
+
+    uint32_t idx = RBIDX_SENTINEL;
+    rbshm_write_lock(&shm);
+    CU_ASSERT(test_add(&shm, 42, &idx) == RBTREE_OK);
+    rbshm_write_unlock(&shm);
+
+    pid_t pid = fork();
+    CU_ASSERT_FATAL(pid >= 0);
+
+    if (pid == 0) {
+        rbshm_t writer;
+        if (rbshm_open(&writer, name, test_compare, 1) == RBTREE_OK) {
+            rbshm_write_lock(&writer);
+        }
+
+        _exit(0);
+    }
+
+    int status = 0;
+    CU_ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+
+    /** readers do not wait forever */
+    test_record_t record;
+    uint64_t key = 42;
+    CU_ASSERT(rbshm_lookup(&shm, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &record) == RBTREE_INVALID_TOPOLOGY);
+
+    /** the next writer is told, and holds the lock */
+    CU_ASSERT(rbshm_write_lock(&shm) == RBTREE_INVALID_TOPOLOGY);
+    CU_ASSERT(test_add(&shm, 43, &idx) == RBTREE_OK);
+    CU_ASSERT(rbshm_write_unlock(&shm) == RBTREE_OK);
+
+    CU_ASSERT(rbshm_lookup(&shm, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &record) == RBTREE_OK);
+    CU_ASSERT(record.key == 43);
+
+    CU_ASSERT(rbshm_write_lock(&shm) == RBTREE_OK);
+    CU_ASSERT(rbshm_write_unlock(&shm) == RBTREE_OK);
+
+    rbshm_close(&shm);
+    CU_ASSERT(rbshm_unlink(name) == RBTREE_OK);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbshm[] = {
+    { "test_open",        test_open        },
+    { "test_readers",     test_readers     },
+    { "test_dead_writer", test_dead_writer },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbshm",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbshm,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,320 @@
+/**
+ * file name: rbtree_small.c
+ *
+ * small-size optimized rbtree implemention
+ *
+ * array mode keeps node pointers sorted, search is a binary search
+ * over the array and insert/delete shift the tail with memmove.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "rbtree_small.h"
+
+
+/** `key` is a probe node when `compare` is NULL */
+static inline int
+rbsmall_compare(rbsmall_t *set,
+                const void *key,
+                rbtree_key_compare compare,
+                rbtree_node_t *item)
+{
+    if (compare == NULL) {
+        return set->compare((rbtree_node_t *)key, item);
+    }
+
+    return compare(key, item);
+}
+
+
+/**
+ * index of first item greater than or equal to `key`,
+ * or strictly greater if `upper` is set
+ */
+static uint32_t
+rbsmall_bound(rbsmall_t *set,
+              const void *key,
+              rbtree_key_compare compare,
+              int upper)
+{
+    uint32_t low  = 0;
+    uint32_t high = set->count;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int ret = rbsmall_compare(set, key, compare, set->u.items[mid]);
+
+        if (ret > 0 || (upper && ret == 0)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+/** index of node in array, count if not there */
+static uint32_t
+rbsmall_index(rbsmall_t *set, rbtree_node_t *node)
+{
+    uint32_t idx = 0;
+
+    while (idx < set->count && set->u.items[idx] != node) {
+        idx++;
+    }
+
+    return idx;
+}
+
+
+static void
+rbsmall_to_tree(rbsmall_t *set)
+{
+    rbtree_node_t *items[RBSMALL_CAPACITY];
+    uint32_t count = set->count;
+
+    /** array and tree share storage */
+    memcpy(items, set->u.items, count * sizeof(*items));
+
+    /** array is in order already, equal nodes included */
+    rbtree_init(&set->u.tree, set->compare);
+    rbtree_build_sorted(&set->u.tree, items, count);
+
+    set->count   = 0;
+    set->is_tree = 1;
+}
+
+
+static void
+rbsmall_to_array(rbsmall_t *set)
+{
+    rbtree_node_t *items[RBSMALL_CAPACITY];
+    uint32_t count = 0;
+
+    for (rbtree_node_t *node = rbtree_first(&set->u.tree);
+         node != NULL;
+         node = rbtree_next(&set->u.tree, node))
+    {
+        items[count++] = node;
+    }
+
+    memcpy(set->u.items, items, count * sizeof(*items));
+
+    set->count   = count;
+    set->is_tree = 0;
+}
+
+
+int
+rbsmall_init(rbsmall_t *set, rbtree_compare compare)
+{
+    rbtree_must(set != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+
+    set->compare = compare;
+    set->count   = 0;
+    set->is_tree = 0;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbsmall_insert(rbsmall_t *set, rbtree_node_t *node)
+{
+    rbtree_must(set != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    if (!set->is_tree && set->count == RBSMALL_CAPACITY) {
+        rbsmall_to_tree(set);
+    }
+
+    if (set->is_tree) {
+        return rbtree_insert(&set->u.tree, node);
+    }
+
+    /** before equal nodes, where rbtree_insert puts it */
+    uint32_t idx = rbsmall_bound(set, node, NULL, 0);
+
+    memmove(&set->u.items[idx + 1], &set->u.items[idx],
+            (set->count - idx) * sizeof(set->u.items[0]));
+    set->u.items[idx] = node;
+    set->count++;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbsmall_delete(rbsmall_t *set, rbtree_node_t *node)
+{
+    rbtree_must(set != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    if (set->is_tree) {
+        int ret = rbtree_delete(&set->u.tree, node);
+        if (ret == RBTREE_OK && rbtree_size(&set->u.tree) <= RBSMALL_SHRINK) {
+            rbsmall_to_array(set);
+        }
+
+        return ret;
+    }
+
+    uint32_t idx = rbsmall_index(set, node);
+    rbtree_must(idx < set->count, RBTREE_NOT_FOUND);
+
+    set->count--;
+    memmove(&set->u.items[idx], &set->u.items[idx + 1],
+            (set->count - idx) * sizeof(set->u.items[0]));
+
+    return RBTREE_OK;
+}
+
+
+static int
+rbsmall_search_array(rbsmall_t *set,
+                     const void *key,
+                     rbtree_key_compare compare,
+                     rbtree_search_mode_t mode,
+                     rbtree_node_t **ret)
+{
+    uint32_t idx = 0;
+
+    switch (mode) {
+    case RBTREE_SEARCH_MODE_EQ:
+        idx = rbsmall_bound(set, key, compare, 0);
+        if (idx < set->count && rbsmall_compare(set, key, compare, set->u.items[idx]) != 0) {
+            idx = set->count;
+        }
+        break;
+
+    case RBTREE_SEARCH_MODE_GE:
+        idx = rbsmall_bound(set, key, compare, 0);
+        break;
+
+    case RBTREE_SEARCH_MODE_GT:
+        idx = rbsmall_bound(set, key, compare, 1);
+        break;
+
+    /** one before the bound, wraps to UINT32_MAX if there is none */
+    case RBTREE_SEARCH_MODE_LE:
+        idx = rbsmall_bound(set, key, compare, 1) - 1;
+        break;
+
+    case RBTREE_SEARCH_MODE_LT:
+        idx = rbsmall_bound(set, key, compare, 0) - 1;
+        break;
+
+    default:
+        return RBTREE_INVALID_ARG;
+    }
+
+    rbtree_must(idx < set->count, RBTREE_NOT_FOUND);
+    *ret = set->u.items[idx];
+
+    return RBTREE_OK;
+}
+
+
+int
+rbsmall_search(rbsmall_t *set,
+               rbtree_node_t *value,
+               rbtree_search_mode_t mode,
+               rbtree_node_t **ret)
+{
+    rbtree_must(set != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(value != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    if (set->is_tree) {
+        return rbtree_search(&set->u.tree, value, mode, ret);
+    }
+
+    return rbsmall_search_array(set, value, NULL, mode, ret);
+}
+
+
+int
+rbsmall_search_key(rbsmall_t *set,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_search_mode_t mode,
+                   rbtree_node_t **ret)
+{
+    rbtree_must(set != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    if (set->is_tree) {
+        return rbtree_search_key(&set->u.tree, key, compare, mode, ret);
+    }
+
+    return rbsmall_search_array(set, key, compare, mode, ret);
+}
+
+
+rbtree_node_t *
+rbsmall_first(rbsmall_t *set)
+{
+    if (set == NULL) {
+        return NULL;
+    }
+
+    if (set->is_tree) {
+        return rbtree_first(&set->u.tree);
+    }
+
+    return set->count > 0 ? set->u.items[0] : NULL;
+}
+
+
+rbtree_node_t *
+rbsmall_last(rbsmall_t *set)
+{
+    if (set == NULL) {
+        return NULL;
+    }
+
+    if (set->is_tree) {
+        return rbtree_last(&set->u.tree);
+    }
+
+    return set->count > 0 ? set->u.items[set->count - 1] : NULL;
+}
+
+
+rbtree_node_t *
+rbsmall_next(rbsmall_t *set, rbtree_node_t *node)
+{
+    if (set == NULL || node == NULL) {
+        return NULL;
+    }
+
+    if (set->is_tree) {
+        return rbtree_next(&set->u.tree, node);
+    }
+
+    uint32_t idx = rbsmall_index(set, node) + 1;
+
+    return idx < set->count ? set->u.items[idx] : NULL;
+}
+
+
+rbtree_node_t *
+rbsmall_prev(rbsmall_t *set, rbtree_node_t *node)
+{
+    if (set == NULL || node == NULL) {
+        return NULL;
+    }
+
+    if (set->is_tree) {
+        return rbtree_prev(&set->u.tree, node);
+    }
+
+    uint32_t idx = rbsmall_index(set, node);
+
+    return (idx > 0 && idx < set->count) ? set->u.items[idx - 1] : NULL;
+}
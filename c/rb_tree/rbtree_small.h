@@ -0,0 +1,86 @@
+/**
+ * file name: rbtree_small.h
+ *
+ * head file of small-size optimized rbtree
+ *
+ * up to RBSMALL_CAPACITY nodes are kept as a sorted array of node pointers
+ * inside the container, nodes are not linked to each other and the records
+ * are not written at all. one more insert moves them into a rbtree_t,
+ * which is kept until the size drops back to RBSMALL_SHRINK, so a set
+ * hovering around the threshold does not convert on every call.
+ *
+ * nodes are the same rbtree_node_t as in rbtree.h, a record can be
+ * put into a rbsmall_t or a rbtree_t without change.
+ */
+#ifndef __RB_TREE_SMALL_H__
+#define __RB_TREE_SMALL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+#define RBSMALL_CAPACITY 16
+#define RBSMALL_SHRINK   (RBSMALL_CAPACITY / 2)
+
+typedef struct rbsmall_s rbsmall_t;
+struct rbsmall_s {
+    rbtree_compare compare;
+    /** nodes in array, unused once converted */
+    uint32_t count;
+    uint32_t is_tree;
+    union {
+        rbtree_node_t *items[RBSMALL_CAPACITY];
+        /** rbtree_t holds its own sentinel, rbsmall_t must not be moved */
+        rbtree_t tree;
+    } u;
+};
+
+
+int
+rbsmall_init(rbsmall_t *set, rbtree_compare compare);
+
+/** equal nodes are allowed, the newest goes first as in rbtree_insert */
+int
+rbsmall_insert(rbsmall_t *set, rbtree_node_t *node);
+
+/** node must be in set */
+int
+rbsmall_delete(rbsmall_t *set, rbtree_node_t *node);
+
+int
+rbsmall_search(rbsmall_t *set,
+               rbtree_node_t *value,
+               rbtree_search_mode_t mode,
+               rbtree_node_t **ret);
+
+int
+rbsmall_search_key(rbsmall_t *set,
+                   const void *key,
+                   rbtree_key_compare compare,
+                   rbtree_search_mode_t mode,
+                   rbtree_node_t **ret);
+
+/** in-order walk, NULL when there is no such node */
+rbtree_node_t *
+rbsmall_first(rbsmall_t *set);
+
+rbtree_node_t *
+rbsmall_last(rbsmall_t *set);
+
+rbtree_node_t *
+rbsmall_next(rbsmall_t *set, rbtree_node_t *node);
+
+rbtree_node_t *
+rbsmall_prev(rbsmall_t *set, rbtree_node_t *node);
+
+
+static inline size_t
+rbsmall_size(rbsmall_t *set)
+{
+    return set->is_tree ? rbtree_size(&set->u.tree) : set->count;
+}
+
+
+#endif
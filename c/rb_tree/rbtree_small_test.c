@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_small.c"
+
+typedef struct test_node_s test_node_t;
+struct test_node_s {
+    int key;
+    rbtree_node_t rbnode;
+};
+
+#define rbsmall_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static int
+test_node_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = rbsmall_owner(na, test_node_t, rbnode)->key;
+    int bkey = rbsmall_owner(nb, test_node_t, rbnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    int akey = *(const int *)key;
+    int bkey = rbsmall_owner(node, test_node_t, rbnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_node_key(rbtree_node_t *node)
+{
+    return rbsmall_owner(node, test_node_t, rbnode)->key;
+}
+
+
+/** walks both ways and checks order and size */
+static void
+test_is_sorted(rbsmall_t *set)
+{
+    size_t count = 0;
+    int last = INT32_MIN;
+
+    for (rbtree_node_t *node = rbsmall_first(set); node != NULL; node = rbsmall_next(set, node)) {
+        CU_ASSERT(test_node_key(node) >= last);
+        last = test_node_key(node);
+        count++;
+    }
+
+    CU_ASSERT(count == rbsmall_size(set));
+
+    for (rbtree_node_t *node = rbsmall_last(set); node != NULL; node = rbsmall_prev(set, node)) {
+        CU_ASSERT(test_node_key(node) <= last);
+        last = test_node_key(node);
+        count--;
+    }
+
+    CU_ASSERT(count == 0);
+}
+
+
+static void
+test_convert(void)
+{
+    rbsmall_t set;
+
+    CU_ASSERT(rbsmall_init(NULL, test_node_compare) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbsmall_init(&set, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbsmall_init(&set, test_node_compare) == RBTREE_OK);
+
+    CU_ASSERT(rbsmall_first(&set) == NULL);
+    CU_ASSERT(rbsmall_insert(&set, NULL) == RBTREE_INVALID_ARG);
+
+    test_node_t nodes[RBSMALL_CAPACITY + 1];
+    for (int idx = 0; idx < RBSMALL_CAPACITY; idx++) {
+        nodes[idx].key = RBSMALL_CAPACITY - idx;
+        CU_ASSERT(rbsmall_insert(&set, &nodes[idx].rbnode) == RBTREE_OK);
+    }
+
+    CU_ASSERT(!set.is_tree);
+    CU_ASSERT(rbsmall_size(&set) == RBSMALL_CAPACITY);
+    CU_ASSERT(test_node_key(rbsmall_first(&set)) == 1);
+    test_is_sorted(&set);
+
+    /** one past capacity converts */
+    nodes[RBSMALL_CAPACITY].key = 0;
+    CU_ASSERT(rbsmall_insert(&set, &nodes[RBSMALL_CAPACITY].rbnode) == RBTREE_OK);
+    CU_ASSERT(set.is_tree);
+    CU_ASSERT(rbsmall_size(&set) == RBSMALL_CAPACITY + 1);
+    CU_ASSERT(test_node_key(rbsmall_first(&set)) == 0);
+    test_is_sorted(&set);
+
+    /** stays a tree until size drops to RBSMALL_SHRINK */
+    int idx = 0;
+    while (rbsmall_size(&set) > RBSMALL_SHRINK + 1) {
+        CU_ASSERT(rbsmall_delete(&set, &nodes[idx++].rbnode) == RBTREE_OK);
+    }
+
+    CU_ASSERT(set.is_tree);
+    CU_ASSERT(rbsmall_delete(&set, &nodes[idx++].rbnode) == RBTREE_OK);
+    CU_ASSERT(!set.is_tree);
+    CU_ASSERT(rbsmall_size(&set) == RBSMALL_SHRINK);
+    test_is_sorted(&set);
+
+    /** deleted nodes are not found */
+    CU_ASSERT(rbsmall_delete(&set, &nodes[0].rbnode) == RBTREE_NOT_FOUND);
+
+    /** refill, back to the array limit without converting */
+    while (idx > 0) {
+        CU_ASSERT(rbsmall_insert(&set, &nodes[--idx].rbnode) == RBTREE_OK);
+        if (rbsmall_size(&set) <= RBSMALL_CAPACITY) {
+            CU_ASSERT(!set.is_tree);
+        }
+    }
+
+    CU_ASSERT(set.is_tree);
+    test_is_sorted(&set);
+}
+
+
+static void
+test_duplicate(void)
+{
+    rbsmall_t set;
+    rbsmall_init(&set, test_node_compare);
+
+    /** equal keys go newest first, as in rbtree_insert */
+    test_node_t nodes[4] = { { .key = 1 }, { .key = 2 }, { .key = 2 }, { .key = 2 } };
+    for (int idx = 0; idx < 4; idx++) {
+        rbsmall_insert(&set, &nodes[idx].rbnode);
+    }
+
+    CU_ASSERT(rbsmall_next(&set, &nodes[0].rbnode) == &nodes[3].rbnode);
+    CU_ASSERT(rbsmall_next(&set, &nodes[3].rbnode) == &nodes[2].rbnode);
+    CU_ASSERT(rbsmall_next(&set, &nodes[2].rbnode) == &nodes[1].rbnode);
+    CU_ASSERT(rbsmall_next(&set, &nodes[1].rbnode) == NULL);
+
+    CU_ASSERT(rbsmall_delete(&set, &nodes[2].rbnode) == RBTREE_OK);
+    CU_ASSERT(rbsmall_next(&set, &nodes[3].rbnode) == &nodes[1].rbnode);
+    CU_ASSERT(rbsmall_prev(&set, &nodes[3].rbnode) == &nodes[0].rbnode);
+    CU_ASSERT(rbsmall_prev(&set, &nodes[0].rbnode) == NULL);
+}
+
+
+/** order of equal keys is the same in array and tree, and in a rbtree_t */
+static void
+test_duplicate_convert(void)
+{
+    enum { NODES = RBSMALL_CAPACITY + 1 };
+
+    test_node_t nodes[NODES];
+    test_node_t others[NODES];
+    rbsmall_t set;
+    rbtree_t tree;
+
+    rbsmall_init(&set, test_node_compare);
+    rbtree_init(&tree, test_node_compare);
+
+    /** three runs of equal keys */
+    for (int idx = 0; idx < NODES; idx++) {
+        nodes[idx].key = idx % 3;
+        others[idx].key = idx % 3;
+
+        rbsmall_insert(&set, &nodes[idx].rbnode);
+        rbtree_insert(&tree, &others[idx].rbnode);
+    }
+
+    CU_ASSERT(set.is_tree);
+
+    rbtree_node_t *other = rbtree_first(&tree);
+    for (rbtree_node_t *node = rbsmall_first(&set); node != NULL; node = rbsmall_next(&set, node)) {
+        CU_ASSERT_FATAL(other != NULL);
+        CU_ASSERT(rbsmall_owner(node, test_node_t, rbnode) - nodes
+                  == rbsmall_owner(other, test_node_t, rbnode) - others);
+        other = rbtree_next(&tree, other);
+    }
+
+    CU_ASSERT(other == NULL);
+
+    /** and back to array */
+    for (int idx = 0; idx < RBSMALL_SHRINK + 1; idx++) {
+        rbsmall_delete(&set, &nodes[idx].rbnode);
+        rbtree_delete(&tree, &others[idx].rbnode);
+    }
+
+    CU_ASSERT(!set.is_tree);
+
+    other = rbtree_first(&tree);
+    for (rbtree_node_t *node = rbsmall_first(&set); node != NULL; node = rbsmall_next(&set, node)) {
+        CU_ASSERT_FATAL(other != NULL);
+        CU_ASSERT(rbsmall_owner(node, test_node_t, rbnode) - nodes
+                  == rbsmall_owner(other, test_node_t, rbnode) - others);
+        other = rbtree_next(&tree, other);
+    }
+
+    CU_ASSERT(other == NULL);
+}
+
+
+static void
+do_test_search(rbsmall_t *set)
+{
+    rbtree_node_t *ret = NULL;
+    int key = 8;
+
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_MAX, &ret) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 8);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 8);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 6);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 10);
+
+    key = 9;
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 8);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 10);
+
+    key = 0;
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbsmall_search_key(set, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 0);
+
+    test_node_t probe = { .key = 100, };
+    CU_ASSERT(rbsmall_search(set, &probe.rbnode, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbsmall_search(set, &probe.rbnode, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == rbsmall_last(set));
+}
+
+
+static void
+test_search(void)
+{
+    rbsmall_t set;
+    rbsmall_init(&set, test_node_compare);
+
+    /** keys 0, 2, 4, ..., array first, then tree */
+    test_node_t nodes[32];
+    for (int idx = 0; idx < 32; idx++) {
+        nodes[idx].key = idx * 2;
+        rbsmall_insert(&set, &nodes[idx].rbnode);
+
+        if (idx == RBSMALL_CAPACITY - 1) {
+            CU_ASSERT(!set.is_tree);
+            do_test_search(&set);
+        }
+    }
+
+    CU_ASSERT(set.is_tree);
+    do_test_search(&set);
+}
+
+
+static void
+test_random(void)
+{
+    rbsmall_t set;
+    rbsmall_init(&set, test_node_compare);
+
+    /** size wanders across the threshold both ways */
+    enum { NODES = 3 * RBSMALL_CAPACITY };
+    test_node_t nodes[NODES];
+    int in_set[NODES];
+    memset(in_set, 0, sizeof(in_set));
+
+    srand(20171004);
+
+    size_t count = 0;
+    for (int round = 0; round < 4096; round++) {
+        int idx = rand() % NODES;
+
+        if (in_set[idx]) {
+            CU_ASSERT(rbsmall_delete(&set, &nodes[idx].rbnode) == RBTREE_OK);
+            in_set[idx] = 0;
+            count--;
+        }
+        else {
+            nodes[idx].key = rand() % NODES;
+            CU_ASSERT(rbsmall_insert(&set, &nodes[idx].rbnode) == RBTREE_OK);
+            in_set[idx] = 1;
+            count++;
+        }
+
+        CU_ASSERT(rbsmall_size(&set) == count);
+        test_is_sorted(&set);
+    }
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbsmall[] = {
+    { "test_convert",           test_convert           },
+    { "test_duplicate",         test_duplicate         },
+    { "test_duplicate_convert", test_duplicate_convert },
+    { "test_search",            test_search            },
+    { "test_random",            test_random            },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbsmall",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbsmall,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,115 @@
+/**
+ * file name: rbtree_str.c
+ *
+ * string keyed rbtree implemention
+ *
+ * prefix bytes are loaded big-endian and zero padded, so comparing two
+ * prefixes as unsigned integers gives memcmp order of their first bytes.
+ * a tie past the prefix is settled by the rest of the keys, then length.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "rbtree_str.h"
+
+
+static inline uint64_t
+rbstr_load_word(const char *key, size_t len)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, key, len < 8 ? len : 8);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return word;
+}
+
+
+static inline int
+rbstr_compare_node(const rbstr_node_t *na, const rbstr_node_t *nb)
+{
+    for (int idx = 0; idx < RBSTR_PREFIX_WORDS; idx++) {
+        if (na->prefix[idx] != nb->prefix[idx]) {
+            return na->prefix[idx] < nb->prefix[idx] ? -1 : 1;
+        }
+    }
+
+    size_t len = na->len < nb->len ? na->len : nb->len;
+    if (len > RBSTR_PREFIX_BYTES) {
+        int ret = memcmp(na->key + RBSTR_PREFIX_BYTES,
+                         nb->key + RBSTR_PREFIX_BYTES,
+                         len - RBSTR_PREFIX_BYTES);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return (na->len > nb->len) - (na->len < nb->len);
+}
+
+
+/** `key` is a probe rbstr_node_t built by rbstr_search */
+static int
+rbstr_key_compare(const void *key, rbtree_node_t *node)
+{
+    return rbstr_compare_node(key, rbstr_entry(node));
+}
+
+
+int
+rbstr_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    return rbstr_compare_node(rbstr_entry(na), rbstr_entry(nb));
+}
+
+
+int
+rbstr_init(rbtree_t *tree)
+{
+    return rbtree_init(tree, rbstr_compare);
+}
+
+
+int
+rbstr_node_init(rbstr_node_t *node, const char *key, size_t len)
+{
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(key != NULL || len == 0, RBTREE_INVALID_ARG);
+
+    for (int idx = 0; idx < RBSTR_PREFIX_WORDS; idx++) {
+        size_t offset = (size_t)idx * 8;
+
+        node->prefix[idx] = len > offset ? rbstr_load_word(key + offset, len - offset) : 0;
+    }
+
+    node->len = len;
+    node->key = key;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbstr_search(rbtree_t *tree,
+             const char *key,
+             size_t len,
+             rbtree_search_mode_t mode,
+             rbstr_node_t **ret)
+{
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+
+    rbstr_node_t probe;
+    int err = rbstr_node_init(&probe, key, len);
+    rbtree_must(err == RBTREE_OK, err);
+
+    rbtree_node_t *node = NULL;
+    err = rbtree_search_key(tree, &probe, rbstr_key_compare, mode, &node);
+    rbtree_must(err == RBTREE_OK, err);
+
+    *ret = rbstr_entry(node);
+
+    return RBTREE_OK;
+}
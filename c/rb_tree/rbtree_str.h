@@ -0,0 +1,62 @@
+/**
+ * file name: rbtree_str.h
+ *
+ * head file of string keyed rbtree
+ *
+ * node keeps the first bytes of its key as a big-endian integer and the
+ * key length, so most comparisons are one integer compare and the key
+ * itself is only read when two prefixes are equal. keys are byte strings
+ * ordered as memcmp, shorter first on a common prefix, and need not be
+ * NUL terminated. the key is not copied and must outlive the node.
+ *
+ * build with -DRBSTR_PREFIX_WORDS=2 for a 16 byte prefix, which helps
+ * keys sharing a long head such as URLs, at 8 more bytes per node.
+ */
+#ifndef __RB_TREE_STR_H__
+#define __RB_TREE_STR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+#ifndef RBSTR_PREFIX_WORDS
+#define RBSTR_PREFIX_WORDS 1
+#endif
+
+#define RBSTR_PREFIX_BYTES (RBSTR_PREFIX_WORDS * 8)
+
+typedef struct rbstr_node_s rbstr_node_t;
+struct rbstr_node_s {
+    rbtree_node_t node;
+    uint64_t prefix[RBSTR_PREFIX_WORDS];
+    size_t len;
+    const char *key;
+};
+
+#define rbstr_entry(ptr) \
+    ((rbstr_node_t *)((uintptr_t)(ptr) - offsetof(rbstr_node_t, node)))
+
+
+/** a plain rbtree_t, insert, delete and walk it with rbtree.h */
+int
+rbstr_init(rbtree_t *tree);
+
+/** set key of a node which is not in tree */
+int
+rbstr_node_init(rbstr_node_t *node, const char *key, size_t len);
+
+int
+rbstr_search(rbtree_t *tree,
+             const char *key,
+             size_t len,
+             rbtree_search_mode_t mode,
+             rbstr_node_t **ret);
+
+/** memcmp order, exposed for callers that sort rbstr_node_t themselves */
+int
+rbstr_compare(rbtree_node_t *na, rbtree_node_t *nb);
+
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_str.c"
+
+
+/** reference order, memcmp then length */
+static int
+test_memcmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+    int ret = memcmp(a, b, alen < blen ? alen : blen);
+    if (ret != 0) {
+        return ret < 0 ? -1 : 1;
+    }
+
+    return (alen > blen) - (alen < blen);
+}
+
+
+static int
+test_sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+
+static void
+test_compare(void)
+{
+    /** small alphabet with zero and high bytes, lengths across prefix size */
+    static const char alphabet[] = { 0x00, 'a', 'b', (char)0xff };
+
+    enum { KEYS = 512, MAX_LEN = 2 * RBSTR_PREFIX_BYTES + 3 };
+    static char keys[KEYS][MAX_LEN];
+    static size_t lens[KEYS];
+    static rbstr_node_t nodes[KEYS];
+
+    srand(20171006);
+
+    for (int idx = 0; idx < KEYS; idx++) {
+        lens[idx] = rand() % (MAX_LEN + 1);
+
+        /** long shared heads so that prefixes tie often */
+        for (size_t pos = 0; pos < lens[idx]; pos++) {
+            keys[idx][pos] = pos < RBSTR_PREFIX_BYTES - 1 ? 'a' : alphabet[rand() % 4];
+        }
+
+        CU_ASSERT(rbstr_node_init(&nodes[idx], keys[idx], lens[idx]) == RBTREE_OK);
+    }
+
+    for (int a = 0; a < KEYS; a++) {
+        for (int b = 0; b < KEYS; b++) {
+            int expect = test_memcmp(keys[a], lens[a], keys[b], lens[b]);
+            CU_ASSERT(test_sign(rbstr_compare(&nodes[a].node, &nodes[b].node)) == expect);
+        }
+    }
+
+    CU_ASSERT(rbstr_node_init(NULL, "a", 1) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbstr_node_init(&nodes[0], NULL, 1) == RBTREE_INVALID_ARG);
+
+    /** empty key sorts first */
+    CU_ASSERT(rbstr_node_init(&nodes[0], NULL, 0) == RBTREE_OK);
+    CU_ASSERT(rbstr_node_init(&nodes[1], "\0", 1) == RBTREE_OK);
+    CU_ASSERT(rbstr_compare(&nodes[0].node, &nodes[1].node) < 0);
+}
+
+
+static void
+test_tree(void)
+{
+    rbtree_t tree;
+    CU_ASSERT(rbstr_init(&tree) == RBTREE_OK);
+
+    enum { KEYS = 1000 };
+    static char keys[KEYS][48];
+    static rbstr_node_t nodes[KEYS];
+
+    /** url like keys share their first 24 bytes */
+    for (int idx = 0; idx < KEYS; idx++) {
+        int len = snprintf(keys[idx], sizeof(keys[idx]), "https://example.com/item/%d", (idx * 7) % KEYS);
+
+        rbstr_node_init(&nodes[idx], keys[idx], len);
+        CU_ASSERT(rbtree_insert(&tree, &nodes[idx].node) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbtree_size(&tree) == KEYS);
+
+    rbstr_node_t *last = NULL;
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        rbstr_node_t *entry = rbstr_entry(node);
+        if (last != NULL) {
+            CU_ASSERT(test_memcmp(last->key, last->len, entry->key, entry->len) < 0);
+        }
+
+        last = entry;
+    }
+
+    rbstr_node_t *ret = NULL;
+    const char *key = "https://example.com/item/42";
+
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(strncmp(ret->key, key, ret->len) == 0 && ret->len == strlen(key));
+
+    /** "item/42" < "item/420" < "item/421" */
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_OK);
+    CU_ASSERT(ret->len == strlen(key) + 1 && memcmp(ret->key, "https://example.com/item/420", ret->len) == 0);
+
+    key = "https://example.com/item/4200";
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(ret->len == strlen(key) - 1 && memcmp(ret->key, "https://example.com/item/420", ret->len) == 0);
+
+    /** a key which is a prefix of all */
+    key = "https://";
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(&ret->node == rbtree_first(&tree));
+
+    CU_ASSERT(rbstr_search(&tree, key, strlen(key), RBTREE_SEARCH_MODE_EQ, NULL) == RBTREE_INVALID_ARG);
+
+    for (int idx = 0; idx < KEYS; idx++) {
+        CU_ASSERT(rbtree_delete(&tree, &nodes[idx].node) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbtree_size(&tree) == 0);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbstr[] = {
+    { "test_compare", test_compare },
+    { "test_tree",    test_tree    },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbstr",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbstr,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,447 @@
+/**
+ * file name: rbtree_td.c
+ *
+ * top-down rbtree implemention
+ *
+ * both insert and delete walk down from root once and keep the tree
+ * balanced on the way, so no parent link is needed to go back up.
+ * a dummy head node above root makes root rotations ordinary.
+ */
+#include <stdio.h>
+
+#include "rbtree_td.h"
+
+
+static inline void
+rbtd_set_child(rbtd_node_t *node, int dir, rbtd_node_t *child)
+{
+    uintptr_t color = (dir == 0) ? (node->link[0] & RBTD_COLOR_MASK) : 0;
+
+    node->link[dir] = (uintptr_t)child | color;
+}
+
+
+static inline void
+rbtd_set_red(rbtd_node_t *node)
+{
+    node->link[0] |= RBTD_COLOR_MASK;
+}
+
+
+static inline void
+rbtd_set_black(rbtd_node_t *node)
+{
+    if (node != NULL) {
+        node->link[0] &= ~RBTD_COLOR_MASK;
+    }
+}
+
+
+/**
+ * rotate `root` towards `dir`, returns the new sub-tree root
+ *
+ * new root becomes black and old root red.
+ */
+static rbtd_node_t *
+rbtd_single_rotate(rbtd_node_t *root, int dir)
+{
+    rbtd_node_t *save = rbtd_child(root, !dir);
+
+    rbtd_set_child(root, !dir, rbtd_child(save, dir));
+    rbtd_set_child(save, dir, root);
+
+    rbtd_set_red(root);
+    rbtd_set_black(save);
+
+    return save;
+}
+
+
+static rbtd_node_t *
+rbtd_double_rotate(rbtd_node_t *root, int dir)
+{
+    rbtd_set_child(root, !dir, rbtd_single_rotate(rbtd_child(root, !dir), !dir));
+
+    return rbtd_single_rotate(root, dir);
+}
+
+
+int
+rbtd_init(rbtd_tree_t *tree, rbtd_compare compare)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+
+    tree->root    = NULL;
+    tree->compare = compare;
+    tree->size    = 0;
+
+    return RBTREE_OK;
+}
+
+
+int
+rbtd_insert(rbtd_tree_t *tree, rbtd_node_t *node)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    /** new node is red */
+    node->link[0] = RBTD_COLOR_MASK;
+    node->link[1] = 0;
+
+    if (tree->root == NULL) {
+        tree->root = node;
+        rbtd_set_black(node);
+        tree->size++;
+
+        return RBTREE_OK;
+    }
+
+    rbtd_node_t head = { .link = { 0, 0 } };
+
+    /** great grandparent, grandparent, parent and current node */
+    rbtd_node_t *t = &head;
+    rbtd_node_t *g = NULL;
+    rbtd_node_t *p = NULL;
+    rbtd_node_t *q = tree->root;
+
+    rbtd_set_child(&head, 1, tree->root);
+
+    int ret  = RBTREE_OK;
+    int dir  = 0;
+    int last = 0;
+
+    for (;;) {
+        if (q == NULL) {
+            /** reach bottom, link new node */
+            q = node;
+            rbtd_set_child(p, dir, q);
+        }
+        else if (rbtd_is_red(rbtd_child(q, 0)) && rbtd_is_red(rbtd_child(q, 1))) {
+            /** color flip, push one black down */
+            rbtd_set_red(q);
+            rbtd_set_black(rbtd_child(q, 0));
+            rbtd_set_black(rbtd_child(q, 1));
+        }
+
+        /** red violation between q and p, rotate at g */
+        if (rbtd_is_red(q) && rbtd_is_red(p)) {
+            int dir2 = rbtd_child(t, 1) == g;
+
+            if (q == rbtd_child(p, last)) {
+                rbtd_set_child(t, dir2, rbtd_single_rotate(g, !last));
+            }
+            else {
+                rbtd_set_child(t, dir2, rbtd_double_rotate(g, !last));
+            }
+        }
+
+        if (q == node) {
+            break;
+        }
+
+        int cmp = tree->compare(node, q);
+        if (cmp == 0) {
+            ret = RBTREE_DUPLICATE;
+
+            break;
+        }
+
+        last = dir;
+        dir  = cmp > 0;
+
+        if (g != NULL) {
+            t = g;
+        }
+
+        g = p;
+        p = q;
+        q = rbtd_child(q, dir);
+    }
+
+    tree->root = rbtd_child(&head, 1);
+    rbtd_set_black(tree->root);
+
+    if (ret == RBTREE_OK) {
+        tree->size++;
+    }
+
+    return ret;
+}
+
+
+int
+rbtd_delete(rbtd_tree_t *tree, rbtd_node_t *node)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    if (tree->root == NULL) {
+        return RBTREE_NOT_FOUND;
+    }
+
+    rbtd_node_t head = { .link = { 0, 0 } };
+
+    rbtd_node_t *g = NULL;
+    rbtd_node_t *p = NULL;
+    rbtd_node_t *q = &head;
+
+    /** found node and where it hangs, kept up to date by rotations */
+    rbtd_node_t *f = NULL;
+    rbtd_node_t *fparent = NULL;
+    int fdir = 0;
+
+    rbtd_set_child(&head, 1, tree->root);
+
+    int dir = 1;
+
+    /**
+     * go down to the in-order predecessor of `node` (or `node` itself),
+     * making sure current node is red so removing it keeps black height.
+     */
+    while (rbtd_child(q, dir) != NULL) {
+        int last = dir;
+
+        g = p;
+        p = q;
+        q = rbtd_child(q, dir);
+
+        int cmp = tree->compare(node, q);
+        dir = cmp > 0;
+
+        if (q == node) {
+            f       = q;
+            fparent = p;
+            fdir    = last;
+        }
+
+        if (rbtd_is_red(q) || rbtd_is_red(rbtd_child(q, dir))) {
+            continue;
+        }
+
+        if (rbtd_is_red(rbtd_child(q, !dir))) {
+            /** rotate red sibling of next node up */
+            rbtd_node_t *r = rbtd_single_rotate(q, dir);
+
+            rbtd_set_child(p, last, r);
+            if (q == f) {
+                fparent = r;
+                fdir    = dir;
+            }
+
+            p = r;
+
+            continue;
+        }
+
+        rbtd_node_t *s = rbtd_child(p, !last);
+        if (s == NULL) {
+            continue;
+        }
+
+        if (rbtd_is_black(rbtd_child(s, !last)) && rbtd_is_black(rbtd_child(s, last))) {
+            /** color flip */
+            rbtd_set_black(p);
+            rbtd_set_red(s);
+            rbtd_set_red(q);
+        }
+        else {
+            int dir2 = rbtd_child(g, 1) == p;
+            rbtd_node_t *r = NULL;
+
+            if (rbtd_is_red(rbtd_child(s, last))) {
+                r = rbtd_double_rotate(p, last);
+            }
+            else {
+                r = rbtd_single_rotate(p, last);
+            }
+
+            rbtd_set_child(g, dir2, r);
+            if (p == f) {
+                fparent = r;
+                fdir    = last;
+            }
+
+            /** make sure coloring is right */
+            rbtd_set_red(q);
+            rbtd_set_red(r);
+            rbtd_set_black(rbtd_child(r, 0));
+            rbtd_set_black(rbtd_child(r, 1));
+        }
+    }
+
+    if (f != NULL) {
+        /** unlink q, it has at most one child */
+        rbtd_node_t *child = rbtd_child(q, rbtd_child(q, 0) == NULL);
+        rbtd_set_child(p, rbtd_child(p, 1) == q, child);
+
+        if (f != q) {
+            /** q takes over position and color of f */
+            q->link[0] = f->link[0];
+            q->link[1] = f->link[1];
+            rbtd_set_child(fparent, fdir, q);
+        }
+
+        tree->size--;
+    }
+
+    tree->root = rbtd_child(&head, 1);
+    rbtd_set_black(tree->root);
+
+    return f != NULL ? RBTREE_OK : RBTREE_NOT_FOUND;
+}
+
+
+/**
+ * one step of search descent, `cmp` is the searched key against `traverse`
+ * returns next node to visit or NULL when search stops.
+ */
+static inline rbtd_node_t *
+rbtd_search_step(rbtd_node_t *traverse,
+                 int cmp,
+                 rbtree_search_mode_t mode,
+                 rbtd_node_t **result)
+{
+    switch (mode) {
+    case RBTREE_SEARCH_MODE_LT:
+        if (cmp > 0) {
+            *result = traverse;
+
+            return rbtd_child(traverse, 1);
+        }
+
+        return rbtd_child(traverse, 0);
+
+    case RBTREE_SEARCH_MODE_GT:
+        if (cmp < 0) {
+            *result = traverse;
+
+            return rbtd_child(traverse, 0);
+        }
+
+        return rbtd_child(traverse, 1);
+
+    default:
+        break;
+    }
+
+    if (cmp == 0) {
+        *result = traverse;
+
+        return NULL;
+    }
+    else if (cmp < 0) {
+        if (mode == RBTREE_SEARCH_MODE_GE) {
+            *result = traverse;
+        }
+
+        return rbtd_child(traverse, 0);
+    }
+
+    if (mode == RBTREE_SEARCH_MODE_LE) {
+        *result = traverse;
+    }
+
+    return rbtd_child(traverse, 1);
+}
+
+
+int
+rbtd_search(rbtd_tree_t *tree,
+            rbtd_node_t *value,
+            rbtree_search_mode_t mode,
+            rbtd_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(value != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    rbtd_node_t *result = NULL;
+    rbtd_node_t *traverse = tree->root;
+
+    while (traverse != NULL) {
+        int cmp = tree->compare(value, traverse);
+
+        traverse = rbtd_search_step(traverse, cmp, mode, &result);
+    }
+
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+int
+rbtd_search_key(rbtd_tree_t *tree,
+                const void *key,
+                rbtd_key_compare compare,
+                rbtree_search_mode_t mode,
+                rbtd_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    rbtd_node_t *result = NULL;
+    rbtd_node_t *traverse = tree->root;
+
+    while (traverse != NULL) {
+        int cmp = compare(key, traverse);
+
+        traverse = rbtd_search_step(traverse, cmp, mode, &result);
+    }
+
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+static inline void
+rbtd_iter_push_left(rbtd_iter_t *iter, rbtd_node_t *node)
+{
+    while (node != NULL && iter->top < RBTREE_MAX_HEIGHT) {
+        iter->stack[iter->top++] = node;
+        node = rbtd_child(node, 0);
+    }
+}
+
+
+rbtd_node_t *
+rbtd_iter_first(rbtd_tree_t *tree, rbtd_iter_t *iter)
+{
+    if (tree == NULL || iter == NULL) {
+        return NULL;
+    }
+
+    iter->top = 0;
+    rbtd_iter_push_left(iter, tree->root);
+
+    return iter->top > 0 ? iter->stack[iter->top - 1] : NULL;
+}
+
+
+rbtd_node_t *
+rbtd_iter_next(rbtd_iter_t *iter)
+{
+    if (iter == NULL || iter->top == 0) {
+        return NULL;
+    }
+
+    /** top of stack is current node, its left sub-tree is done */
+    rbtd_node_t *node = iter->stack[--iter->top];
+    rbtd_iter_push_left(iter, rbtd_child(node, 1));
+
+    return iter->top > 0 ? iter->stack[iter->top - 1] : NULL;
+}
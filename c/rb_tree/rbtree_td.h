@@ -0,0 +1,95 @@
+/**
+ * file name: rbtree_td.h
+ *
+ * head file of top-down rbtree without parent pointers
+ *
+ * node only holds two links, color is packed in the lowest bit of left link.
+ * insert and delete rebalance on the way down in a single pass,
+ * keys in one tree must be unique.
+ */
+#ifndef __RB_TREE_TD_H__
+#define __RB_TREE_TD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+typedef struct rbtd_node_s rbtd_node_t;
+struct rbtd_node_s {
+    /** left and right child, bit 0 of link[0] is the color of node */
+    uintptr_t link[2];
+};
+
+#define RBTD_COLOR_MASK ((uintptr_t)1)
+
+#define rbtd_child(node, dir) \
+    ((rbtd_node_t *)((node)->link[(dir)] & ~RBTD_COLOR_MASK))
+
+#define rbtd_is_red(node) ((node) != NULL && ((node)->link[0] & RBTD_COLOR_MASK))
+#define rbtd_is_black(node) (!rbtd_is_red(node))
+
+
+/** compare function of two node */
+typedef int (*rbtd_compare)(rbtd_node_t *na, rbtd_node_t *nb);
+
+/** compare function of a search key and a node */
+typedef int (*rbtd_key_compare)(const void *key, rbtd_node_t *node);
+
+typedef struct rbtd_tree_s rbtd_tree_t;
+struct rbtd_tree_s {
+    rbtd_node_t *root;
+    rbtd_compare compare;
+    size_t size;
+};
+
+/** iterator over a fixed stack, height of tree never exceeds it */
+typedef struct rbtd_iter_s rbtd_iter_t;
+struct rbtd_iter_s {
+    rbtd_node_t *stack[RBTREE_MAX_HEIGHT];
+    int top;
+};
+
+
+int
+rbtd_init(rbtd_tree_t *tree, rbtd_compare compare);
+
+/** RBTREE_DUPLICATE if an equal node is in tree */
+int
+rbtd_insert(rbtd_tree_t *tree, rbtd_node_t *node);
+
+/** node must be in tree */
+int
+rbtd_delete(rbtd_tree_t *tree, rbtd_node_t *node);
+
+int
+rbtd_search(rbtd_tree_t *tree,
+            rbtd_node_t *value,
+            rbtree_search_mode_t mode,
+            rbtd_node_t **ret);
+
+int
+rbtd_search_key(rbtd_tree_t *tree,
+                const void *key,
+                rbtd_key_compare compare,
+                rbtree_search_mode_t mode,
+                rbtd_node_t **ret);
+
+/** NULL if tree is empty */
+rbtd_node_t *
+rbtd_iter_first(rbtd_tree_t *tree, rbtd_iter_t *iter);
+
+/** NULL after the last node */
+rbtd_node_t *
+rbtd_iter_next(rbtd_iter_t *iter);
+
+
+static inline size_t
+rbtd_size(rbtd_tree_t *tree)
+{
+    return tree->size;
+}
+
+
+#endif
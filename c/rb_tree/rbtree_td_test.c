@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_td.c"
+
+typedef struct test_node_s test_node_t;
+struct test_node_s {
+    int key;
+    rbtd_node_t tdnode;
+};
+
+#define rbtd_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static int
+test_node_compare(rbtd_node_t *na, rbtd_node_t *nb)
+{
+    int akey = rbtd_owner(na, test_node_t, tdnode)->key;
+    int bkey = rbtd_owner(nb, test_node_t, tdnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbtd_node_t *node)
+{
+    int akey = *(const int *)key;
+    int bkey = rbtd_owner(node, test_node_t, tdnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_node_key(rbtd_node_t *node)
+{
+    return rbtd_owner(node, test_node_t, tdnode)->key;
+}
+
+
+/** returns black height of sub-tree, counts nodes in `count` */
+static int
+do_check_sub_rbtd(rbtd_node_t *node, size_t *count)
+{
+    if (node == NULL) {
+        return 1;
+    }
+
+    (*count)++;
+
+    rbtd_node_t *left  = rbtd_child(node, 0);
+    rbtd_node_t *right = rbtd_child(node, 1);
+
+    if (rbtd_is_red(node)) {
+        CU_ASSERT(rbtd_is_black(left));
+        CU_ASSERT(rbtd_is_black(right));
+    }
+
+    if (left != NULL) {
+        CU_ASSERT(test_node_key(left) < test_node_key(node));
+    }
+
+    if (right != NULL) {
+        CU_ASSERT(test_node_key(right) > test_node_key(node));
+    }
+
+    int left_black_height  = do_check_sub_rbtd(left, count);
+    int right_black_height = do_check_sub_rbtd(right, count);
+
+    CU_ASSERT(left_black_height == right_black_height);
+
+    return left_black_height + rbtd_is_black(node);
+}
+
+
+static void
+test_is_rbtd(rbtd_tree_t *tree)
+{
+    size_t count = 0;
+
+    CU_ASSERT(rbtd_is_black(tree->root));
+    do_check_sub_rbtd(tree->root, &count);
+    CU_ASSERT(count == rbtd_size(tree));
+}
+
+
+static void
+test_node_size(void)
+{
+    /** two links and no separate color field */
+    CU_ASSERT(sizeof(rbtd_node_t) == 2 * sizeof(void *));
+}
+
+
+static void
+test_insert(void)
+{
+    rbtd_tree_t tree;
+
+    CU_ASSERT(rbtd_init(NULL, test_node_compare) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtd_init(&tree, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtd_init(&tree, test_node_compare) == RBTREE_OK);
+
+    CU_ASSERT(rbtd_insert(&tree, NULL) == RBTREE_INVALID_ARG);
+
+    /** ascending and descending keys both need rotations */
+    test_node_t nodes[256];
+    for (int idx = 0; idx < 128; idx++) {
+        nodes[idx].key = idx;
+        CU_ASSERT(rbtd_insert(&tree, &nodes[idx].tdnode) == RBTREE_OK);
+    }
+
+    for (int idx = 128; idx < 256; idx++) {
+        nodes[idx].key = 1000 - idx;
+        CU_ASSERT(rbtd_insert(&tree, &nodes[idx].tdnode) == RBTREE_OK);
+    }
+
+    test_is_rbtd(&tree);
+    CU_ASSERT(rbtd_size(&tree) == 256);
+
+    test_node_t dup = { .key = 64, };
+    CU_ASSERT(rbtd_insert(&tree, &dup.tdnode) == RBTREE_DUPLICATE);
+    CU_ASSERT(rbtd_size(&tree) == 256);
+    test_is_rbtd(&tree);
+}
+
+
+static void
+test_delete(void)
+{
+    rbtd_tree_t tree;
+    rbtd_init(&tree, test_node_compare);
+
+    test_node_t missing = { .key = 1, };
+    CU_ASSERT(rbtd_delete(&tree, &missing.tdnode) == RBTREE_NOT_FOUND);
+
+    test_node_t one = { .key = 1, };
+    CU_ASSERT(rbtd_insert(&tree, &one.tdnode) == RBTREE_OK);
+    CU_ASSERT(rbtd_delete(&tree, &one.tdnode) == RBTREE_OK);
+    CU_ASSERT(tree.root == NULL);
+    CU_ASSERT(rbtd_size(&tree) == 0);
+
+    enum { NODES = 1024 };
+    static test_node_t nodes[NODES];
+    static int in_tree[NODES];
+    memset(in_tree, 0, sizeof(in_tree));
+
+    srand(20171002);
+
+    size_t count = 0;
+    for (int round = 0; round < 16 * NODES; round++) {
+        int idx = rand() % NODES;
+
+        if (in_tree[idx]) {
+            CU_ASSERT(rbtd_delete(&tree, &nodes[idx].tdnode) == RBTREE_OK);
+            in_tree[idx] = 0;
+            count--;
+        }
+        else {
+            /** keys are unique */
+            nodes[idx].key = idx;
+            CU_ASSERT(rbtd_insert(&tree, &nodes[idx].tdnode) == RBTREE_OK);
+            in_tree[idx] = 1;
+            count++;
+        }
+
+        CU_ASSERT(rbtd_size(&tree) == count);
+
+        if (round % 256 == 0) {
+            test_is_rbtd(&tree);
+        }
+    }
+
+    test_is_rbtd(&tree);
+
+    /** drain */
+    for (int idx = 0; idx < NODES; idx++) {
+        if (in_tree[idx]) {
+            CU_ASSERT(rbtd_delete(&tree, &nodes[idx].tdnode) == RBTREE_OK);
+        }
+    }
+
+    CU_ASSERT(tree.root == NULL);
+    CU_ASSERT(rbtd_size(&tree) == 0);
+}
+
+
+static void
+test_search(void)
+{
+    rbtd_tree_t tree;
+    rbtd_init(&tree, test_node_compare);
+
+    rbtd_node_t *ret = NULL;
+    int key = 0;
+
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, 0, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+
+    /** keys 0, 2, 4, ..., 62 */
+    test_node_t nodes[32];
+    for (int idx = 0; idx < 32; idx++) {
+        nodes[idx].key = idx * 2;
+        rbtd_insert(&tree, &nodes[idx].tdnode);
+    }
+
+    key = 8;
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[4].tdnode);
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 6);
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 10);
+
+    key = 9;
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 8);
+    CU_ASSERT(rbtd_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 10);
+
+    test_node_t probe = { .key = 62, };
+    CU_ASSERT(rbtd_search(&tree, &probe.tdnode, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[31].tdnode);
+    CU_ASSERT(rbtd_search(&tree, &probe.tdnode, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_NOT_FOUND);
+}
+
+
+static void
+test_iter(void)
+{
+    rbtd_tree_t tree;
+    rbtd_init(&tree, test_node_compare);
+
+    rbtd_iter_t iter;
+    CU_ASSERT(rbtd_iter_first(&tree, &iter) == NULL);
+    CU_ASSERT(rbtd_iter_next(&iter) == NULL);
+
+    test_node_t nodes[500];
+    for (int idx = 0; idx < 500; idx++) {
+        nodes[idx].key = (idx * 7) % 500;
+        rbtd_insert(&tree, &nodes[idx].tdnode);
+    }
+
+    int expect = 0;
+    for (rbtd_node_t *node = rbtd_iter_first(&tree, &iter);
+         node != NULL;
+         node = rbtd_iter_next(&iter))
+    {
+        CU_ASSERT(test_node_key(node) == expect);
+        expect++;
+    }
+
+    CU_ASSERT(expect == 500);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbtd[] = {
+    { "test_node_size", test_node_size },
+    { "test_insert",    test_insert    },
+    { "test_delete",    test_delete    },
+    { "test_search",    test_search    },
+    { "test_iter",      test_iter      },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbtd",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtd,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -98,7 +98,14 @@ test_is_rbtree(rbtree_t *tree)
     /** sentinel aka. leaf is black */
     CU_ASSERT(rbtree_is_black(&tree->sentinel));
 
-    return do_check_sub_rbtree(tree, tree->root);
+    int black_height = do_check_sub_rbtree(tree, tree->root);
+
+    rbtree_stats_t stats;
+    CU_ASSERT(rbtree_stats(tree, &stats) == RBTREE_OK);
+    /** sentinel is not counted by rbtree_stats */
+    CU_ASSERT(stats.black_height + 1 == (size_t)black_height);
+
+    return black_height;
 }
 
 
@@ -115,10 +122,34 @@ test_node_compare(rbtree_node_t *na, rbtree_node_t *nb)
 }
 
 
+static int
+test_key_compare(const void *key, rbtree_node_t *node)
+{
+    test_node_t *tb = rbtree_owner(node, test_node_t, rbnode);
+
+    int akey = *(const int *)key;
+    int bkey = tb->key;
+
+    return akey - bkey;
+}
+
+
+static int
+test_node_key(rbtree_node_t *node)
+{
+    test_node_t *tnode = rbtree_owner(node, test_node_t, rbnode);
+
+    return tnode->key;
+}
+
+
 static void
 test_left_rotate(void)
 {
+    /** rotation updates augment data, so it reads tree state */
     rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
     rbtree_node_t node = rbtree_null_node(&tree);
 
     int ret = rbtree_left_rotate(NULL, &node);
@@ -228,7 +259,10 @@ test_left_rotate(void)
 static void
 test_right_rotate(void)
 {
+    /** rotation updates augment data, so it reads tree state */
     rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
     rbtree_node_t node = rbtree_null_node(&tree);
 
     int ret = rbtree_right_rotate(NULL, &node);
@@ -633,6 +667,1077 @@ test_delete(void)
 }
 
 
+static void
+test_insert_unique(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    test_node_t nodes[64];
+    test_node_t dups[64];
+    rbtree_node_t *ret = NULL;
+
+    CU_ASSERT(rbtree_insert_unique(NULL, &nodes[0].rbnode, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_insert_unique(&tree, NULL, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_insert_unique(&tree, &nodes[0].rbnode, NULL) == RBTREE_INVALID_ARG);
+
+    for (int idx = 0; idx < 64; idx++) {
+        nodes[idx].key = (idx * 37) % 64;
+        dups[idx].key  = nodes[idx].key;
+
+        CU_ASSERT(rbtree_insert_unique(&tree, &nodes[idx].rbnode, &ret) == RBTREE_OK);
+        CU_ASSERT(ret == &nodes[idx].rbnode);
+    }
+
+    test_is_rbtree(&tree);
+
+    /** existing node is returned and tree is untouched */
+    for (int idx = 0; idx < 64; idx++) {
+        CU_ASSERT(rbtree_insert_unique(&tree, &dups[idx].rbnode, &ret) == RBTREE_DUPLICATE);
+        CU_ASSERT(ret == &nodes[idx].rbnode);
+    }
+
+    test_is_rbtree(&tree);
+}
+
+
+static void
+test_find_or_insert(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    test_node_t n1 = { .key = 1, };
+    test_node_t n2 = { .key = 2, };
+    test_node_t n3 = { .key = 3, };
+    test_node_t probe = { .key = 2, };
+
+    rbtree_insert_pos_t pos;
+    rbtree_node_t *ret = NULL;
+
+    /** empty tree */
+    int err = rbtree_find_or_insert(&tree, &n2.rbnode, &pos, &ret);
+    CU_ASSERT(err == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbtree_is_sentinel(&tree, pos.parent));
+    CU_ASSERT(rbtree_insert_at(&tree, &pos, &n2.rbnode) == RBTREE_OK);
+    CU_ASSERT(tree.root == &n2.rbnode);
+
+    err = rbtree_find_or_insert(&tree, &n1.rbnode, &pos, &ret);
+    CU_ASSERT(err == RBTREE_NOT_FOUND);
+    CU_ASSERT(pos.parent == &n2.rbnode && pos.is_left);
+    CU_ASSERT(rbtree_insert_at(&tree, &pos, &n1.rbnode) == RBTREE_OK);
+
+    err = rbtree_find_or_insert(&tree, &n3.rbnode, &pos, &ret);
+    CU_ASSERT(err == RBTREE_NOT_FOUND);
+    CU_ASSERT(pos.parent == &n2.rbnode && !pos.is_left);
+    CU_ASSERT(rbtree_insert_at(&tree, &pos, &n3.rbnode) == RBTREE_OK);
+
+    check_node(&tree, &n2.rbnode, &n1.rbnode, &n3.rbnode, NULL, left, BLACK);
+    check_node(&tree, &n1.rbnode, NULL, NULL, &n2.rbnode, left, RED);
+    check_node(&tree, &n3.rbnode, NULL, NULL, &n2.rbnode, right, RED);
+
+    err = rbtree_find_or_insert(&tree, &probe.rbnode, &pos, &ret);
+    CU_ASSERT(err == RBTREE_OK);
+    CU_ASSERT(ret == &n2.rbnode);
+
+    CU_ASSERT(rbtree_insert_at(&tree, NULL, &probe.rbnode) == RBTREE_INVALID_ARG);
+}
+
+
+static void
+test_search(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    /** keys 0, 2, 4, ..., 62 */
+    test_node_t nodes[32];
+    for (int idx = 0; idx < 32; idx++) {
+        nodes[idx].key = idx * 2;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    test_node_t probe = { .key = 7, };
+    rbtree_node_t *ret = NULL;
+
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, 0, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_MAX, &ret) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_LE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 6);
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 8);
+
+    probe.key = 8;
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[4].rbnode);
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 6);
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 10);
+
+    probe.key = 0;
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_NOT_FOUND);
+    probe.key = 62;
+    CU_ASSERT(rbtree_search(&tree, &probe.rbnode, RBTREE_SEARCH_MODE_GT, &ret) == RBTREE_NOT_FOUND);
+}
+
+
+static void
+test_search_key(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    rbtree_node_t *ret = NULL;
+    int key = 1;
+
+    CU_ASSERT(rbtree_search_key(&tree, &key, NULL, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_NOT_FOUND);
+
+    /** keys 0, 2, 4, ..., 62 */
+    test_node_t nodes[32];
+    for (int idx = 0; idx < 32; idx++) {
+        nodes[idx].key = idx * 2;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    for (key = -1; key <= 64; key++) {
+        int even = (key % 2 == 0);
+
+        int err = rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &ret);
+        if (even && key >= 0 && key <= 62) {
+            CU_ASSERT(err == RBTREE_OK && test_node_key(ret) == key);
+        }
+        else {
+            CU_ASSERT(err == RBTREE_NOT_FOUND);
+        }
+
+        err = rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &ret);
+        if (key >= 0) {
+            CU_ASSERT(err == RBTREE_OK);
+            CU_ASSERT(test_node_key(ret) == (key > 62 ? 62 : key - key % 2));
+        }
+        else {
+            CU_ASSERT(err == RBTREE_NOT_FOUND);
+        }
+
+        err = rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &ret);
+        if (key <= 62) {
+            CU_ASSERT(err == RBTREE_OK);
+            CU_ASSERT(test_node_key(ret) == (key < 0 ? 0 : key + key % 2));
+        }
+        else {
+            CU_ASSERT(err == RBTREE_NOT_FOUND);
+        }
+
+        err = rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LT, &ret);
+        if (key > 0) {
+            CU_ASSERT(err == RBTREE_OK);
+            CU_ASSERT(test_node_key(ret) == (key > 63 ? 62 : (key - 1) - (key - 1) % 2));
+        }
+        else {
+            CU_ASSERT(err == RBTREE_NOT_FOUND);
+        }
+
+        err = rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GT, &ret);
+        if (key < 62) {
+            CU_ASSERT(err == RBTREE_OK);
+            CU_ASSERT(test_node_key(ret) == (key < 0 ? 0 : (key + 1) + (key + 1) % 2));
+        }
+        else {
+            CU_ASSERT(err == RBTREE_NOT_FOUND);
+        }
+    }
+}
+
+
+static void
+test_equal_range(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    /** keys 0..7, each one 8 times */
+    test_node_t nodes[64];
+    for (int idx = 0; idx < 64; idx++) {
+        nodes[idx].key = idx % 8;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    test_is_rbtree(&tree);
+
+    rbtree_node_t *first = NULL;
+    rbtree_node_t *last  = NULL;
+
+    int key = 8;
+    CU_ASSERT(rbtree_equal_range(&tree, &key, test_key_compare, &first, &last) == RBTREE_NOT_FOUND);
+
+    for (key = 0; key < 8; key++) {
+        CU_ASSERT(rbtree_equal_range(&tree, &key, test_key_compare, &first, &last) == RBTREE_OK);
+
+        /** nothing equal is left outside the range */
+        rbtree_node_t *prev = rbtree_predecessor(&tree, first);
+        rbtree_node_t *next = rbtree_successor(&tree, last);
+        CU_ASSERT(rbtree_is_sentinel(&tree, prev) || test_node_key(prev) < key);
+        CU_ASSERT(rbtree_is_sentinel(&tree, next) || test_node_key(next) > key);
+
+        /** walk the range in order, it must hold exactly all equal keys */
+        int count = 1;
+        CU_ASSERT(test_node_key(first) == key);
+        while (first != last) {
+            first = rbtree_successor(&tree, first);
+            CU_ASSERT(test_node_key(first) == key);
+            count++;
+        }
+
+        CU_ASSERT(count == 8);
+    }
+}
+
+
+static void
+test_counters(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    rbtree_counters_t counters;
+
+    CU_ASSERT(rbtree_get_counters(NULL, &counters) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_get_counters(&tree, NULL) == RBTREE_INVALID_ARG);
+
+#ifdef RBTREE_INSTRUMENT
+    test_node_t nodes[128];
+    for (int idx = 0; idx < 128; idx++) {
+        nodes[idx].key = idx;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    CU_ASSERT(rbtree_get_counters(&tree, &counters) == RBTREE_OK);
+    CU_ASSERT(counters.descents == 128);
+    CU_ASSERT(counters.compares == counters.descent_steps);
+    CU_ASSERT(counters.max_descent_depth > 0);
+    CU_ASSERT(counters.max_descent_depth <= 2 * 8);
+    /** ascending keys always go right */
+    CU_ASSERT(counters.left_rotates > 0);
+    CU_ASSERT(counters.insert_fixup_loops ==
+              counters.insert_fixup_cases[0] + counters.insert_fixup_cases[2]);
+
+    for (int idx = 0; idx < 128; idx += 2) {
+        rbtree_delete(&tree, &nodes[idx].rbnode);
+    }
+
+    CU_ASSERT(rbtree_get_counters(&tree, &counters) == RBTREE_OK);
+    CU_ASSERT(counters.delete_fixup_loops > 0);
+
+    CU_ASSERT(rbtree_reset_counters(&tree) == RBTREE_OK);
+    CU_ASSERT(rbtree_get_counters(&tree, &counters) == RBTREE_OK);
+    CU_ASSERT(counters.compares == 0 && counters.left_rotates == 0);
+#else
+    CU_ASSERT(rbtree_get_counters(&tree, &counters) == RBTREE_NOT_SUPPORTED);
+    CU_ASSERT(rbtree_reset_counters(&tree) == RBTREE_NOT_SUPPORTED);
+#endif
+}
+
+
+static void
+test_random_insert_delete(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    enum { NODES = 1024 };
+    static test_node_t nodes[NODES];
+    static int in_tree[NODES];
+    memset(in_tree, 0, sizeof(in_tree));
+
+    srand(20171001);
+
+    size_t count = 0;
+    for (int round = 0; round < 16 * NODES; round++) {
+        int idx = rand() % NODES;
+
+        if (in_tree[idx]) {
+            CU_ASSERT(rbtree_delete(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            in_tree[idx] = 0;
+            count--;
+        }
+        else {
+            nodes[idx].key = rand() % (NODES / 2);
+            CU_ASSERT(rbtree_insert(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            in_tree[idx] = 1;
+            count++;
+        }
+
+        CU_ASSERT(rbtree_size(&tree) == count);
+
+        if (round % 256 == 0) {
+            test_is_rbtree(&tree);
+        }
+    }
+
+    test_is_rbtree(&tree);
+
+    /** in order walk is sorted and covers every node */
+    size_t walked = 0;
+    if (!rbtree_is_sentinel(&tree, tree.root)) {
+        rbtree_node_t *node = rbtree_minimum(&tree, tree.root);
+        int last = -1;
+
+        while (!rbtree_is_sentinel(&tree, node)) {
+            CU_ASSERT(test_node_key(node) >= last);
+            last = test_node_key(node);
+            walked++;
+            node = rbtree_successor(&tree, node);
+        }
+    }
+
+    CU_ASSERT(walked == count);
+}
+
+
+static void
+test_stats(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    rbtree_stats_t stats;
+
+    CU_ASSERT(rbtree_stats(NULL, &stats) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_stats(&tree, NULL) == RBTREE_INVALID_ARG);
+
+    /** empty tree */
+    CU_ASSERT(rbtree_stats(&tree, &stats) == RBTREE_OK);
+    CU_ASSERT(stats.count == 0);
+    CU_ASSERT(stats.height == 0);
+    CU_ASSERT(stats.black_height == 0);
+    CU_ASSERT(stats.memory_bytes == sizeof(tree));
+
+    /** 7 nodes inserted in ascending order */
+    test_node_t nodes[7];
+    for (int idx = 0; idx < 7; idx++) {
+        nodes[idx].key = idx;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    /**
+     *         1
+     *       /   \
+     *      0     3
+     *           / \
+     *          2   5
+     *             / \
+     *            4   6
+     */
+    CU_ASSERT(rbtree_size(&tree) == 7);
+    CU_ASSERT(rbtree_stats(&tree, &stats) == RBTREE_OK);
+    CU_ASSERT(stats.count == 7);
+    CU_ASSERT(stats.red_count == 3);
+    CU_ASSERT(stats.height == 4);
+    CU_ASSERT(stats.max_depth == 3);
+    CU_ASSERT(stats.black_height == 2);
+    CU_ASSERT(stats.depth_histogram[0] == 1);
+    CU_ASSERT(stats.depth_histogram[1] == 2);
+    CU_ASSERT(stats.depth_histogram[2] == 2);
+    CU_ASSERT(stats.depth_histogram[3] == 2);
+    CU_ASSERT(stats.avg_depth > 1.71 && stats.avg_depth < 1.72);
+    CU_ASSERT(stats.memory_bytes == sizeof(tree) + 7 * sizeof(rbtree_node_t));
+
+    test_is_rbtree(&tree);
+}
+
+
+static void
+test_iterate(void)
+{
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    CU_ASSERT(rbtree_first(&tree) == NULL);
+    CU_ASSERT(rbtree_last(&tree) == NULL);
+
+    test_node_t nodes[100];
+    for (int idx = 0; idx < 100; idx++) {
+        nodes[idx].key = (idx * 13) % 100;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    int expect = 0;
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        CU_ASSERT(test_node_key(node) == expect);
+        expect++;
+    }
+    CU_ASSERT(expect == 100);
+
+    for (rbtree_node_t *node = rbtree_last(&tree); node != NULL; node = rbtree_prev(&tree, node)) {
+        expect--;
+        CU_ASSERT(test_node_key(node) == expect);
+    }
+    CU_ASSERT(expect == 0);
+}
+
+
+/** copy into pool and release the heap record */
+static rbtree_node_t *
+test_pool_relocate_free(rbtree_node_t *node, void *ctx)
+{
+    rbtree_node_t *moved = rbtree_compact_pool_relocate(node, ctx);
+    if (moved != NULL) {
+        test_node_t *from = rbtree_owner(node, test_node_t, rbnode);
+        free(from);
+    }
+
+    return moved;
+}
+
+
+/** records scattered on heap, as after long churn */
+static void
+test_compact_build(rbtree_t *tree, int count)
+{
+    rbtree_init(tree, test_node_compare);
+
+    for (int idx = 0; idx < count; idx++) {
+        test_node_t *node = malloc(sizeof(*node));
+        node->key = (idx * 7) % count;
+        rbtree_insert(tree, &node->rbnode);
+    }
+
+    /** leaves sentinel parent pointing into tree */
+    test_node_t *first = rbtree_owner(rbtree_first(tree), test_node_t, rbnode);
+    rbtree_delete(tree, &first->rbnode);
+    free(first);
+}
+
+
+static void
+test_compact(void)
+{
+    enum { NODES = 1000 };
+
+    rbtree_t tree;
+    test_compact_build(&tree, NODES);
+
+    CU_ASSERT(rbtree_compact(NULL, RBTREE_COMPACT_IN_ORDER, test_pool_relocate_free, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_compact(&tree, 0, test_pool_relocate_free, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_compact(&tree, RBTREE_COMPACT_IN_ORDER, NULL, NULL) == RBTREE_INVALID_ARG);
+
+    /** in-order, neighbours in key order are neighbours in memory */
+    test_node_t *slots = malloc(NODES * sizeof(*slots));
+    rbtree_compact_pool_t pool = {
+        .base        = (char *)slots,
+        .record_size = sizeof(test_node_t),
+        .node_offset = offsetof(test_node_t, rbnode),
+        .used        = 0,
+        .capacity    = NODES,
+    };
+
+    CU_ASSERT(rbtree_compact(&tree, RBTREE_COMPACT_IN_ORDER, test_pool_relocate_free, &pool) == RBTREE_OK);
+    CU_ASSERT(pool.used == NODES - 1);
+    test_is_rbtree(&tree);
+
+    int idx = 0;
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        CU_ASSERT(node == &slots[idx].rbnode);
+        CU_ASSERT(test_node_key(node) == idx + 1);
+        idx++;
+    }
+
+    CU_ASSERT(idx == NODES - 1);
+
+    /** breadth-first, root in first slot, then level by level */
+    test_node_t *bfs_slots = malloc(NODES * sizeof(*bfs_slots));
+    pool.base = (char *)bfs_slots;
+    pool.used = 0;
+
+    CU_ASSERT(rbtree_compact(&tree, RBTREE_COMPACT_BREADTH_FIRST, rbtree_compact_pool_relocate, &pool) == RBTREE_OK);
+    CU_ASSERT(pool.used == NODES - 1);
+    CU_ASSERT(tree.root == &bfs_slots[0].rbnode);
+    CU_ASSERT(tree.root->left == &bfs_slots[1].rbnode);
+    CU_ASSERT(tree.root->right == &bfs_slots[2].rbnode);
+    CU_ASSERT(tree.root->left->left == &bfs_slots[3].rbnode);
+    test_is_rbtree(&tree);
+
+    /** nothing left in old slots */
+    memset(slots, 0, NODES * sizeof(*slots));
+    test_is_rbtree(&tree);
+
+    /** pool runs out half way, moved and unmoved nodes are both linked */
+    pool.base = (char *)slots;
+    pool.used = NODES / 2;
+    CU_ASSERT(rbtree_compact(&tree, RBTREE_COMPACT_BREADTH_FIRST, rbtree_compact_pool_relocate, &pool) == RBTREE_NO_SPACE);
+    CU_ASSERT(pool.used == NODES);
+    CU_ASSERT(tree.root == &slots[NODES / 2].rbnode);
+    test_is_rbtree(&tree);
+
+    /** the tree is still usable */
+    rbtree_node_t *node = rbtree_first(&tree);
+    CU_ASSERT(rbtree_delete(&tree, node) == RBTREE_OK);
+    test_is_rbtree(&tree);
+    CU_ASSERT(rbtree_size(&tree) == NODES - 2);
+
+    free(slots);
+    free(bfs_slots);
+}
+
+
+static void
+test_compact_step(void)
+{
+    enum { NODES = 500 };
+
+    rbtree_t tree;
+    test_compact_build(&tree, NODES);
+
+    test_node_t *slots = malloc(NODES * sizeof(*slots));
+    rbtree_compact_pool_t pool = {
+        .base        = (char *)slots,
+        .record_size = sizeof(test_node_t),
+        .node_offset = offsetof(test_node_t, rbnode),
+        .used        = 0,
+        .capacity    = NODES,
+    };
+
+    rbtree_compact_cursor_t cursor;
+    CU_ASSERT(rbtree_compact_start(NULL, &cursor) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_compact_start(&tree, &cursor) == RBTREE_OK);
+
+    int steps = 0;
+    while (cursor.next != NULL) {
+        CU_ASSERT(rbtree_compact_step(&tree, &cursor, 64, test_pool_relocate_free, &pool) == RBTREE_OK);
+        test_is_rbtree(&tree);
+        steps++;
+
+        /** tree changes between steps, inserted node is past the cursor */
+        if (steps == 2) {
+            test_node_t *node = malloc(sizeof(*node));
+            node->key = NODES;
+            rbtree_insert(&tree, &node->rbnode);
+        }
+    }
+
+    CU_ASSERT(steps == (NODES + 63) / 64);
+    CU_ASSERT(pool.used == NODES);
+
+    int idx = 0;
+    for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+        CU_ASSERT(node == &slots[idx].rbnode);
+        idx++;
+    }
+
+    CU_ASSERT(idx == NODES);
+
+    free(slots);
+}
+
+
+/** parent links and key order, returns node count */
+static size_t
+do_check_sub_links(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (rbtree_is_sentinel(tree, node)) {
+        return 0;
+    }
+
+    if (!rbtree_is_sentinel(tree, node->left)) {
+        CU_ASSERT(node->left->parent == node);
+        CU_ASSERT(test_node_key(node->left) <= test_node_key(node));
+    }
+
+    if (!rbtree_is_sentinel(tree, node->right)) {
+        CU_ASSERT(node->right->parent == node);
+        CU_ASSERT(test_node_key(node->right) >= test_node_key(node));
+    }
+
+    return 1 + do_check_sub_links(tree, node->left) + do_check_sub_links(tree, node->right);
+}
+
+
+static void
+test_count_release(rbtree_node_t *node, void *ctx)
+{
+    size_t *count = ctx;
+
+    CU_ASSERT(node != NULL);
+    (*count)++;
+}
+
+
+static void
+test_delete_range(void)
+{
+    enum { NODES = 600 };
+    static test_node_t nodes[NODES];
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    test_node_t lo = { .key = 0, };
+    test_node_t hi = { .key = 0, };
+
+    /** empty tree */
+    CU_ASSERT(rbtree_delete_range(NULL, NULL, NULL, NULL, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_delete_range(&tree, &lo.rbnode, &hi.rbnode, NULL, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_delete_range(&tree, NULL, NULL, NULL, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 0);
+
+    srand(20171007);
+
+    for (int round = 0; round < 400; round++) {
+        /** sizes from tiny to a few hundred, keys with duplicates */
+        int count = rand() % NODES;
+        int range = count / 2 + 1;
+
+        rbtree_init(&tree, test_node_compare);
+        for (int idx = 0; idx < count; idx++) {
+            nodes[idx].key = rand() % range;
+            rbtree_insert(&tree, &nodes[idx].rbnode);
+        }
+
+        lo.key = rand() % (range + 2) - 1;
+        hi.key = rand() % (range + 2) - 1;
+
+        /** some rounds are open on one or both sides */
+        rbtree_node_t *lo_bound = (round % 7 == 1) ? NULL : &lo.rbnode;
+        rbtree_node_t *hi_bound = (round % 5 == 2) ? NULL : &hi.rbnode;
+
+        size_t expect = 0;
+        for (int idx = 0; idx < count; idx++) {
+            int key = nodes[idx].key;
+            expect += (lo_bound == NULL || key >= lo.key) && (hi_bound == NULL || key < hi.key);
+        }
+
+        rbtree_node_t *detached = NULL;
+        CU_ASSERT(rbtree_detach_range(&tree, lo_bound, hi_bound, &detached) == RBTREE_OK);
+        test_is_rbtree(&tree);
+
+        size_t kept = do_check_sub_links(&tree, tree.root);
+        CU_ASSERT(kept == count - expect);
+        CU_ASSERT(rbtree_size(&tree) == (size_t)count);
+
+        if (detached != NULL) {
+            /** detached part is a valid tree of its own */
+            CU_ASSERT(detached->parent == &tree.sentinel);
+            CU_ASSERT(rbtree_is_black(detached));
+            do_check_sub_rbtree(&tree, detached);
+            CU_ASSERT(do_check_sub_links(&tree, detached) == expect);
+        }
+        else {
+            CU_ASSERT(expect == 0);
+        }
+
+        size_t released = 0;
+        CU_ASSERT(rbtree_release_detached(&tree, detached, test_count_release, &released) == expect);
+        CU_ASSERT(released == expect);
+        CU_ASSERT(rbtree_size(&tree) == kept);
+
+        /** nodes outside the range are all still there */
+        for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+            int key = test_node_key(node);
+            CU_ASSERT((lo_bound != NULL && key < lo.key) || (hi_bound != NULL && key >= hi.key));
+        }
+
+        /** tree keeps working after the cut */
+        for (int idx = 0; idx < count; idx++) {
+            int key = nodes[idx].key;
+            if ((lo_bound == NULL || key >= lo.key) && (hi_bound == NULL || key < hi.key)) {
+                rbtree_node_t *found = NULL;
+                CU_ASSERT(rbtree_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &found) ==
+                          RBTREE_NOT_FOUND);
+            }
+        }
+
+        for (int idx = 0; idx < count; idx++) {
+            int key = nodes[idx].key;
+            if ((lo_bound == NULL || key >= lo.key) && (hi_bound == NULL || key < hi.key)) {
+                CU_ASSERT(rbtree_insert(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            }
+        }
+
+        CU_ASSERT(rbtree_size(&tree) == (size_t)count);
+        test_is_rbtree(&tree);
+        CU_ASSERT(do_check_sub_links(&tree, tree.root) == (size_t)count);
+    }
+}
+
+
+static void
+test_delete_range_release(void)
+{
+    enum { NODES = 1000 };
+    static test_node_t nodes[NODES];
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    for (int idx = 0; idx < NODES; idx++) {
+        nodes[idx].key = (idx * 7) % NODES;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    /** retention, drop keys older than a cutoff */
+    test_node_t cutoff = { .key = 300, };
+    size_t released = 0;
+
+    CU_ASSERT(rbtree_delete_range(&tree, NULL, &cutoff.rbnode, test_count_release, &released) == RBTREE_OK);
+    CU_ASSERT(released == 300);
+    CU_ASSERT(rbtree_size(&tree) == NODES - 300);
+    CU_ASSERT(test_node_key(rbtree_first(&tree)) == 300);
+    test_is_rbtree(&tree);
+
+    /** and a window in the middle */
+    test_node_t lo = { .key = 500, };
+    test_node_t hi = { .key = 600, };
+
+    CU_ASSERT(rbtree_delete_range(&tree, &lo.rbnode, &hi.rbnode, test_count_release, &released) == RBTREE_OK);
+    CU_ASSERT(released == 400);
+    CU_ASSERT(rbtree_size(&tree) == NODES - 400);
+    test_is_rbtree(&tree);
+
+    rbtree_node_t *ret = NULL;
+    CU_ASSERT(rbtree_search(&tree, &lo.rbnode, RBTREE_SEARCH_MODE_GE, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 600);
+    CU_ASSERT(rbtree_search(&tree, &lo.rbnode, RBTREE_SEARCH_MODE_LT, &ret) == RBTREE_OK);
+    CU_ASSERT(test_node_key(ret) == 499);
+
+    /** everything */
+    CU_ASSERT(rbtree_delete_range(&tree, NULL, NULL, test_count_release, &released) == RBTREE_OK);
+    CU_ASSERT(released == NODES);
+    CU_ASSERT(rbtree_size(&tree) == 0);
+    CU_ASSERT(rbtree_first(&tree) == NULL);
+}
+
+
+static void
+test_build_sorted(void)
+{
+    enum { NODES = 1100 };
+    static test_node_t nodes[NODES];
+    static rbtree_node_t *sorted[NODES];
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_node_compare);
+
+    CU_ASSERT(rbtree_build_sorted(NULL, sorted, 0) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_build_sorted(&tree, NULL, 1) == RBTREE_INVALID_ARG);
+
+    /** every size up to a few perfect trees, keys with duplicates */
+    for (int count = 0; count < NODES; count += (count < 140 ? 1 : 97)) {
+        for (int idx = 0; idx < count; idx++) {
+            nodes[idx].key = idx / 3;
+            sorted[idx] = &nodes[idx].rbnode;
+        }
+
+        rbtree_init(&tree, test_node_compare);
+        CU_ASSERT(rbtree_build_sorted(&tree, sorted, count) == RBTREE_OK);
+        CU_ASSERT(rbtree_size(&tree) == (size_t)count);
+
+        test_is_rbtree(&tree);
+        CU_ASSERT(do_check_sub_links(&tree, tree.root) == (size_t)count);
+
+        int idx = 0;
+        for (rbtree_node_t *node = rbtree_first(&tree); node != NULL; node = rbtree_next(&tree, node)) {
+            CU_ASSERT(node == sorted[idx++]);
+        }
+
+        CU_ASSERT(idx == count);
+
+        /** only into an empty tree */
+        if (count > 0) {
+            CU_ASSERT(rbtree_build_sorted(&tree, sorted, count) == RBTREE_INVALID_ARG);
+        }
+
+        /** and it is a normal tree afterwards */
+        for (idx = 0; idx < count; idx += 2) {
+            CU_ASSERT(rbtree_delete(&tree, sorted[idx]) == RBTREE_OK);
+        }
+
+        test_is_rbtree(&tree);
+        CU_ASSERT(rbtree_size(&tree) == (size_t)count / 2);
+    }
+}
+
+
+typedef struct test_counted_s test_counted_t;
+struct test_counted_s {
+    int key;
+    size_t count;
+    rbtree_node_t rbnode;
+};
+
+static size_t test_augment_calls = 0;
+
+
+static int
+test_counted_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    int akey = (rbtree_owner(na, test_counted_t, rbnode))->key;
+    int bkey = (rbtree_owner(nb, test_counted_t, rbnode))->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static size_t
+test_counted_count(rbtree_t *tree, rbtree_node_t *node)
+{
+    return rbtree_is_sentinel(tree, node) ? 0 : (rbtree_owner(node, test_counted_t, rbnode))->count;
+}
+
+
+static void
+test_counted_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    test_augment_calls++;
+    (rbtree_owner(node, test_counted_t, rbnode))->count =
+        1 + test_counted_count(tree, node->left) + test_counted_count(tree, node->right);
+}
+
+
+/** returns nodes in sub-tree, every kept count has to agree */
+static size_t
+do_check_sub_counts(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (rbtree_is_sentinel(tree, node)) {
+        return 0;
+    }
+
+    size_t count = 1 + do_check_sub_counts(tree, node->left) + do_check_sub_counts(tree, node->right);
+    CU_ASSERT(test_counted_count(tree, node) == count);
+
+    return count;
+}
+
+
+static void
+test_augment(void)
+{
+    enum { NODES = 800 };
+    static test_counted_t nodes[NODES];
+    static rbtree_node_t *sorted[NODES];
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_counted_compare);
+    CU_ASSERT(tree.augment == NULL);
+    CU_ASSERT(rbtree_set_augment(NULL, test_counted_augment) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_augment_path(&tree, NULL) == RBTREE_INVALID_ARG);
+
+    /** nodes in tree before it is set are counted by set */
+    for (int idx = 0; idx < 100; idx++) {
+        nodes[idx].key = idx;
+        nodes[idx].count = 0;
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    CU_ASSERT(rbtree_set_augment(&tree, test_counted_augment) == RBTREE_OK);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == 100);
+
+    /** inserts, deletes and unique inserts, with rotations of both kinds */
+    srand(20171021);
+
+    int in_tree[NODES] = { 0 };
+    for (int idx = 0; idx < 100; idx++) {
+        in_tree[idx] = 1;
+    }
+
+    for (int round = 0; round < 6000; round++) {
+        int idx = rand() % NODES;
+
+        if (in_tree[idx]) {
+            CU_ASSERT(rbtree_delete(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            in_tree[idx] = 0;
+        }
+        else if (round % 3 == 0) {
+            rbtree_node_t *ret = NULL;
+            nodes[idx].key = rand() % 400;
+            in_tree[idx] = rbtree_insert_unique(&tree, &nodes[idx].rbnode, &ret) == RBTREE_OK;
+        }
+        else {
+            nodes[idx].key = rand() % 400;
+            CU_ASSERT(rbtree_insert(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            in_tree[idx] = 1;
+        }
+
+        if (round % 50 == 0) {
+            CU_ASSERT(do_check_sub_counts(&tree, tree.root) == rbtree_size(&tree));
+        }
+    }
+
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == rbtree_size(&tree));
+
+    /** split and join keep them too */
+    test_counted_t lo = { .key = 100, };
+    test_counted_t hi = { .key = 300, };
+    rbtree_node_t *detached = NULL;
+
+    CU_ASSERT(rbtree_detach_range(&tree, &lo.rbnode, &hi.rbnode, &detached) == RBTREE_OK);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == (size_t)test_counted_count(&tree, tree.root));
+    if (detached != NULL) {
+        CU_ASSERT(do_check_sub_counts(&tree, detached) == test_counted_count(&tree, detached));
+    }
+
+    rbtree_release_detached(&tree, detached, NULL, NULL);
+    CU_ASSERT(test_counted_count(&tree, tree.root) == rbtree_size(&tree));
+
+    /** a key changed in place is pushed up by hand */
+    rbtree_node_t *first = rbtree_first(&tree);
+    (rbtree_owner(first, test_counted_t, rbnode))->count = 0;
+    CU_ASSERT(rbtree_augment_path(&tree, first) == RBTREE_OK);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == rbtree_size(&tree));
+
+    /** build from sorted */
+    for (int idx = 0; idx < NODES; idx++) {
+        nodes[idx].key = idx;
+        sorted[idx] = &nodes[idx].rbnode;
+    }
+
+    rbtree_init(&tree, test_counted_compare);
+    rbtree_set_augment(&tree, test_counted_augment);
+    CU_ASSERT(rbtree_build_sorted(&tree, sorted, NODES) == RBTREE_OK);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == NODES);
+
+    /** O(log n) calls per insert, not O(n) */
+    rbtree_init(&tree, test_counted_compare);
+    rbtree_set_augment(&tree, test_counted_augment);
+    test_augment_calls = 0;
+    for (int idx = 0; idx < NODES; idx++) {
+        rbtree_insert(&tree, &nodes[idx].rbnode);
+    }
+
+    CU_ASSERT(test_augment_calls < NODES * 2 * 2 * 10);
+
+    /** and none once it is cleared */
+    CU_ASSERT(rbtree_set_augment(&tree, NULL) == RBTREE_OK);
+    test_augment_calls = 0;
+    rbtree_delete(&tree, &nodes[0].rbnode);
+    CU_ASSERT(test_augment_calls == 0);
+}
+
+
+static int
+test_counted_key_compare(const void *key, rbtree_node_t *node)
+{
+    return *(const int *)key - (rbtree_owner(node, test_counted_t, rbnode))->key;
+}
+
+
+/** keys in order and as many as size, which holds with fixups pending too */
+static void
+test_is_search_tree(rbtree_t *tree)
+{
+    size_t count = 0;
+    int last = -1;
+
+    for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+        int key = (rbtree_owner(node, test_counted_t, rbnode))->key;
+
+        CU_ASSERT(key >= last);
+        last = key;
+        count++;
+    }
+
+    CU_ASSERT(count == rbtree_size(tree));
+}
+
+
+static void
+test_relaxed(void)
+{
+    enum { NODES = 3000, PENDING = 64 };
+    static test_counted_t nodes[NODES];
+    static rbtree_node_t *pending[PENDING];
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_counted_compare);
+    rbtree_set_augment(&tree, test_counted_augment);
+
+    CU_ASSERT(rbtree_set_relaxed(NULL, pending, PENDING) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_set_relaxed(&tree, NULL, PENDING) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbtree_set_relaxed(&tree, pending, PENDING) == RBTREE_OK);
+    CU_ASSERT(rbtree_rebalance(&tree, 10) == 0);
+
+    /** an ascending burst only links, a chain hangs down the right */
+    for (int idx = 0; idx < PENDING; idx++) {
+        nodes[idx].key = idx;
+        CU_ASSERT(rbtree_insert(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+    }
+
+    rbtree_stats_t stats;
+    rbtree_stats(&tree, &stats);
+    CU_ASSERT(stats.max_depth + 1 >= PENDING);
+    CU_ASSERT(tree.pending_count == PENDING);
+    test_is_search_tree(&tree);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == PENDING);
+
+    /** searches work on it as it is */
+    rbtree_node_t *ret = NULL;
+    int key = PENDING - 1;
+    CU_ASSERT(rbtree_search_key(&tree, &key, test_counted_key_compare, RBTREE_SEARCH_MODE_EQ, &ret) == RBTREE_OK);
+    CU_ASSERT(ret == &nodes[PENDING - 1].rbnode);
+
+    /** in bounded steps */
+    CU_ASSERT(rbtree_rebalance(&tree, 10) == PENDING - 10);
+    test_is_search_tree(&tree);
+    CU_ASSERT(rbtree_rebalance(&tree, SIZE_MAX) == 0);
+    test_is_rbtree(&tree);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == PENDING);
+
+    /** random keys past capacity, a full queue fixes its oldest */
+    srand(20171118);
+
+    int in_tree[NODES] = { 0 };
+    for (int idx = 0; idx < PENDING; idx++) {
+        in_tree[idx] = 1;
+    }
+
+    for (int round = 0; round < 30000; round++) {
+        int idx = rand() % NODES;
+
+        if (!in_tree[idx]) {
+            nodes[idx].key = rand() % 1000;
+            CU_ASSERT(rbtree_insert(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            in_tree[idx] = 1;
+            CU_ASSERT(tree.pending_count <= PENDING);
+        }
+        else if (round % 4 == 0) {
+            /** a delete runs every fixup first */
+            CU_ASSERT(rbtree_delete(&tree, &nodes[idx].rbnode) == RBTREE_OK);
+            CU_ASSERT(tree.pending_count == 0);
+            in_tree[idx] = 0;
+            test_is_rbtree(&tree);
+        }
+
+        if (round % 7 == 0) {
+            rbtree_rebalance(&tree, rand() % 8);
+        }
+
+        if (round % 101 == 0) {
+            test_is_search_tree(&tree);
+            CU_ASSERT(do_check_sub_counts(&tree, tree.root) == rbtree_size(&tree));
+        }
+    }
+
+    /** leaving relaxed mode settles it */
+    CU_ASSERT(rbtree_set_relaxed(&tree, NULL, 0) == RBTREE_OK);
+    CU_ASSERT(tree.pending_count == 0);
+    test_is_rbtree(&tree);
+    CU_ASSERT(do_check_sub_counts(&tree, tree.root) == rbtree_size(&tree));
+
+    /** and inserts fix up at once again */
+    nodes[0].key = 5000;
+    if (in_tree[0]) {
+        rbtree_delete(&tree, &nodes[0].rbnode);
+    }
+
+    CU_ASSERT(rbtree_insert(&tree, &nodes[0].rbnode) == RBTREE_OK);
+    CU_ASSERT(tree.pending_count == 0);
+    test_is_rbtree(&tree);
+}
+
+
 /** test cases for one single suit */
 static CU_TestInfo test_rbtree_rotate[] = {
     { "test_left_rotate",  test_left_rotate  },
@@ -641,10 +1746,38 @@ static CU_TestInfo test_rbtree_rotate[] = {
 };
 
 static CU_TestInfo test_rbtree_insert[] = {
-    { "test_insert_fixup", test_insert_fixup },
-    { "test_insert",       test_insert       },
-    { "test_delete_fixup", test_delete_fixup },
-    { "test_delete",       test_delete       },
+    { "test_insert_fixup",   test_insert_fixup   },
+    { "test_insert",         test_insert         },
+    { "test_delete_fixup",   test_delete_fixup   },
+    { "test_delete",         test_delete         },
+    { "test_insert_unique",  test_insert_unique  },
+    { "test_find_or_insert", test_find_or_insert },
+    { "test_random_insert_delete", test_random_insert_delete },
+    { "test_stats",          test_stats          },
+    { "test_build_sorted",   test_build_sorted   },
+    { "test_augment",        test_augment        },
+    { "test_relaxed",        test_relaxed        },
+    CU_TEST_INFO_NULL,
+};
+
+static CU_TestInfo test_rbtree_search[] = {
+    { "test_search",      test_search      },
+    { "test_search_key",  test_search_key  },
+    { "test_equal_range", test_equal_range },
+    { "test_counters",    test_counters    },
+    { "test_iterate",     test_iterate     },
+    CU_TEST_INFO_NULL,
+};
+
+static CU_TestInfo test_rbtree_range[] = {
+    { "test_delete_range",         test_delete_range         },
+    { "test_delete_range_release", test_delete_range_release },
+    CU_TEST_INFO_NULL,
+};
+
+static CU_TestInfo test_rbtree_compact[] = {
+    { "test_compact",      test_compact      },
+    { "test_compact_step", test_compact_step },
     CU_TEST_INFO_NULL,
 };
 
@@ -670,6 +1803,30 @@ static CU_SuiteInfo suites[] = {
       NULL,
       test_rbtree_insert,
   },
+  {
+      "test_search",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_search,
+  },
+  {
+      "test_compact",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_compact,
+  },
+  {
+      "test_range",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbtree_range,
+  },
 
   CU_SUITE_INFO_NULL,
 };
@@ -0,0 +1,443 @@
+/**
+ * file name: rbtree_thr.c
+ *
+ * threaded rbtree implemention
+ *
+ * balancing is the usual bottom-up one over parent links, written once
+ * for a direction `dir` and its mirror `!dir`. what changes is every
+ * place a child link appears or disappears: a new leaf takes over the
+ * thread of its parent, a rotation turns a moved empty link into a
+ * thread, and delete points the threads around the removed node past it.
+ */
+#include <stdio.h>
+
+#include "rbtree_thr.h"
+
+
+static inline rbthr_node_t *
+rbthr_parent(rbthr_node_t *node)
+{
+    return (rbthr_node_t *)(node->parent_color & ~RBTHR_RED);
+}
+
+
+/** NULL is black */
+static inline int
+rbthr_is_red(rbthr_node_t *node)
+{
+    return node != NULL && (node->parent_color & RBTHR_RED);
+}
+
+
+static inline void
+rbthr_set_parent(rbthr_node_t *node, rbthr_node_t *parent)
+{
+    node->parent_color = (uintptr_t)parent | (node->parent_color & RBTHR_RED);
+}
+
+
+static inline void
+rbthr_set_red(rbthr_node_t *node, int red)
+{
+    node->parent_color = (node->parent_color & ~RBTHR_RED) | (red ? RBTHR_RED : 0);
+}
+
+
+static inline void
+rbthr_set_thread(rbthr_node_t *node, int dir, rbthr_node_t *target)
+{
+    node->link[dir] = (uintptr_t)target | RBTHR_THREAD;
+}
+
+
+static inline void
+rbthr_set_child(rbthr_node_t *node, int dir, rbthr_node_t *child)
+{
+    node->link[dir] = (uintptr_t)child;
+    rbthr_set_parent(child, node);
+}
+
+
+/** side of `parent` that `node` hangs from */
+static inline int
+rbthr_dir(rbthr_node_t *parent, rbthr_node_t *node)
+{
+    return parent->link[1] == (uintptr_t)node;
+}
+
+
+/** hang `child` where `node` hangs now */
+static void
+rbthr_replace(rbthr_tree_t *tree, rbthr_node_t *node, rbthr_node_t *child)
+{
+    rbthr_node_t *parent = rbthr_parent(node);
+
+    if (parent == NULL) {
+        tree->root = child;
+        rbthr_set_parent(child, NULL);
+    }
+    else {
+        rbthr_set_child(parent, rbthr_dir(parent, node), child);
+    }
+}
+
+
+/**
+ * rotate `node` down towards `dir`, its `!dir` child takes its place
+ *
+ * if that child has nothing on its `dir` side, its thread pointed back
+ * to `node`, and `node` gets a thread to the child in turn.
+ */
+static void
+rbthr_rotate(rbthr_tree_t *tree, rbthr_node_t *node, int dir)
+{
+    rbthr_node_t *save = rbthr_link(node, !dir);
+
+    if (rbthr_is_thread(save, dir)) {
+        rbthr_set_thread(node, !dir, save);
+    }
+    else {
+        rbthr_set_child(node, !dir, rbthr_link(save, dir));
+    }
+
+    rbthr_replace(tree, node, save);
+    rbthr_set_child(save, dir, node);
+}
+
+
+int
+rbthr_init(rbthr_tree_t *tree, rbthr_compare compare)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+
+    tree->root = NULL;
+    tree->compare = compare;
+    tree->size = 0;
+
+    return RBTREE_OK;
+}
+
+
+static void
+rbthr_insert_fixup(rbthr_tree_t *tree, rbthr_node_t *node)
+{
+    rbthr_node_t *parent = NULL;
+
+    while ((parent = rbthr_parent(node)) != NULL && rbthr_is_red(parent)) {
+        /** a red parent is never root */
+        rbthr_node_t *grand = rbthr_parent(parent);
+        int dir = rbthr_dir(grand, parent);
+        rbthr_node_t *uncle = rbthr_child(grand, !dir);
+
+        if (rbthr_is_red(uncle)) {
+            rbthr_set_red(parent, 0);
+            rbthr_set_red(uncle, 0);
+            rbthr_set_red(grand, 1);
+            node = grand;
+
+            continue;
+        }
+
+        /** inner grandchild, make it outer first */
+        if (rbthr_dir(parent, node) != dir) {
+            rbthr_rotate(tree, parent, dir);
+            node = parent;
+            parent = rbthr_parent(node);
+        }
+
+        rbthr_set_red(parent, 0);
+        rbthr_set_red(grand, 1);
+        rbthr_rotate(tree, grand, !dir);
+    }
+
+    rbthr_set_red(tree->root, 0);
+}
+
+
+int
+rbthr_insert(rbthr_tree_t *tree, rbthr_node_t *node)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    rbthr_node_t *parent = NULL;
+    rbthr_node_t *traverse = tree->root;
+    int dir = 0;
+
+    while (traverse != NULL) {
+        parent = traverse;
+        dir = tree->compare(node, traverse) > 0;
+        traverse = rbthr_child(traverse, dir);
+    }
+
+    if (parent == NULL) {
+        rbthr_set_thread(node, 0, NULL);
+        rbthr_set_thread(node, 1, NULL);
+        node->parent_color = 0;
+        tree->root = node;
+    }
+    else {
+        /** parent's neighbour on `dir` side becomes ours, parent the other */
+        node->link[dir] = parent->link[dir];
+        rbthr_set_thread(node, !dir, parent);
+        node->parent_color = RBTHR_RED;
+        rbthr_set_child(parent, dir, node);
+
+        rbthr_insert_fixup(tree, node);
+    }
+
+    tree->size++;
+
+    return RBTREE_OK;
+}
+
+
+/**
+ * `node` below `parent` on side `dir` is one black short, NULL as well
+ */
+static void
+rbthr_delete_fixup(rbthr_tree_t *tree, rbthr_node_t *node, rbthr_node_t *parent, int dir)
+{
+    while (parent != NULL && !rbthr_is_red(node)) {
+        /** has a black node more than `node`, so it exists */
+        rbthr_node_t *sibling = rbthr_link(parent, !dir);
+
+        if (rbthr_is_red(sibling)) {
+            rbthr_set_red(sibling, 0);
+            rbthr_set_red(parent, 1);
+            rbthr_rotate(tree, parent, dir);
+            sibling = rbthr_link(parent, !dir);
+        }
+
+        rbthr_node_t *near = rbthr_child(sibling, dir);
+        rbthr_node_t *far  = rbthr_child(sibling, !dir);
+
+        if (!rbthr_is_red(near) && !rbthr_is_red(far)) {
+            rbthr_set_red(sibling, 1);
+            node = parent;
+            parent = rbthr_parent(node);
+            if (parent != NULL) {
+                dir = rbthr_dir(parent, node);
+            }
+
+            continue;
+        }
+
+        if (!rbthr_is_red(far)) {
+            rbthr_set_red(near, 0);
+            rbthr_set_red(sibling, 1);
+            rbthr_rotate(tree, sibling, !dir);
+            sibling = rbthr_link(parent, !dir);
+            far = rbthr_child(sibling, !dir);
+        }
+
+        rbthr_set_red(sibling, rbthr_is_red(parent));
+        rbthr_set_red(parent, 0);
+        rbthr_set_red(far, 0);
+        rbthr_rotate(tree, parent, dir);
+
+        node = tree->root;
+        break;
+    }
+
+    if (node != NULL) {
+        rbthr_set_red(node, 0);
+    }
+}
+
+
+int
+rbthr_delete(rbthr_tree_t *tree, rbthr_node_t *node)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(node != NULL && tree->root != NULL, RBTREE_INVALID_ARG);
+
+    rbthr_node_t *left  = rbthr_child(node, 0);
+    rbthr_node_t *right = rbthr_child(node, 1);
+
+    /** where a black node may have gone missing */
+    rbthr_node_t *fix = NULL;
+    rbthr_node_t *fix_parent = NULL;
+    int fix_dir = 0;
+    int black_removed = 0;
+
+    if (left != NULL && right != NULL) {
+        /** successor takes the place of node, its own place is what is removed */
+        rbthr_node_t *succ = rbthr_extreme(right, 0);
+
+        /** predecessor now precedes the successor */
+        rbthr_set_thread(rbthr_extreme(left, 1), 1, succ);
+
+        black_removed = !rbthr_is_red(succ);
+        fix = rbthr_child(succ, 1);
+
+        if (succ == right) {
+            fix_parent = succ;
+            fix_dir = 1;
+        }
+        else {
+            fix_parent = rbthr_parent(succ);
+            fix_dir = 0;
+
+            /** succ was a left child with no left child, its parent follows it */
+            if (fix != NULL) {
+                rbthr_set_child(fix_parent, 0, fix);
+            }
+            else {
+                rbthr_set_thread(fix_parent, 0, succ);
+            }
+
+            rbthr_set_child(succ, 1, right);
+        }
+
+        rbthr_set_child(succ, 0, left);
+        rbthr_replace(tree, node, succ);
+        rbthr_set_red(succ, rbthr_is_red(node));
+    }
+    else if (left != NULL || right != NULL) {
+        int dir = left != NULL ? 0 : 1;
+        rbthr_node_t *child = left != NULL ? left : right;
+
+        /** the one neighbour of node inside child's subtree skips node */
+        rbthr_extreme(child, !dir)->link[!dir] = node->link[!dir];
+
+        black_removed = !rbthr_is_red(node);
+        fix = child;
+        fix_parent = rbthr_parent(node);
+        fix_dir = fix_parent != NULL ? rbthr_dir(fix_parent, node) : 0;
+
+        rbthr_replace(tree, node, child);
+    }
+    else {
+        black_removed = !rbthr_is_red(node);
+        fix_parent = rbthr_parent(node);
+
+        if (fix_parent == NULL) {
+            tree->root = NULL;
+        }
+        else {
+            /** parent inherits the thread on the side node hung from */
+            fix_dir = rbthr_dir(fix_parent, node);
+            fix_parent->link[fix_dir] = node->link[fix_dir];
+        }
+    }
+
+    if (black_removed) {
+        rbthr_delete_fixup(tree, fix, fix_parent, fix_dir);
+    }
+
+    tree->size--;
+
+    return RBTREE_OK;
+}
+
+
+/**
+ * one step of search descent, `cmp` is the searched key against `traverse`
+ * returns next node to visit or NULL when search stops.
+ */
+static inline rbthr_node_t *
+rbthr_search_step(rbthr_node_t *traverse,
+                  int cmp,
+                  rbtree_search_mode_t mode,
+                  rbthr_node_t **result)
+{
+    int hit = 0;
+    int dir = 0;
+
+    switch (mode) {
+    case RBTREE_SEARCH_MODE_LT:
+        hit = cmp > 0;
+        dir = cmp > 0;
+        break;
+
+    case RBTREE_SEARCH_MODE_GT:
+        hit = cmp < 0;
+        dir = cmp >= 0;
+        break;
+
+    case RBTREE_SEARCH_MODE_LE:
+        hit = cmp >= 0;
+        dir = cmp >= 0;
+        break;
+
+    case RBTREE_SEARCH_MODE_GE:
+        hit = cmp <= 0;
+        dir = cmp > 0;
+        break;
+
+    default:
+        /** keep going left for the first of equal ones */
+        hit = cmp == 0;
+        dir = cmp > 0;
+        break;
+    }
+
+    if (hit) {
+        *result = traverse;
+    }
+
+    return rbthr_child(traverse, dir);
+}
+
+
+int
+rbthr_search(rbthr_tree_t *tree,
+             rbthr_node_t *value,
+             rbtree_search_mode_t mode,
+             rbthr_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(value != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    rbthr_node_t *result = NULL;
+    rbthr_node_t *traverse = tree->root;
+
+    while (traverse != NULL) {
+        int cmp = tree->compare(value, traverse);
+
+        traverse = rbthr_search_step(traverse, cmp, mode, &result);
+    }
+
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
+
+
+int
+rbthr_search_key(rbthr_tree_t *tree,
+                 const void *key,
+                 rbthr_key_compare compare,
+                 rbtree_search_mode_t mode,
+                 rbthr_node_t **ret)
+{
+    rbtree_must(tree != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(compare != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(ret != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(mode > 0 && mode < RBTREE_SEARCH_MODE_MAX, RBTREE_INVALID_ARG);
+
+    rbthr_node_t *result = NULL;
+    rbthr_node_t *traverse = tree->root;
+
+    while (traverse != NULL) {
+        int cmp = compare(key, traverse);
+
+        traverse = rbthr_search_step(traverse, cmp, mode, &result);
+    }
+
+    if (result != NULL) {
+        *ret = result;
+
+        return RBTREE_OK;
+    }
+
+    return RBTREE_NOT_FOUND;
+}
@@ -0,0 +1,144 @@
+/**
+ * file name: rbtree_thr.h
+ *
+ * head file of threaded rbtree
+ *
+ * a link with no child points to the in-order predecessor (left) or
+ * successor (right) instead, tagged in its lowest bit. the first node's
+ * left thread and the last node's right thread are NULL.
+ *
+ * next and prev never climb to a parent: a right thread is the successor
+ * itself, else it is the leftmost node below the right child, so a full
+ * scan follows every link once and needs no stack. parent links are
+ * kept for rebalancing only, color is packed in their lowest bit.
+ */
+#ifndef __RB_TREE_THR_H__
+#define __RB_TREE_THR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+typedef struct rbthr_node_s rbthr_node_t;
+struct rbthr_node_s {
+    /** left and right, bit 0 set if a thread */
+    uintptr_t link[2];
+    /** parent, bit 0 set if red */
+    uintptr_t parent_color;
+};
+
+#define RBTHR_THREAD ((uintptr_t)1)
+#define RBTHR_RED    ((uintptr_t)1)
+
+#define rbthr_is_thread(node, dir) ((node)->link[(dir)] & RBTHR_THREAD)
+
+/** target of link, child or thread */
+#define rbthr_link(node, dir) \
+    ((rbthr_node_t *)((node)->link[(dir)] & ~RBTHR_THREAD))
+
+/** child, NULL if the link is a thread */
+#define rbthr_child(node, dir) \
+    (rbthr_is_thread(node, dir) ? NULL : rbthr_link(node, dir))
+
+
+/** compare function of two node */
+typedef int (*rbthr_compare)(rbthr_node_t *na, rbthr_node_t *nb);
+
+/** compare function of a search key and a node */
+typedef int (*rbthr_key_compare)(const void *key, rbthr_node_t *node);
+
+typedef struct rbthr_tree_s rbthr_tree_t;
+struct rbthr_tree_s {
+    rbthr_node_t *root;
+    rbthr_compare compare;
+    size_t size;
+};
+
+
+int
+rbthr_init(rbthr_tree_t *tree, rbthr_compare compare);
+
+/** equal nodes are allowed, a new one goes before them as in rbtree_insert */
+int
+rbthr_insert(rbthr_tree_t *tree, rbthr_node_t *node);
+
+/** node must be in tree */
+int
+rbthr_delete(rbthr_tree_t *tree, rbthr_node_t *node);
+
+/** EQ and GE find the first of equal nodes, LE the last */
+int
+rbthr_search(rbthr_tree_t *tree,
+             rbthr_node_t *value,
+             rbtree_search_mode_t mode,
+             rbthr_node_t **ret);
+
+int
+rbthr_search_key(rbthr_tree_t *tree,
+                 const void *key,
+                 rbthr_key_compare compare,
+                 rbtree_search_mode_t mode,
+                 rbthr_node_t **ret);
+
+
+/** leftmost or rightmost node below and including `node` */
+static inline rbthr_node_t *
+rbthr_extreme(rbthr_node_t *node, int dir)
+{
+    while (!rbthr_is_thread(node, dir)) {
+        node = rbthr_link(node, dir);
+    }
+
+    return node;
+}
+
+
+/** NULL if tree is empty */
+static inline rbthr_node_t *
+rbthr_first(rbthr_tree_t *tree)
+{
+    return tree->root != NULL ? rbthr_extreme(tree->root, 0) : NULL;
+}
+
+
+static inline rbthr_node_t *
+rbthr_last(rbthr_tree_t *tree)
+{
+    return tree->root != NULL ? rbthr_extreme(tree->root, 1) : NULL;
+}
+
+
+/** NULL after the last node */
+static inline rbthr_node_t *
+rbthr_next(rbthr_node_t *node)
+{
+    if (rbthr_is_thread(node, 1)) {
+        return rbthr_link(node, 1);
+    }
+
+    return rbthr_extreme(rbthr_link(node, 1), 0);
+}
+
+
+/** NULL before the first node */
+static inline rbthr_node_t *
+rbthr_prev(rbthr_node_t *node)
+{
+    if (rbthr_is_thread(node, 0)) {
+        return rbthr_link(node, 0);
+    }
+
+    return rbthr_extreme(rbthr_link(node, 0), 1);
+}
+
+
+static inline size_t
+rbthr_size(rbthr_tree_t *tree)
+{
+    return tree->size;
+}
+
+
+#endif
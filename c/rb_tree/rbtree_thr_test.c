@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_thr.c"
+
+typedef struct test_node_s test_node_t;
+struct test_node_s {
+    int key;
+    int in_tree;
+    rbthr_node_t thrnode;
+};
+
+#define rbthr_owner(ptr, type, field) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, field)))
+
+
+static int
+test_node_compare(rbthr_node_t *na, rbthr_node_t *nb)
+{
+    int akey = rbthr_owner(na, test_node_t, thrnode)->key;
+    int bkey = rbthr_owner(nb, test_node_t, thrnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_key_compare(const void *key, rbthr_node_t *node)
+{
+    int akey = *(const int *)key;
+    int bkey = rbthr_owner(node, test_node_t, thrnode)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static int
+test_node_key(rbthr_node_t *node)
+{
+    return rbthr_owner(node, test_node_t, thrnode)->key;
+}
+
+
+/**
+ * returns black height of sub-tree, `prev` is the node visited last in
+ * order, which every left thread and right thread has to agree with
+ */
+static int
+do_check_sub_rbthr(rbthr_node_t *node, rbthr_node_t *parent, rbthr_node_t **prev, size_t *count)
+{
+    if (node == NULL) {
+        return 1;
+    }
+
+    (*count)++;
+    CU_ASSERT(rbthr_parent(node) == parent);
+
+    rbthr_node_t *left  = rbthr_child(node, 0);
+    rbthr_node_t *right = rbthr_child(node, 1);
+
+    if (rbthr_is_red(node)) {
+        CU_ASSERT(!rbthr_is_red(left));
+        CU_ASSERT(!rbthr_is_red(right));
+    }
+
+    int left_black_height = do_check_sub_rbthr(left, node, prev, count);
+
+    /** left thread is the predecessor */
+    if (left == NULL) {
+        CU_ASSERT(rbthr_link(node, 0) == *prev);
+    }
+
+    /** right thread of predecessor is this node */
+    if (*prev != NULL) {
+        CU_ASSERT(test_node_key(*prev) <= test_node_key(node));
+        CU_ASSERT(!rbthr_is_thread(*prev, 1) || rbthr_link(*prev, 1) == node);
+    }
+
+    *prev = node;
+
+    int right_black_height = do_check_sub_rbthr(right, node, prev, count);
+
+    CU_ASSERT(left_black_height == right_black_height);
+
+    return left_black_height + !rbthr_is_red(node);
+}
+
+
+static void
+test_is_rbthr(rbthr_tree_t *tree)
+{
+    size_t count = 0;
+    rbthr_node_t *prev = NULL;
+
+    CU_ASSERT(!rbthr_is_red(tree->root));
+    do_check_sub_rbthr(tree->root, NULL, &prev, &count);
+    CU_ASSERT(count == rbthr_size(tree));
+
+    /** last node ends the threads */
+    if (prev != NULL) {
+        CU_ASSERT(rbthr_is_thread(prev, 1) && rbthr_link(prev, 1) == NULL);
+        CU_ASSERT(prev == rbthr_last(tree));
+    }
+}
+
+
+static void
+test_insert(void)
+{
+    rbthr_tree_t tree;
+
+    CU_ASSERT(rbthr_init(NULL, test_node_compare) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbthr_init(&tree, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbthr_init(&tree, test_node_compare) == RBTREE_OK);
+
+    CU_ASSERT(rbthr_insert(&tree, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbthr_first(&tree) == NULL);
+
+    /** ascending and descending keys both need rotations */
+    test_node_t nodes[256];
+    for (int idx = 0; idx < 128; idx++) {
+        nodes[idx].key = idx;
+        CU_ASSERT(rbthr_insert(&tree, &nodes[idx].thrnode) == RBTREE_OK);
+        test_is_rbthr(&tree);
+    }
+
+    for (int idx = 128; idx < 256; idx++) {
+        nodes[idx].key = 1000 - idx;
+        CU_ASSERT(rbthr_insert(&tree, &nodes[idx].thrnode) == RBTREE_OK);
+        test_is_rbthr(&tree);
+    }
+
+    CU_ASSERT(rbthr_size(&tree) == 256);
+
+    /** a duplicate goes before the equal one */
+    test_node_t dup = { .key = 64, };
+    CU_ASSERT(rbthr_insert(&tree, &dup.thrnode) == RBTREE_OK);
+    CU_ASSERT(rbthr_next(&dup.thrnode) == &nodes[64].thrnode);
+    test_is_rbthr(&tree);
+
+    rbthr_node_t *node = NULL;
+    int key = 64;
+    CU_ASSERT(rbthr_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &node) == RBTREE_OK);
+    CU_ASSERT(node == &dup.thrnode);
+    CU_ASSERT(rbthr_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_LE, &node) == RBTREE_OK);
+    CU_ASSERT(node == &nodes[64].thrnode);
+    CU_ASSERT(rbthr_search(&tree, &dup.thrnode, RBTREE_SEARCH_MODE_GT, &node) == RBTREE_OK);
+    CU_ASSERT(test_node_key(node) == 65);
+    CU_ASSERT(rbthr_search(&tree, &dup.thrnode, RBTREE_SEARCH_MODE_LT, &node) == RBTREE_OK);
+    CU_ASSERT(test_node_key(node) == 63);
+
+    key = 500;
+    CU_ASSERT(rbthr_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_EQ, &node) == RBTREE_NOT_FOUND);
+    CU_ASSERT(rbthr_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_GE, &node) == RBTREE_OK);
+    CU_ASSERT(test_node_key(node) == 1000 - 255);
+    CU_ASSERT(rbthr_search_key(&tree, &key, test_key_compare, RBTREE_SEARCH_MODE_MAX, &node) == RBTREE_INVALID_ARG);
+}
+
+
+static void
+test_random(void)
+{
+    enum { NODES = 2000, ROUNDS = 20000 };
+    static test_node_t nodes[NODES];
+
+    rbthr_tree_t tree;
+    rbthr_init(&tree, test_node_compare);
+    memset(nodes, 0, sizeof(nodes));
+
+    srand(20171014);
+
+    size_t in_tree = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        test_node_t *item = &nodes[rand() % NODES];
+
+        if (item->in_tree) {
+            CU_ASSERT(rbthr_delete(&tree, &item->thrnode) == RBTREE_OK);
+            item->in_tree = 0;
+            in_tree--;
+        }
+        else {
+            /** few keys, so many are equal */
+            item->key = rand() % 500;
+            CU_ASSERT(rbthr_insert(&tree, &item->thrnode) == RBTREE_OK);
+            item->in_tree = 1;
+            in_tree++;
+        }
+
+        if (round % 97 == 0) {
+            test_is_rbthr(&tree);
+        }
+    }
+
+    test_is_rbthr(&tree);
+    CU_ASSERT(rbthr_size(&tree) == in_tree);
+
+    /** forward and backward scans see the same nodes */
+    size_t forward = 0;
+    rbthr_node_t *last = NULL;
+    for (rbthr_node_t *node = rbthr_first(&tree); node != NULL; node = rbthr_next(node)) {
+        CU_ASSERT(last == NULL || test_node_key(last) <= test_node_key(node));
+        CU_ASSERT(rbthr_owner(node, test_node_t, thrnode)->in_tree);
+        last = node;
+        forward++;
+    }
+
+    size_t backward = 0;
+    for (rbthr_node_t *node = rbthr_last(&tree); node != NULL; node = rbthr_prev(node)) {
+        backward++;
+    }
+
+    CU_ASSERT(forward == in_tree);
+    CU_ASSERT(backward == in_tree);
+
+    /** empty it */
+    for (int idx = 0; idx < NODES; idx++) {
+        if (nodes[idx].in_tree) {
+            CU_ASSERT(rbthr_delete(&tree, &nodes[idx].thrnode) == RBTREE_OK);
+        }
+    }
+
+    CU_ASSERT(tree.root == NULL);
+    CU_ASSERT(rbthr_size(&tree) == 0);
+    CU_ASSERT(rbthr_delete(&tree, &nodes[0].thrnode) == RBTREE_INVALID_ARG);
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbthr[] = {
+    { "test_insert", test_insert },
+    { "test_random", test_random },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbthr",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbthr,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,720 @@
+/**
+ * file name: rbtree_wal.c
+ *
+ * durable rbtree implemention
+ *
+ * log record is a 16 bytes head and the encoded record:
+ *
+ *     uint32_t len;     bytes of record
+ *     uint32_t sum;     FNV-1a of lsn_op and record
+ *     uint64_t lsn_op;  lsn << 1 | op
+ *
+ * checkpoint is a rbwal_ckpt_head_t then every record in order as
+ * uint32_t len and bytes. it is written aside and renamed over the old
+ * one, so a crash leaves either of them. log records up to its lsn are
+ * skipped on replay, which covers a crash before the log is emptied.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rbtree_wal.h"
+
+
+#define RBWAL_OP_INSERT 0
+#define RBWAL_OP_DELETE 1
+
+#define RBWAL_SUM_SEED  2166136261u
+#define RBWAL_BUF_BYTES (64 * 1024)
+
+typedef struct rbwal_head_s rbwal_head_t;
+struct rbwal_head_s {
+    uint32_t len;
+    uint32_t sum;
+    uint64_t lsn_op;
+};
+
+typedef struct rbwal_ckpt_head_s rbwal_ckpt_head_t;
+struct rbwal_ckpt_head_s {
+    uint32_t magic;
+    uint32_t reserved;
+    /** last operation in checkpoint */
+    uint64_t lsn;
+    uint64_t count;
+};
+
+
+static uint32_t
+rbwal_sum(uint32_t sum, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t idx = 0; idx < len; idx++) {
+        sum = (sum ^ bytes[idx]) * 16777619u;
+    }
+
+    return sum;
+}
+
+
+static char *
+rbwal_path(const char *path, size_t len, const char *suffix)
+{
+    char *ret = malloc(len + strlen(suffix) + 1);
+    if (ret != NULL) {
+        memcpy(ret, path, len);
+        strcpy(ret + len, suffix);
+    }
+
+    return ret;
+}
+
+
+static int
+rbwal_reserve(rbwal_t *wal, size_t bytes)
+{
+    if (bytes <= wal->buf_cap) {
+        return RBTREE_OK;
+    }
+
+    size_t cap = wal->buf_cap * 2 > bytes ? wal->buf_cap * 2 : bytes;
+    char *buf = realloc(wal->buf, cap);
+    if (buf == NULL) {
+        return RBTREE_NO_SPACE;
+    }
+
+    wal->buf = buf;
+    wal->buf_cap = cap;
+
+    return RBTREE_OK;
+}
+
+
+static int
+rbwal_write_all(int fd, const void *data, size_t len)
+{
+    const char *pos = data;
+
+    while (len > 0) {
+        ssize_t ret = write(fd, pos, len);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            return RBTREE_IO_ERROR;
+        }
+
+        pos += ret;
+        len -= (size_t)ret;
+    }
+
+    return RBTREE_OK;
+}
+
+
+static int
+rbwal_sync_dir(rbwal_t *wal)
+{
+    int fd = open(wal->dir_path, O_RDONLY);
+    if (fd < 0) {
+        return RBTREE_IO_ERROR;
+    }
+
+    int ret = fsync(fd) == 0 ? RBTREE_OK : RBTREE_IO_ERROR;
+    close(fd);
+
+    return ret;
+}
+
+
+static void
+rbwal_free(rbwal_t *wal)
+{
+    if (wal->log_fd >= 0) {
+        close(wal->log_fd);
+        wal->log_fd = -1;
+    }
+
+    free(wal->log_path);
+    free(wal->ckpt_path);
+    free(wal->tmp_path);
+    free(wal->dir_path);
+    free(wal->buf);
+
+    wal->log_path = wal->ckpt_path = wal->tmp_path = wal->dir_path = NULL;
+    wal->buf = NULL;
+}
+
+
+static void
+rbwal_release_node(rbtree_node_t *node, void *ctx)
+{
+    rbwal_codec_t *codec = ctx;
+
+    codec->release(node, codec->ctx);
+}
+
+
+/** payload of `len` bytes into wal->buf, RBTREE_INVALID_TOPOLOGY if file ends */
+static int
+rbwal_read_record(rbwal_t *wal, FILE *fp, size_t len)
+{
+    int ret = rbwal_reserve(wal, len);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    if (len > 0 && fread(wal->buf, 1, len, fp) != len) {
+        return ferror(fp) ? RBTREE_IO_ERROR : RBTREE_INVALID_TOPOLOGY;
+    }
+
+    return RBTREE_OK;
+}
+
+
+static int
+rbwal_load_checkpoint(rbwal_t *wal)
+{
+    FILE *fp = fopen(wal->ckpt_path, "rb");
+    if (fp == NULL) {
+        return errno == ENOENT ? RBTREE_OK : RBTREE_IO_ERROR;
+    }
+
+    rbwal_ckpt_head_t head;
+    rbtree_node_t **nodes = NULL;
+    size_t count = 0;
+    int ret = RBTREE_OK;
+
+    if (fread(&head, sizeof(head), 1, fp) != 1 || head.magic != RBWAL_MAGIC ||
+        head.count > SIZE_MAX / sizeof(*nodes))
+    {
+        ret = RBTREE_INVALID_TOPOLOGY;
+        goto done;
+    }
+
+    /** an empty checkpoint builds an empty tree from no array */
+    if (head.count > 0) {
+        nodes = malloc(head.count * sizeof(*nodes));
+        if (nodes == NULL) {
+            ret = RBTREE_NO_SPACE;
+            goto done;
+        }
+    }
+
+    for (; count < head.count; count++) {
+        uint32_t len = 0;
+        if (fread(&len, sizeof(len), 1, fp) != 1) {
+            ret = RBTREE_INVALID_TOPOLOGY;
+            goto done;
+        }
+
+        ret = rbwal_read_record(wal, fp, len);
+        if (ret != RBTREE_OK) {
+            goto done;
+        }
+
+        rbtree_node_t *node = wal->codec.decode(wal->buf, len, wal->codec.ctx);
+        if (node == NULL) {
+            ret = RBTREE_NO_SPACE;
+            goto done;
+        }
+
+        nodes[count] = node;
+
+        /** build trusts the order and keys are unique, so make sure of both */
+        if (count > 0 && wal->tree->compare(nodes[count - 1], node) >= 0) {
+            count++;
+            ret = RBTREE_INVALID_TOPOLOGY;
+            goto done;
+        }
+    }
+
+    ret = rbtree_build_sorted(wal->tree, nodes, count);
+    if (ret == RBTREE_OK) {
+        wal->lsn = head.lsn;
+        wal->stats.loaded = count;
+    }
+
+done:
+    if (ret != RBTREE_OK) {
+        for (size_t idx = 0; idx < count; idx++) {
+            wal->codec.release(nodes[idx], wal->codec.ctx);
+        }
+    }
+
+    free(nodes);
+    fclose(fp);
+
+    return ret;
+}
+
+
+static int
+rbwal_apply(rbwal_t *wal, int op, size_t len)
+{
+    rbtree_node_t *node = wal->codec.decode(wal->buf, len, wal->codec.ctx);
+    rbtree_must(node != NULL, RBTREE_NO_SPACE);
+
+    rbtree_node_t *found = NULL;
+
+    if (op == RBWAL_OP_INSERT) {
+        if (rbtree_insert_unique(wal->tree, node, &found) != RBTREE_OK) {
+            wal->codec.release(node, wal->codec.ctx);
+
+            return RBTREE_INVALID_TOPOLOGY;
+        }
+
+        return RBTREE_OK;
+    }
+
+    /** keys are unique, the equal record is the logged one */
+    int ret = rbtree_search(wal->tree, node, RBTREE_SEARCH_MODE_EQ, &found);
+    wal->codec.release(node, wal->codec.ctx);
+
+    if (ret != RBTREE_OK) {
+        return RBTREE_INVALID_TOPOLOGY;
+    }
+
+    rbtree_delete(wal->tree, found);
+    wal->codec.release(found, wal->codec.ctx);
+
+    return RBTREE_OK;
+}
+
+
+/** replay log after checkpoint, `*valid` ends at the last whole record */
+static int
+rbwal_replay(rbwal_t *wal, off_t *valid)
+{
+    *valid = 0;
+
+    FILE *fp = fopen(wal->log_path, "rb");
+    if (fp == NULL) {
+        return errno == ENOENT ? RBTREE_OK : RBTREE_IO_ERROR;
+    }
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+
+        return RBTREE_IO_ERROR;
+    }
+
+    int ret = RBTREE_OK;
+    rbwal_head_t head;
+
+    while (fread(&head, sizeof(head), 1, fp) == 1) {
+        /** a torn tail is a record running past the end or failing its sum */
+        if ((off_t)head.len > st.st_size - *valid - (off_t)sizeof(head)) {
+            break;
+        }
+
+        ret = rbwal_read_record(wal, fp, head.len);
+        if (ret != RBTREE_OK) {
+            ret = ret == RBTREE_INVALID_TOPOLOGY ? RBTREE_OK : ret;
+            break;
+        }
+
+        uint32_t sum = rbwal_sum(RBWAL_SUM_SEED, &head.lsn_op, sizeof(head.lsn_op));
+        if (rbwal_sum(sum, wal->buf, head.len) != head.sum) {
+            break;
+        }
+
+        uint64_t lsn = head.lsn_op >> 1;
+        if (lsn > wal->lsn) {
+            ret = rbwal_apply(wal, (int)(head.lsn_op & 1), head.len);
+            if (ret != RBTREE_OK) {
+                break;
+            }
+
+            wal->lsn = lsn;
+            wal->stats.replayed++;
+        }
+
+        *valid += (off_t)(sizeof(head) + head.len);
+    }
+
+    if (ret == RBTREE_OK && ferror(fp)) {
+        ret = RBTREE_IO_ERROR;
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+
+int
+rbwal_open(rbwal_t *wal,
+           rbtree_t *tree,
+           const char *path,
+           const rbwal_codec_t *codec,
+           const rbwal_options_t *options)
+{
+    rbtree_must(wal != NULL && tree != NULL && path != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(codec != NULL && codec->encode != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(codec->decode != NULL && codec->release != NULL, RBTREE_INVALID_ARG);
+    rbtree_must(rbtree_size(tree) == 0, RBTREE_INVALID_ARG);
+
+    memset(wal, 0, sizeof(*wal));
+
+    wal->tree  = tree;
+    wal->codec = *codec;
+    wal->log_fd = -1;
+
+    wal->options.group_ops = 1;
+    if (options != NULL) {
+        wal->options = *options;
+    }
+
+    size_t len = strlen(path);
+    const char *slash = strrchr(path, '/');
+
+    wal->log_path  = rbwal_path(path, len, ".log");
+    wal->ckpt_path = rbwal_path(path, len, ".ckpt");
+    wal->tmp_path  = rbwal_path(path, len, ".ckpt.tmp");
+    wal->dir_path  = slash == NULL ? rbwal_path(".", 1, "")
+                   : rbwal_path(path, slash == path ? 1 : (size_t)(slash - path), "");
+    wal->buf       = malloc(RBWAL_BUF_BYTES);
+    wal->buf_cap   = RBWAL_BUF_BYTES;
+
+    int ret = RBTREE_NO_SPACE;
+    if (wal->log_path == NULL || wal->ckpt_path == NULL || wal->tmp_path == NULL ||
+        wal->dir_path == NULL || wal->buf == NULL)
+    {
+        goto failed;
+    }
+
+    ret = rbwal_load_checkpoint(wal);
+    if (ret != RBTREE_OK) {
+        goto failed;
+    }
+
+    off_t valid = 0;
+    ret = rbwal_replay(wal, &valid);
+    if (ret != RBTREE_OK) {
+        goto failed;
+    }
+
+    ret = RBTREE_IO_ERROR;
+
+    wal->log_fd = open(wal->log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (wal->log_fd < 0) {
+        goto failed;
+    }
+
+    /** drop a torn tail, so new records follow the last whole one */
+    if (ftruncate(wal->log_fd, valid) != 0 || fsync(wal->log_fd) != 0) {
+        goto failed;
+    }
+
+    if (rbwal_sync_dir(wal) != RBTREE_OK) {
+        goto failed;
+    }
+
+    wal->log_size = (size_t)valid;
+
+    return RBTREE_OK;
+
+failed:
+    rbtree_delete_range(tree, NULL, NULL, rbwal_release_node, &wal->codec);
+    rbwal_free(wal);
+
+    return ret;
+}
+
+
+int
+rbwal_close(rbwal_t *wal)
+{
+    rbtree_must(wal != NULL && wal->log_fd >= 0, RBTREE_INVALID_ARG);
+
+    int ret = rbwal_sync(wal);
+    rbwal_free(wal);
+
+    return ret;
+}
+
+
+/** move buffer to log file without waiting for disk */
+static int
+rbwal_flush(rbwal_t *wal)
+{
+    if (wal->buf_len == 0) {
+        return RBTREE_OK;
+    }
+
+    int ret = rbwal_write_all(wal->log_fd, wal->buf, wal->buf_len);
+    if (ret != RBTREE_OK) {
+        /** cut what a short write left, buffer goes out whole next time */
+        if (ftruncate(wal->log_fd, (off_t)wal->log_size) != 0) {
+            wal->failed = 1;
+        }
+
+        return ret;
+    }
+
+    wal->log_size += wal->buf_len;
+    wal->stats.log_bytes += wal->buf_len;
+    wal->buf_len = 0;
+
+    return RBTREE_OK;
+}
+
+
+static int
+rbwal_append(rbwal_t *wal, int op, rbtree_node_t *node)
+{
+    size_t head = sizeof(rbwal_head_t);
+    size_t room = wal->buf_cap - wal->buf_len;
+    room = room > head ? room - head : 0;
+
+    char *record = room > 0 ? wal->buf + wal->buf_len + head : NULL;
+    size_t len = wal->codec.encode(node, record, room, wal->codec.ctx);
+
+    if (len > room) {
+        int ret = rbwal_flush(wal);
+        rbtree_must(ret == RBTREE_OK, ret);
+
+        ret = rbwal_reserve(wal, head + len);
+        rbtree_must(ret == RBTREE_OK, ret);
+
+        room = wal->buf_cap - head;
+        record = wal->buf + head;
+        len = wal->codec.encode(node, record, room, wal->codec.ctx);
+        rbtree_must(len <= room, RBTREE_INVALID_ARG);
+    }
+
+    rbtree_must(len <= UINT32_MAX, RBTREE_INVALID_ARG);
+
+    rbwal_head_t rec;
+    rec.len    = (uint32_t)len;
+    rec.lsn_op = (wal->lsn + 1) << 1 | (uint64_t)op;
+    rec.sum    = rbwal_sum(rbwal_sum(RBWAL_SUM_SEED, &rec.lsn_op, sizeof(rec.lsn_op)), record, len);
+
+    /** records are packed, head may sit anywhere in buffer */
+    memcpy(record - head, &rec, head);
+
+    wal->buf_len += head + len;
+    wal->lsn++;
+    wal->pending_ops++;
+    wal->stats.ops++;
+    wal->stats.payload_bytes += len;
+
+    return RBTREE_OK;
+}
+
+
+/** write out and fdatasync the log */
+static int
+rbwal_sync_log(rbwal_t *wal)
+{
+    int ret = rbwal_flush(wal);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_must(fdatasync(wal->log_fd) == 0, RBTREE_IO_ERROR);
+
+    wal->pending_ops = 0;
+    wal->stats.syncs++;
+
+    return RBTREE_OK;
+}
+
+
+static inline int
+rbwal_checkpoint_due(rbwal_t *wal)
+{
+    return wal->options.checkpoint_bytes > 0 && wal->log_size >= wal->options.checkpoint_bytes;
+}
+
+
+/**
+ * sync a full group after an operation is in tree already, so a failure
+ * is RBTREE_NOT_DURABLE rather than an error which would read as undone
+ */
+static int
+rbwal_commit(rbwal_t *wal)
+{
+    if (wal->options.group_ops == 0 || wal->pending_ops < wal->options.group_ops) {
+        return RBTREE_OK;
+    }
+
+    rbtree_must(rbwal_sync_log(wal) == RBTREE_OK, RBTREE_NOT_DURABLE);
+
+    /** the operation is in log, a failed checkpoint is tried again next sync */
+    if (rbwal_checkpoint_due(wal)) {
+        rbwal_checkpoint(wal);
+    }
+
+    return RBTREE_OK;
+}
+
+
+int
+rbwal_insert(rbwal_t *wal, rbtree_node_t *node)
+{
+    rbtree_must(wal != NULL && wal->log_fd >= 0, RBTREE_INVALID_ARG);
+    rbtree_must(!wal->failed, RBTREE_IO_ERROR);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    /** keys are unique, so a logged delete names exactly one record */
+    rbtree_node_t *exist = NULL;
+    int ret = rbtree_insert_unique(wal->tree, node, &exist);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    ret = rbwal_append(wal, RBWAL_OP_INSERT, node);
+    if (ret != RBTREE_OK) {
+        rbtree_delete(wal->tree, node);
+
+        return ret;
+    }
+
+    return rbwal_commit(wal);
+}
+
+
+int
+rbwal_delete(rbwal_t *wal, rbtree_node_t *node)
+{
+    rbtree_must(wal != NULL && wal->log_fd >= 0, RBTREE_INVALID_ARG);
+    rbtree_must(!wal->failed, RBTREE_IO_ERROR);
+    rbtree_must(node != NULL, RBTREE_INVALID_ARG);
+
+    int ret = rbwal_append(wal, RBWAL_OP_DELETE, node);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_delete(wal->tree, node);
+
+    return rbwal_commit(wal);
+}
+
+
+int
+rbwal_sync(rbwal_t *wal)
+{
+    rbtree_must(wal != NULL && wal->log_fd >= 0, RBTREE_INVALID_ARG);
+    rbtree_must(!wal->failed, RBTREE_IO_ERROR);
+
+    if (wal->pending_ops == 0 && wal->buf_len == 0) {
+        return RBTREE_OK;
+    }
+
+    int ret = rbwal_sync_log(wal);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    if (rbwal_checkpoint_due(wal)) {
+        return rbwal_checkpoint(wal);
+    }
+
+    return RBTREE_OK;
+}
+
+
+/** head is written last with the count of records written, not of size */
+static int
+rbwal_write_checkpoint(rbwal_t *wal, FILE *fp, uint64_t *bytes)
+{
+    rbwal_ckpt_head_t head = {
+        .magic = RBWAL_MAGIC,
+        .lsn   = wal->lsn,
+        .count = 0,
+    };
+
+    rbtree_must(fwrite(&head, sizeof(head), 1, fp) == 1, RBTREE_IO_ERROR);
+    *bytes = sizeof(head);
+
+    /** records go after the log buffer, which must survive a failure here */
+    size_t room = 256;
+    char *scratch = malloc(room);
+    rbtree_must(scratch != NULL, RBTREE_NO_SPACE);
+
+    int ret = RBTREE_OK;
+    for (rbtree_node_t *node = rbtree_first(wal->tree);
+         node != NULL && ret == RBTREE_OK;
+         node = rbtree_next(wal->tree, node))
+    {
+        size_t len = wal->codec.encode(node, scratch, room, wal->codec.ctx);
+        if (len > room) {
+            char *grown = realloc(scratch, len);
+            if (grown == NULL) {
+                ret = RBTREE_NO_SPACE;
+                break;
+            }
+
+            scratch = grown;
+            room = len;
+            len = wal->codec.encode(node, scratch, room, wal->codec.ctx);
+        }
+
+        uint32_t len32 = (uint32_t)len;
+        if (len > room || len > UINT32_MAX) {
+            ret = RBTREE_INVALID_ARG;
+        }
+        else if (fwrite(&len32, sizeof(len32), 1, fp) != 1 || fwrite(scratch, 1, len, fp) != len) {
+            ret = RBTREE_IO_ERROR;
+        }
+
+        *bytes += sizeof(len32) + len;
+        head.count++;
+    }
+
+    free(scratch);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    rbtree_must(fseek(fp, 0, SEEK_SET) == 0, RBTREE_IO_ERROR);
+    rbtree_must(fwrite(&head, sizeof(head), 1, fp) == 1, RBTREE_IO_ERROR);
+
+    rbtree_must(fflush(fp) == 0 && fsync(fileno(fp)) == 0, RBTREE_IO_ERROR);
+
+    return RBTREE_OK;
+}
+
+
+int
+rbwal_checkpoint(rbwal_t *wal)
+{
+    rbtree_must(wal != NULL && wal->log_fd >= 0, RBTREE_INVALID_ARG);
+    rbtree_must(!wal->failed, RBTREE_IO_ERROR);
+
+    FILE *fp = fopen(wal->tmp_path, "wb");
+    rbtree_must(fp != NULL, RBTREE_IO_ERROR);
+
+    uint64_t bytes = 0;
+    int ret = rbwal_write_checkpoint(wal, fp, &bytes);
+
+    if (fclose(fp) != 0 && ret == RBTREE_OK) {
+        ret = RBTREE_IO_ERROR;
+    }
+
+    if (ret == RBTREE_OK && rename(wal->tmp_path, wal->ckpt_path) != 0) {
+        ret = RBTREE_IO_ERROR;
+    }
+
+    if (ret != RBTREE_OK) {
+        unlink(wal->tmp_path);
+
+        return ret;
+    }
+
+    ret = rbwal_sync_dir(wal);
+    rbtree_must(ret == RBTREE_OK, ret);
+
+    wal->stats.checkpoint_bytes += bytes;
+    wal->stats.checkpoints++;
+
+    /** checkpoint holds everything, buffered records need not be written */
+    wal->buf_len = 0;
+    wal->pending_ops = 0;
+
+    rbtree_must(ftruncate(wal->log_fd, 0) == 0, RBTREE_IO_ERROR);
+    rbtree_must(fdatasync(wal->log_fd) == 0, RBTREE_IO_ERROR);
+
+    wal->log_size = 0;
+
+    return RBTREE_OK;
+}
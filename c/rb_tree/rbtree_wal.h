@@ -0,0 +1,149 @@
+/**
+ * file name: rbtree_wal.h
+ *
+ * head file of durable rbtree
+ *
+ * an operation log and a checkpoint around a plain rbtree_t. every
+ * rbwal_insert and rbwal_delete appends the encoded record to
+ * `<path>.log`, a checkpoint writes all records in order to
+ * `<path>.ckpt` and empties the log.
+ *
+ * log writes are batched: an operation is durable once rbwal_sync
+ * returns, which happens by itself every `group_ops` operations. on open
+ * the checkpoint is loaded with rbtree_build_sorted in O(n) and the log
+ * tail replayed, a torn last record is cut off.
+ *
+ * keys are unique, a logged delete has to name one record on replay.
+ *
+ * files are in native byte order and not meant to move between machines.
+ */
+#ifndef __RB_TREE_WAL_H__
+#define __RB_TREE_WAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbtree.h"
+
+
+#define RBWAL_MAGIC 0x7262776c
+
+/** how records of tree become bytes and back */
+typedef struct rbwal_codec_s rbwal_codec_t;
+struct rbwal_codec_s {
+    /**
+     * write `node` into `buf` of `cap` bytes, returns bytes it takes,
+     * if that is more than `cap` nothing was written and it is called again
+     */
+    size_t (*encode)(rbtree_node_t *node, void *buf, size_t cap, void *ctx);
+    /** a new record from bytes, NULL if out of memory */
+    rbtree_node_t *(*decode)(const void *buf, size_t len, void *ctx);
+    /** free a record made by `decode` */
+    void (*release)(rbtree_node_t *node, void *ctx);
+    void *ctx;
+};
+
+typedef struct rbwal_options_s rbwal_options_t;
+struct rbwal_options_s {
+    /** sync after this many operations, 1 for every one, 0 only by rbwal_sync */
+    size_t group_ops;
+    /** checkpoint on sync once log is this large, 0 only by rbwal_checkpoint */
+    size_t checkpoint_bytes;
+};
+
+typedef struct rbwal_stats_s rbwal_stats_t;
+struct rbwal_stats_s {
+    uint64_t ops;
+    /** encoded records of operations, what has to be written at least */
+    uint64_t payload_bytes;
+    uint64_t log_bytes;
+    uint64_t checkpoint_bytes;
+    uint64_t syncs;
+    uint64_t checkpoints;
+    /** by the last open */
+    uint64_t loaded;
+    uint64_t replayed;
+};
+
+typedef struct rbwal_s rbwal_t;
+struct rbwal_s {
+    rbtree_t *tree;
+    rbwal_codec_t codec;
+    rbwal_options_t options;
+
+    char *log_path;
+    char *ckpt_path;
+    char *tmp_path;
+    char *dir_path;
+    int log_fd;
+    /** of log file, not counting buffer */
+    size_t log_size;
+    /** log may end in torn bytes which could not be cut, nothing goes after them */
+    int failed;
+
+    /** log records not written yet */
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+    size_t pending_ops;
+
+    /** of last operation */
+    uint64_t lsn;
+
+    rbwal_stats_t stats;
+};
+
+
+/**
+ * recover `tree` from files under `path` and start logging
+ *
+ * `tree` must be initialized and empty, records it gets are made by
+ * `codec->decode`. missing files are an empty tree. `options` may be NULL.
+ */
+int
+rbwal_open(rbwal_t *wal,
+           rbtree_t *tree,
+           const char *path,
+           const rbwal_codec_t *codec,
+           const rbwal_options_t *options);
+
+/** sync and close files, records stay in tree */
+int
+rbwal_close(rbwal_t *wal);
+
+/**
+ * RBTREE_DUPLICATE if a record equal to `node` is in tree already.
+ *
+ * RBTREE_NOT_DURABLE if `node` is in tree but the sync of its group
+ * failed, any other error leaves tree as it was. a checkpoint this sync
+ * would start is tried again by the next one if it fails.
+ */
+int
+rbwal_insert(rbwal_t *wal, rbtree_node_t *node);
+
+/** `node` must be in tree, it is not released. errors as rbwal_insert */
+int
+rbwal_delete(rbwal_t *wal, rbtree_node_t *node);
+
+/**
+ * write out and fsync the log, RBTREE_IO_ERROR if either fails.
+ *
+ * a failed write is cut off the log again; if even that fails every call
+ * but rbwal_close gives RBTREE_IO_ERROR from then on.
+ */
+int
+rbwal_sync(rbwal_t *wal);
+
+/** write all records to a new checkpoint and empty the log */
+int
+rbwal_checkpoint(rbwal_t *wal);
+
+
+static inline const rbwal_stats_t *
+rbwal_stats(rbwal_t *wal)
+{
+    return &wal->stats;
+}
+
+
+#endif
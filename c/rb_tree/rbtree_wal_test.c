@@ -0,0 +1,593 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/TestDB.h>
+#include <CUnit/Basic.h>
+#include <CUnit/TestRun.h>
+
+#include "rbtree_wal.c"
+
+typedef struct test_record_s test_record_t;
+struct test_record_s {
+    uint64_t key;
+    uint64_t value;
+    rbtree_node_t node;
+};
+
+#define test_record_of(ptr) \
+    ((test_record_t *)((uintptr_t)(ptr) - offsetof(test_record_t, node)))
+
+
+static int
+test_compare(rbtree_node_t *na, rbtree_node_t *nb)
+{
+    uint64_t akey = test_record_of(na)->key;
+    uint64_t bkey = test_record_of(nb)->key;
+
+    return (akey > bkey) - (akey < bkey);
+}
+
+
+static size_t
+test_encode(rbtree_node_t *node, void *buf, size_t cap, void *ctx)
+{
+    if (cap >= 16) {
+        memcpy(buf, &test_record_of(node)->key, 8);
+        memcpy((char *)buf + 8, &test_record_of(node)->value, 8);
+    }
+
+    return 16;
+}
+
+
+static rbtree_node_t *
+test_decode(const void *buf, size_t len, void *ctx)
+{
+    test_record_t *record = malloc(sizeof(*record));
+    if (record == NULL || len != 16) {
+        free(record);
+
+        return NULL;
+    }
+
+    memcpy(&record->key, buf, 8);
+    memcpy(&record->value, (const char *)buf + 8, 8);
+
+    return &record->node;
+}
+
+
+static void
+test_release(rbtree_node_t *node, void *ctx)
+{
+    free(test_record_of(node));
+}
+
+
+static const rbwal_codec_t test_codec = {
+    .encode  = test_encode,
+    .decode  = test_decode,
+    .release = test_release,
+};
+
+
+static char test_dir[64];
+static char test_path[96];
+
+
+static void
+test_paths(char *log, char *ckpt)
+{
+    snprintf(log, 128, "%s.log", test_path);
+    snprintf(ckpt, 128, "%s.ckpt", test_path);
+}
+
+
+static void
+test_setup(void)
+{
+    snprintf(test_dir, sizeof(test_dir), "/tmp/rbwal_test_XXXXXX");
+    CU_ASSERT_FATAL(mkdtemp(test_dir) != NULL);
+
+    snprintf(test_path, sizeof(test_path), "%s/tree", test_dir);
+}
+
+
+static void
+test_teardown(void)
+{
+    char log[128], ckpt[128];
+    test_paths(log, ckpt);
+
+    unlink(log);
+    unlink(ckpt);
+    rmdir(test_dir);
+}
+
+
+static test_record_t *
+test_new(uint64_t key)
+{
+    test_record_t *record = malloc(sizeof(*record));
+    record->key   = key;
+    record->value = key * 3;
+
+    return record;
+}
+
+
+static void
+test_drop(rbtree_t *tree)
+{
+    rbtree_delete_range(tree, NULL, NULL, test_release, NULL);
+    rbtree_init(tree, test_compare);
+}
+
+
+/** tree holds keys [0, count) but multiples of `skip` if not 0 */
+static void
+test_check_keys(rbtree_t *tree, uint64_t count, uint64_t skip)
+{
+    uint64_t key = 0;
+
+    for (rbtree_node_t *node = rbtree_first(tree); node != NULL; node = rbtree_next(tree, node)) {
+        while (skip != 0 && key % skip == 0) {
+            key++;
+        }
+
+        test_record_t *record = test_record_of(node);
+        CU_ASSERT(record->key == key && record->value == key * 3);
+        key++;
+    }
+
+    while (skip != 0 && key < count && key % skip == 0) {
+        key++;
+    }
+
+    CU_ASSERT(key == count);
+}
+
+
+static size_t
+test_file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+
+static void
+test_recover(void)
+{
+    test_setup();
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(NULL, &tree, test_path, &test_codec, NULL) == RBTREE_INVALID_ARG);
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->loaded == 0 && rbwal_stats(&wal)->replayed == 0);
+
+    static test_record_t *records[1100];
+    for (uint64_t key = 0; key < 1000; key++) {
+        records[key] = test_new(key);
+        CU_ASSERT(rbwal_insert(&wal, &records[key]->node) == RBTREE_OK);
+    }
+
+    for (uint64_t key = 0; key < 1000; key += 3) {
+        CU_ASSERT(rbwal_delete(&wal, &records[key]->node) == RBTREE_OK);
+        free(records[key]);
+    }
+
+    /** one sync per operation by default, 16 bytes head and 16 of record */
+    CU_ASSERT(rbwal_stats(&wal)->syncs == 1334);
+    CU_ASSERT(rbwal_stats(&wal)->log_bytes == 1334 * 32);
+    CU_ASSERT(rbwal_stats(&wal)->payload_bytes == 1334 * 16);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+
+    test_check_keys(&tree, 1000, 3);
+    test_drop(&tree);
+
+    /** log only */
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->loaded == 0);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 1334);
+    CU_ASSERT(rbtree_size(&tree) == 666);
+    test_check_keys(&tree, 1000, 3);
+
+    /** checkpoint empties log, later operations go to log again */
+    CU_ASSERT(rbwal_checkpoint(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->checkpoint_bytes == sizeof(rbwal_ckpt_head_t) + 666 * 20);
+
+    char log[128], ckpt[128];
+    test_paths(log, ckpt);
+    CU_ASSERT(test_file_size(log) == 0);
+
+    for (uint64_t key = 1000; key < 1100; key++) {
+        records[key] = test_new(key);
+        CU_ASSERT(rbwal_insert(&wal, &records[key]->node) == RBTREE_OK);
+    }
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->loaded == 666);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 100);
+    CU_ASSERT(rbtree_size(&tree) == 766);
+    CU_ASSERT(test_record_of(rbtree_last(&tree))->key == 1099);
+
+    /** only into an empty tree */
+    rbwal_t other;
+    CU_ASSERT(rbwal_open(&other, &tree, test_path, &test_codec, NULL) == RBTREE_INVALID_ARG);
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_torn(void)
+{
+    test_setup();
+
+    char log[128], ckpt[128];
+    test_paths(log, ckpt);
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+
+    for (uint64_t key = 0; key < 100; key++) {
+        rbwal_insert(&wal, &test_new(key)->node);
+    }
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    /** half a record at the end, as if power went out while writing */
+    FILE *fp = fopen(log, "ab");
+    fwrite("\x10\0\0\0\x55\x55\x55\x55\x01\0\0\0\0\0\0\0\xaa\xaa", 1, 18, fp);
+    fclose(fp);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 100);
+    CU_ASSERT(test_file_size(log) == 100 * 32);
+
+    /** new records follow the last whole one */
+    rbwal_insert(&wal, &test_new(100)->node);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    /** a record which does not match its sum ends the log */
+    fp = fopen(log, "r+b");
+    fseek(fp, 99 * 32 + 20, SEEK_SET);
+    fputc(0x7f, fp);
+    fclose(fp);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 99);
+    test_check_keys(&tree, 99, 0);
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_checkpoint_crash(void)
+{
+    test_setup();
+
+    char log[128], ckpt[128];
+    test_paths(log, ckpt);
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+
+    for (uint64_t key = 0; key < 200; key++) {
+        rbwal_insert(&wal, &test_new(key)->node);
+    }
+
+    /** keep the log as it was before checkpoint emptied it */
+    size_t bytes = test_file_size(log);
+    char *saved = malloc(bytes);
+    FILE *fp = fopen(log, "rb");
+    CU_ASSERT(fread(saved, 1, bytes, fp) == bytes);
+    fclose(fp);
+
+    CU_ASSERT(rbwal_checkpoint(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    fp = fopen(log, "wb");
+    fwrite(saved, 1, bytes, fp);
+    fclose(fp);
+    free(saved);
+
+    /** everything in log is in checkpoint already */
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->loaded == 200);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 0);
+    test_check_keys(&tree, 200, 0);
+
+    /** lsn goes on after the checkpoint */
+    rbwal_insert(&wal, &test_new(200)->node);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 1);
+    test_check_keys(&tree, 201, 0);
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_group(void)
+{
+    test_setup();
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_options_t options = { .group_ops = 64, .checkpoint_bytes = 0, };
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, &options) == RBTREE_OK);
+
+    for (uint64_t key = 0; key < 1000; key++) {
+        rbwal_insert(&wal, &test_new(key)->node);
+    }
+
+    CU_ASSERT(rbwal_stats(&wal)->syncs == 1000 / 64);
+    CU_ASSERT(rbwal_stats(&wal)->log_bytes == 1000 / 64 * 64 * 32);
+    CU_ASSERT(rbwal_sync(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->syncs == 1000 / 64 + 1);
+    CU_ASSERT(rbwal_sync(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->syncs == 1000 / 64 + 1);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    /** checkpoint whenever log passes 4KB */
+    options.checkpoint_bytes = 4096;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, &options) == RBTREE_OK);
+
+    for (uint64_t key = 0; key < 1000; key++) {
+        rbtree_node_t *node = NULL;
+        test_record_t probe = { .key = key, };
+
+        rbtree_search(&tree, &probe.node, RBTREE_SEARCH_MODE_EQ, &node);
+        if (key % 2 == 0) {
+            rbwal_delete(&wal, node);
+            free(test_record_of(node));
+        }
+    }
+
+    /** first sync finds the old log over limit, then 128 ops of 32 bytes fill 4KB */
+    CU_ASSERT(rbwal_stats(&wal)->checkpoints == 4);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, &options) == RBTREE_OK);
+    CU_ASSERT(rbwal_stats(&wal)->replayed == 500 - 7 * 64);
+    CU_ASSERT(rbtree_size(&tree) == 500);
+    test_check_keys(&tree, 1000, 2);
+
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_not_durable(void)
+{
+    test_setup();
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+
+    /** an empty checkpoint loads as an empty tree */
+    CU_ASSERT(rbwal_checkpoint(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 0);
+
+    CU_ASSERT(rbwal_insert(&wal, &test_new(1)->node) == RBTREE_OK);
+
+    /** writes past the file size limit stop short, then fail with EFBIG */
+    signal(SIGXFSZ, SIG_IGN);
+
+    struct rlimit limit;
+    CU_ASSERT_FATAL(getrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    struct rlimit small = limit;
+    small.rlim_cur = wal.log_size + sizeof(rbwal_head_t) + 4;
+    CU_ASSERT_FATAL(setrlimit(RLIMIT_FSIZE, &small) == 0);
+
+    test_record_t *record = test_new(2);
+    CU_ASSERT(rbwal_insert(&wal, &record->node) == RBTREE_NOT_DURABLE);
+    CU_ASSERT(rbtree_size(&tree) == 2);
+    CU_ASSERT(rbwal_delete(&wal, &record->node) == RBTREE_NOT_DURABLE);
+    CU_ASSERT(rbtree_size(&tree) == 1);
+    free(record);
+
+    CU_ASSERT_FATAL(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    /** torn bytes were cut, buffered records and the next go out after 1 */
+    CU_ASSERT(rbwal_insert(&wal, &test_new(3)->node) == RBTREE_OK);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 2);
+    test_check_keys(&tree, 4, 2);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_failed(void)
+{
+    test_setup();
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbwal_insert(&wal, &test_new(1)->node) == RBTREE_OK);
+
+    /** a read only descriptor can neither be written nor truncated */
+    char log[128], ckpt[128];
+    test_paths(log, ckpt);
+
+    int log_fd = wal.log_fd;
+    wal.log_fd = open(log, O_RDONLY);
+    CU_ASSERT_FATAL(wal.log_fd >= 0);
+
+    CU_ASSERT(rbwal_insert(&wal, &test_new(2)->node) == RBTREE_NOT_DURABLE);
+    CU_ASSERT(wal.failed);
+
+    test_record_t *record = test_new(3);
+    CU_ASSERT(rbwal_insert(&wal, &record->node) == RBTREE_IO_ERROR);
+    CU_ASSERT(rbtree_size(&tree) == 2);
+    free(record);
+
+    CU_ASSERT(rbwal_sync(&wal) == RBTREE_IO_ERROR);
+    CU_ASSERT(rbwal_checkpoint(&wal) == RBTREE_IO_ERROR);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_IO_ERROR);
+    close(log_fd);
+    test_drop(&tree);
+
+    /** only what was synced before */
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 1);
+    test_check_keys(&tree, 2, 2);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+static void
+test_duplicate(void)
+{
+    test_setup();
+
+    rbtree_t tree;
+    rbtree_init(&tree, test_compare);
+
+    rbwal_t wal;
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+
+    test_record_t *first = test_new(1);
+    CU_ASSERT(rbwal_insert(&wal, &first->node) == RBTREE_OK);
+
+    /** an equal key is refused and not logged */
+    test_record_t *record = test_new(1);
+    record->value = 100;
+    CU_ASSERT(rbwal_insert(&wal, &record->node) == RBTREE_DUPLICATE);
+    CU_ASSERT(rbtree_size(&tree) == 1);
+    CU_ASSERT(rbwal_stats(&wal)->ops == 1);
+
+    /** so after a delete the key holds the new payload only */
+    CU_ASSERT(rbwal_delete(&wal, &first->node) == RBTREE_OK);
+    free(first);
+    CU_ASSERT(rbwal_insert(&wal, &record->node) == RBTREE_OK);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 1);
+    CU_ASSERT(test_record_of(rbtree_first(&tree))->value == 100);
+
+    /** and a checkpoint of it loads back the same */
+    CU_ASSERT(rbwal_checkpoint(&wal) == RBTREE_OK);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+
+    CU_ASSERT(rbwal_open(&wal, &tree, test_path, &test_codec, NULL) == RBTREE_OK);
+    CU_ASSERT(rbtree_size(&tree) == 1);
+    CU_ASSERT(test_record_of(rbtree_first(&tree))->value == 100);
+    CU_ASSERT(rbwal_close(&wal) == RBTREE_OK);
+    test_drop(&tree);
+    test_teardown();
+}
+
+
+/** test cases for one single suit */
+static CU_TestInfo test_rbwal[] = {
+    { "test_recover",          test_recover          },
+    { "test_torn",             test_torn             },
+    { "test_checkpoint_crash", test_checkpoint_crash },
+    { "test_group",            test_group            },
+    { "test_not_durable",      test_not_durable      },
+    { "test_failed",           test_failed           },
+    { "test_duplicate",        test_duplicate        },
+    CU_TEST_INFO_NULL,
+};
+
+/** test suites */
+static CU_SuiteInfo suites[] = {
+  {
+      "test_rbwal",
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      test_rbwal,
+  },
+
+  CU_SUITE_INFO_NULL,
+};
+
+
+int
+main(void)
+{
+    /** initialize registry */
+    CU_ErrorCode err = CU_initialize_registry();
+    if (err != CUE_SUCCESS) {
+        printf("failed to initialize registry: %d\n", err);
+
+        exit(err);
+    }
+
+    /** add test suits and test cases in them */
+    CU_register_suites(suites);
+
+    /** set run mode */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    /** cleanup */
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}